@@ -0,0 +1,420 @@
+//Benchmark sweep over scenes, resolutions, rays per pixel and thread counts.
+//Each configuration renders FramesCount frames from the same random seed and
+//the fastest one is written as a csv row so that runs can be compared across builds
+
+struct benchmark_settings
+{
+    u32 OutputWidth;  //Biggest resolution, the smaller ones are divided by BenchmarkResolutionDivisors
+    u32 OutputHeight;
+    u32 RaysPerPixel; //Biggest number of rays per pixel, 1 is always measured too
+    u32 RayBounces;
+    u32 MaxThreads;   //Thread counts are powers of two up to this, plus this
+    u32 FramesCount;
+    render_mode RenderMode;
+    bvh_build_settings BVHSettings;
+};
+
+u32 BenchmarkResolutionDivisors[] = { 4, 2, 1 };
+
+//Thread counts to measure: 1, 2, 4, ... and MaxThreads, returns the count
+internal u32
+GetBenchmarkThreadCounts(u32 MaxThreads, u32* ThreadCounts, u32 MaxCount)
+{
+    u32 Count = 0;
+    for(u32 Threads = 1; Threads < MaxThreads && Count < MaxCount - 1; Threads *= 2)
+    {
+        ThreadCounts[Count++] = Threads;
+    }
+    ThreadCounts[Count++] = MaxThreads;
+    return Count;
+}
+
+internal void
+RunBenchmark(char* OutputPath, benchmark_settings* Settings)
+{
+    FILE* File = fopen(OutputPath, "w");
+    if(!File) {
+        printf("Failed to open benchmark output file at %s\n", OutputPath);
+        exit(1);
+    }
+    
+    fprintf(File, "scene,triangles,bvh_build_ms,bvh_format,leaf_format,render_mode,width,height,"
+            "vertex_order,rays_per_pixel,bounces,threads,ray_counters,seconds,rays,mrays_per_s,triangle_tests_per_ray,"
+            "speedup,parallel_efficiency,llc_misses_per_ray\n");
+    
+    u32 ThreadCounts[32];
+    u32 ThreadCountsCount = GetBenchmarkThreadCounts(Settings->MaxThreads, ThreadCounts, ArrayCount(ThreadCounts));
+    
+    u32 RaysPerPixelCounts[2] = { 1, Settings->RaysPerPixel };
+    u32 RaysPerPixelCountsCount = Settings->RaysPerPixel > 1 ? 2 : 1;
+    
+    //Samples and output image are sized for the biggest configuration
+    image_data OutputImage = AllocateImage(Settings->OutputWidth, Settings->OutputHeight);
+    tile_worker_thread_init* Init = (tile_worker_thread_init*)ZeroAlloc(sizeof(tile_worker_thread_init));
+    
+    //Meshes are always preprocessed with all the threads
+    thread_pool BuildThreadPool;
+    CreateThreadPool(&BuildThreadPool, Settings->MaxThreads - 1);
+    
+    For(SceneIndex, SCENE_COUNT)
+    {
+        camera Camera;
+        world World;
+        //Mesh caches are not used so that the build time is measured
+        if(!BuildScene((scene)SceneIndex, &Settings->BVHSettings, false, &BuildThreadPool, &World, &Camera))
+        {
+            printf("Skipping %s scene\n", SceneNames[SceneIndex]);
+            continue;
+        }
+        
+        timestamp BuildBegin = GetCurrentCounter();
+        PreprocessWorldMeshes(&World, &Settings->BVHSettings, &BuildThreadPool, false);
+        BuildWorldTLAS(&World, false);
+        timestamp BuildEnd = GetCurrentCounter();
+        f32 BuildMilliseconds = GetSecondsElapsed(BuildBegin, BuildEnd) * 1000.0f;
+        
+        u32 TrianglesCount = 0;
+        For(Index, World.MeshesInfoCount)
+        {
+            TrianglesCount += World.MeshesInfo[Index].TrianglesCount;
+        }
+        
+        //Speedup is relative to the single thread run of the same configuration
+        f32 SingleThreadSeconds[ArrayCount(BenchmarkResolutionDivisors)][2] = {};
+        
+        For(ThreadsIndex, ThreadCountsCount)
+        {
+            u32 NumberOfThreads = ThreadCounts[ThreadsIndex];
+            //Opened first so that the workers are counted too
+            cache_miss_counter CacheMissCounter = OpenCacheMissCounter();
+            thread_pool ThreadPool;
+            CreateThreadPool(&ThreadPool, NumberOfThreads - 1);
+            
+            For(ResolutionIndex, ArrayCount(BenchmarkResolutionDivisors))
+            {
+                u32 Divisor = BenchmarkResolutionDivisors[ResolutionIndex];
+                u32 OutputWidth = MAX(1, Settings->OutputWidth / Divisor);
+                u32 OutputHeight = MAX(1, Settings->OutputHeight / Divisor);
+                
+                For(RaysIndex, RaysPerPixelCountsCount)
+                {
+                    u32 RaysPerPixel = RaysPerPixelCounts[RaysIndex];
+                    
+                    *Init = {};
+                    Init->OutputWidth = OutputWidth;
+                    Init->OutputHeight = OutputHeight;
+                    Init->OutputImage = &OutputImage;
+                    Init->RaysPerPixel = RaysPerPixel;
+                    Init->RayBounces = Settings->RayBounces;
+                    Init->RenderMode = Settings->RenderMode;
+                    Init->World = &World;
+                    Init->CameraP = Camera.P;
+                    Init->CameraX = Camera.X;
+                    Init->CameraY = Camera.Y;
+                    Init->CameraZ = Camera.Z;
+                    GetSamplePositions(Init->Samples, RaysPerPixel);
+                    
+                    //Keep the fastest frame, every frame starts from the same tile seeds
+                    frame_stats Best = {};
+                    u64 BestCacheMisses = 0;
+                    bool HasCacheMisses = false;
+                    For(FrameIndex, Settings->FramesCount)
+                    {
+                        srand(BENCHMARK_SEED);
+                        u64 CacheMissesBegin, CacheMissesEnd;
+                        HasCacheMisses = ReadCacheMissCounter(CacheMissCounter, &CacheMissesBegin);
+                        frame_stats Frame = RenderTileWorkFrame(&ThreadPool, Init);
+                        HasCacheMisses &= ReadCacheMissCounter(CacheMissCounter, &CacheMissesEnd);
+                        if(FrameIndex == 0 || Frame.SecondsElapsed < Best.SecondsElapsed)
+                        {
+                            Best = Frame;
+                            BestCacheMisses = CacheMissesEnd - CacheMissesBegin;
+                        }
+                    }
+                    
+                    if(NumberOfThreads == 1)
+                    {
+                        SingleThreadSeconds[ResolutionIndex][RaysIndex] = Best.SecondsElapsed;
+                    }
+                    f32 Speedup = SingleThreadSeconds[ResolutionIndex][RaysIndex] / Best.SecondsElapsed;
+                    f32 MRaysPerSecond = Best.RaysCasted / (Best.SecondsElapsed * (1000 * 1000));
+                    
+                    //Left empty when the hardware counters are not available
+                    char CacheMisses[32] = "";
+                    if(HasCacheMisses)
+                    {
+                        snprintf(CacheMisses, sizeof(CacheMisses), "%.4f", (f64)BestCacheMisses / (f64)Best.RaysCasted);
+                    }
+                    
+                    printf("%s %ux%u %u rays per pixel %u threads: %.3f MRays/s, %.2fx speedup%s%s\n",
+                           SceneNames[SceneIndex], OutputWidth, OutputHeight, RaysPerPixel, NumberOfThreads,
+                           MRaysPerSecond, Speedup, HasCacheMisses ? ", LLC misses per ray " : "", CacheMisses);
+                    
+                    fprintf(File, "%s,%u,%.3f,%s,%s,%s,%u,%u,%s,%u,%u,%u,%s,%.6f,%" PRId64 ",%.4f,%.3f,%.3f,%.3f,%s\n",
+                            SceneNames[SceneIndex], TrianglesCount, BuildMilliseconds,
+                            BVHFormatNames[World.BVHFormat], BVHLeafFormatNames[World.BVHLeafFormat],
+                            RenderModeNames[Settings->RenderMode], OutputWidth, OutputHeight,
+                            Settings->BVHSettings.ReorderVertices ? "leaf" : "file",
+                            RaysPerPixel, Settings->RayBounces, NumberOfThreads,
+                            SHARED_RAY_COUNTERS ? "shared" : "worker", Best.SecondsElapsed,
+                            Best.RaysCasted, MRaysPerSecond, (f64)Best.TriangleTestsTotal / (f64)Best.RaysCasted,
+                            Speedup, Speedup / NumberOfThreads, CacheMisses);
+                    fflush(File);
+                }
+            }
+            
+            DestroyThreadPool(&ThreadPool);
+            CloseCacheMissCounter(CacheMissCounter);
+        }
+        
+        FreeWorld(&World);
+    }
+    
+    DestroyThreadPool(&BuildThreadPool);
+    Free(OutputImage.Data);
+    Free(Init);
+    fclose(File);
+}
+
+//Number array parsing benchmark. Generated float_array and p payloads are parsed with the
+//lexer path the number array parser replaced and with the parser on 1 and ThreadsCount threads,
+//the results are checked to match and the throughput of the fastest of RunsCount runs is
+//written as csv rows
+
+enum number_payload
+{
+    NUMBER_PAYLOAD_POSITIONS,
+    NUMBER_PAYLOAD_NORMALS,
+    NUMBER_PAYLOAD_DOUBLES,
+    NUMBER_PAYLOAD_INDICES,
+    
+    NUMBER_PAYLOAD_COUNT
+};
+
+char* NumberPayloadNames[] =
+{
+    "positions",
+    "normals",
+    "doubles",
+    "indices",
+};
+
+#define NUMBER_PAYLOAD_VALUES_COUNT (3 * 1024 * 1024)
+
+internal f32
+RandomBenchmarkFloat(f32 Min, f32 Max)
+{
+    return Min + (Max - Min) * ((f32)rand() / (f32)RAND_MAX);
+}
+
+//Whitespace separated values formatted like exporters do, with a line break every 3 values
+internal char*
+GenerateNumberPayload(number_payload Payload, u32 Count)
+{
+    char* Result = (char*)ZeroAlloc((u64)Count * 32 + 1);
+    char* At = Result;
+    For(Index, Count)
+    {
+        char Separator = (Index % 3 == 2) ? '\n' : ' ';
+        switch(Payload)
+        {
+            case NUMBER_PAYLOAD_POSITIONS: {
+                At += sprintf(At, "%.7g%c", RandomBenchmarkFloat(-20.0f, 20.0f), Separator);
+            } break;
+            case NUMBER_PAYLOAD_NORMALS: {
+                At += sprintf(At, "%.6f%c", RandomBenchmarkFloat(-1.0f, 1.0f), Separator);
+            } break;
+            case NUMBER_PAYLOAD_DOUBLES: {
+                //Round trip precision of exporters that write doubles, too many digits for one exact operation
+                f64 Value = RandomBenchmarkFloat(-20.0f, 20.0f) * (1.0 + (f64)rand() / RAND_MAX * 1e-7);
+                At += sprintf(At, "%.17g%c", Value, Separator);
+            } break;
+            case NUMBER_PAYLOAD_INDICES: {
+                At += sprintf(At, "%u%c", (u32)rand() % (1 << 20), Separator);
+            } break;
+            default: InvalidCodePath;
+        }
+    }
+    
+    return Result;
+}
+
+internal void
+LexNumberPayload(number_payload Payload, char* Text, u32* Result, u32 Count)
+{
+    lexer Lexer;
+    InitLexer(&Lexer, Text, LEXER_IGNORE_NEWLINES | LEXER_XML_COMMENTS);
+    
+    u32 Index = 0;
+    while(!IsToken(&Lexer, TOKEN_EOF) && Index < Count)
+    {
+        if(Payload == NUMBER_PAYLOAD_INDICES)
+        {
+            Result[Index++] = ParseInt(&Lexer);
+        }
+        else
+        {
+            f32 Value = ParseFloatOrIntWithSign(&Lexer);
+            memcpy(Result + Index++, &Value, sizeof(f32));
+        }
+    }
+    Assert(Index == Count && IsToken(&Lexer, TOKEN_EOF));
+    FreeLexer(&Lexer);
+}
+
+internal void
+WriteNumberParseResult(FILE* File, number_payload Payload, u64 Bytes, u32 Count, char* Parser,
+                       u32 ThreadsCount, f32 Seconds, f32 LexerSeconds, u32 Mismatches)
+{
+    f32 MBPerSecond = Bytes / (Seconds * (1000 * 1000));
+    f32 Speedup = LexerSeconds / Seconds;
+    printf("%s %.1f MB %s %u threads: %.1f MB/s, %.2fx speedup, %u mismatches\n",
+           NumberPayloadNames[Payload], Bytes / (1000.0f * 1000.0f), Parser, ThreadsCount,
+           MBPerSecond, Speedup, Mismatches);
+    
+    fprintf(File, "%s,%" PRIu64 ",%u,%s,%u,%.6f,%.2f,%.3f\n",
+            NumberPayloadNames[Payload], Bytes, Count, Parser, ThreadsCount, Seconds, MBPerSecond, Speedup);
+    fflush(File);
+}
+
+internal void
+RunNumberParseBenchmark(char* OutputPath, u32 RunsCount, u32 ThreadsCount)
+{
+    FILE* File = fopen(OutputPath, "w");
+    if(!File) {
+        printf("Failed to open benchmark output file at %s\n", OutputPath);
+        exit(1);
+    }
+    
+    fprintf(File, "payload,bytes,values,parser,threads,seconds,mb_per_s,speedup\n");
+    
+    thread_pool ThreadPool;
+    CreateThreadPool(&ThreadPool, ThreadsCount - 1);
+    
+    u32 Count = NUMBER_PAYLOAD_VALUES_COUNT;
+    u32* Lexed = (u32*)ZeroAlloc(sizeof(u32) * Count);
+    u32* Parsed = (u32*)ZeroAlloc(sizeof(u32) * Count);
+    
+    srand(BENCHMARK_SEED);
+    For(PayloadIndex, NUMBER_PAYLOAD_COUNT)
+    {
+        number_payload Payload = (number_payload)PayloadIndex;
+        number_array_type Type = (Payload == NUMBER_PAYLOAD_INDICES) ? NUMBER_ARRAY_U32 : NUMBER_ARRAY_F32;
+        char* Text = GenerateNumberPayload(Payload, Count);
+        u64 Bytes = strlen(Text);
+        xml_text Range = { Text, Text + Bytes };
+        
+        f32 LexerSeconds = 0;
+        For(RunIndex, RunsCount)
+        {
+            timestamp Begin = GetCurrentCounter();
+            LexNumberPayload(Payload, Text, Lexed, Count);
+            f32 Seconds = GetSecondsElapsed(Begin, GetCurrentCounter());
+            if(RunIndex == 0 || Seconds < LexerSeconds) LexerSeconds = Seconds;
+        }
+        WriteNumberParseResult(File, Payload, Bytes, Count, "lexer", 1, LexerSeconds, LexerSeconds, 0);
+        
+        thread_pool* Pools[2] = { 0, &ThreadPool };
+        For(PoolIndex, ThreadsCount > 1 ? 2 : 1)
+        {
+            f32 ParserSeconds = 0;
+            For(RunIndex, RunsCount)
+            {
+                memset(Parsed, 0, sizeof(u32) * Count);
+                timestamp Begin = GetCurrentCounter();
+                bool Success = ParseNumberArray(Type, Range, Parsed, Count, Pools[PoolIndex]);
+                f32 Seconds = GetSecondsElapsed(Begin, GetCurrentCounter());
+                Assert(Success);
+                if(RunIndex == 0 || Seconds < ParserSeconds) ParserSeconds = Seconds;
+            }
+            
+            //Compared bitwise, both paths must round every value the same way
+            u32 Mismatches = 0;
+            For(Index, Count)
+            {
+                if(Lexed[Index] != Parsed[Index]) Mismatches++;
+            }
+            
+            WriteNumberParseResult(File, Payload, Bytes, Count, "parser", PoolIndex ? ThreadsCount : 1,
+                                   ParserSeconds, LexerSeconds, Mismatches);
+        }
+        
+        Free(Text);
+    }
+    
+    DestroyThreadPool(&ThreadPool);
+    Free(Lexed);
+    Free(Parsed);
+    fclose(File);
+}
+
+//Xml tree benchmark. The dragon asset is parsed into a full xml_file RunsCount times, the fastest
+//parse and free are written as a csv row with the heap allocations made by one parse
+
+#define XML_BENCHMARK_PATH "../res/dragon.dae"
+
+internal u64
+CountXmlElements(xml_element* Element)
+{
+    u64 Count = 1;
+    For(Index, Element->ChildrenCount)
+    {
+        Count += CountXmlElements(Element->Children[Index]);
+    }
+    return Count;
+}
+
+internal void
+RunXmlParseBenchmark(char* OutputPath, u32 RunsCount)
+{
+    FILE* File = fopen(OutputPath, "w");
+    if(!File) {
+        printf("Failed to open benchmark output file at %s\n", OutputPath);
+        exit(1);
+    }
+    
+    file_view View;
+    if(!MapFileAsString(XML_BENCHMARK_PATH, &View)) {
+        printf("Failed to open %s\n", XML_BENCHMARK_PATH);
+        exit(1);
+    }
+    
+    fprintf(File, "file,bytes,elements,arena_blocks,parse_seconds,mb_per_s,free_seconds\n");
+    
+    u64 Elements = 0;
+    u64 ArenaBlocks = 0;
+    f32 ParseSeconds = 0;
+    f32 FreeSeconds = 0;
+    For(RunIndex, RunsCount)
+    {
+        //The lexer interns the names so it is part of the parse
+        timestamp ParseBegin = GetCurrentCounter();
+        lexer Lexer;
+        InitLexer(&Lexer, (char*)View.Data, LEXER_IGNORE_NEWLINES | LEXER_XML_COMMENTS | LEXER_NO_STRING_COPY);
+        xml_file Document = ParseXmlFile(&Lexer);
+        f32 Seconds = GetSecondsElapsed(ParseBegin, GetCurrentCounter());
+        if(RunIndex == 0 || Seconds < ParseSeconds) ParseSeconds = Seconds;
+        
+        Elements = Document.Root ? CountXmlElements(Document.Root) : 0;
+        //The tree and the interned names are the only allocations that grow with the document
+        ArenaBlocks = SbufLen(Document.Arena.Blocks) + SbufLen(Lexer.Intern.Arena.Blocks);
+        
+        timestamp FreeBegin = GetCurrentCounter();
+        FreeXmlFile(&Document);
+        FreeLexer(&Lexer);
+        Seconds = GetSecondsElapsed(FreeBegin, GetCurrentCounter());
+        if(RunIndex == 0 || Seconds < FreeSeconds) FreeSeconds = Seconds;
+    }
+    
+    f32 MBPerSecond = View.Size / (ParseSeconds * (1000 * 1000));
+    printf("%s %.1f MB: %" PRIu64 " elements, %" PRIu64 " arena blocks, "
+           "parse %.3fs (%.1f MB/s), free %.4fs\n",
+           XML_BENCHMARK_PATH, View.Size / (1000.0f * 1000.0f), Elements, ArenaBlocks,
+           ParseSeconds, MBPerSecond, FreeSeconds);
+    fprintf(File, "%s,%" PRIu64 ",%" PRIu64 ",%" PRIu64 ",%.6f,%.2f,%.6f\n",
+            XML_BENCHMARK_PATH, View.Size, Elements, ArenaBlocks, ParseSeconds,
+            MBPerSecond, FreeSeconds);
+    
+    UnmapFile(&View);
+    fclose(File);
+}
@@ -150,46 +150,2015 @@ PartitionIndexedTriangles(vec3* Positions, u32* Indices, u32 IndicesCount)
     return BeginningOfAbove;
 }
 
+//Split a node at the mean and return the index of the beginning of the right child, or 0 for a leaf
+internal u32
+SplitIndexedTrianglesMean(vec3* Positions, u32* Indices, u32 IndicesCount, u32 Depth)
+{
+    //Stop if we have too few triangles left or if the tree would be too deep to traverse
+    if(IndicesCount / 3 < MIN_TRIANGLES_PER_LEAF || Depth + 1 >= BVH_MAX_DEPTH)
+    {
+        return 0;
+    }
+    
+    u32 k = PartitionIndexedTriangles(Positions, Indices, IndicesCount);
+    u32 LeftCount = k;
+    u32 RightCount = IndicesCount - k;
+    
+    u32 IndicesDifference = MIN_TRIANGLE_DIFFERENCE * 3;
+    
+    // Stop if we have almost the same amount of primitives in one of the child as the parent
+    if(LeftCount < IndicesDifference ||
+       RightCount < IndicesDifference)
+    {
+        return 0;
+    }
+    
+    return k;
+}
+
+internal aabb_tree*
+ComputeAABBTree(vec3* Positions, u32* Indices, u32 IndicesCount, u32 Depth = 0)
+{
+    aabb_tree* Tree = (aabb_tree*)ZeroAlloc(sizeof(aabb_tree));
+    
+    
+    Tree->AABB = ComputeAABBIndexed(Positions, Indices, IndicesCount);
+    Assert(IndicesCount % 3 == 0);
+    
+    u32 k = SplitIndexedTrianglesMean(Positions, Indices, IndicesCount, Depth);
+    if(k == 0)
+    {
+        Tree->Indices = Indices;
+        Tree->IndicesCount = IndicesCount;
+    }
+    else
+    {
+        // Recursively construct left and right subtree from subarrays and
+        // point the left and right fields of the current node at the subtrees
+        Tree->Left = ComputeAABBTree(Positions, &Indices[0], k, Depth + 1);
+        Tree->Right = ComputeAABBTree(Positions, &Indices[k], IndicesCount - k, Depth + 1);
+    }
+    
+    return Tree;
+}
+
+//Returns the bin in which a centroid falls along an axis, same for binning and partitioning
+inline u32
+GetSAHBinIndex(f32 Centroid, f32 Min, f32 Scale, u32 BinsCount)
+{
+    u32 Result = (u32)((Centroid - Min) * Scale);
+    return MIN(Result, BinsCount - 1);
+}
+
+//Cost of intersecting triangles that are tested in groups of GroupSize,
+//a partially filled group costs as much as a full one
+inline f32
+GetSAHTrianglesCost(u32 TrianglesCount, u32 GroupSize)
+{
+    u32 GroupsCount = (TrianglesCount + GroupSize - 1) / GroupSize;
+    return SAH_TRIANGLE_COST * (f32)(GroupsCount * GroupSize);
+}
+
+//Bounds of the centroids of the triangles, splitting is only done between those
+internal aabb
+ComputeCentroidAABBIndexed(vec3* Positions, u32* Indices, u32 IndicesCount)
+{
+    aabb CentroidAABB;
+    CentroidAABB.Min = vec3(FLT_MAX);
+    CentroidAABB.Max = vec3(-FLT_MAX);
+    for(u32 i = 0; i < IndicesCount; i += 3)
+    {
+        vec3 C = (Positions[Indices[i + 0]] + Positions[Indices[i + 1]] + Positions[Indices[i + 2]]) * (1.0f / 3.0f);
+        UpdateAABB(&CentroidAABB, C);
+    }
+    return CentroidAABB;
+}
+
+//Scale from centroid position to bin index for each axis, 0 if the centroids are flat on the axis
+internal void
+GetSAHBinScales(aabb CentroidAABB, u32 BinsCount, f32* Scale)
+{
+    vec3 Extent = CentroidAABB.Max - CentroidAABB.Min;
+    For(Axis, 3)
+    {
+        Scale[Axis] = Extent.e[Axis] > 0.0f ? (f32)BinsCount / Extent.e[Axis] : 0.0f;
+    }
+}
+
+internal void
+ClearSAHBins(sah_bin Bins[3][MAX_SAH_BINS_COUNT], u32 BinsCount)
+{
+    aabb InitAABB;
+    InitAABB.Max = vec3(-FLT_MAX);
+    InitAABB.Min = vec3(FLT_MAX);
+    
+    For(Axis, 3)
+    {
+        For(Bin, BinsCount)
+        {
+            Bins[Axis][Bin].AABB = InitAABB;
+            Bins[Axis][Bin].TrianglesCount = 0;
+        }
+    }
+}
+
+//Fill the bins of all 3 axis in a single pass over the triangles
+internal void
+FillSAHBins(vec3* Positions, u32* Indices, u32 IndicesCount, aabb CentroidAABB, f32* Scale,
+            sah_bin Bins[3][MAX_SAH_BINS_COUNT], u32 BinsCount)
+{
+    for(u32 i = 0; i < IndicesCount; i += 3)
+    {
+        vec3 P[3];
+        P[0] = Positions[Indices[i + 0]];
+        P[1] = Positions[Indices[i + 1]];
+        P[2] = Positions[Indices[i + 2]];
+        
+        vec3 C = (P[0] + P[1] + P[2]) * (1.0f / 3.0f);
+        
+        For(Axis, 3)
+        {
+            if(Scale[Axis] == 0.0f) continue;
+            
+            sah_bin* Bin = &Bins[Axis][GetSAHBinIndex(C.e[Axis], CentroidAABB.Min.e[Axis], Scale[Axis], BinsCount)];
+            Bin->TrianglesCount++;
+            UpdateAABB(&Bin->AABB, P[0]);
+            UpdateAABB(&Bin->AABB, P[1]);
+            UpdateAABB(&Bin->AABB, P[2]);
+        }
+    }
+}
+
+//Evaluate the cost of splitting after each bin and return the best one, FLT_MAX if no split is possible
+internal f32
+FindSAHSplit(sah_bin Bins[3][MAX_SAH_BINS_COUNT], u32 BinsCount, f32* Scale, u32 GroupSize, f32 ParentArea,
+             u32* OutAxis, u32* OutBin)
+{
+    aabb InitAABB;
+    InitAABB.Max = vec3(-FLT_MAX);
+    InitAABB.Min = vec3(FLT_MAX);
+    
+    //Sweep from the right to get the area and count of the right partition and then from the left
+    f32 InvParentArea = ParentArea > 0.0f ? 1.0f / ParentArea : 0.0f;
+    f32 BestCost = FLT_MAX;
+    u32 BestAxis = 0;
+    u32 BestBin = 0;
+    For(Axis, 3)
+    {
+        if(Scale[Axis] == 0.0f) continue;
+        
+        f32 RightAreas[MAX_SAH_BINS_COUNT];
+        u32 RightCounts[MAX_SAH_BINS_COUNT];
+        aabb Right = InitAABB;
+        u32 RightCount = 0;
+        for(u32 Bin = BinsCount - 1; Bin > 0; Bin--)
+        {
+            sah_bin* Current = &Bins[Axis][Bin];
+            if(Current->TrianglesCount)
+            {
+                UpdateAABB(&Right, Current->AABB.Min);
+                UpdateAABB(&Right, Current->AABB.Max);
+            }
+            RightCount += Current->TrianglesCount;
+            RightAreas[Bin - 1] = RightCount ? AABBArea(Right) : 0.0f;
+            RightCounts[Bin - 1] = RightCount;
+        }
+        
+        aabb Left = InitAABB;
+        u32 LeftCount = 0;
+        For(Bin, BinsCount - 1)
+        {
+            sah_bin* Current = &Bins[Axis][Bin];
+            if(Current->TrianglesCount)
+            {
+                UpdateAABB(&Left, Current->AABB.Min);
+                UpdateAABB(&Left, Current->AABB.Max);
+            }
+            LeftCount += Current->TrianglesCount;
+            
+            //Only consider splits that leave triangles on both sides
+            if(LeftCount == 0 || RightCounts[Bin] == 0) continue;
+            
+            f32 Cost = SAH_TRAVERSAL_COST + InvParentArea *
+                (AABBArea(Left) * GetSAHTrianglesCost(LeftCount, GroupSize) +
+                 RightAreas[Bin] * GetSAHTrianglesCost(RightCounts[Bin], GroupSize));
+            if(Cost < BestCost)
+            {
+                BestCost = Cost;
+                BestAxis = Axis;
+                BestBin = Bin;
+            }
+        }
+    }
+    
+    *OutAxis = BestAxis;
+    *OutBin = BestBin;
+    return BestCost;
+}
+
+//True if no split is possible or if a leaf is cheaper, unless it would be too big
+inline bool
+IsSAHLeafBetter(f32 BestCost, u32 TrianglesCount, u32 GroupSize)
+{
+    f32 LeafCost = GetSAHTrianglesCost(TrianglesCount, GroupSize);
+    return BestCost == FLT_MAX || (LeafCost <= BestCost && TrianglesCount <= SAH_MAX_TRIANGLES_PER_LEAF);
+}
+
+//True if the centroid of the triangle falls in a bin on the left of the split
+inline bool
+IsLeftOfSAHSplit(vec3* Positions, u32* Triangle, aabb CentroidAABB, f32* Scale, u32 BinsCount, u32 Axis, u32 SplitBin)
+{
+    vec3 C = (Positions[Triangle[0]] + Positions[Triangle[1]] + Positions[Triangle[2]]) * (1.0f / 3.0f);
+    return GetSAHBinIndex(C.e[Axis], CentroidAABB.Min.e[Axis], Scale[Axis], BinsCount) <= SplitBin;
+}
+
+//Divides indices in two partitions using the binned surface area heuristic
+//and returns index of beginning of second partition, or 0 if a leaf is cheaper than any split
+internal u32
+PartitionIndexedTrianglesSAH(vec3* Positions, u32* Indices, u32 IndicesCount, u32 BinsCount, u32 GroupSize, f32 ParentArea)
+{
+    Assert(BinsCount >= 2 && BinsCount <= MAX_SAH_BINS_COUNT);
+    u32 TrianglesCount = IndicesCount / 3;
+    
+    aabb CentroidAABB = ComputeCentroidAABBIndexed(Positions, Indices, IndicesCount);
+    f32 Scale[3];
+    GetSAHBinScales(CentroidAABB, BinsCount, Scale);
+    
+    sah_bin Bins[3][MAX_SAH_BINS_COUNT];
+    ClearSAHBins(Bins, BinsCount);
+    FillSAHBins(Positions, Indices, IndicesCount, CentroidAABB, Scale, Bins, BinsCount);
+    
+    u32 BestAxis, BestBin;
+    f32 BestCost = FindSAHSplit(Bins, BinsCount, Scale, GroupSize, ParentArea, &BestAxis, &BestBin);
+    if(IsSAHLeafBetter(BestCost, TrianglesCount, GroupSize))
+    {
+        return 0;
+    }
+    
+    //Partition triangles moving the ones in the bins to the right of the split at the end of the array
+    u32 BelowIt = 0;
+    u32 AboveIt = IndicesCount;
+    while(BelowIt != AboveIt)
+    {
+        if(!IsLeftOfSAHSplit(Positions, &Indices[BelowIt], CentroidAABB, Scale, BinsCount, BestAxis, BestBin))
+        {
+            AboveIt -= 3;
+            
+            //Swap 3 indices from AboveIt to BelowIt
+            For(SwapIndex, 3)
+            {
+                u32 Temp = Indices[AboveIt + SwapIndex];
+                Indices[AboveIt + SwapIndex] = Indices[BelowIt + SwapIndex];
+                Indices[BelowIt + SwapIndex] = Temp;
+            }
+        }
+        else
+        {
+            BelowIt += 3;
+        }
+    }
+    
+    Assert(BelowIt != 0 && BelowIt != IndicesCount);
+    return BelowIt;
+}
+
+internal aabb_tree*
+ComputeAABBTreeSAH(vec3* Positions, u32* Indices, u32 IndicesCount, u32 BinsCount, u32 GroupSize, u32 Depth = 0)
+{
+    aabb_tree* Tree = (aabb_tree*)ZeroAlloc(sizeof(aabb_tree));
+    
+    Tree->AABB = ComputeAABBIndexed(Positions, Indices, IndicesCount);
+    Assert(IndicesCount % 3 == 0);
+    
+    u32 k = 0;
+    if(IndicesCount / 3 > 1 && Depth + 1 < BVH_MAX_DEPTH)
+    {
+        k = PartitionIndexedTrianglesSAH(Positions, Indices, IndicesCount, BinsCount, GroupSize, AABBArea(Tree->AABB));
+    }
+    
+    //Make a leaf if the heuristic decided not to split
+    if(k == 0)
+    {
+        Tree->Indices = Indices;
+        Tree->IndicesCount = IndicesCount;
+    }
+    else
+    {
+        Tree->Left = ComputeAABBTreeSAH(Positions, &Indices[0], k, BinsCount, GroupSize, Depth + 1);
+        Tree->Right = ComputeAABBTreeSAH(Positions, &Indices[k], IndicesCount - k, BinsCount, GroupSize, Depth + 1);
+    }
+    
+    return Tree;
+}
+
+inline aabb
+IntersectAABBs(aabb A, aabb B)
+{
+    aabb Result;
+    For(Axis, 3)
+    {
+        Result.Min.e[Axis] = MAX(A.Min.e[Axis], B.Min.e[Axis]);
+        Result.Max.e[Axis] = MIN(A.Max.e[Axis], B.Max.e[Axis]);
+    }
+    return Result;
+}
+
+//True for the inverted bounds of a side of a split that the triangle doesn't reach
+inline bool
+IsAABBEmpty(aabb AABB)
+{
+    return AABB.Min.x > AABB.Max.x || AABB.Min.y > AABB.Max.y || AABB.Min.z > AABB.Max.z;
+}
+
+//Bounds of the parts of the triangle of a reference on each side of a plane, from the vertices and the points
+//where the edges cross the plane. Both are limited to the bounds of the reference, a side is empty if
+//the triangle doesn't reach it
+internal void
+SplitSBVHReference(sbvh_build* Build, sbvh_reference* Reference, u32 Axis, f32 Plane, aabb* Left, aabb* Right)
+{
+    Left->Min = Right->Min = vec3(FLT_MAX);
+    Left->Max = Right->Max = vec3(-FLT_MAX);
+    
+    vec3 Triangle[3];
+    For(Index, 3)
+    {
+        Triangle[Index] = Build->Positions[Build->SourceIndices[Reference->Triangle + Index]];
+    }
+    
+    For(Index, 3)
+    {
+        vec3 a = Triangle[Index];
+        vec3 b = Triangle[(Index + 1) % 3];
+        f32 pa = a.e[Axis];
+        f32 pb = b.e[Axis];
+        if(pa <= Plane) UpdateAABB(Left, a);
+        if(pa >= Plane) UpdateAABB(Right, a);
+        
+        if((pa < Plane && pb > Plane) || (pa > Plane && pb < Plane))
+        {
+            vec3 p = a + (b - a) * ((Plane - pa) / (pb - pa));
+            p.e[Axis] = Plane;
+            UpdateAABB(Left, p);
+            UpdateAABB(Right, p);
+        }
+    }
+    
+    *Left = IntersectAABBs(*Left, Reference->Bounds);
+    *Right = IntersectAABBs(*Right, Reference->Bounds);
+}
+
+inline vec3
+GetAABBCenter(aabb AABB)
+{
+    return (AABB.Min + AABB.Max) * 0.5f;
+}
+
+inline aabb
+MergeAABBs(aabb A, aabb B)
+{
+    UpdateAABB(&A, B.Min);
+    UpdateAABB(&A, B.Max);
+    return A;
+}
+
+//Area of the intersection of two boxes, 0 if they don't overlap
+inline f32
+GetAABBOverlapArea(aabb A, aabb B)
+{
+    aabb Overlap;
+    For(Axis, 3)
+    {
+        Overlap.Min.e[Axis] = MAX(A.Min.e[Axis], B.Min.e[Axis]);
+        Overlap.Max.e[Axis] = MIN(A.Max.e[Axis], B.Max.e[Axis]);
+        if(Overlap.Min.e[Axis] > Overlap.Max.e[Axis]) return 0.0f;
+    }
+    return AABBArea(Overlap);
+}
+
+//Binned SAH over the centers of the reference bounds, same as PartitionIndexedTrianglesSAH
+internal sbvh_split
+FindSBVHObjectSplit(sbvh_build* Build, sbvh_reference* References, u32 ReferencesCount, f32 ParentArea,
+                    aabb* CentroidAABB, f32* Scale)
+{
+    CentroidAABB->Min = vec3(FLT_MAX);
+    CentroidAABB->Max = vec3(-FLT_MAX);
+    For(Index, ReferencesCount)
+    {
+        UpdateAABB(CentroidAABB, GetAABBCenter(References[Index].Bounds));
+    }
+    GetSAHBinScales(*CentroidAABB, Build->BinsCount, Scale);
+    
+    sah_bin Bins[3][MAX_SAH_BINS_COUNT];
+    ClearSAHBins(Bins, Build->BinsCount);
+    For(Index, ReferencesCount)
+    {
+        aabb Bounds = References[Index].Bounds;
+        vec3 C = GetAABBCenter(Bounds);
+        For(Axis, 3)
+        {
+            if(Scale[Axis] == 0.0f) continue;
+            
+            sah_bin* Bin = &Bins[Axis][GetSAHBinIndex(C.e[Axis], CentroidAABB->Min.e[Axis], Scale[Axis], Build->BinsCount)];
+            Bin->TrianglesCount++;
+            UpdateAABB(&Bin->AABB, Bounds.Min);
+            UpdateAABB(&Bin->AABB, Bounds.Max);
+        }
+    }
+    
+    sbvh_split Split = {};
+    Split.Cost = FindSAHSplit(Bins, Build->BinsCount, Scale, Build->GroupSize, ParentArea, &Split.Axis, &Split.Bin);
+    if(Split.Cost == FLT_MAX) return Split;
+    
+    //Children bounds to measure their overlap
+    Split.Left.Min = Split.Right.Min = vec3(FLT_MAX);
+    Split.Left.Max = Split.Right.Max = vec3(-FLT_MAX);
+    For(Bin, Build->BinsCount)
+    {
+        sah_bin* Current = &Bins[Split.Axis][Bin];
+        if(Current->TrianglesCount == 0) continue;
+        
+        if(Bin <= Split.Bin)
+        {
+            Split.Left = MergeAABBs(Split.Left, Current->AABB);
+            Split.LeftCount += Current->TrianglesCount;
+        }
+        else
+        {
+            Split.Right = MergeAABBs(Split.Right, Current->AABB);
+            Split.RightCount += Current->TrianglesCount;
+        }
+    }
+    
+    return Split;
+}
+
+//Split the node with a plane between bins of the same size along each axis, references crossing
+//the plane are clipped in both children. Splits adding more references than Budget are skipped
+internal sbvh_split
+FindSBVHSpatialSplit(sbvh_build* Build, sbvh_reference* References, u32 ReferencesCount, aabb Bounds, u32 Budget)
+{
+    u32 BinsCount = Build->BinsCount;
+    f32 InvParentArea = 1.0f / AABBArea(Bounds);
+    
+    sbvh_split Best = {};
+    Best.Cost = FLT_MAX;
+    Best.Spatial = true;
+    For(Axis, 3)
+    {
+        f32 Min = Bounds.Min.e[Axis];
+        f32 Extent = Bounds.Max.e[Axis] - Min;
+        if(Extent <= 0.0f) continue;
+        f32 BinSize = Extent / (f32)BinsCount;
+        f32 Scale = (f32)BinsCount / Extent;
+        
+        sbvh_spatial_bin Bins[MAX_SAH_BINS_COUNT];
+        For(Bin, BinsCount)
+        {
+            Bins[Bin].AABB.Min = vec3(FLT_MAX);
+            Bins[Bin].AABB.Max = vec3(-FLT_MAX);
+            Bins[Bin].Entries = 0;
+            Bins[Bin].Exits = 0;
+        }
+        
+        //Each reference adds the part of its triangle inside every bin it crosses
+        For(Index, ReferencesCount)
+        {
+            sbvh_reference* Reference = &References[Index];
+            u32 First = GetSAHBinIndex(Reference->Bounds.Min.e[Axis], Min, Scale, BinsCount);
+            u32 Last = GetSAHBinIndex(Reference->Bounds.Max.e[Axis], Min, Scale, BinsCount);
+            Bins[First].Entries++;
+            Bins[Last].Exits++;
+            
+            if(First == Last)
+            {
+                Bins[First].AABB = MergeAABBs(Bins[First].AABB, Reference->Bounds);
+                continue;
+            }
+            
+            //Split the reference at the end of each bin, what's left goes in the next one
+            sbvh_reference Remaining = *Reference;
+            for(u32 Bin = First; Bin < Last; Bin++)
+            {
+                aabb LeftPart;
+                SplitSBVHReference(Build, &Remaining, Axis, Min + BinSize * (f32)(Bin + 1), &LeftPart, &Remaining.Bounds);
+                if(!IsAABBEmpty(LeftPart)) Bins[Bin].AABB = MergeAABBs(Bins[Bin].AABB, LeftPart);
+                if(IsAABBEmpty(Remaining.Bounds)) break;
+            }
+            if(!IsAABBEmpty(Remaining.Bounds)) Bins[Last].AABB = MergeAABBs(Bins[Last].AABB, Remaining.Bounds);
+        }
+        
+        //Same sweep as FindSAHSplit, references on the left started before the plane and the ones
+        //on the right end after it
+        aabb RightBounds[MAX_SAH_BINS_COUNT];
+        u32 RightCounts[MAX_SAH_BINS_COUNT];
+        aabb Right;
+        Right.Min = vec3(FLT_MAX);
+        Right.Max = vec3(-FLT_MAX);
+        u32 RightCount = 0;
+        for(u32 Bin = BinsCount - 1; Bin > 0; Bin--)
+        {
+            Right = MergeAABBs(Right, Bins[Bin].AABB);
+            RightCount += Bins[Bin].Exits;
+            RightBounds[Bin - 1] = Right;
+            RightCounts[Bin - 1] = RightCount;
+        }
+        
+        aabb Left;
+        Left.Min = vec3(FLT_MAX);
+        Left.Max = vec3(-FLT_MAX);
+        u32 LeftCount = 0;
+        For(Bin, BinsCount - 1)
+        {
+            Left = MergeAABBs(Left, Bins[Bin].AABB);
+            LeftCount += Bins[Bin].Entries;
+            
+            if(LeftCount == 0 || RightCounts[Bin] == 0) continue;
+            if(LeftCount + RightCounts[Bin] - ReferencesCount > Budget) continue;
+            
+            f32 Cost = SAH_TRAVERSAL_COST + InvParentArea *
+                (AABBArea(Left) * GetSAHTrianglesCost(LeftCount, Build->GroupSize) +
+                 AABBArea(RightBounds[Bin]) * GetSAHTrianglesCost(RightCounts[Bin], Build->GroupSize));
+            if(Cost < Best.Cost)
+            {
+                Best.Cost = Cost;
+                Best.Axis = Axis;
+                Best.Bin = Bin;
+                Best.Plane = Min + BinSize * (f32)(Bin + 1);
+                Best.Left = Left;
+                Best.Right = RightBounds[Bin];
+                Best.LeftCount = LeftCount;
+                Best.RightCount = RightCounts[Bin];
+            }
+        }
+    }
+    
+    return Best;
+}
+
+//Add a reference to one of the children of a node, merging its bounds in the bounds of the child
+inline void
+PushSBVHReference(sbvh_reference* Child, u32* Count, aabb* Bounds, sbvh_reference Reference)
+{
+    Child[(*Count)++] = Reference;
+    *Bounds = MergeAABBs(*Bounds, Reference.Bounds);
+}
+
+//Move the references in two children with the split, returns false if one of the children would be empty
+//so a spatial split can be replaced with the object one, or the node made a leaf. Left and Right must have space
+//for all the references
+internal bool
+PartitionSBVHReferences(sbvh_build* Build, sbvh_reference* References, u32 ReferencesCount, sbvh_split* Split,
+                        aabb CentroidAABB, f32* Scale, sbvh_reference* Left, u32* LeftCount, aabb* LeftBounds,
+                        sbvh_reference* Right, u32* RightCount, aabb* RightBounds)
+{
+    *LeftCount = *RightCount = 0;
+    LeftBounds->Min = RightBounds->Min = vec3(FLT_MAX);
+    LeftBounds->Max = RightBounds->Max = vec3(-FLT_MAX);
+    u32 Axis = Split->Axis;
+    u32 AddedCount = 0;
+    
+    //Cost of keeping a reference crossing the plane whole in one of the children instead of
+    //clipping it in both, compared on the children estimated by the bins
+    f32 LeftArea = AABBArea(Split->Left);
+    f32 RightArea = AABBArea(Split->Right);
+    f32 SplitCost = LeftArea * (f32)Split->LeftCount + RightArea * (f32)Split->RightCount;
+    
+    For(Index, ReferencesCount)
+    {
+        sbvh_reference Reference = References[Index];
+        if(!Split->Spatial)
+        {
+            vec3 C = GetAABBCenter(Reference.Bounds);
+            if(GetSAHBinIndex(C.e[Axis], CentroidAABB.Min.e[Axis], Scale[Axis], Build->BinsCount) <= Split->Bin)
+            {
+                PushSBVHReference(Left, LeftCount, LeftBounds, Reference);
+            }
+            else
+            {
+                PushSBVHReference(Right, RightCount, RightBounds, Reference);
+            }
+            continue;
+        }
+        
+        if(Reference.Bounds.Max.e[Axis] <= Split->Plane)
+        {
+            PushSBVHReference(Left, LeftCount, LeftBounds, Reference);
+            continue;
+        }
+        if(Reference.Bounds.Min.e[Axis] >= Split->Plane)
+        {
+            PushSBVHReference(Right, RightCount, RightBounds, Reference);
+            continue;
+        }
+        
+        f32 AllLeftCost = AABBArea(MergeAABBs(Split->Left, Reference.Bounds)) * (f32)Split->LeftCount +
+            RightArea * (f32)(Split->RightCount - 1);
+        f32 AllRightCost = LeftArea * (f32)(Split->LeftCount - 1) +
+            AABBArea(MergeAABBs(Split->Right, Reference.Bounds)) * (f32)Split->RightCount;
+        b32 OverBudget = Build->ReferencesCount + AddedCount >= Build->MaxReferencesCount;
+        if((AllLeftCost < SplitCost || OverBudget) && AllLeftCost <= AllRightCost)
+        {
+            PushSBVHReference(Left, LeftCount, LeftBounds, Reference);
+        }
+        else if(AllRightCost < SplitCost || OverBudget)
+        {
+            PushSBVHReference(Right, RightCount, RightBounds, Reference);
+        }
+        else
+        {
+            sbvh_reference LeftPart = Reference;
+            sbvh_reference RightPart = Reference;
+            SplitSBVHReference(Build, &Reference, Axis, Split->Plane, &LeftPart.Bounds, &RightPart.Bounds);
+            b32 InLeft = !IsAABBEmpty(LeftPart.Bounds);
+            b32 InRight = !IsAABBEmpty(RightPart.Bounds);
+            if(InLeft) PushSBVHReference(Left, LeftCount, LeftBounds, LeftPart);
+            if(InRight) PushSBVHReference(Right, RightCount, RightBounds, RightPart);
+            
+            //The bounds can be bigger than the triangle after the previous splits so it can miss a side,
+            //but never both
+            if(!InLeft && !InRight) PushSBVHReference(Left, LeftCount, LeftBounds, Reference);
+            if(InLeft && InRight) AddedCount++;
+        }
+    }
+    
+    if(*LeftCount == 0 || *RightCount == 0) return false;
+    
+    Build->ReferencesCount += AddedCount;
+    return true;
+}
+
 internal aabb_tree*
-ComputeAABBTree(vec3* Positions, u32* Indices, u32 IndicesCount)
+ComputeAABBTreeSBVHRec(sbvh_build* Build, sbvh_reference* References, u32 ReferencesCount, aabb Bounds, u32 Depth)
+{
+    aabb_tree* Tree = (aabb_tree*)ZeroAlloc(sizeof(aabb_tree));
+    Tree->AABB = Bounds;
+    
+    sbvh_split Split = {};
+    Split.Cost = FLT_MAX;
+    aabb CentroidAABB = {};
+    f32 Scale[3] = {};
+    if(ReferencesCount > 1 && Depth + 1 < BVH_MAX_DEPTH)
+    {
+        Split = FindSBVHObjectSplit(Build, References, ReferencesCount, AABBArea(Bounds), &CentroidAABB, Scale);
+        
+        //Spatial splits only help if the children of the object split overlap, or if there is none
+        f32 Overlap = Split.Cost == FLT_MAX ? FLT_MAX : GetAABBOverlapArea(Split.Left, Split.Right);
+        u32 Budget = Build->MaxReferencesCount - Build->ReferencesCount;
+        if(Overlap > Build->MinOverlapArea && Budget > 0)
+        {
+            sbvh_split Spatial = FindSBVHSpatialSplit(Build, References, ReferencesCount, Bounds, Budget);
+            if(Spatial.Cost < Split.Cost) Split = Spatial;
+        }
+    }
+    
+    sbvh_reference* Left = Build->ScratchLeft;
+    sbvh_reference* Right = Build->ScratchRight;
+    u32 LeftCount = 0;
+    u32 RightCount = 0;
+    aabb LeftBounds, RightBounds;
+    b32 IsLeaf = IsSAHLeafBetter(Split.Cost, ReferencesCount, Build->GroupSize);
+    if(!IsLeaf)
+    {
+        b32 Partitioned = PartitionSBVHReferences(Build, References, ReferencesCount, &Split, CentroidAABB, Scale,
+                                                  Left, &LeftCount, &LeftBounds, Right, &RightCount, &RightBounds);
+        if(!Partitioned && Split.Spatial)
+        {
+            //Spatial splits can send every reference to one side, the object split can then be used
+            Split = FindSBVHObjectSplit(Build, References, ReferencesCount, AABBArea(Bounds), &CentroidAABB, Scale);
+            IsLeaf = IsSAHLeafBetter(Split.Cost, ReferencesCount, Build->GroupSize);
+            if(!IsLeaf)
+            {
+                Partitioned = PartitionSBVHReferences(Build, References, ReferencesCount, &Split, CentroidAABB, Scale,
+                                                      Left, &LeftCount, &LeftBounds, Right, &RightCount, &RightBounds);
+            }
+        }
+        
+        //Object splits can still leave a side empty when the centroids are not finite, the node is a leaf then
+        if(!Partitioned) IsLeaf = true;
+    }
+    
+    if(IsLeaf)
+    {
+        Tree->Indices = Build->Indices + Build->IndicesCount;
+        Tree->IndicesCount = ReferencesCount * 3;
+        For(Index, ReferencesCount)
+        {
+            For(Vertex, 3)
+            {
+                Build->Indices[Build->IndicesCount++] = Build->SourceIndices[References[Index].Triangle + Vertex];
+            }
+        }
+        Assert(Build->IndicesCount <= Build->MaxReferencesCount * 3);
+        
+        Free(References);
+    }
+    else
+    {
+        //The children reuse the scratch arrays
+        Free(References);
+        Left = (sbvh_reference*)ZeroAlloc(sizeof(sbvh_reference) * LeftCount);
+        Right = (sbvh_reference*)ZeroAlloc(sizeof(sbvh_reference) * RightCount);
+        memcpy(Left, Build->ScratchLeft, sizeof(sbvh_reference) * LeftCount);
+        memcpy(Right, Build->ScratchRight, sizeof(sbvh_reference) * RightCount);
+        
+        Tree->Left = ComputeAABBTreeSBVHRec(Build, Left, LeftCount, LeftBounds, Depth + 1);
+        Tree->Right = ComputeAABBTreeSBVHRec(Build, Right, RightCount, RightBounds, Depth + 1);
+    }
+    
+    return Tree;
+}
+
+//Spatial split BVH: the binned SAH builder working on references to the triangles, when the children of
+//the best split overlap it also considers splitting the node with a plane that clips the triangles crossing it
+//in both children. Triangles can then be in multiple leaves, up to SBVH_MAX_DUPLICATION more references
+//than triangles, so the tree doesn't reference Indices but the new indices returned in OutIndices
+internal aabb_tree*
+ComputeAABBTreeSBVH(vec3* Positions, u32* Indices, u32 IndicesCount, u32 BinsCount, u32 GroupSize,
+                    u32** OutIndices, u32* OutIndicesCount)
+{
+    u32 TrianglesCount = IndicesCount / 3;
+    
+    sbvh_build Build = {};
+    Build.Positions = Positions;
+    Build.SourceIndices = Indices;
+    Build.BinsCount = BinsCount;
+    Build.GroupSize = GroupSize;
+    Build.ReferencesCount = TrianglesCount;
+    Build.MaxReferencesCount = TrianglesCount + (u32)(SBVH_MAX_DUPLICATION * (f32)TrianglesCount);
+    Build.Indices = (u32*)ZeroAlloc(sizeof(u32) * 3 * Build.MaxReferencesCount);
+    
+    //A node never has more references than the whole mesh
+    Build.ScratchLeft = (sbvh_reference*)ZeroAlloc(sizeof(sbvh_reference) * MAX(Build.MaxReferencesCount, 1));
+    Build.ScratchRight = (sbvh_reference*)ZeroAlloc(sizeof(sbvh_reference) * MAX(Build.MaxReferencesCount, 1));
+    
+    //References start with the bounds of the whole triangles
+    sbvh_reference* References = (sbvh_reference*)ZeroAlloc(sizeof(sbvh_reference) * MAX(TrianglesCount, 1));
+    aabb Bounds;
+    Bounds.Min = vec3(FLT_MAX);
+    Bounds.Max = vec3(-FLT_MAX);
+    For(Triangle, TrianglesCount)
+    {
+        References[Triangle].Triangle = Triangle * 3;
+        References[Triangle].Bounds = ComputeAABBIndexed(Positions, Indices + Triangle * 3, 3);
+        Bounds = MergeAABBs(Bounds, References[Triangle].Bounds);
+    }
+    Build.MinOverlapArea = SBVH_ALPHA * AABBArea(Bounds);
+    
+    aabb_tree* Tree = ComputeAABBTreeSBVHRec(&Build, References, TrianglesCount, Bounds, 0);
+    Assert(Build.IndicesCount == Build.ReferencesCount * 3);
+    Free(Build.ScratchLeft);
+    Free(Build.ScratchRight);
+    
+    *OutIndices = Build.Indices;
+    *OutIndicesCount = Build.IndicesCount;
+    return Tree;
+}
+
+//Spread the lower 21 bits of x so that there are two zero bits between each of them
+inline u64
+SpreadMortonBits(u64 x)
+{
+    x &= 0x1fffff;
+    x = (x | x << 32) & 0x001f00000000ffffull;
+    x = (x | x << 16) & 0x001f0000ff0000ffull;
+    x = (x | x << 8)  & 0x100f00f00f00f00full;
+    x = (x | x << 4)  & 0x10c30c30c30c30c3ull;
+    x = (x | x << 2)  & 0x1249249249249249ull;
+    return x;
+}
+
+//Morton code of a point inside the bounds with BitsPerAxis bits for each axis
+inline u64
+GetMortonCode(vec3 P, aabb Bounds, vec3 Scale, u32 BitsPerAxis)
+{
+    f32 MaxCell = (f32)((1 << BitsPerAxis) - 1);
+    u64 Cells[3];
+    For(Axis, 3)
+    {
+        f32 Cell = (P.e[Axis] - Bounds.Min.e[Axis]) * Scale.e[Axis] * MaxCell;
+        Cells[Axis] = (u64)Clamp(Cell, 0.0f, MaxCell);
+    }
+    return (SpreadMortonBits(Cells[0]) << 2) | (SpreadMortonBits(Cells[1]) << 1) | SpreadMortonBits(Cells[2]);
+}
+
+//Length of the common prefix of the keys of two sorted triangles, keys that are the same
+//are made unique by their position. -1 if j is out of range
+inline s32
+GetLBVHCommonPrefix(u64* Keys, u32 Count, s64 i, s64 j)
+{
+    if(j < 0 || j >= Count) return -1;
+    
+    u64 KeyI = Keys[i];
+    u64 KeyJ = Keys[j];
+    if(KeyI == KeyJ)
+    {
+        return 64 + CountLeadingZeros((u32)i ^ (u32)j);
+    }
+    return CountLeadingZeros64(KeyI ^ KeyJ);
+}
+
+//Find the range and split of an internal node of the radix tree over the sorted keys,
+//each internal node is independent of the others (Karras 2012)
+internal lbvh_node
+GetLBVHNode(u64* Keys, u32 Count, s64 i)
+{
+    //Direction of the range, towards the neighbour with the longest common prefix
+    s64 d = GetLBVHCommonPrefix(Keys, Count, i, i + 1) > GetLBVHCommonPrefix(Keys, Count, i, i - 1) ? 1 : -1;
+    
+    //Upper bound of the length of the range and then binary search of the other end
+    s32 MinPrefix = GetLBVHCommonPrefix(Keys, Count, i, i - d);
+    s64 MaxLength = 2;
+    while(GetLBVHCommonPrefix(Keys, Count, i, i + MaxLength * d) > MinPrefix)
+    {
+        MaxLength *= 2;
+    }
+    
+    s64 Length = 0;
+    for(s64 Step = MaxLength / 2; Step >= 1; Step /= 2)
+    {
+        if(GetLBVHCommonPrefix(Keys, Count, i, i + (Length + Step) * d) > MinPrefix)
+        {
+            Length += Step;
+        }
+    }
+    s64 j = i + Length * d;
+    
+    //The split is where the common prefix of the range ends
+    s32 NodePrefix = GetLBVHCommonPrefix(Keys, Count, i, j);
+    s64 Split = 0;
+    s64 Divisor = 2;
+    s64 Step;
+    do
+    {
+        Step = (Length + Divisor - 1) / Divisor;
+        if(GetLBVHCommonPrefix(Keys, Count, i, i + (Split + Step) * d) > NodePrefix)
+        {
+            Split += Step;
+        }
+        Divisor *= 2;
+    }
+    while(Step > 1);
+    
+    lbvh_node Node;
+    Node.First = (u32)MIN(i, j);
+    Node.Last = (u32)MAX(i, j);
+    Node.Split = (u32)(i + Split * d + MIN(d, 0));
+    return Node;
+}
+
+//Passes over the triangles run by all the threads of the pool, or only by the calling one
+THREAD_PROC(LBVHJobProc)
+{
+    lbvh_job* Job = (lbvh_job*)Data;
+    vec3* Positions = Job->Positions;
+    
+    while(true)
+    {
+        u32 Chunk = InterlockedIncrement(&Job->NextChunk) - 1;
+        if(Chunk >= Job->ChunksCount) break;
+        
+        u32 Begin = Chunk * Job->ChunkSize;
+        u32 End = MIN(Begin + Job->ChunkSize, Job->TrianglesCount);
+        
+        switch(Job->Pass)
+        {
+            case LBVH_PASS_BOUNDS: {
+                Job->ChunkAABBs[Chunk] = ComputeCentroidAABBIndexed(Positions, Job->Indices + Begin * 3, (End - Begin) * 3);
+            } break;
+            
+            case LBVH_PASS_CODES: {
+                for(u32 Triangle = Begin; Triangle < End; Triangle++)
+                {
+                    u32* Indices = Job->Indices + Triangle * 3;
+                    vec3 C = (Positions[Indices[0]] + Positions[Indices[1]] + Positions[Indices[2]]) * (1.0f / 3.0f);
+                    Job->Keys[Triangle] = GetMortonCode(C, Job->CentroidAABB, Job->Scale, Job->BitsPerAxis);
+                    Job->Values[Triangle] = Triangle;
+                }
+            } break;
+            
+            case LBVH_PASS_HISTOGRAM: {
+                u32* Histogram = Job->ChunkHistograms[Chunk];
+                memset(Histogram, 0, sizeof(u32) * LBVH_RADIX_SIZE);
+                for(u32 Index = Begin; Index < End; Index++)
+                {
+                    Histogram[(Job->Keys[Index] >> Job->Shift) & (LBVH_RADIX_SIZE - 1)]++;
+                }
+            } break;
+            
+            case LBVH_PASS_SCATTER: {
+                //Histograms were turned into the first destination of each digit of the chunk
+                u32* Offsets = Job->ChunkHistograms[Chunk];
+                for(u32 Index = Begin; Index < End; Index++)
+                {
+                    u64 Key = Job->Keys[Index];
+                    u32 Dest = Offsets[(Key >> Job->Shift) & (LBVH_RADIX_SIZE - 1)]++;
+                    Job->SortedKeys[Dest] = Key;
+                    Job->SortedValues[Dest] = Job->Values[Index];
+                }
+            } break;
+            
+            case LBVH_PASS_NODES: {
+                for(u32 Index = Begin; Index < MIN(End, Job->TrianglesCount - 1); Index++)
+                {
+                    Job->Nodes[Index] = GetLBVHNode(Job->Keys, Job->TrianglesCount, Index);
+                }
+            } break;
+            
+            case LBVH_PASS_GATHER: {
+                for(u32 Triangle = Begin; Triangle < End; Triangle++)
+                {
+                    u32* Source = Job->Indices + Job->Values[Triangle] * 3;
+                    u32* Dest = Job->Scratch + Triangle * 3;
+                    Dest[0] = Source[0];
+                    Dest[1] = Source[1];
+                    Dest[2] = Source[2];
+                }
+            } break;
+            
+            case LBVH_PASS_COPY: {
+                memcpy(Job->Indices + Begin * 3, Job->Scratch + Begin * 3, sizeof(u32) * 3 * (End - Begin));
+            } break;
+            
+            default: InvalidCodePath;
+        }
+    }
+    
+    return 0;
+}
+
+internal void
+RunLBVHPass(thread_pool* Pool, lbvh_job* Job, lbvh_pass Pass)
+{
+    Job->Pass = Pass;
+    Job->NextChunk = 0;
+    if(Pool) StartThreadPoolJob(Pool, LBVHJobProc, Job);
+    LBVHJobProc(Job);
+    if(Pool) WaitThreadPoolJob(Pool);
+}
+
+//Convert the subtree of the radix tree covering the sorted triangles from First to Last to an aabb_tree,
+//small subtrees are collapsed in a single leaf
+internal aabb_tree*
+ConvertLBVHNode(lbvh_job* Job, u32 NodeIndex, u32 First, u32 Last, u32 Depth)
+{
+    aabb_tree* Tree = (aabb_tree*)ZeroAlloc(sizeof(aabb_tree));
+    u32 TrianglesCount = Last - First + 1;
+    
+    if(TrianglesCount <= LBVH_MAX_TRIANGLES_PER_LEAF || Depth + 1 >= BVH_MAX_DEPTH)
+    {
+        Tree->Indices = Job->Indices + First * 3;
+        Tree->IndicesCount = TrianglesCount * 3;
+        Tree->AABB = ComputeAABBIndexed(Job->Positions, Tree->Indices, Tree->IndicesCount);
+    }
+    else
+    {
+        //The children of the node covering First to Last are the internal nodes Split and Split + 1,
+        //unless they cover a single triangle
+        lbvh_node* Node = &Job->Nodes[NodeIndex];
+        Assert(Node->First == First && Node->Last == Last);
+        Tree->Left = ConvertLBVHNode(Job, Node->Split, First, Node->Split, Depth + 1);
+        Tree->Right = ConvertLBVHNode(Job, Node->Split + 1, Node->Split + 1, Last, Depth + 1);
+        
+        Tree->AABB = Tree->Left->AABB;
+        UpdateAABB(&Tree->AABB, Tree->Right->AABB.Min);
+        UpdateAABB(&Tree->AABB, Tree->Right->AABB.Max);
+    }
+    
+    return Tree;
+}
+
+//Linear BVH: triangles are sorted by the morton code of their centroid and the tree is
+//the radix tree of the codes. Much faster to build than the other builders but of lower quality.
+//Pool can be 0 to build on the calling thread only
+internal aabb_tree*
+ComputeAABBTreeLBVH(thread_pool* Pool, vec3* Positions, u32* Indices, u32 IndicesCount)
+{
+    u32 TrianglesCount = IndicesCount / 3;
+    u32 WorkersCount = Pool ? Pool->ThreadsCount + 1 : 1;
+    
+    //Empty meshes are a single empty leaf like with the other builders
+    if(TrianglesCount == 0)
+    {
+        aabb_tree* Tree = (aabb_tree*)ZeroAlloc(sizeof(aabb_tree));
+        Tree->AABB = ComputeAABBIndexed(Positions, Indices, 0);
+        Tree->Indices = Indices;
+        return Tree;
+    }
+    
+    lbvh_job Job = {};
+    Job.Positions = Positions;
+    Job.Indices = Indices;
+    Job.TrianglesCount = TrianglesCount;
+    Job.BitsPerAxis = LBVH_MORTON_BITS / 3;
+    Job.ChunksCount = MIN(WorkersCount * 4, LBVH_MAX_CHUNKS_COUNT);
+    Job.ChunkSize = (TrianglesCount + Job.ChunksCount - 1) / Job.ChunksCount;
+    Job.ChunksCount = (TrianglesCount + Job.ChunkSize - 1) / Job.ChunkSize;
+    
+    Job.Keys = (u64*)ZeroAlloc(sizeof(u64) * TrianglesCount);
+    Job.SortedKeys = (u64*)ZeroAlloc(sizeof(u64) * TrianglesCount);
+    Job.Values = (u32*)ZeroAlloc(sizeof(u32) * TrianglesCount);
+    Job.SortedValues = (u32*)ZeroAlloc(sizeof(u32) * TrianglesCount);
+    Job.Nodes = (lbvh_node*)ZeroAlloc(sizeof(lbvh_node) * MAX(TrianglesCount - 1, 1));
+    Job.Scratch = (u32*)ZeroAlloc(sizeof(u32) * IndicesCount);
+    
+    //Morton codes relative to the bounds of the centroids
+    RunLBVHPass(Pool, &Job, LBVH_PASS_BOUNDS);
+    Job.CentroidAABB = Job.ChunkAABBs[0];
+    for(u32 Chunk = 1; Chunk < Job.ChunksCount; Chunk++)
+    {
+        UpdateAABB(&Job.CentroidAABB, Job.ChunkAABBs[Chunk].Min);
+        UpdateAABB(&Job.CentroidAABB, Job.ChunkAABBs[Chunk].Max);
+    }
+    vec3 Extent = Job.CentroidAABB.Max - Job.CentroidAABB.Min;
+    For(Axis, 3)
+    {
+        Job.Scale.e[Axis] = Extent.e[Axis] > 0.0f ? 1.0f / Extent.e[Axis] : 0.0f;
+    }
+    RunLBVHPass(Pool, &Job, LBVH_PASS_CODES);
+    
+    //Least significant digit radix sort, stable so each chunk scatters its keys after the ones of the
+    //previous chunks with the same digit
+    for(Job.Shift = 0; Job.Shift < Job.BitsPerAxis * 3; Job.Shift += LBVH_RADIX_BITS)
+    {
+        RunLBVHPass(Pool, &Job, LBVH_PASS_HISTOGRAM);
+        
+        u32 Offset = 0;
+        For(Digit, LBVH_RADIX_SIZE)
+        {
+            For(Chunk, Job.ChunksCount)
+            {
+                u32 Count = Job.ChunkHistograms[Chunk][Digit];
+                Job.ChunkHistograms[Chunk][Digit] = Offset;
+                Offset += Count;
+            }
+        }
+        
+        RunLBVHPass(Pool, &Job, LBVH_PASS_SCATTER);
+        
+        u64* Keys = Job.Keys;
+        Job.Keys = Job.SortedKeys;
+        Job.SortedKeys = Keys;
+        u32* Values = Job.Values;
+        Job.Values = Job.SortedValues;
+        Job.SortedValues = Values;
+    }
+    
+    //Internal nodes of the radix tree and triangles in sorted order
+    RunLBVHPass(Pool, &Job, LBVH_PASS_NODES);
+    RunLBVHPass(Pool, &Job, LBVH_PASS_GATHER);
+    RunLBVHPass(Pool, &Job, LBVH_PASS_COPY);
+    
+    aabb_tree* Tree = ConvertLBVHNode(&Job, 0, 0, TrianglesCount - 1, 0);
+    
+    Free(Job.Keys);
+    Free(Job.SortedKeys);
+    Free(Job.Values);
+    Free(Job.SortedValues);
+    Free(Job.Nodes);
+    Free(Job.Scratch);
+    
+    return Tree;
+}
+
+//Number of triangles that the SAH considers as intersected at the cost of one,
+//packet leaves test SIMD_WIDTH triangles at the cost of one
+inline u32
+GetSAHGroupSize(bvh_build_settings* Settings)
+{
+    return Settings->LeafFormat == BVH_LEAF_FORMAT_PACKET && Settings->Format != BVH_FORMAT_TREE ? SIMD_WIDTH : 1;
+}
+
+//Build the subtree of a node at the given depth with the algorithm specified in the settings
+internal aabb_tree*
+BuildAABBSubtree(vec3* Positions, u32* Indices, u32 IndicesCount, bvh_build_settings* Settings, u32 Depth)
+{
+    switch(Settings->Builder)
+    {
+        case BVH_BUILDER_MEAN: return ComputeAABBTree(Positions, Indices, IndicesCount, Depth);
+        case BVH_BUILDER_SAH:  return ComputeAABBTreeSAH(Positions, Indices, IndicesCount, Settings->SAHBinsCount,
+                                                         GetSAHGroupSize(Settings), Depth);
+        case BVH_BUILDER_LBVH: Assert(Depth == 0); return ComputeAABBTreeLBVH(0, Positions, Indices, IndicesCount);
+        //The SBVH doesn't build in place, see BuildAABBTreesParallel
+        case BVH_BUILDER_SBVH:
+        default: InvalidCodePath;
+    }
+    
+    return 0;
+}
+
+//Data parallel pass over the triangles of a big node, run by all the threads of the pool
+//which take chunks of triangles until there are none left
+THREAD_PROC(BVHPartitionJobProc)
+{
+    bvh_partition_job* Job = (bvh_partition_job*)Data;
+    vec3* Positions = Job->Positions;
+    
+    while(true)
+    {
+        u32 Chunk = InterlockedIncrement(&Job->NextChunk) - 1;
+        if(Chunk >= Job->ChunksCount) break;
+        
+        u32 Begin = Chunk * Job->ChunkIndicesCount;
+        u32 Count = MIN(Job->ChunkIndicesCount, Job->IndicesCount - Begin);
+        u32* Indices = Job->Indices + Begin;
+        
+        switch(Job->Pass)
+        {
+            case BVH_PARTITION_PASS_BOUNDS: {
+                Job->ChunkAABBs[Chunk] = ComputeAABBIndexed(Positions, Indices, Count);
+                Job->ChunkCentroidAABBs[Chunk] = ComputeCentroidAABBIndexed(Positions, Indices, Count);
+            } break;
+            
+            case BVH_PARTITION_PASS_BINS: {
+                ClearSAHBins(Job->ChunkBins[Chunk], Job->BinsCount);
+                FillSAHBins(Positions, Indices, Count, Job->CentroidAABB, Job->Scale, Job->ChunkBins[Chunk], Job->BinsCount);
+            } break;
+            
+            case BVH_PARTITION_PASS_COUNT: {
+                u32 LeftCount = 0;
+                for(u32 i = 0; i < Count; i += 3)
+                {
+                    if(IsLeftOfSAHSplit(Positions, &Indices[i], Job->CentroidAABB, Job->Scale, Job->BinsCount, Job->Axis, Job->Bin))
+                    {
+                        LeftCount += 3;
+                    }
+                }
+                Job->ChunkLeftCounts[Chunk] = LeftCount;
+            } break;
+            
+            case BVH_PARTITION_PASS_SCATTER: {
+                //Chunks write to their own ranges of the scratch buffer, keeping the order of the triangles
+                u32* Left = Job->Scratch + Job->ChunkLeftOffsets[Chunk];
+                u32* Right = Job->Scratch + Job->ChunkRightOffsets[Chunk];
+                for(u32 i = 0; i < Count; i += 3)
+                {
+                    u32** Dest = IsLeftOfSAHSplit(Positions, &Indices[i], Job->CentroidAABB, Job->Scale,
+                                                  Job->BinsCount, Job->Axis, Job->Bin) ? &Left : &Right;
+                    (*Dest)[0] = Indices[i + 0];
+                    (*Dest)[1] = Indices[i + 1];
+                    (*Dest)[2] = Indices[i + 2];
+                    *Dest += 3;
+                }
+            } break;
+            
+            case BVH_PARTITION_PASS_COPY: {
+                memcpy(Indices, Job->Scratch + Begin, sizeof(u32) * Count);
+            } break;
+            
+            default: InvalidCodePath;
+        }
+    }
+    
+    return 0;
+}
+
+internal void
+RunBVHPartitionPass(thread_pool* Pool, bvh_partition_job* Job, bvh_partition_pass Pass)
+{
+    Job->Pass = Pass;
+    Job->NextChunk = 0;
+    StartThreadPoolJob(Pool, BVHPartitionJobProc, Job);
+    BVHPartitionJobProc(Job);
+    WaitThreadPoolJob(Pool);
+}
+
+//Same as PartitionIndexedTrianglesSAH with every pass over the triangles split between the threads
+//of the pool, also computes the bounds of the node. The partition is stable so the order of the
+//triangles can differ from the serial version but the split chosen is the same
+internal u32
+PartitionIndexedTrianglesSAHParallel(bvh_build_context* Context, vec3* Positions, u32* Indices, u32 IndicesCount,
+                                     u32 Depth, aabb* OutAABB)
+{
+    bvh_partition_job* Job = &Context->PartitionJob;
+    u32 BinsCount = Context->Settings->SAHBinsCount;
+    u32 TrianglesCount = IndicesCount / 3;
+    
+    u32 ChunkTriangles = (TrianglesCount + BVH_PARTITION_CHUNKS_COUNT - 1) / BVH_PARTITION_CHUNKS_COUNT;
+    Job->Positions = Positions;
+    Job->Indices = Indices;
+    Job->IndicesCount = IndicesCount;
+    Job->ChunkIndicesCount = ChunkTriangles * 3;
+    Job->ChunksCount = (TrianglesCount + ChunkTriangles - 1) / ChunkTriangles;
+    Job->BinsCount = BinsCount;
+    
+    //Node and centroid bounds
+    RunBVHPartitionPass(Context->Pool, Job, BVH_PARTITION_PASS_BOUNDS);
+    aabb AABB = Job->ChunkAABBs[0];
+    aabb CentroidAABB = Job->ChunkCentroidAABBs[0];
+    for(u32 Chunk = 1; Chunk < Job->ChunksCount; Chunk++)
+    {
+        UpdateAABB(&AABB, Job->ChunkAABBs[Chunk].Min);
+        UpdateAABB(&AABB, Job->ChunkAABBs[Chunk].Max);
+        UpdateAABB(&CentroidAABB, Job->ChunkCentroidAABBs[Chunk].Min);
+        UpdateAABB(&CentroidAABB, Job->ChunkCentroidAABBs[Chunk].Max);
+    }
+    *OutAABB = AABB;
+    
+    if(TrianglesCount <= 1 || Depth + 1 >= BVH_MAX_DEPTH)
+    {
+        return 0;
+    }
+    
+    //Bins of each chunk merged in the ones of the first chunk
+    Job->CentroidAABB = CentroidAABB;
+    GetSAHBinScales(CentroidAABB, BinsCount, Job->Scale);
+    RunBVHPartitionPass(Context->Pool, Job, BVH_PARTITION_PASS_BINS);
+    sah_bin (*Bins)[MAX_SAH_BINS_COUNT] = Job->ChunkBins[0];
+    for(u32 Chunk = 1; Chunk < Job->ChunksCount; Chunk++)
+    {
+        For(Axis, 3)
+        {
+            For(Bin, BinsCount)
+            {
+                sah_bin* ChunkBin = &Job->ChunkBins[Chunk][Axis][Bin];
+                if(ChunkBin->TrianglesCount == 0) continue;
+                
+                Bins[Axis][Bin].TrianglesCount += ChunkBin->TrianglesCount;
+                UpdateAABB(&Bins[Axis][Bin].AABB, ChunkBin->AABB.Min);
+                UpdateAABB(&Bins[Axis][Bin].AABB, ChunkBin->AABB.Max);
+            }
+        }
+    }
+    
+    f32 BestCost = FindSAHSplit(Bins, BinsCount, Job->Scale, Context->GroupSize, AABBArea(AABB), &Job->Axis, &Job->Bin);
+    if(IsSAHLeafBetter(BestCost, TrianglesCount, Context->GroupSize))
+    {
+        return 0;
+    }
+    
+    //Count the triangles going left in each chunk to find where each chunk writes
+    RunBVHPartitionPass(Context->Pool, Job, BVH_PARTITION_PASS_COUNT);
+    u32 LeftCount = 0;
+    For(Chunk, Job->ChunksCount)
+    {
+        LeftCount += Job->ChunkLeftCounts[Chunk];
+    }
+    
+    u32 LeftOffset = 0;
+    u32 RightOffset = LeftCount;
+    For(Chunk, Job->ChunksCount)
+    {
+        u32 Begin = Chunk * Job->ChunkIndicesCount;
+        u32 Count = MIN(Job->ChunkIndicesCount, IndicesCount - Begin);
+        Job->ChunkLeftOffsets[Chunk] = LeftOffset;
+        Job->ChunkRightOffsets[Chunk] = RightOffset;
+        LeftOffset += Job->ChunkLeftCounts[Chunk];
+        RightOffset += Count - Job->ChunkLeftCounts[Chunk];
+    }
+    
+    RunBVHPartitionPass(Context->Pool, Job, BVH_PARTITION_PASS_SCATTER);
+    RunBVHPartitionPass(Context->Pool, Job, BVH_PARTITION_PASS_COPY);
+    
+    Assert(LeftCount != 0 && LeftCount != IndicesCount);
+    return LeftCount;
+}
+
+//Build the upper levels of a tree on the calling thread, using all the threads for the passes
+//over the triangles of big nodes. Subtrees small enough are left as tasks for BVHBuildTaskProc
+internal void
+BuildAABBTreeTopLevels(bvh_build_context* Context, aabb_tree** Result, vec3* Positions, u32* Indices, u32 IndicesCount, u32 Depth)
+{
+    bvh_build_settings* Settings = Context->Settings;
+    if(IndicesCount / 3 <= Context->TaskMaxTriangles)
+    {
+        bvh_build_task Task;
+        Task.Result = Result;
+        Task.Positions = Positions;
+        Task.Indices = Indices;
+        Task.IndicesCount = IndicesCount;
+        Task.Depth = Depth;
+        SbufPush(Context->Tasks, Task);
+        return;
+    }
+    
+    aabb_tree* Tree = (aabb_tree*)ZeroAlloc(sizeof(aabb_tree));
+    *Result = Tree;
+    
+    u32 k = 0;
+    if(Settings->Builder == BVH_BUILDER_SAH && Context->Pool->ThreadsCount > 0 &&
+       IndicesCount / 3 >= BVH_PARALLEL_PARTITION_MIN_TRIANGLES)
+    {
+        k = PartitionIndexedTrianglesSAHParallel(Context, Positions, Indices, IndicesCount, Depth, &Tree->AABB);
+    }
+    else
+    {
+        Tree->AABB = ComputeAABBIndexed(Positions, Indices, IndicesCount);
+        if(Settings->Builder == BVH_BUILDER_SAH)
+        {
+            if(IndicesCount / 3 > 1 && Depth + 1 < BVH_MAX_DEPTH)
+            {
+                k = PartitionIndexedTrianglesSAH(Positions, Indices, IndicesCount, Settings->SAHBinsCount,
+                                                 Context->GroupSize, AABBArea(Tree->AABB));
+            }
+        }
+        else
+        {
+            k = SplitIndexedTrianglesMean(Positions, Indices, IndicesCount, Depth);
+        }
+    }
+    
+    if(k == 0)
+    {
+        Tree->Indices = Indices;
+        Tree->IndicesCount = IndicesCount;
+    }
+    else
+    {
+        BuildAABBTreeTopLevels(Context, &Tree->Left, Positions, &Indices[0], k, Depth + 1);
+        BuildAABBTreeTopLevels(Context, &Tree->Right, Positions, &Indices[k], IndicesCount - k, Depth + 1);
+    }
+}
+
+//Subtrees are independent so each thread builds whole tasks, the biggest ones are taken first
+THREAD_PROC(BVHBuildTaskProc)
+{
+    bvh_build_context* Context = (bvh_build_context*)Data;
+    
+    while(true)
+    {
+        u32 TaskIndex = InterlockedIncrement(&Context->NextTask) - 1;
+        if(TaskIndex >= SbufLen(Context->Tasks)) break;
+        
+        bvh_build_task* Task = &Context->Tasks[TaskIndex];
+        *Task->Result = BuildAABBSubtree(Task->Positions, Task->Indices, Task->IndicesCount, Context->Settings, Task->Depth);
+    }
+    
+    return 0;
+}
+
+internal int
+CompareBVHBuildTasks(const void* A, const void* B)
+{
+    u32 CountA = ((bvh_build_task*)A)->IndicesCount;
+    u32 CountB = ((bvh_build_task*)B)->IndicesCount;
+    return CountA < CountB ? 1 : (CountA > CountB ? -1 : 0);
+}
+
+//Spatial split trees are built from the start to the end by a single thread, so the threads take whole meshes
+THREAD_PROC(SBVHMeshesJobProc)
+{
+    sbvh_meshes_job* Job = (sbvh_meshes_job*)Data;
+    
+    while(true)
+    {
+        u32 Index = InterlockedIncrement(&Job->NextMesh) - 1;
+        if(Index >= Job->MeshesCount) break;
+        
+        bvh_build_mesh* Mesh = &Job->Meshes[Index];
+        Mesh->Tree = ComputeAABBTreeSBVH(Mesh->Positions, Mesh->Indices, Mesh->IndicesCount, Job->Settings->SAHBinsCount,
+                                         GetSAHGroupSize(Job->Settings), &Mesh->Indices, &Mesh->IndicesCount);
+    }
+    
+    return 0;
+}
+
+//Build the trees of multiple meshes with all the threads of the pool and the calling one,
+//the result is the same tree that BuildAABBSubtree would build serially for each mesh, spatial split trees can only be built here
+internal void
+BuildAABBTreesParallel(thread_pool* Pool, bvh_build_mesh* Meshes, u32 MeshesCount, bvh_build_settings* Settings)
+{
+    u32 WorkersCount = Pool->ThreadsCount + 1;
+    
+    //Every pass of the linear builder is already parallel, meshes are built one after the other
+    if(Settings->Builder == BVH_BUILDER_LBVH)
+    {
+        For(Index, MeshesCount)
+        {
+            bvh_build_mesh* Mesh = &Meshes[Index];
+            Mesh->Tree = ComputeAABBTreeLBVH(Pool, Mesh->Positions, Mesh->Indices, Mesh->IndicesCount);
+        }
+        return;
+    }
+    
+    if(Settings->Builder == BVH_BUILDER_SBVH)
+    {
+        sbvh_meshes_job Job = {};
+        Job.Meshes = Meshes;
+        Job.MeshesCount = MeshesCount;
+        Job.Settings = Settings;
+        StartThreadPoolJob(Pool, SBVHMeshesJobProc, &Job);
+        SBVHMeshesJobProc(&Job);
+        WaitThreadPoolJob(Pool);
+        return;
+    }
+    
+    bvh_build_context Context = {};
+    Context.Pool = Pool;
+    Context.Settings = Settings;
+    Context.GroupSize = GetSAHGroupSize(Settings);
+    
+    //Subtrees are made small enough to have multiple tasks per thread, with a single thread
+    //every mesh is a single task
+    u32 TotalTriangles = 0;
+    u32 MaxIndicesCount = 0;
+    For(Index, MeshesCount)
+    {
+        TotalTriangles += Meshes[Index].IndicesCount / 3;
+        MaxIndicesCount = MAX(MaxIndicesCount, Meshes[Index].IndicesCount);
+    }
+    Context.TaskMaxTriangles = WorkersCount == 1 ? UINT_MAX :
+        MAX(TotalTriangles / (WorkersCount * BVH_BUILD_TASKS_PER_THREAD), BVH_BUILD_TASK_MIN_TRIANGLES);
+    
+    //Scratch space for the passes of the parallel partition
+    bvh_partition_job* Job = &Context.PartitionJob;
+    if(WorkersCount > 1 && Settings->Builder == BVH_BUILDER_SAH)
+    {
+        Job->Scratch = (u32*)ZeroAlloc(sizeof(u32) * MaxIndicesCount);
+        Job->ChunkAABBs = (aabb*)ZeroAlloc(sizeof(aabb) * BVH_PARTITION_CHUNKS_COUNT);
+        Job->ChunkCentroidAABBs = (aabb*)ZeroAlloc(sizeof(aabb) * BVH_PARTITION_CHUNKS_COUNT);
+        Job->ChunkBins = (sah_bin(*)[3][MAX_SAH_BINS_COUNT])ZeroAlloc(sizeof(sah_bin) * 3 * MAX_SAH_BINS_COUNT * BVH_PARTITION_CHUNKS_COUNT);
+        Job->ChunkLeftCounts = (u32*)ZeroAlloc(sizeof(u32) * BVH_PARTITION_CHUNKS_COUNT);
+        Job->ChunkLeftOffsets = (u32*)ZeroAlloc(sizeof(u32) * BVH_PARTITION_CHUNKS_COUNT);
+        Job->ChunkRightOffsets = (u32*)ZeroAlloc(sizeof(u32) * BVH_PARTITION_CHUNKS_COUNT);
+    }
+    
+    For(Index, MeshesCount)
+    {
+        bvh_build_mesh* Mesh = &Meshes[Index];
+        BuildAABBTreeTopLevels(&Context, &Mesh->Tree, Mesh->Positions, Mesh->Indices, Mesh->IndicesCount, 0);
+    }
+    
+    qsort(Context.Tasks, SbufLen(Context.Tasks), sizeof(bvh_build_task), CompareBVHBuildTasks);
+    StartThreadPoolJob(Pool, BVHBuildTaskProc, &Context);
+    BVHBuildTaskProc(&Context);
+    WaitThreadPoolJob(Pool);
+    
+    SbufFree(Context.Tasks);
+    Free(Job->Scratch);
+    Free(Job->ChunkAABBs);
+    Free(Job->ChunkCentroidAABBs);
+    Free(Job->ChunkBins);
+    Free(Job->ChunkLeftCounts);
+    Free(Job->ChunkLeftOffsets);
+    Free(Job->ChunkRightOffsets);
+}
+
+internal void
+FreeAABBTree(aabb_tree* Tree)
 {
-    aabb_tree* Tree = (aabb_tree*)ZeroAlloc(sizeof(aabb_tree));
+    if(!Tree) return;
     
+    FreeAABBTree(Tree->Left);
+    FreeAABBTree(Tree->Right);
+    Free(Tree);
+}
+
+internal u32
+CountAABBTreeNodes(aabb_tree* Tree)
+{
+    if(!Tree) return 0;
+    return 1 + CountAABBTreeNodes(Tree->Left) + CountAABBTreeNodes(Tree->Right);
+}
+
+//Append the subtree in depth first order and return the index of its root
+internal u32
+FlattenAABBTreeRec(flat_bvh* BVH, aabb_tree* Tree, u32* BaseIndices)
+{
+    u32 NodeIndex = BVH->NodesCount++;
+    flat_bvh_node* Node = &BVH->Nodes[NodeIndex];
+    Node->AABB = Tree->AABB;
     
-    Tree->AABB = ComputeAABBIndexed(Positions, Indices, IndicesCount);
-    Assert(IndicesCount % 3 == 0);
+    if(!Tree->Left && !Tree->Right)
+    {
+        Node->Offset = (u32)(Tree->Indices - BaseIndices);
+        Node->IndicesCount = Tree->IndicesCount;
+    }
+    else
+    {
+        //Our builders always create both children
+        Assert(Tree->Left && Tree->Right);
+        FlattenAABBTreeRec(BVH, Tree->Left, BaseIndices);
+        Node->Offset = FlattenAABBTreeRec(BVH, Tree->Right, BaseIndices);
+        Node->IndicesCount = 0;
+    }
+    
+    return NodeIndex;
+}
+
+//Linearize the tree in a single contiguous array, leaves store ranges relative to BaseIndices
+//which must be the indices array the tree was built on
+internal flat_bvh
+FlattenAABBTree(aabb_tree* Tree, u32* BaseIndices)
+{
+    flat_bvh Result = {};
+    u32 NodesCount = CountAABBTreeNodes(Tree);
+    Result.Nodes = (flat_bvh_node*)ZeroAlloc(sizeof(flat_bvh_node) * NodesCount);
+    FlattenAABBTreeRec(&Result, Tree, BaseIndices);
+    Assert(Result.NodesCount == NodesCount);
     
-    //Stop if we have too few triangles left
-    if(IndicesCount / 3 < MIN_TRIANGLES_PER_LEAF)
+    return Result;
+}
+
+//Collapse the binary subtree rooted at Tree in the wide node at NodeIndex, children are opened
+//starting from the one with the biggest area until the node is full
+internal void
+BuildWideBVHRec(wide_bvh* BVH, u32 NodeIndex, aabb_tree* Tree, u32* BaseIndices)
+{
+    aabb_tree* Children[WIDE_BVH_WIDTH];
+    u32 ChildrenCount = 0;
+    if(!Tree->Left && !Tree->Right)
     {
-        Tree->Indices = Indices;
-        Tree->IndicesCount = IndicesCount;
+        //Only happens if the root is a leaf
+        Children[ChildrenCount++] = Tree;
     }
     else
     {
-        u32 k = PartitionIndexedTriangles(Positions, Indices, IndicesCount);
-        u32 LeftCount = k;
-        u32 RightCount = IndicesCount - k;
+        Children[ChildrenCount++] = Tree->Left;
+        Children[ChildrenCount++] = Tree->Right;
+    }
+    
+    while(ChildrenCount < WIDE_BVH_WIDTH)
+    {
+        u32 BestChild = (u32)-1;
+        f32 BestArea = -1.0f;
+        For(Index, ChildrenCount)
+        {
+            aabb_tree* Child = Children[Index];
+            if(Child->Left && Child->Right && AABBArea(Child->AABB) > BestArea)
+            {
+                BestArea = AABBArea(Child->AABB);
+                BestChild = Index;
+            }
+        }
         
-        u32 IndicesDifference = MIN_TRIANGLE_DIFFERENCE * 3;
+        //Only leaves left
+        if(BestChild == (u32)-1) break;
         
-        // Stop if we have almost the same amount of primitives in one of the child as the parent
-        if(LeftCount < IndicesDifference ||
-           RightCount < IndicesDifference)
+        aabb_tree* Opened = Children[BestChild];
+        Children[BestChild] = Opened->Left;
+        Children[ChildrenCount++] = Opened->Right;
+    }
+    
+    //Allocate internal children next to each other
+    u32 ChildNodeIndices[WIDE_BVH_WIDTH];
+    For(Index, ChildrenCount)
+    {
+        aabb_tree* Child = Children[Index];
+        if(Child->Left && Child->Right)
         {
-            Tree->Indices = Indices;
-            Tree->IndicesCount = IndicesCount;
+            ChildNodeIndices[Index] = BVH->NodesCount++;
+        }
+    }
+    
+    wide_bvh_node* Node = &BVH->Nodes[NodeIndex];
+    For(Index, WIDE_BVH_WIDTH)
+    {
+        if(Index < ChildrenCount)
+        {
+            aabb_tree* Child = Children[Index];
+            For(Axis, 3)
+            {
+                Node->Bounds[Axis][Index] = Child->AABB.Min.e[Axis];
+                Node->Bounds[Axis + 3][Index] = Child->AABB.Max.e[Axis];
+            }
+            
+            if(Child->Left && Child->Right)
+            {
+                Node->Offset[Index] = ChildNodeIndices[Index];
+                Node->IndicesCount[Index] = 0;
+            }
+            else
+            {
+                Node->Offset[Index] = (u32)(Child->Indices - BaseIndices);
+                Node->IndicesCount[Index] = Child->IndicesCount;
+            }
         }
         else
         {
-            // Recursively construct left and right subtree from subarrays and
-            // point the left and right fields of the current node at the subtrees
-            Tree->Left = ComputeAABBTree(Positions, &Indices[0], LeftCount);
-            Tree->Right = ComputeAABBTree(Positions, &Indices[k], RightCount);
+            For(Axis, 3)
+            {
+                Node->Bounds[Axis][Index] = FLT_MAX;
+                Node->Bounds[Axis + 3][Index] = -FLT_MAX;
+            }
+            Node->Offset[Index] = 0;
+            Node->IndicesCount[Index] = 0;
         }
     }
     
-    return Tree;
+    For(Index, ChildrenCount)
+    {
+        aabb_tree* Child = Children[Index];
+        if(Child->Left && Child->Right)
+        {
+            BuildWideBVHRec(BVH, ChildNodeIndices[Index], Child, BaseIndices);
+        }
+    }
+}
+
+//Collapse the binary tree in a tree with WIDE_BVH_WIDTH children per node
+//leaves store ranges relative to BaseIndices which must be the indices array the tree was built on
+internal wide_bvh
+BuildWideBVH(aabb_tree* Tree, u32* BaseIndices)
+{
+    //Every wide node replaces at least one internal node of the binary tree
+    u32 MaxNodesCount = MAX(1, (CountAABBTreeNodes(Tree) - 1) / 2);
+    
+    wide_bvh Result = {};
+    Result.Nodes = (wide_bvh_node*)ZeroAlloc(sizeof(wide_bvh_node) * MaxNodesCount);
+    Result.NodesCount = 1;
+    BuildWideBVHRec(&Result, 0, Tree, BaseIndices);
+    Assert(Result.NodesCount <= MaxNodesCount);
+    
+    return Result;
+}
+
+//Bound reconstructed by the traversal from a quantized value, a multiply and an add like the SIMD code
+inline f32
+DequantizeBound(f32 Origin, f32 Scale, u32 Value)
+{
+    return Origin + (f32)Value * Scale;
+}
+
+//Quantize the child bounds of each node relative to the box of the node, node indices and leaf offsets are kept
+//so it can be done after the leaves are packed
+internal quantized_bvh
+QuantizeWideBVH(wide_bvh* BVH)
+{
+    quantized_bvh Result = {};
+    Result.NodesCount = BVH->NodesCount;
+    Result.Nodes = (quantized_bvh_node*)ZeroAlloc(sizeof(quantized_bvh_node) * Result.NodesCount);
+    
+    For(NodeIndex, BVH->NodesCount)
+    {
+        wide_bvh_node* Node = &BVH->Nodes[NodeIndex];
+        quantized_bvh_node* Quantized = &Result.Nodes[NodeIndex];
+        
+        //Unused children have inverted bounds
+        u32 ChildrenCount = 0;
+        while(ChildrenCount < WIDE_BVH_WIDTH && Node->Bounds[0][ChildrenCount] <= Node->Bounds[3][ChildrenCount])
+        {
+            ChildrenCount++;
+        }
+        Assert(ChildrenCount > 0);
+        Quantized->ChildrenCount = (u8)ChildrenCount;
+        
+        For(Child, WIDE_BVH_WIDTH)
+        {
+            Quantized->Offset[Child] = Node->Offset[Child];
+            Quantized->IndicesCount[Child] = Node->IndicesCount[Child];
+        }
+        
+        For(Axis, 3)
+        {
+            f32 Min = FLT_MAX;
+            f32 Max = -FLT_MAX;
+            For(Child, ChildrenCount)
+            {
+                Min = MIN(Min, Node->Bounds[Axis][Child]);
+                Max = MAX(Max, Node->Bounds[Axis + 3][Child]);
+            }
+            
+            //The last step must reach the max of the node after rounding
+            f32 Origin = Min;
+            f32 Scale = (Max - Min) / 255.0f;
+            while(DequantizeBound(Origin, Scale, 255) < Max)
+            {
+                Scale = nextafterf(Scale, FLT_MAX);
+            }
+            Quantized->Origin[Axis] = Origin;
+            Quantized->Scale[Axis] = Scale;
+            
+            For(Child, ChildrenCount)
+            {
+                f32 ChildMin = Node->Bounds[Axis][Child];
+                f32 ChildMax = Node->Bounds[Axis + 3][Child];
+                
+                u32 Low = 0;
+                u32 High = 0;
+                if(Scale > 0.0f)
+                {
+                    Low = (u32)MIN(MAX(floorf((ChildMin - Origin) / Scale), 0.0f), 255.0f);
+                    High = (u32)MIN(MAX(ceilf((ChildMax - Origin) / Scale), 0.0f), 255.0f);
+                }
+                
+                //The divisions above are rounded too, move by one step until the decoded bounds contain the child
+                while(Low > 0 && DequantizeBound(Origin, Scale, Low) > ChildMin) Low--;
+                while(High < 255 && DequantizeBound(Origin, Scale, High) < ChildMax) High++;
+                Assert(DequantizeBound(Origin, Scale, Low) <= ChildMin && DequantizeBound(Origin, Scale, High) >= ChildMax);
+                
+                Quantized->Bounds[Axis][Child] = (u8)Low;
+                Quantized->Bounds[Axis + 3][Child] = (u8)High;
+            }
+        }
+    }
+    
+    return Result;
+}
+
+//Gather the triangles of a leaf in packets, returns the index of the first packet
+internal u32
+PushLeafTrianglePackets(_sbuf_ triangle_packet** Packets, vec3* Positions, u32* Indices, u32 Offset, u32 IndicesCount)
+{
+    u32 First = (u32)SbufLen(*Packets);
+    u32 TrianglesCount = IndicesCount / 3;
+    u32 PacketsCount = (TrianglesCount + SIMD_WIDTH - 1) / SIMD_WIDTH;
+    SbufPushN(*Packets, PacketsCount);
+    
+    For(PacketIndex, PacketsCount)
+    {
+        triangle_packet* Packet = &(*Packets)[First + PacketIndex];
+        For(Lane, SIMD_WIDTH)
+        {
+            u32 Triangle = PacketIndex * SIMD_WIDTH + Lane;
+            if(Triangle < TrianglesCount)
+            {
+                //Same winding as RayIndexedTrianglesIntersect
+                u32 i = Offset + Triangle * 3;
+                vec3 a = Positions[Indices[i + 0]];
+                vec3 b = Positions[Indices[i + 2]];
+                vec3 c = Positions[Indices[i + 1]];
+                For(Axis, 3)
+                {
+                    Packet->Vertex0[Axis][Lane] = a.e[Axis];
+                    Packet->Vertex1[Axis][Lane] = b.e[Axis];
+                    Packet->Vertex2[Axis][Lane] = c.e[Axis];
+                }
+                Packet->Triangle[Lane] = i;
+            }
+            else
+            {
+                For(Axis, 3)
+                {
+                    Packet->Vertex0[Axis][Lane] = 0.0f;
+                    Packet->Vertex1[Axis][Lane] = 0.0f;
+                    Packet->Vertex2[Axis][Lane] = 0.0f;
+                }
+                Packet->Triangle[Lane] = 0;
+            }
+        }
+    }
+    
+    return First;
+}
+
+internal packed_triangles
+CopyPackedTriangles(_sbuf_ triangle_packet* Packets)
+{
+    packed_triangles Result = {};
+    Result.PacketsCount = (u32)SbufLen(Packets);
+    Result.Packets = (triangle_packet*)ZeroAlloc(sizeof(triangle_packet) * Result.PacketsCount);
+    memcpy(Result.Packets, Packets, sizeof(triangle_packet) * Result.PacketsCount);
+    return Result;
+}
+
+//Gather the triangles of all the leaves in packets, leaf offsets are changed to refer to the first packet
+internal packed_triangles
+PackFlatBVHLeaves(flat_bvh* BVH, vec3* Positions, u32* Indices)
+{
+    _sbuf_ triangle_packet* Packets = 0;
+    For(NodeIndex, BVH->NodesCount)
+    {
+        flat_bvh_node* Node = &BVH->Nodes[NodeIndex];
+        if(Node->IndicesCount)
+        {
+            Node->Offset = PushLeafTrianglePackets(&Packets, Positions, Indices, Node->Offset, Node->IndicesCount);
+        }
+    }
+    
+    packed_triangles Result = CopyPackedTriangles(Packets);
+    SbufFree(Packets);
+    return Result;
+}
+
+internal packed_triangles
+PackWideBVHLeaves(wide_bvh* BVH, vec3* Positions, u32* Indices)
+{
+    _sbuf_ triangle_packet* Packets = 0;
+    For(NodeIndex, BVH->NodesCount)
+    {
+        wide_bvh_node* Node = &BVH->Nodes[NodeIndex];
+        For(Child, WIDE_BVH_WIDTH)
+        {
+            if(Node->IndicesCount[Child])
+            {
+                Node->Offset[Child] = PushLeafTrianglePackets(&Packets, Positions, Indices, Node->Offset[Child], Node->IndicesCount[Child]);
+            }
+        }
+    }
+    
+    packed_triangles Result = CopyPackedTriangles(Packets);
+    SbufFree(Packets);
+    return Result;
+}
+
+//Bytes used by each local index of a cluster with VerticesCount vertices
+inline u32
+GetLocalIndexSize(u32 VerticesCount)
+{
+    if(VerticesCount <= 256) return 1;
+    if(VerticesCount <= 65536) return 2;
+    return 4;
+}
+
+//Leaves are only aligned to 2 bytes, 4 byte indices are read with memcpy
+inline u32
+GetLocalIndex(void* LocalIndices, u32 IndexSize, u32 Index)
+{
+    if(IndexSize == 1) return ((u8*)LocalIndices)[Index];
+    if(IndexSize == 2) return ((u16*)LocalIndices)[Index];
+    
+    u32 Result;
+    memcpy(&Result, (u32*)LocalIndices + Index, sizeof(Result));
+    return Result;
+}
+
+//Leaf of a hierarchy waiting for its cluster to be written, Offset points to the offset of the node
+struct local_leaf_ref
+{
+    u32* Offset;
+    u32 IndicesCount;
+};
+
+//Cluster being gathered, LocalVertices maps mesh vertices to the vertices of the cluster and is
+//all (u32)-1 outside of them
+struct local_cluster_builder
+{
+    mesh_data* Data;
+    u32* LocalVertices;
+    
+    _sbuf_ u32* Words;
+    _sbuf_ u32* Vertices;
+    _sbuf_ local_leaf_ref* Leaves;
+    u32 IndicesCount;
+};
+
+//Write the gathered cluster and its leaves and start an empty one
+internal void
+FlushLocalCluster(local_cluster_builder* Builder)
+{
+    u32 VerticesCount = (u32)SbufLen(Builder->Vertices);
+    u32 LeavesCount = (u32)SbufLen(Builder->Leaves);
+    if(LeavesCount == 0) return;
+    
+    For(Index, VerticesCount)
+    {
+        SbufPush(Builder->Words, Builder->Vertices[Index]);
+    }
+    For(Index, VerticesCount)
+    {
+        For(Axis, 3)
+        {
+            u32 Bits;
+            memcpy(&Bits, &Builder->Data->Positions[Builder->Vertices[Index]].e[Axis], sizeof(Bits));
+            SbufPush(Builder->Words, Bits);
+        }
+    }
+    u32 CountWord = (u32)SbufLen(Builder->Words);
+    SbufPush(Builder->Words, VerticesCount);
+    
+    //Leaves are packed in 16 bit units after the count word, the last word is padded
+    u32 IndexSize = GetLocalIndexSize(VerticesCount);
+    u32 UnitsCount = 0;
+    For(Leaf, LeavesCount)
+    {
+        UnitsCount += 1 + (Builder->Leaves[Leaf].IndicesCount * IndexSize + 1) / 2;
+    }
+    u32 LeavesStart = (u32)SbufLen(Builder->Words);
+    For(Index, (UnitsCount + 1) / 2)
+    {
+        SbufPush(Builder->Words, (u32)0);
+    }
+    
+    u16* Units = (u16*)Builder->Words;
+    u32 Unit = 2 * LeavesStart;
+    For(Leaf, LeavesCount)
+    {
+        local_leaf_ref* Ref = &Builder->Leaves[Leaf];
+        u32* Indices = Builder->Data->Indices + *Ref->Offset;
+        Assert(Unit - 2 * CountWord <= 0xFFFF);
+        Units[Unit] = (u16)(Unit - 2 * CountWord);
+        
+        u8* LocalIndices = (u8*)(Units + Unit + 1);
+        For(Index, Ref->IndicesCount)
+        {
+            u32 Local = Builder->LocalVertices[Indices[Index]];
+            if(IndexSize == 1) LocalIndices[Index] = (u8)Local;
+            else if(IndexSize == 2) memcpy(LocalIndices + 2 * Index, &Local, 2);
+            else memcpy(LocalIndices + 4 * Index, &Local, 4);
+        }
+        
+        *Ref->Offset = Unit;
+        Unit += 1 + (Ref->IndicesCount * IndexSize + 1) / 2;
+    }
+    
+    For(Index, VerticesCount)
+    {
+        Builder->LocalVertices[Builder->Vertices[Index]] = (u32)-1;
+    }
+    SbufPopN(Builder->Vertices, VerticesCount);
+    SbufPopN(Builder->Leaves, LeavesCount);
+    Builder->IndicesCount = 0;
+}
+
+//Add the leaf at *Offset to the current cluster, which is written first if the leaf does not fit
+internal void
+PushLocalLeaf(local_cluster_builder* Builder, u32* Offset, u32 IndicesCount)
+{
+    u32* Indices = Builder->Data->Indices + *Offset;
+    for(u32 Attempt = 0; Attempt < 2; Attempt++)
+    {
+        //Vertices are numbered in order of first use, new ones are removed again if the leaf does not fit
+        u32 FirstNew = (u32)SbufLen(Builder->Vertices);
+        For(Index, IndicesCount)
+        {
+            u32 Vertex = Indices[Index];
+            if(Builder->LocalVertices[Vertex] == (u32)-1)
+            {
+                Builder->LocalVertices[Vertex] = (u32)SbufLen(Builder->Vertices);
+                SbufPush(Builder->Vertices, Vertex);
+            }
+        }
+        
+        bool Fits = SbufLen(Builder->Vertices) <= LOCAL_CLUSTER_MAX_VERTICES &&
+            Builder->IndicesCount + IndicesCount <= LOCAL_CLUSTER_MAX_INDICES;
+        if(Fits || SbufLen(Builder->Leaves) == 0)
+        {
+            local_leaf_ref Ref = { Offset, IndicesCount };
+            SbufPush(Builder->Leaves, Ref);
+            Builder->IndicesCount += IndicesCount;
+            return;
+        }
+        
+        for(u32 Index = FirstNew; Index < SbufLen(Builder->Vertices); Index++)
+        {
+            Builder->LocalVertices[Builder->Vertices[Index]] = (u32)-1;
+        }
+        SbufPopN(Builder->Vertices, SbufLen(Builder->Vertices) - FirstNew);
+        FlushLocalCluster(Builder);
+    }
+    InvalidCodePath;
+}
+
+internal local_cluster_builder
+BeginLocalClusters(mesh_data* Data)
+{
+    local_cluster_builder Builder = {};
+    Builder.Data = Data;
+    Builder.LocalVertices = (u32*)ZeroAlloc(sizeof(u32) * Data->VerticesCount);
+    memset(Builder.LocalVertices, 0xFF, sizeof(u32) * Data->VerticesCount);
+    return Builder;
+}
+
+internal local_triangles
+EndLocalClusters(local_cluster_builder* Builder)
+{
+    FlushLocalCluster(Builder);
+    
+    local_triangles Result = {};
+    Result.WordsCount = (u32)SbufLen(Builder->Words);
+    Result.Words = (u32*)ZeroAlloc(sizeof(u32) * Result.WordsCount);
+    memcpy(Result.Words, Builder->Words, sizeof(u32) * Result.WordsCount);
+    
+    SbufFree(Builder->Words);
+    SbufFree(Builder->Vertices);
+    SbufFree(Builder->Leaves);
+    Free(Builder->LocalVertices);
+    return Result;
+}
+
+//Group the leaves in clusters sharing their vertices, leaf offsets are changed to refer to the clusters.
+//Flat nodes are already in depth first order
+internal local_triangles
+PackFlatBVHLocalLeaves(flat_bvh* BVH, mesh_data* Data)
+{
+    local_cluster_builder Builder = BeginLocalClusters(Data);
+    For(NodeIndex, BVH->NodesCount)
+    {
+        flat_bvh_node* Node = &BVH->Nodes[NodeIndex];
+        if(Node->IndicesCount)
+        {
+            PushLocalLeaf(&Builder, &Node->Offset, Node->IndicesCount);
+        }
+    }
+    
+    return EndLocalClusters(&Builder);
+}
+
+//The children of a wide node are stored together, so the leaves are visited depth first to keep
+//the clusters to nearby triangles
+internal void
+PushWideBVHLocalLeavesRec(local_cluster_builder* Builder, wide_bvh* BVH, u32 NodeIndex)
+{
+    wide_bvh_node* Node = &BVH->Nodes[NodeIndex];
+    For(Child, WIDE_BVH_WIDTH)
+    {
+        if(Node->IndicesCount[Child])
+        {
+            PushLocalLeaf(Builder, &Node->Offset[Child], Node->IndicesCount[Child]);
+        }
+        else if(Node->Bounds[0][Child] <= Node->Bounds[3][Child])
+        {
+            PushWideBVHLocalLeavesRec(Builder, BVH, Node->Offset[Child]);
+        }
+    }
+}
+
+internal local_triangles
+PackWideBVHLocalLeaves(wide_bvh* BVH, mesh_data* Data)
+{
+    local_cluster_builder Builder = BeginLocalClusters(Data);
+    if(BVH->NodesCount) PushWideBVHLocalLeavesRec(&Builder, BVH, 0);
+    return EndLocalClusters(&Builder);
 }
 
 internal void
@@ -211,6 +2180,11 @@ GetAABBTreeInfoRec(bounding_tree_info* Info, aabb_tree* Tree, u32 CurrentDepth)
         Info->TotalVolumeOfLeaves += AABBVolume(Tree->AABB);
         Info->TotalDepthOfPathsToLeaves += CurrentDepth;
         Info->TotalPrimitivesPerLeaf += Tree->IndicesCount / 3;
+        Info->TotalAreaOfLeavesTimesPrimitives += AABBArea(Tree->AABB) * (Tree->IndicesCount / 3);
+    }
+    else
+    {
+        Info->TotalAreaOfInternalNodes += AABBArea(Tree->AABB);
     }
     
     //Traverse the tree recursively
@@ -224,6 +2198,14 @@ GetAABBTreeInfo(aabb_tree* Tree)
     bounding_tree_info Result = {};
     Result.ShortestPathToLeaf = UINT_MAX;
     GetAABBTreeInfoRec(&Result, Tree, 0);
+    
+    //Expected cost of a random ray hitting the root, probability of hitting a node is proportional to its area
+    f32 RootArea = AABBArea(Tree->AABB);
+    if(RootArea > 0.0f)
+    {
+        Result.SAHCost = (SAH_TRAVERSAL_COST * Result.TotalAreaOfInternalNodes +
+                          SAH_TRIANGLE_COST * Result.TotalAreaOfLeavesTimesPrimitives) / RootArea;
+    }
     return Result;
 }
 
@@ -231,15 +2213,60 @@ internal void
 PrintAABBInfo(aabb_tree* Tree)
 {
     bounding_tree_info Info = GetAABBTreeInfo(Tree);
-    u32 FullNodes = (1 << Info.LongestPathToLeaf) - 1;
+    f32 FullNodes = powf(2.0f, (f32)Info.LongestPathToLeaf) - 1.0f;
     printf(" %u nodes of which %u are leaves (%ukb)\n", Info.Count, Info.LeavesCount, (u32)((sizeof(aabb_tree) * Info.Count) / 1024));
     printf(" Total triangles per leaf: %u (%.2f average)\n", Info.TotalPrimitivesPerLeaf, (f32)Info.TotalPrimitivesPerLeaf / Info.LeavesCount);
     printf(" Shortest path to leaf: %u\n", Info.ShortestPathToLeaf);
     printf(" Longest path to leaf: %u\n", Info.LongestPathToLeaf);
     printf(" Average depth of path to leaf: %.2f\n", (f32)Info.TotalDepthOfPathsToLeaves / Info.LeavesCount);
     printf(" Average depth of node: %.2f\n", (f32)Info.TotalDepthOfNodes / Info.Count);
-    printf(" Saturation : %.2f\n", (f32)Info.Count / (f32)FullNodes);
+    printf(" Saturation : %.2f\n", (f32)Info.Count / FullNodes);
     printf(" Total area of leaves: %.2f (%.2f average)\n", Info.TotalAreaOfLeaves, Info.TotalAreaOfLeaves / Info.LeavesCount);
     printf(" Total volume of leaves: %.2f (%.2f%% of total)\n", Info.TotalVolumeOfLeaves, Info.TotalVolumeOfLeaves / AABBVolume(Tree->AABB) * 100.0f);
+    printf(" SAH cost: %.2f\n", Info.SAHCost);
+    printf("\n");
+}
+
+//Build a tree with every available builder on a copy of the indices using the threads of the pool
+//and print their build time, SAH cost, leaf stats and how much the leaves overlap
+internal void
+PrintAABBBuildersComparison(thread_pool* Pool, vec3* Positions, u32* Indices, u32 IndicesCount, bvh_build_settings* Settings)
+{
+    u32* IndicesCopy = (u32*)ZeroAlloc(sizeof(u32) * IndicesCount);
+    
+    printf(" Builders comparison:\n");
+    For(Builder, BVH_BUILDER_COUNT)
+    {
+        memcpy(IndicesCopy, Indices, sizeof(u32) * IndicesCount);
+        
+        bvh_build_settings BuilderSettings = *Settings;
+        BuilderSettings.Builder = (bvh_builder)Builder;
+        
+        bvh_build_mesh Mesh = {};
+        Mesh.Positions = Positions;
+        Mesh.Indices = IndicesCopy;
+        Mesh.IndicesCount = IndicesCount;
+        
+        timestamp Begin = GetCurrentCounter();
+        BuildAABBTreesParallel(Pool, &Mesh, 1, &BuilderSettings);
+        timestamp End = GetCurrentCounter();
+        
+        //Volume of the leaves relative to the root measures their overlap, spatial splits reduce it
+        //by referencing triangles from more leaves
+        bounding_tree_info Info = GetAABBTreeInfo(Mesh.Tree);
+        u32 TrianglesCount = IndicesCount / 3;
+        printf("  %-5s SAH cost: %8.2f - %u nodes, %u leaves, %.2f triangles per leaf, %u max depth, "
+               "%.2f%% leaf volume, %.2f%% duplicated (%.3f ms)\n",
+               BVHBuilderNames[Builder], Info.SAHCost, Info.Count, Info.LeavesCount,
+               (f32)Info.TotalPrimitivesPerLeaf / Info.LeavesCount, Info.LongestPathToLeaf,
+               Info.TotalVolumeOfLeaves / AABBVolume(Mesh.Tree->AABB) * 100.0f,
+               (f32)(Info.TotalPrimitivesPerLeaf - TrianglesCount) / (f32)TrianglesCount * 100.0f,
+               GetSecondsElapsed(Begin, End) * 1000.0f);
+        
+        FreeAABBTree(Mesh.Tree);
+        if(Mesh.Indices != IndicesCopy) Free(Mesh.Indices);
+    }
     printf("\n");
+    
+    Free(IndicesCopy);
 }
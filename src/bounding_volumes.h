@@ -1,3 +1,64 @@
+//Algorithms available to build the AABB tree
+enum bvh_builder
+{
+    BVH_BUILDER_MEAN, //Split at the mean of the vertices
+    BVH_BUILDER_SAH,  //Binned surface area heuristic
+    BVH_BUILDER_LBVH, //Radix tree of the morton codes of the centroids
+    BVH_BUILDER_SBVH, //Binned surface area heuristic with spatial splits that duplicate triangle references
+    
+    BVH_BUILDER_COUNT,
+};
+
+char* BVHBuilderNames[BVH_BUILDER_COUNT] = {
+    "mean",
+    "sah",
+    "lbvh",
+    "sbvh",
+};
+
+//Layouts of the hierarchy that can be used for traversal
+enum bvh_format
+{
+    BVH_FORMAT_TREE, //Pointer linked aabb_tree
+    BVH_FORMAT_FLAT, //Depth first array of flat_bvh_node
+    BVH_FORMAT_WIDE, //Collapsed tree with WIDE_BVH_WIDTH children per node
+    BVH_FORMAT_QUANTIZED, //Wide tree with the child bounds quantized to 8 bits
+    
+    BVH_FORMAT_COUNT,
+};
+
+char* BVHFormatNames[BVH_FORMAT_COUNT] = {
+    "tree",
+    "flat",
+    "wide",
+    "quantized",
+};
+
+//Layouts of the triangles referenced by the leaves of flat and wide hierarchies
+enum bvh_leaf_format
+{
+    BVH_LEAF_FORMAT_INDEXED, //Range of the mesh indices
+    BVH_LEAF_FORMAT_PACKET,  //Range of triangle_packet with the vertices already gathered
+    BVH_LEAF_FORMAT_LOCAL,   //8 or 16 bit indices into a block of vertices shared by a cluster of leaves
+    
+    BVH_LEAF_FORMAT_COUNT,
+};
+
+char* BVHLeafFormatNames[BVH_LEAF_FORMAT_COUNT] = {
+    "indexed",
+    "packet",
+    "local",
+};
+
+struct bvh_build_settings
+{
+    bvh_builder Builder;
+    u32 SAHBinsCount;
+    bvh_format Format;
+    bvh_leaf_format LeafFormat;
+    bool ReorderVertices; //Renumber mesh vertices in leaf order after the build
+};
+
 //Binary AABB tree
 struct aabb_tree
 {
@@ -11,6 +72,294 @@ struct aabb_tree
     aabb_tree* Right;
 };
 
+//Node of a flattened AABB tree (32 bytes), nodes are stored in depth first order
+//so the left child of an internal node is always the one following it
+struct flat_bvh_node
+{
+    aabb AABB;
+    
+    //Internal nodes: index of the right child
+    //Leaves: offset of the first index of the leaf in the mesh indices, or first packet with packet leaves
+    u32 Offset;
+    u32 IndicesCount; //0 for internal nodes
+};
+
+struct flat_bvh
+{
+    flat_bvh_node* Nodes;
+    u32 NodesCount;
+};
+
+//Children per node of the wide bvh, matches the SIMD width so all the child boxes are tested at once
+#define WIDE_BVH_WIDTH SIMD_WIDTH
+
+//Node of a wide bvh, bounds of the children are stored in SoA layout
+//Unused children have inverted bounds so they are never hit
+struct wide_bvh_node
+{
+    f32 Bounds[6][WIDE_BVH_WIDTH]; //MinX, MinY, MinZ, MaxX, MaxY, MaxZ
+    
+    //Internal children: index of the child node
+    //Leaves: offset of the first index of the leaf in the mesh indices, or first packet with packet leaves
+    u32 Offset[WIDE_BVH_WIDTH];
+    u32 IndicesCount[WIDE_BVH_WIDTH]; //0 for internal and unused children
+};
+
+struct wide_bvh
+{
+    wide_bvh_node* Nodes;
+    u32 NodesCount;
+};
+
+//Node of a wide bvh with the child bounds stored as 8 bit steps of Scale from Origin, the box of the node,
+//the quantized boxes are rounded outwards so they always contain the exact ones
+struct quantized_bvh_node
+{
+    f32 Origin[3];
+    f32 Scale[3];
+    
+    //Same as wide_bvh_node
+    u32 Offset[WIDE_BVH_WIDTH];
+    u32 IndicesCount[WIDE_BVH_WIDTH];
+    
+    u8 Bounds[6][WIDE_BVH_WIDTH]; //MinX, MinY, MinZ, MaxX, MaxY, MaxZ
+    u8 ChildrenCount; //Used children are always the first ones
+};
+
+struct quantized_bvh
+{
+    quantized_bvh_node* Nodes;
+    u32 NodesCount;
+};
+
+//Triangles of a leaf gathered in SIMD_WIDTH lanes with their vertices in SoA layout, so the traversal
+//can pick the axes of each ray. Unused lanes are degenerate so they are never hit
+struct triangle_packet
+{
+    f32 Vertex0[3][SIMD_WIDTH];
+    f32 Vertex1[3][SIMD_WIDTH];
+    f32 Vertex2[3][SIMD_WIDTH];
+    u32 Triangle[SIMD_WIDTH]; //Offset of the first index of the triangle in the mesh indices
+};
+
+//Leaves with local indices are grouped in clusters of consecutive leaves of the depth first order using
+//up to LOCAL_CLUSTER_MAX_VERTICES vertices. A cluster is made of the mesh indices of its vertices, their
+//positions and a word with their count, followed by its leaves. A leaf starts with the number of 16 bit
+//units back to the count word of its cluster and goes on with its indices into the cluster vertices,
+//packed in 1 byte up to 256 vertices, 2 up to 65536 and 4 above. Only a leaf bigger than the limit
+//gets a cluster with more vertices
+#define LOCAL_CLUSTER_MAX_VERTICES 256
+
+//Leaves of a cluster stay within 16 bit units of its count word
+#define LOCAL_CLUSTER_MAX_INDICES 32768
+
+struct local_triangles
+{
+    u32* Words; //Clusters in the order of their leaves, leaf offsets are in 16 bit units from Words
+    u32 WordsCount;
+};
+
+struct packed_triangles
+{
+    triangle_packet* Packets;
+    u32 PacketsCount;
+};
+
+//Bin used to evaluate the surface area heuristic of a range of split planes
+struct sah_bin
+{
+    aabb AABB;
+    u32 TrianglesCount;
+};
+
+//Triangle referenced by a node of the spatial split builder, Bounds only covers the part
+//of the triangle inside the node
+struct sbvh_reference
+{
+    aabb Bounds;
+    u32 Triangle; //Offset of the first index of the triangle in the source indices
+};
+
+//Bin of the spatial splits along an axis, references are counted in the bin where they start
+//and in the one where they end, AABB has the parts of the triangles inside the bin
+struct sbvh_spatial_bin
+{
+    aabb AABB;
+    u32 Entries;
+    u32 Exits;
+};
+
+//Best split of a node found by the spatial split builder, the children bounds and counts are
+//estimated from the bins
+struct sbvh_split
+{
+    f32 Cost; //FLT_MAX if no split is possible
+    u32 Axis;
+    u32 Bin;
+    b32 Spatial;
+    f32 Plane; //Spatial splits only
+    aabb Left;
+    aabb Right;
+    u32 LeftCount;
+    u32 RightCount;
+};
+
+//State shared by all the nodes of a spatial split build
+struct sbvh_build
+{
+    vec3* Positions;
+    u32* SourceIndices;
+    u32 BinsCount;
+    u32 GroupSize;
+    f32 MinOverlapArea; //Spatial splits are only tried if the children of the object split overlap more
+    
+    u32 ReferencesCount; //Of all the nodes being built, can't exceed MaxReferencesCount
+    u32 MaxReferencesCount;
+    
+    //Leaves write the triangles of their references here, allocated for MaxReferencesCount triangles
+    u32* Indices;
+    u32 IndicesCount;
+    
+    //Nodes are partitioned here, then the children are copied to arrays of their size before recursing
+    sbvh_reference* ScratchLeft;
+    sbvh_reference* ScratchRight;
+};
+
+//Passes over the triangles of a node when partitioning it with multiple threads
+enum bvh_partition_pass
+{
+    BVH_PARTITION_PASS_BOUNDS,  //Bounds of the triangles and of their centroids
+    BVH_PARTITION_PASS_BINS,    //SAH bins
+    BVH_PARTITION_PASS_COUNT,   //Triangles on the left of the split
+    BVH_PARTITION_PASS_SCATTER, //Copy to the scratch buffer in partitioned order
+    BVH_PARTITION_PASS_COPY,    //Copy back to the indices
+};
+
+//Triangles of the node are split in chunks, the results of each chunk are merged after each pass
+struct bvh_partition_job
+{
+    bvh_partition_pass Pass;
+    volatile u32 NextChunk;
+    u32 ChunksCount;
+    u32 ChunkIndicesCount;
+    
+    vec3* Positions;
+    u32* Indices;
+    u32 IndicesCount;
+    u32* Scratch;
+    
+    //Split settings
+    u32 BinsCount;
+    aabb CentroidAABB;
+    f32 Scale[3];
+    u32 Axis;
+    u32 Bin;
+    
+    //One for each chunk
+    aabb* ChunkAABBs;
+    aabb* ChunkCentroidAABBs;
+    sah_bin (*ChunkBins)[3][MAX_SAH_BINS_COUNT];
+    u32* ChunkLeftCounts;
+    u32* ChunkLeftOffsets;
+    u32* ChunkRightOffsets;
+};
+
+//Subtree built by a single thread, the root is written to Result
+struct bvh_build_task
+{
+    aabb_tree** Result;
+    vec3* Positions;
+    u32* Indices;
+    u32 IndicesCount;
+    u32 Depth;
+};
+
+struct bvh_build_context
+{
+    thread_pool* Pool;
+    bvh_build_settings* Settings;
+    u32 GroupSize;
+    u32 TaskMaxTriangles;
+    
+    bvh_partition_job PartitionJob;
+    
+    _sbuf_ bvh_build_task* Tasks;
+    volatile u32 NextTask;
+};
+
+//Input and result of a tree built by BuildAABBTreesParallel, the spatial split builder replaces
+//Indices with new ones allocated by the build where triangles can be repeated
+struct bvh_build_mesh
+{
+    vec3* Positions;
+    u32* Indices;
+    u32 IndicesCount;
+    aabb_tree* Tree;
+};
+
+struct sbvh_meshes_job
+{
+    bvh_build_mesh* Meshes;
+    u32 MeshesCount;
+    bvh_build_settings* Settings;
+    volatile u32 NextMesh;
+};
+
+//Internal node of the radix tree of the sorted morton codes, covering the sorted triangles
+//from First to Last. Its children cover First to Split and Split + 1 to Last
+struct lbvh_node
+{
+    u32 First;
+    u32 Last;
+    u32 Split;
+};
+
+enum lbvh_pass
+{
+    LBVH_PASS_BOUNDS,    //Bounds of the centroids
+    LBVH_PASS_CODES,     //Morton codes of the centroids
+    LBVH_PASS_HISTOGRAM, //Count of each digit of the keys
+    LBVH_PASS_SCATTER,   //Move the keys in the sorted arrays
+    LBVH_PASS_NODES,     //Internal nodes of the radix tree
+    LBVH_PASS_GATHER,    //Copy triangles to the scratch buffer in sorted order
+    LBVH_PASS_COPY,      //Copy back to the indices
+};
+
+#define LBVH_RADIX_BITS 8
+#define LBVH_RADIX_SIZE (1 << LBVH_RADIX_BITS)
+#define LBVH_MAX_CHUNKS_COUNT 64
+
+//Triangles are split in chunks taken by the threads of the pool in each pass
+struct lbvh_job
+{
+    lbvh_pass Pass;
+    volatile u32 NextChunk;
+    u32 ChunksCount;
+    u32 ChunkSize; //In triangles
+    
+    vec3* Positions;
+    u32* Indices;
+    u32 TrianglesCount;
+    u32* Scratch;
+    
+    aabb CentroidAABB;
+    vec3 Scale; //Inverse of the extent of the centroids
+    u32 BitsPerAxis;
+    u32 Shift; //Of the digit sorted by the current pass
+    
+    //Morton codes and triangle index, swapped with the sorted ones after each radix pass
+    u64* Keys;
+    u32* Values;
+    u64* SortedKeys;
+    u32* SortedValues;
+    
+    lbvh_node* Nodes; //TrianglesCount - 1
+    
+    //One for each chunk
+    aabb ChunkAABBs[LBVH_MAX_CHUNKS_COUNT];
+    u32 ChunkHistograms[LBVH_MAX_CHUNKS_COUNT][LBVH_RADIX_SIZE];
+};
+
 //Tree info, used for printing stats about the tree
 struct bounding_tree_info
 {
@@ -20,6 +369,9 @@ struct bounding_tree_info
     u32 TotalDepthOfPathsToLeaves;
     f32 TotalAreaOfLeaves;
     f32 TotalVolumeOfLeaves;
+    f32 TotalAreaOfInternalNodes;
+    f32 TotalAreaOfLeavesTimesPrimitives;
+    f32 SAHCost;
     u32 TotalPrimitivesPerLeaf;
     u32 LongestPathToLeaf;
     u32 ShortestPathToLeaf;
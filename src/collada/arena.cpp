@@ -1,9 +1,13 @@
-#define ARENA_BLOCK_SIZE 1024
+//Blocks double in size from the minimum up to the maximum, a big document takes a few
+//allocations instead of one per KB
+#define ARENA_MIN_BLOCK_SIZE Kilobytes(64)
+#define ARENA_MAX_BLOCK_SIZE Megabytes(16)
 
 typedef struct arena
 {
     u8* Top; //Top of current block
     u8* End;   //End of current block
+    size_t BlockSize; //Size of the last block allocated for the growth policy
     _sbuf_ u8** Blocks; //Keep track of allocated blocks to allow freeing.
 } arena;
 
@@ -13,22 +17,27 @@ typedef struct arena
 internal void 
 ArenaGrow(arena* Arena, size_t MinimumSize)
 {
-    size_t AllocSize = MAX(ARENA_BLOCK_SIZE, MinimumSize);
+    Arena->BlockSize = Arena->BlockSize ? MIN(Arena->BlockSize * 2, ARENA_MAX_BLOCK_SIZE) : ARENA_MIN_BLOCK_SIZE;
+    size_t AllocSize = MAX(Arena->BlockSize, MinimumSize);
     Arena->Top = (u8*)ZeroAlloc(AllocSize);
     Arena->End = Arena->Top + AllocSize;
     
     SbufPush(Arena->Blocks, Arena->Top);
 }
 
+//Alignment must be a power of two, blocks start at the malloc alignment
 internal void* 
-ArenaAlloc(arena* Arena, size_t Size)
+ArenaAlloc(arena* Arena, size_t Size, size_t Alignment = sizeof(void*))
 {
-    size_t RemainingSize = ArenaSize(Arena);
-    if(RemainingSize < Size)
+    Assert(IS_POW2(Alignment));
+    u8* Aligned = (u8*)ALIGN_UP_PTR(Arena->Top, Alignment);
+    if(!Arena->Top || Aligned + Size > Arena->End)
     {
         ArenaGrow(Arena, Size);
         Assert(ArenaSize(Arena) >= Size);
+        Aligned = Arena->Top;
     }
+    Arena->Top = Aligned;
     void* Result = Arena->Top;
     Arena->Top = Arena->Top + Size;
     return Result;
@@ -42,13 +51,14 @@ FreeArena(arena* Arena)
         Free(*It);
     }
     SbufFree(Arena->Blocks);
+    *Arena = {};
 }
 
 
 internal void 
 TestArena()
 {
-    arena Arena = {0};
+    arena Arena = {};
     int* Test = (int*)ArenaAlloc(&Arena, sizeof(int));
     *Test = 5;
     int* Test2 = (int*)ArenaAlloc(&Arena, sizeof(int) * 1024);
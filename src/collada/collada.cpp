@@ -4,61 +4,61 @@
 #include "string_intern.cpp"
 #include "lexer.cpp"
 #include "xml.cpp"
+#include "number_array.cpp"
 
 #include "collada.h"
 
+//Pool that parses the big number arrays of the file being read, can be 0
+global_variable thread_pool* GlobalColladaThreadPool;
+
 internal vec3*
-FloatArrayElementToVec3Array(xml_element* FloatArray, u32 Count)
+ParseVec3Array(xml_text Text, u32 Count)
 {
     if(Count == 0) return 0;
     
     Assert(Count % 3 == 0);
     vec3* Result = (vec3*)ZeroAlloc(sizeof(float) * Count);
     
-    lexer Lexer;
-    InitLexer(&Lexer, FloatArray->Text, LEXER_IGNORE_NEWLINES | LEXER_XML_COMMENTS);
-    
-    
-    u32 Index = 0;
-    while(!IsToken(&Lexer, TOKEN_EOF) && Index < (Count / 3))
-    {
-        float x = ParseFloatOrIntWithSign(&Lexer);
-        float y = ParseFloatOrIntWithSign(&Lexer);
-        float z = ParseFloatOrIntWithSign(&Lexer);
-        Result[Index++] = vec3(x, y, z);
-    }
-    Assert(Index == Count / 3 && IsToken(&Lexer, TOKEN_EOF));
-    FreeLexer(&Lexer);
+    bool Parsed = ParseNumberArray(NUMBER_ARRAY_F32, Text, Result, Count, GlobalColladaThreadPool);
+    Assert(Parsed);
     
     return Result;
 }
 
 internal vec2*
-FloatArrayElementToVec2Array(xml_element* FloatArray, u32 Count)
+ParseVec2Array(xml_text Text, u32 Count)
 {
     if(Count == 0) return 0;
     
     Assert(Count % 2 == 0);
     vec2* Result = (vec2*)ZeroAlloc(sizeof(float) * Count);
     
-    lexer Lexer;
-    InitLexer(&Lexer, FloatArray->Text, LEXER_IGNORE_NEWLINES | LEXER_XML_COMMENTS);
+    bool Parsed = ParseNumberArray(NUMBER_ARRAY_F32, Text, Result, Count, GlobalColladaThreadPool);
+    Assert(Parsed);
     
-    u32 Index = 0;
-    while(!IsToken(&Lexer, TOKEN_EOF) && Index < (Count / 2))
+    return Result;
+}
+
+//Matrices are stored row major in the file
+internal void
+TransposeRowMajorMat4s(mat4* Matrices, u32 Count)
+{
+    For(Index, Count)
     {
-        float x = ParseFloatOrIntWithSign(&Lexer);
-        float y = ParseFloatOrIntWithSign(&Lexer);
-        Result[Index++] = vec2(x, y);
+        for(u32 Row = 0; Row < 4; Row++)
+        {
+            for(u32 Column = Row + 1; Column < 4; Column++)
+            {
+                f32 Swap = Matrices[Index].e[Column][Row];
+                Matrices[Index].e[Column][Row] = Matrices[Index].e[Row][Column];
+                Matrices[Index].e[Row][Column] = Swap;
+            }
+        }
     }
-    Assert(Index == Count / 2 && IsToken(&Lexer, TOKEN_EOF));
-    FreeLexer(&Lexer);
-    
-    return Result;
 }
 
 internal mat4*
-FloatArrayElementToMat4Array(xml_element* FloatArray, u32 Count)
+ParseMat4Array(xml_text Text, u32 Count)
 {
     if(Count == 0) return 0;
     
@@ -66,58 +66,35 @@ FloatArrayElementToMat4Array(xml_element* FloatArray, u32 Count)
     u32 MatCount = Count / 16;
     mat4* Result = (mat4*)ZeroAlloc(sizeof(float) * Count);
     
-    lexer Lexer;
-    InitLexer(&Lexer, FloatArray->Text, LEXER_IGNORE_NEWLINES | LEXER_XML_COMMENTS);
-    
-    u32 Index = 0;
-    while(!IsToken(&Lexer, TOKEN_EOF) && Index < MatCount)
-    {
-        Result[Index++] = ParseMat4RowMajor(&Lexer);
-    }
-    Assert(Index == MatCount && IsToken(&Lexer, TOKEN_EOF));
-    FreeLexer(&Lexer);
+    bool Parsed = ParseNumberArray(NUMBER_ARRAY_F32, Text, Result, Count, GlobalColladaThreadPool);
+    Assert(Parsed);
+    TransposeRowMajorMat4s(Result, MatCount);
     
     return Result;
 }
 
 internal u32*
-IntArrayElementToU32Array(xml_element* ArrayElement, u32 Count)
+ParseU32Array(xml_text Text, u32 Count)
 {
     if(Count == 0) return 0;
     
     u32* Result = (u32*)ZeroAlloc(sizeof(u32) * Count);
     
-    lexer Lexer;
-    InitLexer(&Lexer, ArrayElement->Text, LEXER_IGNORE_NEWLINES | LEXER_XML_COMMENTS);
-    
-    u32 Index = 0;
-    while(!IsToken(&Lexer, TOKEN_EOF) && Index < Count)
-    {
-        Result[Index++] = (u32)ParseInt(&Lexer);
-    }
-    Assert(Index == Count && IsToken(&Lexer, TOKEN_EOF));
-    FreeLexer(&Lexer);
+    bool Parsed = ParseNumberArray(NUMBER_ARRAY_U32, Text, Result, Count, GlobalColladaThreadPool);
+    Assert(Parsed);
     
     return Result;
 }
 
 internal f32*
-FloatArrayElementToFloatArray(xml_element* ArrayElement, u32 Count)
+ParseF32Array(xml_text Text, u32 Count)
 {
     if(Count == 0) return 0;
     
     f32* Result = (f32*)ZeroAlloc(sizeof(f32) * Count);
     
-    lexer Lexer;
-    InitLexer(&Lexer, ArrayElement->Text, LEXER_IGNORE_NEWLINES | LEXER_XML_COMMENTS);
-    
-    u32 Index = 0;
-    while(!IsToken(&Lexer, TOKEN_EOF) && Index < Count)
-    {
-        Result[Index++] = (f32)ParseFloatOrIntWithSign(&Lexer);
-    }
-    Assert(Index == Count && IsToken(&Lexer, TOKEN_EOF));
-    FreeLexer(&Lexer);
+    bool Parsed = ParseNumberArray(NUMBER_ARRAY_F32, Text, Result, Count, GlobalColladaThreadPool);
+    Assert(Parsed);
     
     return Result;
 }
@@ -129,24 +106,17 @@ NameArrayElementToStringArray(xml_element* ArrayElement, u32 Count)
     
     char** Result = (char**)ZeroAlloc(sizeof(char*) * Count);
     
-    lexer Lexer;
-    InitLexer(&Lexer, ArrayElement->Text, LEXER_IGNORE_NEWLINES | LEXER_XML_COMMENTS
-              | LEXER_NO_NAME_INTERNING);
-    
+    //Names are separated by whitespace and comments like numbers, the text ends at the closing tag
+    xml_text Text = ArrayElement->Text;
+    char* At = Text.Begin ? SkipNumberSeparators(Text.Begin) : 0;
     u32 Index = 0;
-    while(!IsToken(&Lexer, TOKEN_EOF) && Index < Count)
+    while(At < Text.End && Index < Count)
     {
-        char* NameBegin = Lexer.Token.Start;
-        char* NameEnd = Lexer.Token.End;
-        ExpectToken(&Lexer, TOKEN_NAME);
-        
-        u32 NameLength = (u32)(NameEnd - NameBegin);
-        char* String = (char*)ZeroAlloc(NameLength + 1);
-        strncpy(String, NameBegin, NameLength);
-        Result[Index++] = String;
+        char* NameEnd = FindNumberEnd(At);
+        Result[Index++] = XmlTextToString({At, NameEnd});
+        At = SkipNumberSeparators(NameEnd);
     }
-    Assert(Index == Count && IsToken(&Lexer, TOKEN_EOF));
-    FreeLexer(&Lexer);
+    Assert(Index == Count && At >= Text.End);
     
     return Result;
 }
@@ -160,6 +130,8 @@ GetUrlNameFromString(char* String)
     return Result;
 }
 
+//Corners of the faces reference each attribute with its own index, corners with the same
+//indices for all the attributes we use are welded into a single vertex
 internal collada_vertex_data
 AssembleVerticesFromColladaLoadingData(collada_loading_data* Data, u32 * Indices,
                                        u32 IndicesCount)
@@ -167,148 +139,124 @@ AssembleVerticesFromColladaLoadingData(collada_loading_data* Data, u32 * Indices
     collada_vertex_data Result = {};
     
     Assert(Data->Positions);
-    //We use the indexing of the positions as a base, we then add other attributes
-    //at the same index as long as they match the same vertex, otherwise we push a new vertex
-    SbufPushN(Result.Positions, Data->PositionsCount);
-    SbufPushN(Result.Normals, Data->PositionsCount);
-    SbufPushN(Result.UVs, Data->PositionsCount);
-    SbufPushN(Result.Tangents, Data->PositionsCount);
-    
-    //Those are matched with positions, so we index them with VertexIndex
-    if(Data->Weights && Data->Joints)
-    {
-        SbufPushN(Result.Weights, Data->PositionsCount);
-        SbufPushN(Result.Joints, Data->PositionsCount);
-    }
+    b32 HasSkin = Data->Weights && Data->Joints;
     
-    for(u32 Index = 0; Index < Data->PositionsCount; Index++)
-    {
-        Result.Positions[Index] = Data->Positions[Index];
-        if(Data->Weights && Data->Joints)
-        {
-            Result.Weights[Index] = Data->Weights[Index];
-            Result.Joints[Index] = Data->Joints[Index];
-        }
-        
-        Result.Normals[Index] = Data->Normals ? vec3(NAN, NAN, NAN) : vec3(0);
-        Result.Tangents[Index] = Data->Tangents ? vec3(NAN, NAN, NAN) : vec3(0);
-        Result.UVs[Index] = Data->UVs ? vec2(NAN, NAN) : vec2(0);
-    }
+    //The map goes from the hash of a key to the last vertex with that hash + 1,
+    //vertices with the same hash are chained by NextVertex
+    map Map = {};
+    _sbuf_ collada_vertex_key* Keys = 0;
+    _sbuf_ u32* NextVertex = 0;
+    Result.Indices = (u32*)ZeroAlloc(sizeof(u32) * (IndicesCount / Data->AttributesCount));
     
     for(u32 i = 0; i < IndicesCount; i += Data->AttributesCount)
     {
-        //The position index becomes the index of the vertex
-        u32 VertexIndex = Indices[i + Data->PositionsOffset];
-        u32 NormalsIndex = Indices[i + Data->NormalsOffset];
-        u32 UVsIndex = Indices[i + Data->UVsOffset];
-        u32 TangentsIndex = Indices[i + Data->TangentsOffset];
+        collada_vertex_key Key = {};
+        Key.Position = Indices[i + Data->PositionsOffset];
+        if(Data->Normals) Key.Normal = Indices[i + Data->NormalsOffset];
+        if(Data->UVs) Key.UV = Indices[i + Data->UVsOffset];
+        if(Data->Tangents) Key.Tangent = Indices[i + Data->TangentsOffset];
         
-        SbufPush(Result.Indices, VertexIndex);
-        b32 NeedToPushVertex = false;
+        u64 Hash = HashBytes(&Key, sizeof(Key));
+        void* MapKey = Hash ? (void*)Hash : (void*)1;
+        u32 Head = (u32)(uintptr_t)MapGet(&Map, MapKey);
         
-        
-#define NEED_TO_PUSH(attribute) \
-if(Data->attribute && \
-!isnan(Result.attribute[VertexIndex].x) && \
-Result.attribute[VertexIndex] != Data->attribute[attribute##Index]) \
-{ NeedToPushVertex = true; }
-        
-        NEED_TO_PUSH(Normals);
-        NEED_TO_PUSH(UVs);
-        NEED_TO_PUSH(Tangents);
-        
-#define PUSH_ATTRIBUTE(attribute) \
-if(Data->attribute) { SbufPush(Result.attribute, Data->attribute[attribute##Index]); } \
-else { SbufPush(Result.attribute, {}); }
-        
-        if(NeedToPushVertex) {
-            //Put the last vertex position as new index
-            Result.Indices[i / Data->AttributesCount] = (u32)SbufLen(Result.Positions);
-            //Push copies of these at the end of the array
-            SbufPush(Result.Positions, Result.Positions[VertexIndex]);
-            if(Data->Weights && Data->Joints)
+        u32 VertexIndex = (u32)-1;
+        for(u32 It = Head; It != 0; It = NextVertex[It - 1])
+        {
+            if(memcmp(&Keys[It - 1], &Key, sizeof(Key)) == 0)
             {
-                SbufPush(Result.Weights, Result.Weights[VertexIndex]);
-                SbufPush(Result.Joints, Result.Joints[VertexIndex]);
+                VertexIndex = It - 1;
+                break;
             }
-            
-            PUSH_ATTRIBUTE(Normals);
-            PUSH_ATTRIBUTE(Tangents);
-            PUSH_ATTRIBUTE(UVs);
         }
-        else {
-#define SET_ATTRIBUTE(attribute) if(Data->attribute) { Result.attribute[VertexIndex] = Data->attribute[attribute##Index]; }
-            SET_ATTRIBUTE(Normals);
-            SET_ATTRIBUTE(Tangents);
-            SET_ATTRIBUTE(UVs);
+        
+        if(VertexIndex == (u32)-1)
+        {
+            VertexIndex = (u32)SbufLen(Keys);
+            SbufPush(Keys, Key);
+            SbufPush(NextVertex, Head);
+            MapPut(&Map, MapKey, (void*)(uintptr_t)(VertexIndex + 1));
         }
+        Result.Indices[Result.IndicesCount++] = VertexIndex;
     }
     
-    //Some models are made up of multiple meshes, we currently don't support this behaviour,
-    //In case we will in the future it might be more clever to recreate the positions buffer
-    //aswell instead of reusing it, because there might be some vertices that are not indexed
-    //by the primitive node, this way their attributes remain NAN as no index references them.
-#if 1
-    u64 VertexCount = SbufLen(Result.Positions);
-    u64 FinalIndicesCount = SbufLen(Result.Indices);
-    Assert(VertexCount == SbufLen(Result.Normals) &&
-           VertexCount == SbufLen(Result.Tangents) &&
-           VertexCount == SbufLen(Result.UVs));
-    
-    for(u32 Index = 0; Index < VertexCount; Index++)
+    //Attributes are gathered once per vertex, positions that no face uses are dropped
+    u32 VertexCount = (u32)SbufLen(Keys);
+    Result.VerticesCount = VertexCount;
+    Result.Positions = (vec3*)ZeroAlloc(sizeof(vec3) * VertexCount);
+    Result.Normals = (vec3*)ZeroAlloc(sizeof(vec3) * VertexCount);
+    Result.UVs = (vec2*)ZeroAlloc(sizeof(vec2) * VertexCount);
+    Result.Tangents = (vec3*)ZeroAlloc(sizeof(vec3) * VertexCount);
+    
+    //Those are matched with positions, so we index them with the position index
+    if(HasSkin)
     {
-        if(IsNan(Result.Positions[Index]))
-            Result.Positions[Index] = vec3(0);
-        if(IsNan(Result.Normals[Index]))
-            Result.Normals[Index] = vec3(0);
-        if(IsNan(Result.Tangents[Index]))
-            Result.Tangents[Index] = vec3(0);
-        if(IsNan(Result.UVs[Index]))
-            Result.UVs[Index] = vec2(0);
+        Result.Weights = (vec4*)ZeroAlloc(sizeof(vec4) * VertexCount);
+        Result.Joints = (ivec4*)ZeroAlloc(sizeof(ivec4) * VertexCount);
     }
-#endif
+    
+    For(Index, VertexCount)
+    {
+        collada_vertex_key* Key = &Keys[Index];
+        Assert(Key->Position < Data->PositionsCount &&
+               (!Data->Normals || Key->Normal < Data->NormalsCount) &&
+               (!Data->Tangents || Key->Tangent < Data->TangentsCount) &&
+               (!Data->UVs || Key->UV < Data->UVsCount));
+        Result.Positions[Index] = Data->Positions[Key->Position];
+        if(HasSkin)
+        {
+            Result.Weights[Index] = Data->Weights[Key->Position];
+            Result.Joints[Index] = Data->Joints[Key->Position];
+        }
+        
+        Result.Normals[Index] = Data->Normals ? Data->Normals[Key->Normal] : vec3(0);
+        Result.Tangents[Index] = Data->Tangents ? Data->Tangents[Key->Tangent] : vec3(0);
+        Result.UVs[Index] = Data->UVs ? Data->UVs[Key->UV] : vec2(0);
+    }
+    
+    FreeMap(&Map);
+    SbufFree(Keys);
+    SbufFree(NextVertex);
+    
     return Result;
 }
-#undef NEED_TO_PUSH
-#undef PUSH_ATTRIBUTE
-#undef SET_ATTRIBUTE
 
 internal void
-FillColladaLoadingData(collada_loading_data* Data, char* Semantic, xml_element* FloatArray,
-                       xml_element* Accessor, u32 Count, u32 Offset)
+FillColladaLoadingData(collada_loading_data* Data, char* Semantic, collada_source* Source, u32 Offset)
 {
     Data->AttributesCount = MAX(Offset + 1, Data->AttributesCount);
+    u32 Count = Source->FloatArrayCount;
     if(strcmp(Semantic, "POSITION") == 0)
     {
         Assert(Data->Positions == 0);
-        Assert(SbufLen(Accessor->Children) == 3);
+        Assert(Source->ParamsCount == 3);
         Data->PositionsOffset = Offset;
         Data->PositionsCount = Count / 3;
-        Data->Positions = FloatArrayElementToVec3Array(FloatArray, Count);
+        Data->Positions = ParseVec3Array(Source->FloatArray, Count);
     }
     else if(strcmp(Semantic, "NORMAL") == 0)
     {
         Assert(Data->Normals == 0);
-        Assert(SbufLen(Accessor->Children) == 3);
+        Assert(Source->ParamsCount == 3);
         Data->NormalsOffset = Offset;
         Data->NormalsCount = Count / 3;
-        Data->Normals = FloatArrayElementToVec3Array(FloatArray, Count);
+        Data->Normals = ParseVec3Array(Source->FloatArray, Count);
     }
     else if(strcmp(Semantic, "TEXCOORD") == 0)
     {
         Assert(Data->UVs == 0);
-        Assert(SbufLen(Accessor->Children) == 2);
+        Assert(Source->ParamsCount == 2);
         Data->UVsOffset = Offset;
         Data->UVsCount = Count / 2;
-        Data->UVs = FloatArrayElementToVec2Array(FloatArray, Count);
+        Data->UVs = ParseVec2Array(Source->FloatArray, Count);
     }
     else if(strcmp(Semantic, "TANGENT") == 0)
     {
         Assert(Data->Tangents == 0);
-        Assert(SbufLen(Accessor->Children) == 3);
+        Assert(Source->ParamsCount == 3);
         Data->TangentsOffset = Offset;
         Data->TangentsCount = Count / 3;
-        Data->Tangents = FloatArrayElementToVec3Array(FloatArray, Count);
+        Data->Tangents = ParseVec3Array(Source->FloatArray, Count);
     }
     
 }
@@ -370,11 +318,10 @@ FindStringPositionInArray(char* String, char** Array, u32 Count)
 internal mat4
 GetMatrixFromElement(xml_element* Element)
 {
-    lexer Lexer;
-    InitLexer(&Lexer, Element->Text, LEXER_IGNORE_NEWLINES | LEXER_XML_COMMENTS
-              | LEXER_NO_NAME_INTERNING);
-    mat4 Result = ParseMat4RowMajor(&Lexer);
-    Assert(IsToken(&Lexer, TOKEN_EOF));
+    mat4 Result;
+    bool Parsed = ParseNumberArray(NUMBER_ARRAY_F32, Element->Text, &Result, 16, 0);
+    Assert(Parsed);
+    TransposeRowMajorMat4s(&Result, 1);
     
     return Result;
 }
@@ -432,7 +379,7 @@ LoadColladaJointTree(xml_element* Element, char** JointsNames, u32 JointsNamesCo
     xml_element* InputSource = FindXmlFirstChildByAttribute(AnimationElement, Id_Keyword, InputSourceId);
     xml_element* InputFloatArray = FindXmlFirstChildByName(InputSource, FloatArray_Keyword);
     u32 InputCount = GetXmlAttributeValueAsU32(InputFloatArray, Count_Keyword);
-    float* KeyframeTimes = FloatArrayElementToFloatArray(InputFloatArray, InputCount);
+    float* KeyframeTimes = ParseF32Array(InputFloatArray->Text, InputCount);
     
     xml_element* OutputElement = FindXmlFirstChildByAttribute(SamplerElement, Semantic_Keyword, "OUTPUT");
     char* OutputSourceId = GetXmlAttributeValue(OutputElement, Source_Keyword);
@@ -440,11 +387,11 @@ LoadColladaJointTree(xml_element* Element, char** JointsNames, u32 JointsNamesCo
     xml_element* OutputSource = FindXmlFirstChildByAttribute(AnimationElement, Id_Keyword, OutputSourceId);
     xml_element* OutputFloatArray = FindXmlFirstChildByName(OutputSource, FloatArray_Keyword);
     u32 OutputCount = GetXmlAttributeValueAsU32(OutputFloatArray, Count_Keyword);
-    mat4* KeyframeTransforms = FloatArrayElementToMat4Array(OutputFloatArray, OutputCount);
+    mat4* KeyframeTransforms = ParseMat4Array(OutputFloatArray->Text, OutputCount);
     Assert(OutputCount / 16 == InputCount);
     
     collada_joint_tree** JointChildren = 0;
-    for(u32 Index = 0; Index < SbufLen(Element->Children); Index++)
+    for(u32 Index = 0; Index < Element->ChildrenCount; Index++)
     {
         xml_element* Child = Element->Children[Index];
         if(Child->Name == Node_Keyword)
@@ -542,53 +489,268 @@ FreeColladaLoadingData(collada_loading_data* Data)
     Data = {};
 }
 
+internal void
+InternColladaKeywords(intern_map* Intern)
+{
+    LibraryGeometries_Keyword = InternString(Intern, "library_geometries");
+    LibraryControllers_Keyword = InternString(Intern, "library_controllers");
+    Param_Keyword = InternString(Intern, "param");
+    Geometry_Keyword = InternString(Intern, "geometry");
+    Mesh_Keyword = InternString(Intern, "mesh");
+    Polylist_Keyword = InternString(Intern, "polylist");
+    Source_Keyword = InternString(Intern, "source");
+    Input_Keyword = InternString(Intern, "input");
+    Id_Keyword = InternString(Intern, "id");
+    Vertices_Keyword = InternString(Intern, "vertices");
+    Semantic_Keyword = InternString(Intern, "semantic");
+    FloatArray_Keyword = InternString(Intern, "float_array");
+    Accessor_Keyword = InternString(Intern, "accessor");
+    Count_Keyword = InternString(Intern, "count");
+    Triangles_Keyword = InternString(Intern, "triangles");
+    Offset_Keyword = InternString(Intern, "offset");
+    VCount_Keyword = InternString(Intern, "vcount");
+    P_Keyword = InternString(Intern, "p");
+    V_Keyword = InternString(Intern, "v");
+    Controller_Keyword = InternString(Intern, "controller");
+    Skin_Keyword = InternString(Intern, "skin");
+    BindShapeMatrix_Keyword = InternString(Intern, "bind_shape_matrix");
+    Joints_Keyword = InternString(Intern, "joints");
+    Stride_Keyword = InternString(Intern, "stride");
+    VertexWeights_Keyword = InternString(Intern, "vertex_weights");
+    NameArray_Keyword = InternString(Intern, "Name_array");
+    InstanceController_Keyword = InternString(Intern, "instance_controller");
+    Url_Keyword = InternString(Intern, "url");
+    Skeleton_Keyword = InternString(Intern, "skeleton");
+    LibraryVisualScenes_Keyword = InternString(Intern, "library_visual_scenes");
+    Node_Keyword = InternString(Intern, "node");
+    Name_Keyword = InternString(Intern, "name");
+    Sid_Keyword = InternString(Intern, "sid");
+    Matrix_Keyword = InternString(Intern, "matrix");
+    Animation_Keyword = InternString(Intern, "animation");
+    Channel_Keyword = InternString(Intern, "channel");
+    LibraryAnimations_Keyword = InternString(Intern, "library_animations");
+    Target_Keyword = InternString(Intern, "target");
+    Type_Keyword = InternString(Intern, "type");
+}
+
+//Attribute of the last open event interned, a leading # of urls is skipped
+internal char*
+InternColladaAttribute(xml_reader* Reader, char* Name)
+{
+    char* Value = GetXmlEventAttribute(Reader, Name);
+    if(!Value) return 0;
+    if(Value[0] == '#') Value++;
+    return InternString(&Reader->Lexer->Intern, Value);
+}
+
+//Reads the <input> children of the element of the last open event
+internal _sbuf_ collada_input*
+ReadColladaInputs(xml_reader* Reader, collada_primitive* Primitive = 0)
+{
+    _sbuf_ collada_input* Inputs = 0;
+    u32 Depth = Reader->Depth;
+    xml_event Event;
+    while(ReadXmlEvent(Reader, &Event) && !(Event.Kind == XML_EVENT_CLOSE && Reader->Depth < Depth))
+    {
+        if(Event.Kind != XML_EVENT_OPEN) continue;
+        
+        if(Event.Name == Input_Keyword)
+        {
+            collada_input Input = {};
+            Input.Semantic = InternColladaAttribute(Reader, Semantic_Keyword);
+            Input.Source = InternColladaAttribute(Reader, Source_Keyword);
+            Input.Offset = GetXmlEventAttributeAsU32(Reader, Offset_Keyword);
+            SbufPush(Inputs, Input);
+            SkipXmlElement(Reader);
+        }
+        else if(Primitive && Event.Name == VCount_Keyword)
+        {
+            Primitive->VCount = ReadXmlElementText(Reader);
+        }
+        else if(Primitive && Event.Name == P_Keyword)
+        {
+            Primitive->P = ReadXmlElementText(Reader);
+        }
+        else
+        {
+            SkipXmlElement(Reader);
+        }
+    }
+    
+    return Inputs;
+}
+
+internal collada_source
+ReadColladaSource(xml_reader* Reader)
+{
+    collada_source Source = {};
+    Source.Id = InternColladaAttribute(Reader, Id_Keyword);
+    
+    b32 InAccessor = false;
+    u32 Depth = Reader->Depth;
+    xml_event Event;
+    while(ReadXmlEvent(Reader, &Event) && !(Event.Kind == XML_EVENT_CLOSE && Reader->Depth < Depth))
+    {
+        if(Event.Kind == XML_EVENT_OPEN && Event.Name == FloatArray_Keyword)
+        {
+            Source.FloatArrayCount = GetXmlEventAttributeAsU32(Reader, Count_Keyword);
+            Source.FloatArray = ReadXmlElementText(Reader);
+        }
+        else if(Event.Kind == XML_EVENT_OPEN && Event.Name == Accessor_Keyword)
+        {
+            InAccessor = true;
+        }
+        else if(Event.Kind == XML_EVENT_CLOSE && Event.Name == Accessor_Keyword)
+        {
+            InAccessor = false;
+        }
+        else if(Event.Kind == XML_EVENT_OPEN && Event.Name == Param_Keyword && InAccessor)
+        {
+            Source.ParamsCount++;
+        }
+    }
+    
+    return Source;
+}
+
+//Reads the <geometry> of the last open event, nothing is parsed or copied but its attributes
+internal collada_geometry
+ReadColladaGeometry(xml_reader* Reader)
+{
+    collada_geometry Geometry = {};
+    Geometry.Id = InternColladaAttribute(Reader, Id_Keyword);
+    
+    u32 Depth = Reader->Depth;
+    xml_event Event;
+    while(ReadXmlEvent(Reader, &Event) && !(Event.Kind == XML_EVENT_CLOSE && Reader->Depth < Depth))
+    {
+        if(Event.Kind != XML_EVENT_OPEN) continue;
+        
+        //The children of <mesh> are read by this loop too
+        if(Event.Name == Mesh_Keyword && Reader->Depth == Depth + 1)
+        {
+            Geometry.HasMesh = true;
+        }
+        else if(Reader->Depth != Depth + 2 || !Geometry.HasMesh)
+        {
+            SkipXmlElement(Reader);
+        }
+        else if(Event.Name == Source_Keyword)
+        {
+            collada_source Source = ReadColladaSource(Reader);
+            SbufPush(Geometry.Sources, Source);
+        }
+        else if(Event.Name == Vertices_Keyword)
+        {
+            Geometry.VerticesId = InternColladaAttribute(Reader, Id_Keyword);
+            Geometry.VerticesInputs = ReadColladaInputs(Reader);
+        }
+        else if(Event.Name == Polylist_Keyword && !Geometry.HasPolylist)
+        {
+            Geometry.HasPolylist = true;
+            Geometry.Polylist.Count = GetXmlEventAttributeAsU32(Reader, Count_Keyword);
+            Geometry.Polylist.Inputs = ReadColladaInputs(Reader, &Geometry.Polylist);
+        }
+        else if(Event.Name == Triangles_Keyword && !Geometry.HasTriangles)
+        {
+            Geometry.HasTriangles = true;
+            Geometry.Triangles.Count = GetXmlEventAttributeAsU32(Reader, Count_Keyword);
+            Geometry.Triangles.Inputs = ReadColladaInputs(Reader, &Geometry.Triangles);
+        }
+        else
+        {
+            SkipXmlElement(Reader);
+        }
+    }
+    
+    return Geometry;
+}
+
+internal void
+FreeColladaGeometry(collada_geometry* Geometry)
+{
+    SbufFree(Geometry->Sources);
+    SbufFree(Geometry->VerticesInputs);
+    SbufFree(Geometry->Polylist.Inputs);
+    SbufFree(Geometry->Triangles.Inputs);
+    *Geometry = {};
+}
+
+//Id must be interned
+internal collada_source*
+FindColladaSource(collada_geometry* Geometry, char* Id)
+{
+    for(u32 Index = 0; Index < SbufLen(Geometry->Sources); Index++)
+    {
+        if(Geometry->Sources[Index].Id == Id)
+        {
+            return &Geometry->Sources[Index];
+        }
+    }
+    
+    return 0;
+}
+
+//Geometry is streamed and its arrays are parsed in place from String when each mesh is assembled,
+//only the libraries needed for skins and animations are kept as an xml tree
 internal collada_scene
-ReadColladaFromString(char* String)
+ReadColladaFromString(char* String, thread_pool* Pool = 0)
 {
+    GlobalColladaThreadPool = Pool;
+    
     lexer Lexer;
-    InitLexer(&Lexer, String, LEXER_IGNORE_NEWLINES | LEXER_XML_COMMENTS);
-    xml_file XmlFile = ParseXmlFile(&Lexer);
-    xml_element* Root = XmlFile.Root;
-    
-    xml_element* LibraryGeometries =
-        FindXmlFirstChildByName(Root, InternString(&Lexer.Intern, "library_geometries"));
-    
-    Geometry_Keyword = InternString(&Lexer.Intern, "geometry");
-    Mesh_Keyword = InternString(&Lexer.Intern, "mesh");
-    Polylist_Keyword = InternString(&Lexer.Intern, "polylist");
-    Source_Keyword = InternString(&Lexer.Intern, "source");
-    Input_Keyword = InternString(&Lexer.Intern, "input");
-    Id_Keyword = InternString(&Lexer.Intern, "id");
-    Vertices_Keyword = InternString(&Lexer.Intern, "vertices");
-    Semantic_Keyword = InternString(&Lexer.Intern, "semantic");
-    FloatArray_Keyword = InternString(&Lexer.Intern, "float_array");
-    Accessor_Keyword = InternString(&Lexer.Intern, "accessor");
-    Count_Keyword = InternString(&Lexer.Intern, "count");
-    Triangles_Keyword = InternString(&Lexer.Intern, "triangles");
-    Offset_Keyword = InternString(&Lexer.Intern, "offset");
-    VCount_Keyword = InternString(&Lexer.Intern, "vcount");
-    P_Keyword = InternString(&Lexer.Intern, "p");
-    V_Keyword = InternString(&Lexer.Intern, "v");
-    Controller_Keyword = InternString(&Lexer.Intern, "controller");
-    Skin_Keyword = InternString(&Lexer.Intern, "skin");
-    BindShapeMatrix_Keyword = InternString(&Lexer.Intern, "bind_shape_matrix");
-    Joints_Keyword = InternString(&Lexer.Intern, "joints");
-    Stride_Keyword = InternString(&Lexer.Intern, "stride");
-    VertexWeights_Keyword = InternString(&Lexer.Intern, "vertex_weights");
-    NameArray_Keyword = InternString(&Lexer.Intern, "Name_array");
-    InstanceController_Keyword = InternString(&Lexer.Intern, "instance_controller");
-    Url_Keyword = InternString(&Lexer.Intern, "url");
-    Skeleton_Keyword = InternString(&Lexer.Intern, "skeleton");
-    LibraryVisualScenes_Keyword = InternString(&Lexer.Intern, "library_visual_scenes");
-    Node_Keyword = InternString(&Lexer.Intern, "node");
-    Name_Keyword = InternString(&Lexer.Intern, "name");
-    Sid_Keyword = InternString(&Lexer.Intern, "sid");
-    Matrix_Keyword = InternString(&Lexer.Intern, "matrix");
-    Animation_Keyword = InternString(&Lexer.Intern, "animation");
-    Channel_Keyword = InternString(&Lexer.Intern, "channel");
-    LibraryAnimations_Keyword = InternString(&Lexer.Intern, "library_animations");
-    Target_Keyword = InternString(&Lexer.Intern, "target");
-    Type_Keyword = InternString(&Lexer.Intern, "type");
+    InitLexer(&Lexer, String, LEXER_IGNORE_NEWLINES | LEXER_XML_COMMENTS | LEXER_NO_STRING_COPY);
+    InternColladaKeywords(&Lexer.Intern);
+    
+    xml_reader Reader;
+    InitXmlReader(&Reader, &Lexer);
+    
+    xml_event Event;
+    ReadXmlEvent(&Reader, &Event);
+    Assert(Event.Kind == XML_EVENT_OPEN);
+    xml_file Document = {};
+    Document.Root = AllocXmlElement(&Document.Arena, Event.Name, Event.Namespace);
+    CopyXmlAttributes(&Reader, &Document.Arena, Document.Root);
+    xml_element* Root = Document.Root;
+    
+    _sbuf_ xml_element** Libraries = 0;
+    _sbuf_ collada_geometry* Geometries = 0;
+    while(ReadXmlEvent(&Reader, &Event) && Event.Kind != XML_EVENT_CLOSE)
+    {
+        if(Event.Kind != XML_EVENT_OPEN) continue;
+        
+        if(Event.Name == LibraryGeometries_Keyword)
+        {
+            while(ReadXmlEvent(&Reader, &Event) && Event.Kind != XML_EVENT_CLOSE)
+            {
+                if(Event.Kind != XML_EVENT_OPEN) continue;
+                
+                if(Event.Name == Geometry_Keyword)
+                {
+                    collada_geometry Geometry = ReadColladaGeometry(&Reader);
+                    SbufPush(Geometries, Geometry);
+                }
+                else
+                {
+                    SkipXmlElement(&Reader);
+                }
+            }
+        }
+        else if(Event.Name == LibraryControllers_Keyword ||
+                Event.Name == LibraryVisualScenes_Keyword ||
+                Event.Name == LibraryAnimations_Keyword)
+        {
+            xml_element* Library = ReadXmlElementTree(&Reader, &Event, Root, &Document.Arena);
+            SbufPush(Libraries, Library);
+        }
+        else
+        {
+            SkipXmlElement(&Reader);
+        }
+    }
+    SetXmlChildren(&Document.Arena, Root, Libraries, SbufLen(Libraries));
+    SbufFree(Libraries);
+    FreeXmlReader(&Reader);
     
     char* Semantics[] = {
         "POSITION",
@@ -599,7 +761,6 @@ ReadColladaFromString(char* String)
     };
     
     collada_scene Result = {};
-    _sbuf_ xml_element** Geometries = FindAllDirectXmlChildrenByName(LibraryGeometries, Geometry_Keyword);
     for(u32 GeometryIndex = 0; GeometryIndex < SbufLen(Geometries); GeometryIndex++)
     {
         collada_loading_data Data = {};
@@ -608,13 +769,12 @@ ReadColladaFromString(char* String)
         u32 MeshAnimationsCount = 0;
         
         //Gather vertex data arrays
-        xml_element* GeometryElement = Geometries[GeometryIndex];
-        xml_element* MeshElement = FindXmlFirstChildByName(GeometryElement, Mesh_Keyword);
-        if(!MeshElement) continue;
+        collada_geometry* Geometry = &Geometries[GeometryIndex];
+        if(!Geometry->HasMesh) continue;
         
         //If we have a mesh we first load the animation data, because we will need it
         //to assemble primitives.
-        char* MeshId = GetXmlAttributeValue(GeometryElement, Id_Keyword);
+        char* MeshId = Geometry->Id;
         
         char* SkinSourceId = GetUrlNameFromString(MeshId);
         xml_element* SkinElement =
@@ -642,7 +802,7 @@ ReadColladaFromString(char* String)
             u32 InvBindStride = GetXmlAttributeValueAsU32(InvBindAccessor, Stride_Keyword);
             Assert(InvBindStride == 16);
             Assert(InvBindCount * 16 == InvBindFloatArrayCount);
-            mat4* InvBindMatrices = FloatArrayElementToMat4Array(InvBindFloatArray, InvBindFloatArrayCount);
+            mat4* InvBindMatrices = ParseMat4Array(InvBindFloatArray->Text, InvBindFloatArrayCount);
             
             //Load vertex weights and joint ids
             xml_element* VertexWeightsElement = FindXmlFirstChildByName(SkinElement, VertexWeights_Keyword);
@@ -655,7 +815,7 @@ ReadColladaFromString(char* String)
             xml_element* WeightSource = FindXmlFirstChildByAttribute(SkinElement, Id_Keyword, WeightSourceName);
             xml_element* WeightFloatArray = FindXmlFirstChildByName(WeightSource, FloatArray_Keyword);
             u32 WeightCount = strtoul(GetXmlAttributeValue(WeightFloatArray, Count_Keyword), 0, 10);
-            f32* WeightsArray = FloatArrayElementToFloatArray(WeightFloatArray, WeightCount);
+            f32* WeightsArray = ParseF32Array(WeightFloatArray->Text, WeightCount);
             
             xml_element* JointInput = FindXmlFirstChildByAttribute(VertexWeightsElement, Semantic_Keyword, "JOINT");
             u32 JointOffset = GetXmlAttributeValueAsU32(JointInput, Offset_Keyword);
@@ -667,7 +827,7 @@ ReadColladaFromString(char* String)
             char** JointsArray = NameArrayElementToStringArray(JointNameArray, JointsCount);
             
             xml_element* VCountElement = FindXmlFirstChildByName(VertexWeightsElement, VCount_Keyword);
-            u32* VCountArray = IntArrayElementToU32Array(VCountElement, VertexWeightsCount);
+            u32* VCountArray = ParseU32Array(VCountElement->Text, VertexWeightsCount);
             u32 TotalVCount = 0;
             u32 MaxWeightCount = 0; //We calculate the maximum number of weights affecting a vertex
             for(u32 Index = 0; Index < VertexWeightsCount; Index++)
@@ -679,7 +839,7 @@ ReadColladaFromString(char* String)
             TotalVCount *= WeightAttributeCount;
             
             xml_element* VElement = FindXmlFirstChildByName(VertexWeightsElement, V_Keyword);
-            u32* VArray = IntArrayElementToU32Array(VElement, TotalVCount);
+            u32* VArray = ParseU32Array(VElement->Text, TotalVCount);
             
             //Assemble vertex weights and joint ids
             joint_weight_pair* CurrentPairs = (joint_weight_pair*)ZeroAlloc(MaxWeightCount * sizeof(joint_weight_pair));
@@ -737,9 +897,10 @@ ReadColladaFromString(char* String)
             if(SkeletonElement)
             {
                 //@Logging
-                char* RootJointId = SkeletonElement->Text;
-                RootJointId++; //Skip #
+                char* SkeletonUrl = XmlTextToString(SkeletonElement->Text);
+                char* RootJointId = SkeletonUrl + 1; //Skip #
                 RootJointElement = FindXmlFirstChildByNameAndAttribute(LibraryVisualScenes, Node_Keyword, Id_Keyword, RootJointId);
+                Free(SkeletonUrl);
             } else {
                 RootJointElement = FindXmlFirstChildByAttribute(LibraryVisualScenes, Type_Keyword, "JOINT");
             }
@@ -767,17 +928,14 @@ ReadColladaFromString(char* String)
             }
         }
         
-        xml_element* PolylistElement = FindXmlFirstChildByName(MeshElement, Polylist_Keyword);
-        xml_element* TrianglesElement = FindXmlFirstChildByName(MeshElement, Triangles_Keyword);
-        
-        xml_element* PrimitiveElement = 0;
-        if(PolylistElement)
+        collada_primitive* Primitive = 0;
+        if(Geometry->HasPolylist)
         {
-            PrimitiveElement = PolylistElement;
+            Primitive = &Geometry->Polylist;
         }
-        else if(TrianglesElement)
+        else if(Geometry->HasTriangles)
         {
-            PrimitiveElement = TrianglesElement;
+            Primitive = &Geometry->Triangles;
         }
         else
         {
@@ -785,84 +943,56 @@ ReadColladaFromString(char* String)
             Assert(0);
         }
         
-        xml_element** Inputs = FindAllDirectXmlChildrenByName(PrimitiveElement, Input_Keyword);
-        for(u32 InputIndex = 0; InputIndex < SbufLen(Inputs); InputIndex++)
+        for(u32 InputIndex = 0; InputIndex < SbufLen(Primitive->Inputs); InputIndex++)
         {
-            xml_element* Input = Inputs[InputIndex];
-            char* InputSource = GetXmlAttributeValue(Input, Source_Keyword);
-            InputSource++; //Skip # char
-            xml_element* Source = FindXmlFirstChildByAttribute(MeshElement, Id_Keyword, InputSource);
-            u32 Offset = GetXmlAttributeValueAsU32(Input, Offset_Keyword);
+            collada_input* Input = &Primitive->Inputs[InputIndex];
             //Now the fun begins, if this is VERTEX we go look for the <vertices>
             //thing and then use that to find the right source, otherwise we go direct
             //to source, people thinking this must have been drunk af
-            if(Source->Name == Vertices_Keyword)
+            if(Input->Source == Geometry->VerticesId)
             {
                 for(u32 SemanticIndex = 0; SemanticIndex < ArrayCount(Semantics); SemanticIndex++)
                 {
                     char* Semantic = Semantics[SemanticIndex];
-                    xml_element* VertInput = FindXmlFirstChildByAttribute(Source, Semantic_Keyword, Semantic);
-                    if(VertInput)
+                    for(u32 VertIndex = 0; VertIndex < SbufLen(Geometry->VerticesInputs); VertIndex++)
                     {
-                        char* ActualInputSource = GetXmlAttributeValue(VertInput, Source_Keyword);
-                        ActualInputSource++; //Skip # char
-                        xml_element* ActualSource = FindXmlFirstChildByAttribute(MeshElement, Id_Keyword, ActualInputSource);
+                        collada_input* VertInput = &Geometry->VerticesInputs[VertIndex];
+                        if(strcmp(VertInput->Semantic, Semantic) != 0) continue;
                         
-                        xml_element* FloatArray = FindXmlFirstChildByName(ActualSource, FloatArray_Keyword);
-                        u32 Count = GetXmlAttributeValueAsU32(FloatArray, Count_Keyword);
-                        xml_element* Accessor = FindXmlFirstChildByName(ActualSource, Accessor_Keyword);
-                        
-                        FillColladaLoadingData(&Data, Semantic, FloatArray, Accessor, Count, Offset);
+                        collada_source* Source = FindColladaSource(Geometry, VertInput->Source);
+                        if(Source) FillColladaLoadingData(&Data, Semantic, Source, Input->Offset);
+                        break;
                     }
                 }
             }
-            else if(Source->Name == Source_Keyword)
+            else
             {
-                char* Semantic = GetXmlAttributeValue(Input, Semantic_Keyword);
-                xml_element* FloatArray = FindXmlFirstChildByName(Source, FloatArray_Keyword);
-                xml_element* Accessor = FindXmlFirstChildByName(Source, Accessor_Keyword);
-                u32 Count = GetXmlAttributeValueAsU32(FloatArray, Count_Keyword);
                 //Can POSITION even happen here without the indirection to vertices?
-                FillColladaLoadingData(&Data, Semantic, FloatArray, Accessor, Count, Offset);
+                collada_source* Source = FindColladaSource(Geometry, Input->Source);
+                if(Source) FillColladaLoadingData(&Data, Input->Semantic, Source, Input->Offset);
             }
         }
-        SbufFree(Inputs);
         
         //Now analyze the primitives to gather indices and form the result arrays
-        u32 IndicesCount = 0;
-        u32* Indices = 0;
-        if(PolylistElement)
+        u32 IndicesCount = Primitive->Count * 3 * Data.AttributesCount;
+        if(Primitive == &Geometry->Polylist)
         {
             //Number of polygons, basically the number of elements in the vcount element text
-            u32 PolyCount = GetXmlAttributeValueAsU32(PolylistElement, Count_Keyword);
-            xml_element* VCountElement = FindXmlFirstChildByName(PolylistElement, VCount_Keyword);
-            u32* VCountArray = IntArrayElementToU32Array(VCountElement, PolyCount);
+            u32* VCountArray = ParseU32Array(Primitive->VCount, Primitive->Count);
             //Only support triangles
-            for(u32 Index = 0; Index < PolyCount; Index++)
+            for(u32 Index = 0; Index < Primitive->Count; Index++)
             {
                 Assert(VCountArray[Index] == 3);
             }
-            
-            xml_element* P = FindXmlFirstChildByName(PolylistElement, P_Keyword);
-            IndicesCount = PolyCount * 3 * Data.AttributesCount;
-            Indices = IntArrayElementToU32Array(P, IndicesCount);
-        }
-        else if(TrianglesElement)
-        {
-            u32 TrianglesCount = GetXmlAttributeValueAsU32(TrianglesElement, Count_Keyword);
-            xml_element* P = FindXmlFirstChildByName(TrianglesElement, P_Keyword);
-            IndicesCount = TrianglesCount * 3 * Data.AttributesCount;
-            Indices = IntArrayElementToU32Array(P, IndicesCount);
-        }
-        else
-        {
-            Assert(0);
+            Free(VCountArray);
         }
+        u32* Indices = ParseU32Array(Primitive->P, IndicesCount);
         
         if(Data.Joints && Data.Weights) {
             Assert(VertexWeightsCount == Data.PositionsCount);
         }
         collada_vertex_data VertexData = AssembleVerticesFromColladaLoadingData(&Data, Indices, IndicesCount);
+        Free(Indices);
         
         mesh_data Mesh = {};
         Mesh.Positions = VertexData.Positions;
@@ -871,9 +1001,9 @@ ReadColladaFromString(char* String)
         Mesh.Normals = VertexData.Normals;
         Mesh.Tangents = VertexData.Tangents;
         Mesh.UVs = VertexData.UVs;
-        Mesh.VerticesCount = (u32)SbufLen(VertexData.Positions);
+        Mesh.VerticesCount = VertexData.VerticesCount;
         Mesh.Indices = VertexData.Indices;
-        Mesh.IndicesCount = (u32)SbufLen(VertexData.Indices);
+        Mesh.IndicesCount = VertexData.IndicesCount;
         Mesh.RootJoint = MeshRootJoint;
         Mesh.JointsCount = JointsCount;
         Mesh.Animations = MeshAnimations;
@@ -886,24 +1016,31 @@ ReadColladaFromString(char* String)
         SbufPush(Result.Meshes, Mesh);
         FreeColladaLoadingData(&Data);
     }
+    For(GeometryIndex, SbufLen(Geometries))
+    {
+        FreeColladaGeometry(&Geometries[GeometryIndex]);
+    }
     SbufFree(Geometries);
+    FreeXmlFile(&Document);
     FreeLexer(&Lexer);
-    FreeXmlFile(&XmlFile);
+    GlobalColladaThreadPool = 0;
     
     Result.MeshesCount = (u32)SbufLen(Result.Meshes);
     return Result;
 }
 
+//Pool can be 0, otherwise big number arrays are parsed by all its threads
 internal collada_scene
-ReadColladaFromFile(char* Path)
+ReadColladaFromFile(char* Path, thread_pool* Pool = 0)
 {
-    char* FileString = (char*)ReadFileAsString(Path);
-    if(!FileString) {
+    //The lexer reads straight from the page cache, the view ends with a 0 sentinel
+    file_view View;
+    if(!MapFileAsString(Path, &View)) {
         return {};
     }
     
-    collada_scene Result = ReadColladaFromString(FileString);
-    FreeFileMemory(FileString);
+    collada_scene Result = ReadColladaFromString((char*)View.Data, Pool);
+    UnmapFile(&View);
     
     return Result;
 }
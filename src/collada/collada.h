@@ -24,17 +24,29 @@ struct collada_loading_data
     u32 AttributesCount;
 };
 
+//Indices of the attributes of a face corner, the ones the mesh doesn't have are 0
+struct collada_vertex_key
+{
+    u32 Position;
+    u32 Normal;
+    u32 UV;
+    u32 Tangent;
+};
+
+//Arrays are allocated with ZeroAlloc and owned by the mesh built from them
 struct collada_vertex_data
 {
-    _sbuf_ vec3* Positions;
-    _sbuf_ vec3* Normals;
-    _sbuf_ vec3* Tangents;
-    _sbuf_ vec2* UVs;
+    vec3* Positions;
+    vec3* Normals;
+    vec3* Tangents;
+    vec2* UVs;
     
-    _sbuf_ vec4* Weights;
-    _sbuf_ ivec4* Joints;
+    vec4* Weights;
+    ivec4* Joints;
+    u32 VerticesCount;
     
-    _sbuf_ u32* Indices;
+    u32* Indices;
+    u32 IndicesCount;
 };
 
 struct collada_joint_tree
@@ -54,6 +66,47 @@ struct collada_joint_tree
     u32 KeyframeCount;
 };
 
+//Mesh data read while streaming library_geometries. Ids are interned without the # and
+//arrays are ranges of the source that are only parsed when the mesh is assembled
+struct collada_source
+{
+    char* Id;
+    xml_text FloatArray;
+    u32 FloatArrayCount;
+    u32 ParamsCount; //Values per element in the accessor
+};
+
+struct collada_input
+{
+    char* Semantic;
+    char* Source;
+    u32 Offset;
+};
+
+struct collada_primitive
+{
+    _sbuf_ collada_input* Inputs;
+    u32 Count;
+    xml_text VCount;
+    xml_text P;
+};
+
+struct collada_geometry
+{
+    char* Id;
+    b32 HasMesh;
+    _sbuf_ collada_source* Sources;
+    
+    char* VerticesId;
+    _sbuf_ collada_input* VerticesInputs;
+    
+    //Only the first polylist or triangles of the mesh is used, polylist first
+    b32 HasPolylist;
+    b32 HasTriangles;
+    collada_primitive Polylist;
+    collada_primitive Triangles;
+};
+
 struct collada_scene
 {
     _sbuf_ mesh_data* Meshes;
@@ -67,6 +120,9 @@ struct joint_weight_pair
 };
 
 //Keywords (for now those are interned every time we read a file
+char* LibraryGeometries_Keyword = 0;
+char* LibraryControllers_Keyword = 0;
+char* Param_Keyword = 0;
 char* Geometry_Keyword = 0;
 char* Mesh_Keyword = 0;
 char* Polylist_Keyword = 0;
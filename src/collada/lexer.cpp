@@ -144,7 +144,9 @@ ScanString(lexer* Lexer) {
                 LexerError("Invalid string literal escape '\\%c'", *Lexer->Stream);
             }
         }
-        SbufPush(String, Val);
+        if (!(Lexer->Flags & LEXER_NO_STRING_COPY)) {
+            SbufPush(String, Val);
+        }
         Lexer->Stream++;
     }
     if (*Lexer->Stream) {
@@ -153,7 +155,9 @@ ScanString(lexer* Lexer) {
     } else {
         LexerError("Unexpected end of file within string literal");
     }
-    SbufPush(String, (char)0);
+    if (!(Lexer->Flags & LEXER_NO_STRING_COPY)) {
+        SbufPush(String, (char)0);
+    }
     Lexer->Token.Kind = TOKEN_STRING;
     Lexer->Token.StringVal = String;
 }
@@ -311,15 +315,17 @@ NextToken(lexer* Lexer)
             Lexer->Token.Kind = TOKEN_LTEQ;
             Lexer->Stream++;
         } else if(*Lexer->Stream == '!' && Lexer->Flags & LEXER_XML_COMMENTS) {
-            while(*Lexer->Stream)
+            //Comments are skipped like whitespace, they can contain '>' so they end at "-->"
+            char* CommentEnd = (strncmp(Lexer->Stream, "!--", 3) == 0) ? strstr(Lexer->Stream + 3, "-->") : 0;
+            if(CommentEnd)
             {
-                if(*Lexer->Stream == '>')
-                {
-                    Lexer->Stream++;
-                    break;
-                }
-                Lexer->Stream++;
+                Lexer->Stream = CommentEnd + 3;
             }
+            else
+            {
+                while(*Lexer->Stream && *Lexer->Stream++ != '>');
+            }
+            goto repeat;
         }
         break;
         
@@ -503,21 +509,6 @@ ParseInt(lexer* Lexer)
     return Result;
 }
 
-internal mat4
-ParseMat4RowMajor(lexer* Lexer)
-{
-    mat4 Result;
-    for(u32 Row = 0; Row < 4; Row++)
-    {
-        for(u32 Column = 0; Column < 4; Column++)
-        {
-            Result.e[Column][Row] = ParseFloatOrIntWithSign(Lexer);
-        }
-    }
-    
-    return Result;
-}
-
 internal void
 InitLexer(lexer* Lexer, char* Stream, u32 Flags = 0)
 {
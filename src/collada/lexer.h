@@ -95,6 +95,9 @@ typedef enum lexer_flags
     //If you use this flag the Name field is left null. Use Token.Start and Token.End if needed
     LEXER_NO_NAME_INTERNING = 64, 
     LEXER_XML_COMMENTS = 128,
+    //If you use this flag the StringVal field is left null and escapes are not processed.
+    //The string is between Token.Start + 1 and Token.End - 1
+    LEXER_NO_STRING_COPY = 256,
 } lexer_flags;
 
 typedef struct lexer {
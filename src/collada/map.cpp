@@ -29,8 +29,9 @@ u64 HashMix(u64 x, u64 y)
     return x;
 }
 
-u64 HashBytes(void *Bytes, size_t Length) {
-    u64 x = 0xcbf29ce484222325;
+//Seed is the result of a previous call to continue hashing
+u64 HashBytes(void *Bytes, size_t Length, u64 Seed = 0xcbf29ce484222325) {
+    u64 x = Seed;
     char *Buffer = (char *)Bytes;
     for (size_t Index = 0; Index < Length; Index++) {
         x ^= Buffer[Index];
@@ -0,0 +1,539 @@
+//Parsing of the whitespace separated number lists in float_array, p and vcount elements
+//without going through the lexer, directly from the source text. Token boundaries are found 16 bytes at a time and
+//floats are built from their decimal digits with a single exact double operation when
+//possible, with the Eisel-Lemire algorithm otherwise and with strtod for the numbers neither
+//handles. All paths give the correctly rounded double so the f32 results are the same as the lexer ones.
+
+//Loads are aligned so they never cross into the next page past the 0 terminator
+inline u32
+GetNumberBlockMask(char* Block, __m128i Limit)
+{
+    __m128i Bytes = _mm_load_si128((__m128i*)Block);
+    //Unsigned Bytes <= Limit
+    __m128i Less = _mm_cmpeq_epi8(_mm_max_epu8(Bytes, Limit), Limit);
+    return (u32)_mm_movemask_epi8(Less);
+}
+
+//First byte that is not a space, tab or newline (any byte from 1 to ' ')
+internal char*
+SkipNumberWhitespace(char* At)
+{
+    __m128i Space = _mm_set1_epi8(' ');
+    __m128i Zero = _mm_setzero_si128();
+    
+    char* Block = (char*)((uintptr_t)At & ~(uintptr_t)15);
+    u32 Offset = (u32)(At - Block);
+    for(;;)
+    {
+        u32 Whitespace = GetNumberBlockMask(Block, Space) & ~GetNumberBlockMask(Block, Zero);
+        u32 Stop = (~Whitespace & 0xFFFF) >> Offset;
+        if(Stop) return Block + Offset + FindLowestSetBit(Stop);
+        
+        Block += 16;
+        Offset = 0;
+    }
+}
+
+//First byte that is not whitespace or part of a comment. The text of an element goes on past
+//the comments in it, which only stop the scan of a token since they start with '<'
+internal char*
+SkipNumberSeparators(char* At)
+{
+    At = SkipNumberWhitespace(At);
+    while(At[0] == '<' && At[1] == '!' && At[2] == '-' && At[3] == '-')
+    {
+        char* CommentEnd = strstr(At + 4, "-->");
+        if(!CommentEnd) return At + strlen(At);
+        At = SkipNumberWhitespace(CommentEnd + 3);
+    }
+    return At;
+}
+
+//First whitespace, 0 or '<' byte after the token at At, arrays can be parsed in place
+//up to the tag that closes them
+internal char*
+FindNumberEnd(char* At)
+{
+    __m128i Space = _mm_set1_epi8(' ');
+    __m128i Tag = _mm_set1_epi8('<');
+    
+    char* Block = (char*)((uintptr_t)At & ~(uintptr_t)15);
+    u32 Offset = (u32)(At - Block);
+    for(;;)
+    {
+        __m128i Bytes = _mm_load_si128((__m128i*)Block);
+        u32 TagMask = (u32)_mm_movemask_epi8(_mm_cmpeq_epi8(Bytes, Tag));
+        u32 Stop = (GetNumberBlockMask(Block, Space) | TagMask) >> Offset;
+        if(Stop) return Block + Offset + FindLowestSetBit(Stop);
+        
+        Block += 16;
+        Offset = 0;
+    }
+}
+
+inline bool
+IsEightDigits(u64 Chars)
+{
+    return ((Chars & 0xF0F0F0F0F0F0F0F0) |
+            (((Chars + 0x0606060606060606) & 0xF0F0F0F0F0F0F0F0) >> 4)) == 0x3333333333333333;
+}
+
+//Value of 8 ascii digits loaded little endian, first digit in the lowest byte
+inline u32
+ParseEightDigits(u64 Chars)
+{
+    Chars = (Chars & 0x0F0F0F0F0F0F0F0F) * 2561 >> 8;
+    Chars = (Chars & 0x00FF00FF00FF00FF) * 6553601 >> 16;
+    return (u32)((Chars & 0x0000FFFF0000FFFF) * 42949672960001 >> 32);
+}
+
+//Appends the digits at At to Value, Overflow is set if it no longer fits in 19 digits
+internal char*
+ParseNumberDigits(char* At, char* End, u64* Value, bool* Overflow)
+{
+    u64 Result = *Value;
+    while(End - At >= 8 && Result < 100000000000ull)
+    {
+        u64 Chars;
+        memcpy(&Chars, At, 8);
+        if(!IsEightDigits(Chars)) break;
+        
+        Result = Result * 100000000 + ParseEightDigits(Chars);
+        At += 8;
+    }
+    
+    while(At < End && (u8)(*At - '0') < 10)
+    {
+        if(Result >= 1000000000000000000ull) *Overflow = true;
+        Result = Result * 10 + (*At - '0');
+        At++;
+    }
+    
+    *Value = Result;
+    return At;
+}
+
+global_variable f64 GlobalExactPowersOf10[] =
+{
+    1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+    1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22,
+};
+
+//Powers of 5 normalized to 128 bits, from 5^NUMBER_MIN_POWER_OF_10 to 5^NUMBER_MAX_POWER_OF_10. Only
+//the powers of 10 that can give a finite non zero f32 are covered, the others go to strtod
+#define NUMBER_MIN_POWER_OF_10 -64
+#define NUMBER_MAX_POWER_OF_10 38
+
+global_variable u64 GlobalPowersOf5[][2] =
+{
+    {0xA87FEA27A539E9A5, 0x3F2398D747B36224}, //-64
+    {0xD29FE4B18E88640E, 0x8EEC7F0D19A03AAD}, //-63
+    {0x83A3EEEEF9153E89, 0x1953CF68300424AC}, //-62
+    {0xA48CEAAAB75A8E2B, 0x5FA8C3423C052DD7}, //-61
+    {0xCDB02555653131B6, 0x3792F412CB06794D}, //-60
+    {0x808E17555F3EBF11, 0xE2BBD88BBEE40BD0}, //-59
+    {0xA0B19D2AB70E6ED6, 0x5B6ACEAEAE9D0EC4}, //-58
+    {0xC8DE047564D20A8B, 0xF245825A5A445275}, //-57
+    {0xFB158592BE068D2E, 0xEED6E2F0F0D56712}, //-56
+    {0x9CED737BB6C4183D, 0x55464DD69685606B}, //-55
+    {0xC428D05AA4751E4C, 0xAA97E14C3C26B886}, //-54
+    {0xF53304714D9265DF, 0xD53DD99F4B3066A8}, //-53
+    {0x993FE2C6D07B7FAB, 0xE546A8038EFE4029}, //-52
+    {0xBF8FDB78849A5F96, 0xDE98520472BDD033}, //-51
+    {0xEF73D256A5C0F77C, 0x963E66858F6D4440}, //-50
+    {0x95A8637627989AAD, 0xDDE7001379A44AA8}, //-49
+    {0xBB127C53B17EC159, 0x5560C018580D5D52}, //-48
+    {0xE9D71B689DDE71AF, 0xAAB8F01E6E10B4A6}, //-47
+    {0x9226712162AB070D, 0xCAB3961304CA70E8}, //-46
+    {0xB6B00D69BB55C8D1, 0x3D607B97C5FD0D22}, //-45
+    {0xE45C10C42A2B3B05, 0x8CB89A7DB77C506A}, //-44
+    {0x8EB98A7A9A5B04E3, 0x77F3608E92ADB242}, //-43
+    {0xB267ED1940F1C61C, 0x55F038B237591ED3}, //-42
+    {0xDF01E85F912E37A3, 0x6B6C46DEC52F6688}, //-41
+    {0x8B61313BBABCE2C6, 0x2323AC4B3B3DA015}, //-40
+    {0xAE397D8AA96C1B77, 0xABEC975E0A0D081A}, //-39
+    {0xD9C7DCED53C72255, 0x96E7BD358C904A21}, //-38
+    {0x881CEA14545C7575, 0x7E50D64177DA2E54}, //-37
+    {0xAA242499697392D2, 0xDDE50BD1D5D0B9E9}, //-36
+    {0xD4AD2DBFC3D07787, 0x955E4EC64B44E864}, //-35
+    {0x84EC3C97DA624AB4, 0xBD5AF13BEF0B113E}, //-34
+    {0xA6274BBDD0FADD61, 0xECB1AD8AEACDD58E}, //-33
+    {0xCFB11EAD453994BA, 0x67DE18EDA5814AF2}, //-32
+    {0x81CEB32C4B43FCF4, 0x80EACF948770CED7}, //-31
+    {0xA2425FF75E14FC31, 0xA1258379A94D028D}, //-30
+    {0xCAD2F7F5359A3B3E, 0x096EE45813A04330}, //-29
+    {0xFD87B5F28300CA0D, 0x8BCA9D6E188853FC}, //-28
+    {0x9E74D1B791E07E48, 0x775EA264CF55347E}, //-27
+    {0xC612062576589DDA, 0x95364AFE032A819E}, //-26
+    {0xF79687AED3EEC551, 0x3A83DDBD83F52205}, //-25
+    {0x9ABE14CD44753B52, 0xC4926A9672793543}, //-24
+    {0xC16D9A0095928A27, 0x75B7053C0F178294}, //-23
+    {0xF1C90080BAF72CB1, 0x5324C68B12DD6339}, //-22
+    {0x971DA05074DA7BEE, 0xD3F6FC16EBCA5E04}, //-21
+    {0xBCE5086492111AEA, 0x88F4BB1CA6BCF585}, //-20
+    {0xEC1E4A7DB69561A5, 0x2B31E9E3D06C32E6}, //-19
+    {0x9392EE8E921D5D07, 0x3AFF322E62439FD0}, //-18
+    {0xB877AA3236A4B449, 0x09BEFEB9FAD487C3}, //-17
+    {0xE69594BEC44DE15B, 0x4C2EBE687989A9B4}, //-16
+    {0x901D7CF73AB0ACD9, 0x0F9D37014BF60A11}, //-15
+    {0xB424DC35095CD80F, 0x538484C19EF38C95}, //-14
+    {0xE12E13424BB40E13, 0x2865A5F206B06FBA}, //-13
+    {0x8CBCCC096F5088CB, 0xF93F87B7442E45D4}, //-12
+    {0xAFEBFF0BCB24AAFE, 0xF78F69A51539D749}, //-11
+    {0xDBE6FECEBDEDD5BE, 0xB573440E5A884D1C}, //-10
+    {0x89705F4136B4A597, 0x31680A88F8953031}, //-9
+    {0xABCC77118461CEFC, 0xFDC20D2B36BA7C3E}, //-8
+    {0xD6BF94D5E57A42BC, 0x3D32907604691B4D}, //-7
+    {0x8637BD05AF6C69B5, 0xA63F9A49C2C1B110}, //-6
+    {0xA7C5AC471B478423, 0x0FCF80DC33721D54}, //-5
+    {0xD1B71758E219652B, 0xD3C36113404EA4A9}, //-4
+    {0x83126E978D4FDF3B, 0x645A1CAC083126EA}, //-3
+    {0xA3D70A3D70A3D70A, 0x3D70A3D70A3D70A4}, //-2
+    {0xCCCCCCCCCCCCCCCC, 0xCCCCCCCCCCCCCCCD}, //-1
+    {0x8000000000000000, 0x0000000000000000}, //0
+    {0xA000000000000000, 0x0000000000000000}, //1
+    {0xC800000000000000, 0x0000000000000000}, //2
+    {0xFA00000000000000, 0x0000000000000000}, //3
+    {0x9C40000000000000, 0x0000000000000000}, //4
+    {0xC350000000000000, 0x0000000000000000}, //5
+    {0xF424000000000000, 0x0000000000000000}, //6
+    {0x9896800000000000, 0x0000000000000000}, //7
+    {0xBEBC200000000000, 0x0000000000000000}, //8
+    {0xEE6B280000000000, 0x0000000000000000}, //9
+    {0x9502F90000000000, 0x0000000000000000}, //10
+    {0xBA43B74000000000, 0x0000000000000000}, //11
+    {0xE8D4A51000000000, 0x0000000000000000}, //12
+    {0x9184E72A00000000, 0x0000000000000000}, //13
+    {0xB5E620F480000000, 0x0000000000000000}, //14
+    {0xE35FA931A0000000, 0x0000000000000000}, //15
+    {0x8E1BC9BF04000000, 0x0000000000000000}, //16
+    {0xB1A2BC2EC5000000, 0x0000000000000000}, //17
+    {0xDE0B6B3A76400000, 0x0000000000000000}, //18
+    {0x8AC7230489E80000, 0x0000000000000000}, //19
+    {0xAD78EBC5AC620000, 0x0000000000000000}, //20
+    {0xD8D726B7177A8000, 0x0000000000000000}, //21
+    {0x878678326EAC9000, 0x0000000000000000}, //22
+    {0xA968163F0A57B400, 0x0000000000000000}, //23
+    {0xD3C21BCECCEDA100, 0x0000000000000000}, //24
+    {0x84595161401484A0, 0x0000000000000000}, //25
+    {0xA56FA5B99019A5C8, 0x0000000000000000}, //26
+    {0xCECB8F27F4200F3A, 0x0000000000000000}, //27
+    {0x813F3978F8940984, 0x4000000000000000}, //28
+    {0xA18F07D736B90BE5, 0x5000000000000000}, //29
+    {0xC9F2C9CD04674EDE, 0xA400000000000000}, //30
+    {0xFC6F7C4045812296, 0x4D00000000000000}, //31
+    {0x9DC5ADA82B70B59D, 0xF020000000000000}, //32
+    {0xC5371912364CE305, 0x6C28000000000000}, //33
+    {0xF684DF56C3E01BC6, 0xC732000000000000}, //34
+    {0x9A130B963A6C115C, 0x3C7F400000000000}, //35
+    {0xC097CE7BC90715B3, 0x4B9F100000000000}, //36
+    {0xF0BDC21ABB48DB20, 0x1E86D40000000000}, //37
+    {0x96769950B50D88F4, 0x1314448000000000}, //38
+};
+
+//Eisel-Lemire conversion of Mantissa * 10^Exponent (Lemire 2021, with the proof from Mushtak and
+//Lemire 2023 that the 128 bit product is always enough). Returns false if strtod is needed
+internal bool
+ComputeNumberEiselLemire(u64 Mantissa, s32 Exponent, bool Negative, f64* Value)
+{
+    if(Mantissa == 0)
+    {
+        *Value = Negative ? -0.0 : 0.0;
+        return true;
+    }
+    if(Exponent < NUMBER_MIN_POWER_OF_10 || Exponent > NUMBER_MAX_POWER_OF_10) return false;
+    
+    u32 LeadingZeros = CountLeadingZeros64(Mantissa);
+    Mantissa <<= LeadingZeros;
+    
+    //The low half of the power is only needed when the bits below the 55 we keep are all set
+    u64* Power = GlobalPowersOf5[Exponent - NUMBER_MIN_POWER_OF_10];
+    u64 High;
+    u64 Low = MultiplyU64(Mantissa, Power[0], &High);
+    if((High & 0x1FF) == 0x1FF)
+    {
+        u64 SecondHigh;
+        MultiplyU64(Mantissa, Power[1], &SecondHigh);
+        Low += SecondHigh;
+        if(SecondHigh > Low) High++;
+    }
+    
+    //floor(log2(10^Exponent)) + 63 with the power in the IEEE bias
+    u32 UpperBit = (u32)(High >> 63);
+    u32 Shift = UpperBit + 9;
+    u64 Result = High >> Shift;
+    s32 Power2 = (((152170 + 65536) * Exponent) >> 16) + 63 + (s32)UpperBit - (s32)LeadingZeros + 1023;
+    if(Power2 <= 0) return false;
+    
+    //Exactly halfway between two doubles, which can only happen for small powers: round to even
+    if(Low <= 1 && Exponent >= -4 && Exponent <= 23 && (Result & 3) == 1 && (Result << Shift) == High)
+    {
+        Result &= ~1ull;
+    }
+    
+    Result += Result & 1;
+    Result >>= 1;
+    if(Result >= (2ull << 52))
+    {
+        Result = 1ull << 52;
+        Power2++;
+    }
+    if(Power2 >= 0x7FF) return false;
+    
+    u64 Bits = (Result & ~(1ull << 52)) | ((u64)Power2 << 52) | ((u64)Negative << 63);
+    memcpy(Value, &Bits, sizeof(Bits));
+    return true;
+}
+
+//Decimal number with optional sign, fraction and exponent filling [Begin, End)
+internal bool
+ParseNumberToken(char* Begin, char* End, f64* Value)
+{
+    char* At = Begin;
+    bool Negative = (*At == '-');
+    if(*At == '-' || *At == '+') At++;
+    
+    u64 Mantissa = 0;
+    bool Overflow = false;
+    char* IntegerBegin = At;
+    At = ParseNumberDigits(At, End, &Mantissa, &Overflow);
+    u32 DigitsCount = (u32)(At - IntegerBegin);
+    
+    s32 Exponent = 0;
+    if(At < End && *At == '.')
+    {
+        At++;
+        char* FractionBegin = At;
+        At = ParseNumberDigits(At, End, &Mantissa, &Overflow);
+        Exponent = -(s32)(At - FractionBegin);
+        DigitsCount += (u32)(At - FractionBegin);
+    }
+    if(DigitsCount == 0) return false;
+    
+    if(At < End && (*At == 'e' || *At == 'E'))
+    {
+        At++;
+        bool NegativeExponent = (*At == '-');
+        if(*At == '-' || *At == '+') At++;
+        if(At == End || (u8)(*At - '0') >= 10) return false;
+        
+        s32 ExplicitExponent = 0;
+        for(; At < End && (u8)(*At - '0') < 10; At++)
+        {
+            if(ExplicitExponent < 100000) ExplicitExponent = ExplicitExponent * 10 + (*At - '0');
+        }
+        Exponent += NegativeExponent ? -ExplicitExponent : ExplicitExponent;
+    }
+    if(At != End) return false;
+    
+    //Mantissa and power of 10 are both exact doubles so one operation rounds correctly
+    if(!Overflow && Mantissa <= (1ull << 53) && Exponent >= -22 && Exponent <= 22)
+    {
+        f64 Result = (f64)Mantissa;
+        if(Exponent < 0) Result /= GlobalExactPowersOf10[-Exponent];
+        else Result *= GlobalExactPowersOf10[Exponent];
+        
+        *Value = Negative ? -Result : Result;
+    }
+    else if(Overflow || !ComputeNumberEiselLemire(Mantissa, Exponent, Negative, Value))
+    {
+        //More than 19 digits or out of the f32 range, strtod stops at the delimiter after the token
+        *Value = strtod(Begin, 0);
+    }
+    
+    return true;
+}
+
+internal void
+NumberArrayError(char* Begin, char* End)
+{
+    printf("Invalid number '%.*s' in number array\n", (int)(End - Begin), Begin);
+    Assert(0);
+}
+
+enum number_array_type
+{
+    NUMBER_ARRAY_F32,
+    NUMBER_ARRAY_U32,
+};
+
+#define NUMBER_RANGE_INVALID ((u32)-1)
+
+//Parses the numbers starting in [At, End) to Result and returns how many there are, End must be
+//at a delimiter. Returns NUMBER_RANGE_INVALID if a number is invalid or there are more than MaxCount
+internal u32
+ParseNumberRange(number_array_type Type, char* At, char* End, void* Result, u32 MaxCount)
+{
+    At = SkipNumberSeparators(At);
+    u32 Index = 0;
+    while(At < End)
+    {
+        if(Index == MaxCount) return NUMBER_RANGE_INVALID;
+        
+        char* TokenEnd = FindNumberEnd(At);
+        if(Type == NUMBER_ARRAY_F32)
+        {
+            f64 Value;
+            if(!ParseNumberToken(At, TokenEnd, &Value))
+            {
+                NumberArrayError(At, TokenEnd);
+                return NUMBER_RANGE_INVALID;
+            }
+            ((f32*)Result)[Index++] = (f32)Value;
+        }
+        else
+        {
+            u64 Value = 0;
+            bool Overflow = false;
+            char* DigitsEnd = ParseNumberDigits(At, TokenEnd, &Value, &Overflow);
+            if(DigitsEnd == At || DigitsEnd != TokenEnd || Overflow || Value > 0xFFFFFFFF)
+            {
+                NumberArrayError(At, TokenEnd);
+                return NUMBER_RANGE_INVALID;
+            }
+            ((u32*)Result)[Index++] = (u32)Value;
+        }
+        At = SkipNumberSeparators(TokenEnd);
+    }
+    
+    return Index;
+}
+
+//Number of tokens starting in [At, End), End must be at a delimiter
+internal u32
+CountNumbersInRange(char* At, char* End)
+{
+    u32 Count = 0;
+    At = SkipNumberSeparators(At);
+    while(At < End)
+    {
+        //Tokens are at least one byte, a stray '<' must not stop the count
+        Count++;
+        At = SkipNumberSeparators(FindNumberEnd(At + 1));
+    }
+    return Count;
+}
+
+//Big arrays are split in chunks at whitespace, the numbers of each chunk are counted in a
+//first pass so that the second one knows where each chunk writes its values
+enum number_array_pass
+{
+    NUMBER_ARRAY_PASS_COUNT,
+    NUMBER_ARRAY_PASS_PARSE,
+};
+
+struct number_array_job
+{
+    number_array_pass Pass;
+    number_array_type Type;
+    void* Result;
+    
+    //ChunksCount + 1 boundaries
+    char** ChunkBegins;
+    u32* ChunkCounts;
+    u32* ChunkOffsets;
+    u32 ChunksCount;
+    
+    volatile u32 NextChunk;
+    volatile u32 Failed;
+};
+
+THREAD_PROC(NumberArrayJobProc)
+{
+    number_array_job* Job = (number_array_job*)Data;
+    u32 ValueSize = (Job->Type == NUMBER_ARRAY_F32) ? sizeof(f32) : sizeof(u32);
+    
+    while(true)
+    {
+        u32 Chunk = InterlockedIncrement(&Job->NextChunk) - 1;
+        if(Chunk >= Job->ChunksCount) break;
+        
+        char* Begin = Job->ChunkBegins[Chunk];
+        char* End = Job->ChunkBegins[Chunk + 1];
+        
+        switch(Job->Pass)
+        {
+            case NUMBER_ARRAY_PASS_COUNT: {
+                Job->ChunkCounts[Chunk] = CountNumbersInRange(Begin, End);
+            } break;
+            
+            case NUMBER_ARRAY_PASS_PARSE: {
+                void* Result = (u8*)Job->Result + (u64)Job->ChunkOffsets[Chunk] * ValueSize;
+                u32 Count = Job->ChunkCounts[Chunk];
+                if(ParseNumberRange(Job->Type, Begin, End, Result, Count) != Count)
+                {
+                    Job->Failed = true;
+                }
+            } break;
+            
+            default: InvalidCodePath;
+        }
+    }
+    
+    return 0;
+}
+
+internal void
+RunNumberArrayPass(thread_pool* Pool, number_array_job* Job, number_array_pass Pass)
+{
+    Job->Pass = Pass;
+    Job->NextChunk = 0;
+    StartThreadPoolJob(Pool, NumberArrayJobProc, Job);
+    NumberArrayJobProc(Job);
+    WaitThreadPoolJob(Pool);
+}
+
+//Returns true if Text holds exactly Count numbers. Arrays bigger than COLLADA_PARALLEL_PARSE_MIN_BYTES
+//are parsed by all the threads of Pool, which can be 0
+internal bool
+ParseNumberArray(number_array_type Type, xml_text Text, void* Result, u32 Count, thread_pool* Pool)
+{
+    if(!Text.Begin) return Count == 0;
+    
+    //Chunk boundaries could fall inside a comment, the rare arrays with comments are parsed serially
+    u64 Length = Text.End - Text.Begin;
+    if(!Pool || Pool->ThreadsCount == 0 || Length < COLLADA_PARALLEL_PARSE_MIN_BYTES ||
+       memchr(Text.Begin, '<', Length))
+    {
+        return ParseNumberRange(Type, Text.Begin, Text.End, Result, Count) == Count;
+    }
+    
+    number_array_job Job = {};
+    Job.Type = Type;
+    Job.Result = Result;
+    Job.ChunksCount = (u32)MIN((Pool->ThreadsCount + 1) * COLLADA_PARSE_CHUNKS_PER_THREAD,
+                               Length / (COLLADA_PARALLEL_PARSE_MIN_BYTES / COLLADA_PARSE_CHUNKS_PER_THREAD));
+    Job.ChunkBegins = (char**)ZeroAlloc(sizeof(char*) * (Job.ChunksCount + 1));
+    Job.ChunkCounts = (u32*)ZeroAlloc(sizeof(u32) * Job.ChunksCount);
+    Job.ChunkOffsets = (u32*)ZeroAlloc(sizeof(u32) * Job.ChunksCount);
+    
+    //Boundaries are moved forward to the end of the token they fall in
+    Job.ChunkBegins[0] = Text.Begin;
+    for(u32 Chunk = 1; Chunk < Job.ChunksCount; Chunk++)
+    {
+        char* Begin = FindNumberEnd(Text.Begin + (Length * Chunk) / Job.ChunksCount);
+        Job.ChunkBegins[Chunk] = MAX(Begin, Job.ChunkBegins[Chunk - 1]);
+    }
+    Job.ChunkBegins[Job.ChunksCount] = Text.End;
+    
+    RunNumberArrayPass(Pool, &Job, NUMBER_ARRAY_PASS_COUNT);
+    
+    u64 TotalCount = 0;
+    For(Chunk, Job.ChunksCount)
+    {
+        Job.ChunkOffsets[Chunk] = (u32)TotalCount;
+        TotalCount += Job.ChunkCounts[Chunk];
+    }
+    
+    bool Success = (TotalCount == Count);
+    if(Success)
+    {
+        RunNumberArrayPass(Pool, &Job, NUMBER_ARRAY_PASS_PARSE);
+        Success = !Job.Failed;
+    }
+    
+    Free(Job.ChunkBegins);
+    Free(Job.ChunkCounts);
+    Free(Job.ChunkOffsets);
+    return Success;
+}
@@ -53,7 +53,7 @@ InternString(intern_map* InternMap, char* String)
 internal void 
 TestStringIntern()
 {
-    intern_map InternMap = {0};
+    intern_map InternMap = {};
     
     char* Test = InternString(&InternMap, "Hello there");
     char* Test2 = InternString(&InternMap, "Hello there");
@@ -1,24 +1,24 @@
 #include "xml.h"
 
 internal xml_element*
-AllocXmlElement(char* Name, char* Namespace = 0, xml_attribute* Attributes = 0,
-                char* Text = 0, xml_element** Children = 0)
+AllocXmlElement(arena* Arena, char* Name, char* Namespace = 0)
 {
-    xml_element* Result = (xml_element*)ZeroAlloc(sizeof(xml_element));
+    xml_element* Result = (xml_element*)ArenaAlloc(Arena, sizeof(xml_element));
     Result->Name = Name;
     Result->Namespace = Namespace;
-    Result->Attributes = Attributes;
-    Result->Text = Text;
-    Result->Children = Children;
-    Result->ChildrenCount = SbufLen(Children);
     
     return Result;
 }
 
-internal xml_attribute*
-ParseXmlAttributes(lexer* Lexer)
+//Values are copied 0 terminated into Reader->AttributeChars, the pointers are set once all
+//are read because the buffer can move while growing
+internal void
+ParseXmlAttributes(xml_reader* Reader)
 {
-    _sbuf_ xml_attribute* Attributes = 0;
+    lexer* Lexer = Reader->Lexer;
+    SbufPopN(Reader->Attributes, SbufLen(Reader->Attributes));
+    SbufPopN(Reader->AttributeChars, SbufLen(Reader->AttributeChars));
+    
     while(IsToken(Lexer, TOKEN_NAME))
     {
         xml_attribute Item = {};
@@ -29,130 +29,278 @@ ParseXmlAttributes(lexer* Lexer)
             Item.Name = ParseName(Lexer);
         }
         ExpectToken(Lexer, TOKEN_ASSIGN);
-        Item.Value = Lexer->Token.StringVal;
+        
+        //Without string copies the token spans the quotes
+        char* ValueBegin = Lexer->Token.Start + 1;
+        u32 ValueLength = (u32)(Lexer->Token.End - 1 - ValueBegin);
         ExpectToken(Lexer, TOKEN_STRING);
         
-        SbufPush(Attributes, Item);
+        u64 Offset = SbufLen(Reader->AttributeChars);
+        SbufPushN(Reader->AttributeChars, ValueLength + 1);
+        memcpy(Reader->AttributeChars + Offset, ValueBegin, ValueLength);
+        Reader->AttributeChars[Offset + ValueLength] = 0;
+        Item.Value = (char*)Offset;
+        
+        SbufPush(Reader->Attributes, Item);
     }
     
-    return Attributes;
+    for(u32 Index = 0; Index < SbufLen(Reader->Attributes); Index++)
+    {
+        Reader->Attributes[Index].Value = Reader->AttributeChars + (u64)Reader->Attributes[Index].Value;
+    }
 }
 
-internal xml_element*
-ParseXmlElement(lexer* Lexer)
+//Expects an initialized lexer, flags should be LEXER_IGNORE_NEWLINES | LEXER_XML_COMMENTS
+//| LEXER_NO_STRING_COPY. Parses the <?xml ?> header, the elements are then read with ReadXmlEvent
+internal void
+InitXmlReader(xml_reader* Reader, lexer* Lexer)
+{
+    Assert(Lexer->Flags & LEXER_NO_STRING_COPY);
+    *Reader = {};
+    Reader->Lexer = Lexer;
+    
+    ExpectToken(Lexer, TOKEN_LT);
+    ExpectToken(Lexer, TOKEN_QUESTION);
+    Reader->HeaderName = ParseName(Lexer);
+    ParseXmlAttributes(Reader);
+    ExpectToken(Lexer, TOKEN_QUESTION);
+    ExpectToken(Lexer, TOKEN_GT);
+}
+
+internal void
+FreeXmlReader(xml_reader* Reader)
+{
+    SbufFree(Reader->Attributes);
+    SbufFree(Reader->AttributeChars);
+    SbufFree(Reader->ChildrenStack);
+    *Reader = {};
+}
+
+//Returns false at the end of the file. Text is not lexed or copied, the event points to
+//the source up to the next tag, comments included
+internal bool
+ReadXmlEvent(xml_reader* Reader, xml_event* Event)
 {
-    char* Name = ParseName(Lexer);
-    char* Namespace = 0;
+    lexer* Lexer = Reader->Lexer;
+    *Event = {};
+    SbufPopN(Reader->Attributes, SbufLen(Reader->Attributes));
+    
+    if(Reader->SelfClosedName)
+    {
+        Event->Kind = XML_EVENT_CLOSE;
+        Event->Name = Reader->SelfClosedName;
+        Reader->SelfClosedName = 0;
+        Reader->Depth--;
+        return true;
+    }
+    
+    if(IsToken(Lexer, TOKEN_EOF))
+    {
+        Assert(Reader->Depth == 0);
+        Event->Kind = XML_EVENT_END;
+        return false;
+    }
+    
+    if(!IsToken(Lexer, TOKEN_LT))
+    {
+        Event->Kind = XML_EVENT_TEXT;
+        //The lexer skips comments, so the text goes on past them up to the next tag
+        Event->Text.Begin = Lexer->Token.Start;
+        do
+        {
+            JumpToChar(Lexer, '<');
+        } while(!IsToken(Lexer, TOKEN_LT) && !IsToken(Lexer, TOKEN_EOF));
+        Event->Text.End = Lexer->Token.Start;
+        return true;
+    }
+    
+    ExpectToken(Lexer, TOKEN_LT);
+    b32 Closing = MatchToken(Lexer, TOKEN_DIV);
+    Event->Name = ParseName(Lexer);
     if(MatchToken(Lexer, TOKEN_COLON))
     {
-        Namespace = Name;
-        Name = ParseName(Lexer);
+        Event->Namespace = Event->Name;
+        Event->Name = ParseName(Lexer);
     }
     
-    xml_attribute* Attributes = ParseXmlAttributes(Lexer);
-    if(MatchToken(Lexer, TOKEN_DIV))
+    if(Closing)
     {
         ExpectToken(Lexer, TOKEN_GT);
-        xml_element* Element = AllocXmlElement(Name, Namespace, Attributes);
-        return Element;
+        Event->Kind = XML_EVENT_CLOSE;
+        Reader->Depth--;
+        return true;
     }
-    ExpectToken(Lexer, TOKEN_GT);
     
-    //while no element beginning
-    char* TextBegin = 0;
-    char* TextEnd = 0;
-    if(!IsToken(Lexer, TOKEN_LT))
+    ParseXmlAttributes(Reader);
+    if(MatchToken(Lexer, TOKEN_DIV))
     {
-        TextBegin = Lexer->Token.Start;
-        JumpToChar(Lexer, '<');
-        TextEnd = Lexer->Token.Start;
+        Reader->SelfClosedName = Event->Name;
     }
-    char* Text = 0;
-    if(TextBegin)
+    ExpectToken(Lexer, TOKEN_GT);
+    Event->Kind = XML_EVENT_OPEN;
+    Reader->Depth++;
+    
+    return true;
+}
+
+internal char*
+PushXmlString(arena* Arena, char* String)
+{
+    u64 Length = strlen(String);
+    char* Result = (char*)ArenaAlloc(Arena, Length + 1, 1);
+    memcpy(Result, String, Length + 1);
+    return Result;
+}
+
+//Copy the attributes of the last open event (or of the header) to the element
+internal void
+CopyXmlAttributes(xml_reader* Reader, arena* Arena, xml_element* Element)
+{
+    Element->AttributesCount = SbufLen(Reader->Attributes);
+    if(Element->AttributesCount == 0) return;
+    
+    Element->Attributes = (xml_attribute*)ArenaAlloc(Arena, sizeof(xml_attribute) * Element->AttributesCount);
+    For(Index, Element->AttributesCount)
     {
-        Text = (char*)ZeroAlloc(TextEnd - TextBegin + 1);
-        strncpy(Text, TextBegin, TextEnd - TextBegin);
+        Element->Attributes[Index] = Reader->Attributes[Index];
+        Element->Attributes[Index].Value = PushXmlString(Arena, Reader->Attributes[Index].Value);
     }
+}
+
+internal void
+SetXmlChildren(arena* Arena, xml_element* Element, xml_element** Children, u64 Count)
+{
+    Element->ChildrenCount = Count;
+    if(Count == 0) return;
     
-    _sbuf_ xml_element** Children = 0;
-    while(MatchToken(Lexer, TOKEN_LT))
+    Element->Children = (xml_element**)ArenaAlloc(Arena, sizeof(xml_element*) * Count);
+    memcpy(Element->Children, Children, sizeof(xml_element*) * Count);
+}
+
+//Name must be interned, the value is valid until the next event
+internal char*
+GetXmlEventAttribute(xml_reader* Reader, char* Name)
+{
+    for(u32 Index = 0; Index < SbufLen(Reader->Attributes); Index++)
     {
-        if(MatchToken(Lexer, TOKEN_DIV))
+        if(Reader->Attributes[Index].Name == Name)
         {
-            char* ClosingName = ParseName(Lexer);
-            ExpectToken(Lexer, TOKEN_GT);
-            Assert(ClosingName == Name);
-            break;
+            return Reader->Attributes[Index].Value;
         }
-        xml_element* Child = ParseXmlElement(Lexer);
-        SbufPush(Children, Child);
     }
     
-    xml_element* Element = AllocXmlElement(Name, Namespace, Attributes, Text, Children);
-    return Element;
+    return 0;
+}
+
+internal u32
+GetXmlEventAttributeAsU32(xml_reader* Reader, char* Name)
+{
+    char* Value = GetXmlEventAttribute(Reader, Name);
+    return Value ? strtoul(Value, 0, 10) : 0;
 }
 
+//Read the rest of the element of the last open event up to its close
 internal void
-SetParentToXmlTree(xml_element* Element, xml_element* Parent)
+SkipXmlElement(xml_reader* Reader)
 {
-    Element->Parent = Parent;
-    for(u32 Index = 0; Index < SbufLen(Element->Children); Index++)
+    u32 Depth = Reader->Depth;
+    xml_event Event;
+    while(ReadXmlEvent(Reader, &Event))
     {
-        SetParentToXmlTree(Element->Children[Index], Element);
+        if(Event.Kind == XML_EVENT_CLOSE && Reader->Depth < Depth) break;
     }
 }
 
-//Expects an initialized lexer, flags should be LEXER_IGNORE_NEWLINES | LEXER_XML_COMMENTS
-internal xml_file
-ParseXmlFile(lexer* Lexer)
+//First text of the element of the last open event, its children are skipped
+internal xml_text
+ReadXmlElementText(xml_reader* Reader)
 {
-    ExpectToken(Lexer, TOKEN_LT);
-    ExpectToken(Lexer, TOKEN_QUESTION);
-    char* HeaderName = ParseName(Lexer);
-    xml_attribute* HeaderAttributes = ParseXmlAttributes(Lexer);
-    ExpectToken(Lexer, TOKEN_QUESTION);
-    ExpectToken(Lexer, TOKEN_GT);
-    
-    xml_element* Header = AllocXmlElement(HeaderName, 0, HeaderAttributes);
-    
-    //We parse the elements starting from the token after the opening angled bracket
-    ExpectToken(Lexer, TOKEN_LT);
-    xml_element* Root = ParseXmlElement(Lexer);
-    SetParentToXmlTree(Root, 0);
-    
-    xml_file Result = {};
-    Result.Header = Header;
-    Result.Root = Root;
+    xml_text Result = {};
+    u32 Depth = Reader->Depth;
+    xml_event Event;
+    while(ReadXmlEvent(Reader, &Event))
+    {
+        if(Event.Kind == XML_EVENT_TEXT && Reader->Depth == Depth && !Result.Begin)
+        {
+            Result = Event.Text;
+        }
+        if(Event.Kind == XML_EVENT_CLOSE && Reader->Depth < Depth) break;
+    }
     
     return Result;
 }
 
-internal void
-FreeXmlElement(xml_element* Element)
+//Build the element of the last open event and its subtree in Arena, the children are
+//gathered on the reader stack and copied once the element is closed
+internal xml_element*
+ReadXmlElementTree(xml_reader* Reader, xml_event* Open, xml_element* Parent, arena* Arena)
 {
-    for(u32 Index = 0; Index < SbufLen(Element->Children); Index++)
+    xml_element* Element = AllocXmlElement(Arena, Open->Name, Open->Namespace);
+    CopyXmlAttributes(Reader, Arena, Element);
+    Element->Parent = Parent;
+    
+    u64 FirstChild = SbufLen(Reader->ChildrenStack);
+    xml_event Event;
+    while(ReadXmlEvent(Reader, &Event) && Event.Kind != XML_EVENT_CLOSE)
     {
-        FreeXmlElement(Element->Children[Index]);
+        if(Event.Kind == XML_EVENT_OPEN)
+        {
+            xml_element* Child = ReadXmlElementTree(Reader, &Event, Element, Arena);
+            SbufPush(Reader->ChildrenStack, Child);
+        }
+        else if(Event.Kind == XML_EVENT_TEXT && !Element->Text.Begin)
+        {
+            Element->Text = Event.Text;
+        }
     }
+    Assert(Event.Kind == XML_EVENT_CLOSE && Event.Name == Element->Name);
     
-    for(u32 Index = 0; Index < SbufLen(Element->Attributes); Index++)
+    u64 ChildrenCount = SbufLen(Reader->ChildrenStack) - FirstChild;
+    SetXmlChildren(Arena, Element, Reader->ChildrenStack + FirstChild, ChildrenCount);
+    SbufPopN(Reader->ChildrenStack, ChildrenCount);
+    
+    return Element;
+}
+
+//Expects an initialized lexer, flags should be LEXER_IGNORE_NEWLINES | LEXER_XML_COMMENTS
+//| LEXER_NO_STRING_COPY. The text of the elements points into the lexer source
+internal xml_file
+ParseXmlFile(lexer* Lexer)
+{
+    xml_reader Reader;
+    InitXmlReader(&Reader, Lexer);
+    
+    xml_file Result = {};
+    Result.Header = AllocXmlElement(&Result.Arena, Reader.HeaderName);
+    CopyXmlAttributes(&Reader, &Result.Arena, Result.Header);
+    
+    xml_event Event;
+    if(ReadXmlEvent(&Reader, &Event) && Event.Kind == XML_EVENT_OPEN)
     {
-        SbufFree(Element->Attributes[Index].Value);
+        Result.Root = ReadXmlElementTree(&Reader, &Event, 0, &Result.Arena);
     }
-    SbufFree(Element->Attributes);
-    SbufFree(Element->Children);
-    Free(Element->Text);
+    FreeXmlReader(&Reader);
+    
+    return Result;
 }
 
 internal void
 FreeXmlFile(xml_file* XmlFile)
 {
-    FreeXmlElement(XmlFile->Header);
-    FreeXmlElement(XmlFile->Root);
-    
+    FreeArena(&XmlFile->Arena);
     *XmlFile = {};
 }
 
+//0 terminated copy of a text, to be freed by the caller
+internal char*
+XmlTextToString(xml_text Text)
+{
+    u64 Length = Text.End - Text.Begin;
+    char* Result = (char*)ZeroAlloc(Length + 1);
+    memcpy(Result, Text.Begin, Length);
+    return Result;
+}
+
 internal void
 PrintIndentation(u32 Indentation)
 {
@@ -175,7 +323,7 @@ PrintXmlElement(xml_element* Element, u32 Indentation)
     
     printf("%s", Element->Name);
     
-    for(u32 Index = 0; Index < SbufLen(Element->Attributes); Index++)
+    for(u32 Index = 0; Index < Element->AttributesCount; Index++)
     {
         printf(" %s=\"%s\"", Element->Attributes[Index].Name, Element->Attributes[Index].Value);
     }
@@ -183,23 +331,23 @@ PrintXmlElement(xml_element* Element, u32 Indentation)
     printf(">");
     Indentation++;
     
-    if(Element->Text)
+    if(Element->Text.Begin)
     {
-        printf("%s", Element->Text);
+        printf("%.*s", (int)(Element->Text.End - Element->Text.Begin), Element->Text.Begin);
     }
     
-    if(Element->Children)
+    if(Element->ChildrenCount)
     {
         printf("\n");
     }
     
-    for(u32 Index = 0; Index < SbufLen(Element->Children); Index++)
+    for(u32 Index = 0; Index < Element->ChildrenCount; Index++)
     {
         PrintXmlElement(Element->Children[Index], Indentation);
     }
     
     Indentation--;
-    if(Element->Children)
+    if(Element->ChildrenCount)
     {
         PrintIndentation(Indentation);
     }
@@ -215,7 +363,7 @@ FindXmlFirstChildByNameRec(xml_element* Element, char* Name)
     if(Element->Name == Name)
         return Element;
     
-    for(u32 Index = 0; Index < SbufLen(Element->Children); Index++)
+    for(u32 Index = 0; Index < Element->ChildrenCount; Index++)
     {
         xml_element* Result = FindXmlFirstChildByNameRec(Element->Children[Index], Name);
         if(Result) return Result;
@@ -227,7 +375,7 @@ FindXmlFirstChildByNameRec(xml_element* Element, char* Name)
 internal xml_element*
 FindXmlFirstChildByName(xml_element* Element, char* Name)
 {
-    for(u32 Index = 0; Index < SbufLen(Element->Children); Index++)
+    for(u32 Index = 0; Index < Element->ChildrenCount; Index++)
     {
         xml_element* Result = FindXmlFirstChildByNameRec(Element->Children[Index], Name);
         if(Result) return Result;
@@ -241,7 +389,7 @@ FindXmlFirstChildByName(xml_element* Element, char* Name)
 internal xml_element*
 FindXmlFirstChildByAttributeRec(xml_element* Element, char* Name, char* Value)
 {
-    for(u32 Index = 0; Index < SbufLen(Element->Attributes); Index++)
+    for(u32 Index = 0; Index < Element->AttributesCount; Index++)
     {
         if(Element->Attributes[Index].Name == Name &&
            strcmp(Element->Attributes[Index].Value, Value) == 0)
@@ -250,7 +398,7 @@ FindXmlFirstChildByAttributeRec(xml_element* Element, char* Name, char* Value)
         }
     }
     
-    for(u32 Index = 0; Index < SbufLen(Element->Children); Index++)
+    for(u32 Index = 0; Index < Element->ChildrenCount; Index++)
     {
         xml_element* Result = FindXmlFirstChildByAttributeRec(Element->Children[Index], Name, Value);
         if(Result) return Result;
@@ -262,7 +410,7 @@ FindXmlFirstChildByAttributeRec(xml_element* Element, char* Name, char* Value)
 internal xml_element*
 FindXmlFirstChildByAttribute(xml_element* Element, char* Name, char* Value)
 {
-    for(u32 Index = 0; Index < SbufLen(Element->Children); Index++)
+    for(u32 Index = 0; Index < Element->ChildrenCount; Index++)
     {
         xml_element* Result = FindXmlFirstChildByAttributeRec(Element->Children[Index], Name, Value);
         if(Result) return Result;
@@ -271,23 +419,6 @@ FindXmlFirstChildByAttribute(xml_element* Element, char* Name, char* Value)
     return 0;
 }
 
-//Name must be interned
-internal _sbuf_ xml_element**
-FindAllDirectXmlChildrenByName(xml_element* Element, char* Name)
-{
-    _sbuf_ xml_element** Result = 0;
-    for(u32 Index = 0; Index < SbufLen(Element->Children); Index++)
-    {
-        xml_element* Child = Element->Children[Index];
-        if(Child->Name == Name)
-        {
-            SbufPush(Result, Child);
-        }
-    }
-    
-    return Result;
-}
-
 //ElementName and AttributeName must be interned, Value is not
 internal xml_element*
 FindXmlFirstChildByNameAndAttributeRec(xml_element* Element, char* ElementName, char* AttributeName,
@@ -295,7 +426,7 @@ FindXmlFirstChildByNameAndAttributeRec(xml_element* Element, char* ElementName,
 {
     if(Element->Name == ElementName)
     {
-        for(u32 Index = 0; Index < SbufLen(Element->Attributes); Index++)
+        for(u32 Index = 0; Index < Element->AttributesCount; Index++)
         {
             if(Element->Attributes[Index].Name == AttributeName &&
                strcmp(Element->Attributes[Index].Value, Value) == 0)
@@ -305,7 +436,7 @@ FindXmlFirstChildByNameAndAttributeRec(xml_element* Element, char* ElementName,
         }
     }
     
-    for(u32 Index = 0; Index < SbufLen(Element->Children); Index++)
+    for(u32 Index = 0; Index < Element->ChildrenCount; Index++)
     {
         xml_element* Result = FindXmlFirstChildByNameAndAttributeRec(Element->Children[Index], ElementName,
                                                                      AttributeName, Value);
@@ -320,7 +451,7 @@ internal xml_element*
 FindXmlFirstChildByNameAndAttribute(xml_element* Element, char* ElementName, char* AttributeName,
                                     char* Value)
 {
-    for(u32 Index = 0; Index < SbufLen(Element->Children); Index++)
+    for(u32 Index = 0; Index < Element->ChildrenCount; Index++)
     {
         xml_element* Result = FindXmlFirstChildByNameAndAttributeRec(Element->Children[Index], ElementName,
                                                                      AttributeName, Value);
@@ -334,7 +465,7 @@ FindXmlFirstChildByNameAndAttribute(xml_element* Element, char* ElementName, cha
 internal char*
 GetXmlAttributeValue(xml_element* Element, char* Name)
 {
-    for(u32 Index = 0; Index < SbufLen(Element->Attributes); Index++)
+    for(u32 Index = 0; Index < Element->AttributesCount; Index++)
     {
         if(Element->Attributes[Index].Name == Name)
         {
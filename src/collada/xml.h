@@ -2,25 +2,67 @@ struct xml_attribute
 {
     char* Namespace;
     char* Name;
-    _sbuf_ char* Value; //Sbuf because parsed as a string by the lexer
+    char* Value; //0 terminated copy, escapes are kept as in the source
 };
 
+//Text of an element as a range of the source, it is not 0 terminated
+struct xml_text
+{
+    char* Begin;
+    char* End;
+};
+
+//Everything but the text is allocated in the arena of its file
 struct xml_element
 {
     char* Name;
     char* Namespace;
-    _sbuf_ xml_attribute* Attributes;
+    xml_attribute* Attributes;
+    u64 AttributesCount;
     //@Cleanup We currently alow text only if there are no children,
     //or if they come after it
-    char* Text;
-    _sbuf_ xml_element** Children;
-    _sbuf_ xml_element* Parent;
+    xml_text Text; //Points into the source, which must outlive the file
+    xml_element** Children;
     u64 ChildrenCount;
+    xml_element* Parent;
 };
 
 struct xml_file
 {
+    arena Arena; //All the elements, freed at once
     xml_element* Header;
     xml_element* Root;
 };
 
+enum xml_event_kind
+{
+    XML_EVENT_OPEN,
+    XML_EVENT_TEXT,
+    XML_EVENT_CLOSE,
+    XML_EVENT_END,
+};
+
+struct xml_event
+{
+    xml_event_kind Kind;
+    char* Name;      //Open and close, interned
+    char* Namespace;
+    xml_text Text;   //Text only
+};
+
+//Streaming reader, events are pulled one at a time with ReadXmlEvent
+struct xml_reader
+{
+    lexer* Lexer;
+    char* HeaderName;
+    
+    //Attributes of the header after init, then of the last open event, overwritten by the next
+    //event. The buffers are reused so reading does not allocate once they are big enough
+    _sbuf_ xml_attribute* Attributes;
+    _sbuf_ char* AttributeChars;
+    //Children of the elements being built by ReadXmlElementTree
+    _sbuf_ xml_element** ChildrenStack;
+    //A self closing element still has to send its close event
+    char* SelfClosedName;
+    u32 Depth;
+};
@@ -17,20 +17,57 @@
 #define RAY_BOUNCES 8
 #define RAYS_PER_PIXEL 8
 #define MAX_RAYS_PER_PIXEL 4096
+#define RENDER_MODE RENDER_MODE_SINGLE
+#define RAY_PACKET_WIDTH 4
+#define WAVEFRONT_MAX_QUEUE_RAYS (1 << 14) //Rays traced together by a wavefront worker
 
 //PREPROCESSING
 #define MIN_TRIANGLES_PER_LEAF 10
 #define MIN_TRIANGLE_DIFFERENCE 3
+#define BVH_MAX_DEPTH 64
+#define BVH_BUILDER BVH_BUILDER_SAH
+#define SAH_BINS_COUNT 16
+#define MAX_SAH_BINS_COUNT 256
+#define SAH_TRAVERSAL_COST 1.0f
+#define SAH_TRIANGLE_COST 1.0f
+#define SAH_MAX_TRIANGLES_PER_LEAF 16
+#define LBVH_MORTON_BITS 30 //30 or 63, 63 avoids duplicate codes on big meshes but takes twice the sort passes
+#define LBVH_MAX_TRIANGLES_PER_LEAF 4
+#define SBVH_ALPHA 1e-5f //Min child overlap to try spatial splits, fraction of root area
+#define SBVH_MAX_DUPLICATION 0.3f //Max added references, fraction of triangles
+#define BVH_FORMAT BVH_FORMAT_FLAT
+#define BVH_LEAF_FORMAT BVH_LEAF_FORMAT_PACKET
+#define REORDER_MESH_VERTICES 1
+#define TLAS_MAX_OBJECTS_PER_LEAF 2
+#define BVH_BUILD_TASKS_PER_THREAD 16
+#define BVH_BUILD_TASK_MIN_TRIANGLES 1024
+#define BVH_PARALLEL_PARTITION_MIN_TRIANGLES 32768
+#define BVH_PARTITION_CHUNKS_COUNT 64
 #define PREPROCESSING_ONLY 0
-#define SCENE_DRAGONS 1
+
+//LOADING
+#define COLLADA_PARALLEL_PARSE_MIN_BYTES (1 << 20)
+#define COLLADA_PARSE_CHUNKS_PER_THREAD 8
+
+//SCENE
+#define SCENE SCENE_DRAGONS
+#define TERRAIN_RESOLUTION 384
 
 //MULTITHREADING
 #define NUMBER_OF_THREADS 8
+#define TILES_PER_THREAD 8
+#define MIN_TILE_SIZE 8
+#define MAX_TILE_SIZE 64
+#define SHARED_RAY_COUNTERS 0 //Atomic ray counters shared by all workers, to compare scaling
+
+//BENCHMARK
+#define BENCHMARK_SEED 1
 
 //DEBUG
 #define DEBUG_COLORS 0
 
 #include "defines.h"
+#include "simd.h"
 
 
 //Platform dependent code
@@ -50,9 +87,13 @@
 #include "sampler.cpp"
 #include "geometry.cpp"
 #include "bounding_volumes.cpp"
+#include "mesh_cache.cpp"
 #include "world.cpp"
 #include "ray.cpp"
+#include "wavefront.cpp"
 #include "tile_work.cpp"
+#include "scene.cpp"
+#include "benchmark.cpp"
 
 struct command_line_options
 {
@@ -62,7 +103,16 @@ struct command_line_options
     u32 RaysPerPixel;
     u32 RayBounces;
     u32 NumberOfThreads;
+    u32 FramesCount;
     bool PreprocessingOnly;
+    bool Benchmark;
+    bool ParseBenchmark;
+    bool XmlBenchmark;
+    bool SelfCheck;
+    bool NoMeshCache;
+    scene Scene;
+    render_mode RenderMode;
+    bvh_build_settings BVHSettings;
 };
 
 internal command_line_options
@@ -75,7 +125,20 @@ ParseCommandLineOptions(int argc, char** argv)
     Opt.RaysPerPixel = RAYS_PER_PIXEL;
     Opt.RayBounces = RAY_BOUNCES;
     Opt.NumberOfThreads = NUMBER_OF_THREADS;
+    Opt.FramesCount = 1;
     Opt.PreprocessingOnly = PREPROCESSING_ONLY;
+    Opt.Benchmark = false;
+    Opt.ParseBenchmark = false;
+    Opt.XmlBenchmark = false;
+    Opt.SelfCheck = false;
+    Opt.NoMeshCache = false;
+    Opt.Scene = SCENE;
+    Opt.RenderMode = RENDER_MODE;
+    Opt.BVHSettings.Builder = BVH_BUILDER;
+    Opt.BVHSettings.SAHBinsCount = SAH_BINS_COUNT;
+    Opt.BVHSettings.Format = BVH_FORMAT;
+    Opt.BVHSettings.LeafFormat = BVH_LEAF_FORMAT;
+    Opt.BVHSettings.ReorderVertices = REORDER_MESH_VERTICES;
     Opt.OutputFileName = 0;
         
     char* UseHMessage = ", use -h for help\n";
@@ -147,17 +210,190 @@ ParseCommandLineOptions(int argc, char** argv)
                     }
                 } break;
                 
+                case 'f': {
+                    if(argc - i <= 1) {
+                        printf("Expected number of frames after -f%s", UseHMessage);
+                        exit(1);
+                    }
+                    
+                    Opt.FramesCount = atoi(argv[++i]);
+                    if(Opt.FramesCount < 1)
+                    {
+                        printf("Number of frames must be integer bigger than zero");
+                        exit(1);
+                    }
+                } break;
+                
                 case 'p': {
                     Opt.PreprocessingOnly = true;
                 } break;
                 
+                case 'n': {
+                    Opt.NoMeshCache = true;
+                } break;
+                
+                case 'v': {
+                    Opt.BVHSettings.ReorderVertices = false;
+                } break;
+                
+                case 'x': {
+                    Opt.Benchmark = true;
+                } break;
+                
+                case 'y': {
+                    Opt.ParseBenchmark = true;
+                } break;
+                
+                case 'd': {
+                    Opt.XmlBenchmark = true;
+                } break;
+                
+                case 'c': {
+                    Opt.SelfCheck = true;
+                } break;
+                
+                case 'w': {
+                    if(argc - i <= 1) {
+                        printf("Expected scene after -w%s", UseHMessage);
+                        exit(1);
+                    }
+                    
+                    char* Name = argv[++i];
+                    u32 Scene = 0;
+                    for(; Scene < SCENE_COUNT; Scene++)
+                    {
+                        if(strcmp(Name, SceneNames[Scene]) == 0) break;
+                    }
+                    
+                    if(Scene == SCENE_COUNT)
+                    {
+                        printf("Invalid scene %s%s", Name, UseHMessage);
+                        exit(1);
+                    }
+                    Opt.Scene = (scene)Scene;
+                } break;
+                
+                case 'm': {
+                    if(argc - i <= 1) {
+                        printf("Expected render mode after -m%s", UseHMessage);
+                        exit(1);
+                    }
+                    
+                    char* Name = argv[++i];
+                    u32 Mode = 0;
+                    for(; Mode < RENDER_MODE_COUNT; Mode++)
+                    {
+                        if(strcmp(Name, RenderModeNames[Mode]) == 0) break;
+                    }
+                    
+                    if(Mode == RENDER_MODE_COUNT)
+                    {
+                        printf("Invalid render mode %s%s", Name, UseHMessage);
+                        exit(1);
+                    }
+                    Opt.RenderMode = (render_mode)Mode;
+                } break;
+                
+                case 'a': {
+                    if(argc - i <= 1) {
+                        printf("Expected bvh builder after -a%s", UseHMessage);
+                        exit(1);
+                    }
+                    
+                    char* Name = argv[++i];
+                    u32 Builder = 0;
+                    for(; Builder < BVH_BUILDER_COUNT; Builder++)
+                    {
+                        if(strcmp(Name, BVHBuilderNames[Builder]) == 0) break;
+                    }
+                    
+                    if(Builder == BVH_BUILDER_COUNT)
+                    {
+                        printf("Invalid bvh builder %s%s", Name, UseHMessage);
+                        exit(1);
+                    }
+                    Opt.BVHSettings.Builder = (bvh_builder)Builder;
+                } break;
+                
+                case 't': {
+                    if(argc - i <= 1) {
+                        printf("Expected bvh format after -t%s", UseHMessage);
+                        exit(1);
+                    }
+                    
+                    char* Name = argv[++i];
+                    u32 Format = 0;
+                    for(; Format < BVH_FORMAT_COUNT; Format++)
+                    {
+                        if(strcmp(Name, BVHFormatNames[Format]) == 0) break;
+                    }
+                    
+                    if(Format == BVH_FORMAT_COUNT)
+                    {
+                        printf("Invalid bvh format %s%s", Name, UseHMessage);
+                        exit(1);
+                    }
+                    Opt.BVHSettings.Format = (bvh_format)Format;
+                } break;
+                
+                case 'l': {
+                    if(argc - i <= 1) {
+                        printf("Expected bvh leaf format after -l%s", UseHMessage);
+                        exit(1);
+                    }
+                    
+                    char* Name = argv[++i];
+                    u32 LeafFormat = 0;
+                    for(; LeafFormat < BVH_LEAF_FORMAT_COUNT; LeafFormat++)
+                    {
+                        if(strcmp(Name, BVHLeafFormatNames[LeafFormat]) == 0) break;
+                    }
+                    
+                    if(LeafFormat == BVH_LEAF_FORMAT_COUNT)
+                    {
+                        printf("Invalid bvh leaf format %s%s", Name, UseHMessage);
+                        exit(1);
+                    }
+                    Opt.BVHSettings.LeafFormat = (bvh_leaf_format)LeafFormat;
+                } break;
+                
+                case 's': {
+                    if(argc - i <= 1) {
+                        printf("Expected number of sah bins after -s%s", UseHMessage);
+                        exit(1);
+                    }
+                    
+                    Opt.BVHSettings.SAHBinsCount = atoi(argv[++i]);
+                    if(Opt.BVHSettings.SAHBinsCount < 2 || Opt.BVHSettings.SAHBinsCount > MAX_SAH_BINS_COUNT)
+                    {
+                        printf("Number of sah bins must be integer between two and %u", MAX_SAH_BINS_COUNT);
+                        exit(1);
+                    }
+                } break;
+                
                 case 'h': {
                     printf("Usage: %s OUTPUT_FILE [OPTIONS]...\n", argv[0]);
                     printf("    -o WIDTH HEIGHT    specify output resolution\n");
                     printf("    -r RAYS            specify number of rays per pixel\n");
                     printf("    -b BOUNCES         specify number of bounces per ray\n");
                     printf("    -j THREADS         specify number of threads to use\n");
+                    printf("    -f FRAMES          render the image multiple times reusing the worker threads\n");
                     printf("    -p                 only do mesh preprocessing and print stats\n");
+                    printf("    -n                 don't load or write preprocessed mesh caches next to the assets\n");
+                    printf("    -w SCENE           specify scene to render (dragons, spheres, terrain)\n");
+                    printf("    -x                 benchmark all scenes over powers of two threads up to -j, resolutions\n");
+                    printf("                       up to -o and 1 or -r rays per pixel, write csv results to OUTPUT_FILE\n");
+                    printf("    -y                 benchmark the COLLADA number array parser against the lexer, with 1\n");
+                    printf("                       and -j threads, keep the fastest of -f runs and write csv results to OUTPUT_FILE\n");
+                    printf("    -d                 benchmark parsing the dragon asset into an xml tree, keep the fastest\n");
+                    printf("                       of -f runs and write csv results to OUTPUT_FILE\n");
+                    printf("    -c                 run the self checks of the ray intersection code and exit\n");
+                    printf("    -m MODE            specify render mode (single, packet, wavefront)\n");
+                    printf("    -a BUILDER         specify bvh builder (mean, sah, lbvh, sbvh)\n");
+                    printf("    -s BINS            specify number of bins used by the sah and sbvh builders\n");
+                    printf("    -t FORMAT          specify bvh format used for traversal (tree, flat, wide, quantized)\n");
+                    printf("    -l FORMAT          specify triangle layout of flat, wide and quantized leaves (indexed, packet, local)\n");
+                    printf("    -v                 keep mesh vertices in file order instead of bvh leaf order\n");
                     printf("    -h                 show this message\n");
                     exit(1);
                 } break;
@@ -180,7 +416,7 @@ ParseCommandLineOptions(int argc, char** argv)
         }
     }
     
-    if(!Opt.OutputFileName)
+    if(!Opt.OutputFileName && !Opt.SelfCheck)
     {
         printf("Must specify an output file path%s", UseHMessage);
         exit(1);
@@ -202,177 +438,119 @@ int main(int argc,char** argv)
     bool PreprocessingOnly = Opt.PreprocessingOnly;
     
     
-    //Prepare output image
-    image_data OutputImage = AllocateImage(OutputWidth, OutputHeight);
-    
-    
-    //Init scene
-    world World = AllocWorld(vec3(0.7f, 0.9f, 1.0f));
-        
-    char* DragonPath = "../res/dragon.dae";
-    collada_scene DragonScene = ReadColladaFromFile(DragonPath);
-    if(DragonScene.MeshesCount == 0) {
-        printf("Failed to load collada file at %s\n", DragonPath);
-        exit(1);
+    //Self checks exit on the first failure
+    if(Opt.SelfCheck)
+    {
+        CheckSignedZeroRays();
+        CheckWatertightPackets();
+        printf("Self checks passed\n");
+        return 0;
     }
-    mesh_data Dragon = DragonScene.Meshes[0];
-    mat4 ModelMatrix = Mat4Rotate(90.0f, vec3(1.0f, 0.0f, 0.0f));
-    //Transform to Z up
-    TransformMeshVertices(&Dragon, ModelMatrix);
     
-    PushMaterial(&World, vec3(0.5f, 0.5f, 0.5f), vec3(0.0f), 0.1f);
-    PushMaterial(&World, vec3(0.7f, 0.5f, 0.3f), vec3(0.0f), 0.3f);
-    PushMaterial(&World, vec3(0.3f, 0.6f, 0.9f), vec3(0.0f), 0.8f);
-    PushMaterial(&World, vec3(0.0f), vec3(0.9f, 0.0, 0.0f), 0.0f);
-    
-    //Dragons
-    PushMaterial(&World, vec3(1, 1, 1), vec3(0.0f), 1.0f);
-    PushMaterial(&World, vec3(0.3f, 0.6f, 0.9f), vec3(0.0f), 0.8f);
-    PushMaterial(&World, vec3(0.804f, 0.498f, 0.196f), vec3(0.0f), 0.9f);
-    
-    PushPlane(&World, vec3(0, 0, 1), 0.0f, 0);
-    PushSphere(&World, vec3(5.5, 7, 2.5), 2.5f, 4);
-    PushSphere(&World, vec3(-5.5, 7, 2.5), 2.5f, 4);
-    
-    PushMeshInfo(&World, &Dragon);
-    f32 DragonBigScale = 0.3f;
-    f32 DragonSmallScale = 0.20f;
-    PushMesh(&World, 0, vec3(-2.0f, 0.0f, 0.0f), Mat3Rotate(vec3(0.0f, 0.0f, 1.0f), 90.0f), vec3(DragonSmallScale), 5);
-    PushMesh(&World, 0, vec3(0.0f,  0.0f, 0.0f), Mat3Rotate(vec3(0.0f, 0.0f, 1.0f), 90.0f), vec3(DragonBigScale), 4);
-    PushMesh(&World, 0, vec3(2.0f,  0.0f, 0.0f), Mat3Rotate(vec3(0.0f, 0.0f, 1.0f), 90.0f), vec3(DragonSmallScale), 6);
+    //Run the benchmark sweep instead of a single render
+    if(Opt.Benchmark)
+    {
+        benchmark_settings Settings = {};
+        Settings.OutputWidth = OutputWidth;
+        Settings.OutputHeight = OutputHeight;
+        Settings.RaysPerPixel = RaysPerPixel;
+        Settings.RayBounces = RayBounces;
+        Settings.MaxThreads = NumberOfThreads;
+        Settings.FramesCount = Opt.FramesCount;
+        Settings.RenderMode = Opt.RenderMode;
+        Settings.BVHSettings = Opt.BVHSettings;
+        RunBenchmark(Opt.OutputFileName, &Settings);
+        return 0;
+    }
     
-    //Spheres
-    u32 FirstSphereMaterial = World.MaterialsCount;
-    PushMaterial(&World, vec3(1,1,1), vec3(0), 1.0f);
-    PushMaterial(&World, vec3(1,0,0), vec3(0), 0.1f);
-    PushMaterial(&World, vec3(0,1,0), vec3(0), 0.8f);
-    PushMaterial(&World, vec3(0,0,1), vec3(0), 0.2f);
+    if(Opt.ParseBenchmark)
+    {
+        RunNumberParseBenchmark(Opt.OutputFileName, Opt.FramesCount, NumberOfThreads);
+        return 0;
+    }
     
-    PushMaterial(&World, vec3(0.3f,0.2f,0.6f), vec3(0), 0.2f);
-    PushMaterial(&World, vec3(1.0f,0.2f,0.1f), vec3(0), 0.3f);
-    PushMaterial(&World, vec3(1.0f,0.6f,0.1f), vec3(0), 0.8f);
-    PushMaterial(&World, vec3(0.3f, 1, 0.8f), vec3(0), 0.6f);
+    if(Opt.XmlBenchmark)
+    {
+        RunXmlParseBenchmark(Opt.OutputFileName, Opt.FramesCount);
+        return 0;
+    }
     
-    u32 SphereMaterialsCount = World.MaterialsCount - FirstSphereMaterial;
+    //Prepare output image
+    image_data OutputImage = AllocateImage(OutputWidth, OutputHeight);
     
-    random_series ColSeries = RandSeries(324634);
-    random_series PosSeries = RandSeries(3634);
-    random_series SizeSeries = RandSeries(33);
     
-    u32 SpheresX = 15;
-    u32 SpheresY = 15;
+    //Worker threads are created once and reused for loading, preprocessing and every frame, the main thread also works
+    thread_pool ThreadPool;
+    CreateThreadPool(&ThreadPool, NumberOfThreads - 1);
     
-    f32 Center = 15;
-    f32 Range = 30;
-    For(y, SpheresY)
-    {
-        For(x, SpheresX)
-        {
-            f32 Radius = RandRange(&SizeSeries, 0.2f, 0.3f);
-            f32 Off = 0.5f;
-
-            vec3 Position;
-            Position.x = (f32)x / SpheresX * Range - Center + RandRange(&PosSeries, -Off, Off);
-            Position.y = (f32)y / SpheresY * Range - Center + RandRange(&PosSeries, -Off, Off);
-            Position.z = Radius;
-            
-            
-            u32 Material = RandU32(&ColSeries) % SphereMaterialsCount + FirstSphereMaterial;
-            
-            PushSphere(&World, Position, Radius, Material);
-        }
+    //Init scene
+    camera Camera;
+    world World;
+    if(!BuildScene(Opt.Scene, &Opt.BVHSettings, !Opt.NoMeshCache, &ThreadPool, &World, &Camera)) {
+        exit(1);
     }
     
-    
-    //Init camera
-    vec3 CameraP = vec3(0, -10, 1);
-    vec3 CameraZ = Normalize(vec3(0, 0, 1) - CameraP);
-    vec3 CameraX = Normalize(Cross(vec3(0, 0, 1), CameraZ));
-    vec3 CameraY = Normalize(Cross(CameraZ, CameraX));
-    
     //Preprocess meshes
-    PreprocessWorldMeshes(&World, PreprocessingOnly);
+    PreprocessWorldMeshes(&World, &Opt.BVHSettings, &ThreadPool, PreprocessingOnly);
+    BuildWorldTLAS(&World, PreprocessingOnly);
     if(PreprocessingOnly) {
+        DestroyThreadPool(&ThreadPool);
         return 0;
     }
     
-    //Compute tile ranges for workers
-    tile_work_array WorkArray = {};
-    
-    u32 TilesX = 16;
-    u32 TilesY = 16;
-    u32 TilesToDo = TilesX * TilesY;
-    u32 TileWidth = OutputWidth / TilesX;
-    u32 TileHeight = OutputHeight / TilesY;
-    u32 LastTileWidth = OutputWidth - TileWidth * (TilesX - 1);
-    u32 LastTileHeight = OutputHeight - TileHeight * (TilesY - 1);
-    
-    WorkArray.TotalEntries = TilesToDo;
-    WorkArray.Entries = (tile_work_entry*)ZeroAlloc(sizeof(tile_work_entry) * TilesToDo);
-    
-    For(y, TilesY)
+    f32 TotalSecondsElapsed = 0.0f;
+    s64 TotalRaysCasted = 0;
+    For(FrameIndex, Opt.FramesCount)
     {
-        u32 CurrHeight = y == TilesY - 1 ? LastTileHeight : TileHeight;
-        For(x, TilesX)
+        // Data common to all workers
+        tile_worker_thread_init Init = {};
+        Init.OutputWidth = OutputWidth;
+        Init.OutputHeight = OutputHeight;
+        Init.OutputImage = &OutputImage;
+        Init.RaysPerPixel = RaysPerPixel;
+        Init.RayBounces = RayBounces;
+        Init.RenderMode = Opt.RenderMode;
+        Init.World = &World;
+        Init.CameraP = Camera.P;
+        Init.CameraX = Camera.X;
+        Init.CameraY = Camera.Y;
+        Init.CameraZ = Camera.Z;
+        Init.PrintProgress = true;
+        
+        GetSamplePositions(Init.Samples, RaysPerPixel);
+        
+        frame_stats Stats = RenderTileWorkFrame(&ThreadPool, &Init);
+        printf("\rRay casting progress: 100%%");
+        
+        f32 SecondsElapsed = Stats.SecondsElapsed;
+        TotalSecondsElapsed += SecondsElapsed;
+        TotalRaysCasted += Stats.RaysCasted;
+        
+        //Print stats
+        printf("\n");
+        if(Opt.FramesCount > 1)
         {
-            u32 CurrWidth = x == TilesX - 1 ? LastTileWidth : TileWidth;
-            u32 TileIndex = y * TilesY + x;
-            WorkArray.Entries[TileIndex].x = x * TileWidth;
-            WorkArray.Entries[TileIndex].y = y * TileHeight;
-            WorkArray.Entries[TileIndex].CountX = CurrWidth;
-            WorkArray.Entries[TileIndex].CountY = CurrHeight;
-            WorkArray.Entries[TileIndex].RandomSeries.State = rand();
+            printf("Frame %u:\n", FrameIndex);
         }
+        printf("%u - %u Output size\n", OutputWidth, OutputHeight);
+        printf("%u Rays per pixel - %u Rays Bounces\n", RaysPerPixel, RayBounces);
+        printf("%s render mode\n", RenderModeNames[Opt.RenderMode]);
+        printf("%" PRIu64 "/%" PRIu64 "(%.3f %%) rays-triangle intersections passed\n", 
+                   Stats.TriangleTestsPassed, Stats.TriangleTestsTotal, 
+                   (f64)Stats.TriangleTestsPassed / (f64)Stats.TriangleTestsTotal);
+        printf("Casted %" PRIu64 " rays in %.3f seconds(%.3f MRays/s)\n", 
+                   Stats.RaysCasted, SecondsElapsed, Stats.RaysCasted / (SecondsElapsed * (1000 *1000)));
     }
     
-    // Data common to all workers
-    tile_worker_thread_init Init = {};
-    Init.WorkArray = &WorkArray;
-    Init.OutputWidth = OutputWidth;
-    Init.OutputHeight = OutputHeight;
-    Init.OutputImage = &OutputImage;
-    Init.RaysPerPixel = RaysPerPixel;
-    Init.RayBounces = RayBounces;
-    Init.World = &World;
-    Init.CameraP = CameraP;
-    Init.CameraX = CameraX;
-    Init.CameraY = CameraY;
-    Init.CameraZ = CameraZ;
-    Init.MainThreadId = GetCurrentThreadId();
-    
-    GetSamplePositions(Init.Samples, RaysPerPixel);
-    
-    //Create workers
-    timestamp BeginCounter = GetCurrentCounter();
-    u32 SecondaryThreadsCount = NumberOfThreads - 1;
-    For(i, SecondaryThreadsCount)
-    {
-        CreateWorkerThread(TileWorkerProc, &Init);
-    }
-    TileWorkerProc(&Init);
+    DestroyThreadPool(&ThreadPool);
     
-    //Wait for other workers to finish but keep printing stats
-    while(WorkArray.EntriesDone < WorkArray.TotalEntries)
+    if(Opt.FramesCount > 1)
     {
-        Sleep(1);
+        printf("Casted %" PRIu64 " rays in %u frames in %.3f seconds(%.3f MRays/s)\n",
+               TotalRaysCasted, Opt.FramesCount, TotalSecondsElapsed, TotalRaysCasted / (TotalSecondsElapsed * (1000 * 1000)));
     }
     
-    printf("\rRay casting progress: 100%%");
-
-    timestamp EndCounter = GetCurrentCounter();
-    f32 SecondsElapsed = GetSecondsElapsed(BeginCounter, EndCounter);
-    
-    //Print stats
-    printf("\n");
-    printf("%u - %u Output size\n", OutputWidth, OutputHeight);
-    printf("%u Rays per pixel - %u Rays Bounces\n", RaysPerPixel, RayBounces);
-    printf("%" PRIu64 "/%" PRIu64 "(%.3f %%) rays-triangle intersections passed\n", 
-               Init.TriangleTestsPassed, Init.TriangleTestsTotal, 
-               (f64)Init.TriangleTestsPassed / (f64)Init.TriangleTestsTotal);
-    printf("Casted %" PRIu64 " rays in %.3f seconds(%.3f MRays/s)\n", 
-               Init.RaysCasted, SecondsElapsed, Init.RaysCasted / (SecondsElapsed * (1000 *1000)));
-    
-    //Output result to file
+    //Output result of the last frame to file
     WriteImageToBMPFile(&OutputImage, Opt.OutputFileName);
     
     return 0;
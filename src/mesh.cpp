@@ -125,6 +125,83 @@ ComputeMeshTangents(mesh_data* Mesh)
                     Mesh->Indices, Mesh->IndicesCount, Mesh->Tangents);
 }
 
+//Size of a vertex in each of the mesh_data VertexData arrays
+global_variable u32 MeshVertexDataSizes[6] =
+{
+    sizeof(vec3),  //Positions
+    sizeof(vec3),  //Normals
+    sizeof(vec3),  //Tangents
+    sizeof(vec2),  //UVs
+    sizeof(vec4),  //Weights
+    sizeof(ivec4), //Joints
+};
+
+//Renumber the vertices in the order of their first use in the indices and move all their
+//attributes there. Run on the indices sorted by the bvh build the triangles of a leaf fetch
+//vertices that are next to each other instead of scattered over the arrays.
+//Vertices that no triangle uses are kept at the end
+internal void
+ReorderMeshVertices(mesh_data* Mesh)
+{
+    u32 VerticesCount = Mesh->VerticesCount;
+    if(VerticesCount == 0) return;
+    
+    u32* NewIndices = (u32*)ZeroAlloc(sizeof(u32) * VerticesCount * 2);
+    u32* OldIndices = NewIndices + VerticesCount;
+    memset(NewIndices, 0xFF, sizeof(u32) * VerticesCount);
+    
+    u32 Count = 0;
+    For(Index, Mesh->IndicesCount)
+    {
+        u32 Vertex = Mesh->Indices[Index];
+        Assert(Vertex < VerticesCount);
+        if(NewIndices[Vertex] == (u32)-1)
+        {
+            NewIndices[Vertex] = Count;
+            OldIndices[Count++] = Vertex;
+        }
+        Mesh->Indices[Index] = NewIndices[Vertex];
+    }
+    For(Vertex, VerticesCount)
+    {
+        if(NewIndices[Vertex] == (u32)-1)
+        {
+            NewIndices[Vertex] = Count;
+            OldIndices[Count++] = Vertex;
+        }
+    }
+    Assert(Count == VerticesCount);
+    
+    u8* Scratch = (u8*)ZeroAlloc(sizeof(ivec4) * VerticesCount);
+    For(ArrayIndex, ArrayCount(Mesh->VertexData))
+    {
+        u8* Array = (u8*)Mesh->VertexData[ArrayIndex];
+        if(!Array) continue;
+        
+        u32 Size = MeshVertexDataSizes[ArrayIndex];
+        For(Vertex, VerticesCount)
+        {
+            memcpy(Scratch + (u64)Vertex * Size, Array + (u64)OldIndices[Vertex] * Size, Size);
+        }
+        memcpy(Array, Scratch, (u64)Size * VerticesCount);
+    }
+    
+    Free(Scratch);
+    Free(NewIndices);
+}
+
+//Free the vertex arrays and the indices of a mesh, joints and animations are not freed
+internal void
+FreeMeshData(mesh_data* Mesh)
+{
+    For(ArrayIndex, ArrayCount(Mesh->VertexData))
+    {
+        Free(Mesh->VertexData[ArrayIndex]);
+    }
+    Free(Mesh->Indices);
+    *Mesh = {};
+}
+
 internal void
 TransformMeshVertices(mesh_data* Mesh, mat4& Transform)
 {
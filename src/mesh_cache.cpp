@@ -0,0 +1,233 @@
+#include "mesh_cache.h"
+
+inline u64
+HashU32(u64 Hash, u32 Value)
+{
+    return HashBytes(&Value, sizeof(Value), Hash);
+}
+
+//Key of the cache of a mesh loaded from an asset file and transformed by ModelMatrix,
+//returns 0 if the asset can't be read
+internal u64
+GetMeshCacheKey(char* AssetPath, mat4 ModelMatrix, bvh_build_settings* Settings)
+{
+    //The asset is identified by its size and modification time so that a cache hit doesn't read it.
+    //The cache is next to the asset so only the file name is used, the same asset reached through
+    //different relative paths shares the cache
+    u64 Size, ModifiedTime;
+    if(!GetFileStamp(AssetPath, &Size, &ModifiedTime)) return 0;
+    
+    char* FileName = AssetPath;
+    for(char* At = AssetPath; *At; At++)
+    {
+        if(*At == '/' || *At == '\\') FileName = At + 1;
+    }
+    u64 Hash = HashBytes(FileName, strlen(FileName));
+    Hash = HashBytes(&Size, sizeof(Size), Hash);
+    Hash = HashBytes(&ModifiedTime, sizeof(ModifiedTime), Hash);
+    
+    //Anything that changes the content or the layout of the cached data
+    Hash = HashBytes(&ModelMatrix, sizeof(ModelMatrix), Hash);
+    Hash = HashU32(Hash, MESH_CACHE_VERSION);
+    Hash = HashU32(Hash, Settings->Builder);
+    Hash = HashU32(Hash, Settings->SAHBinsCount);
+    Hash = HashU32(Hash, Settings->Format);
+    Hash = HashU32(Hash, Settings->LeafFormat);
+    Hash = HashU32(Hash, Settings->ReorderVertices);
+    Hash = HashU32(Hash, SIMD_WIDTH);
+    Hash = HashU32(Hash, sizeof(flat_bvh_node));
+    Hash = HashU32(Hash, sizeof(wide_bvh_node));
+    Hash = HashU32(Hash, sizeof(quantized_bvh_node));
+    Hash = HashU32(Hash, sizeof(triangle_packet));
+    Hash = HashU32(Hash, MIN_TRIANGLES_PER_LEAF);
+    Hash = HashU32(Hash, MIN_TRIANGLE_DIFFERENCE);
+    Hash = HashU32(Hash, BVH_MAX_DEPTH);
+    Hash = HashU32(Hash, SAH_MAX_TRIANGLES_PER_LEAF);
+    Hash = HashU32(Hash, LBVH_MORTON_BITS);
+    Hash = HashU32(Hash, LBVH_MAX_TRIANGLES_PER_LEAF);
+    Hash = HashU32(Hash, LOCAL_CLUSTER_MAX_VERTICES);
+    Hash = HashU32(Hash, LOCAL_CLUSTER_MAX_INDICES);
+    f32 Heuristics[4] = { SAH_TRAVERSAL_COST, SAH_TRIANGLE_COST, SBVH_ALPHA, SBVH_MAX_DUPLICATION };
+    Hash = HashBytes(Heuristics, sizeof(Heuristics), Hash);
+    
+    return Hash;
+}
+
+//Path of the cache next to the asset, Result must have space for the asset path and 32 more characters
+internal void
+GetMeshCachePath(char* Result, char* AssetPath, u64 Key)
+{
+    sprintf(Result, "%s.%016" PRIx64 ".cache", AssetPath, Key);
+}
+
+inline u64
+AlignMeshCacheOffset(u64 Offset)
+{
+    return (Offset + MESH_CACHE_ALIGNMENT - 1) & ~(u64)(MESH_CACHE_ALIGNMENT - 1);
+}
+
+//Map a cache file and point the mesh arrays inside it, fails if the file is missing,
+//was written by another version or doesn't match the key
+internal bool
+LoadMeshCache(char* Path, u64 Key, cached_mesh* Mesh)
+{
+    *Mesh = {};
+    file_view View;
+    if(!MapFile(Path, &View)) return false;
+    
+    mesh_cache_header* Header = (mesh_cache_header*)View.Data;
+    bool Valid = View.Size >= sizeof(mesh_cache_header) &&
+        Header->Magic == MESH_CACHE_MAGIC && Header->Version == MESH_CACHE_VERSION && Header->Key == Key;
+    
+    u64 ExpectedSizes[MESH_CACHE_SECTION_COUNT] = {};
+    if(Valid)
+    {
+        ExpectedSizes[MESH_CACHE_POSITIONS] = sizeof(vec3) * Header->VerticesCount;
+        ExpectedSizes[MESH_CACHE_INDICES] = sizeof(u32) * Header->IndicesCount;
+        ExpectedSizes[MESH_CACHE_FLAT_NODES] = sizeof(flat_bvh_node) * Header->FlatNodesCount;
+        ExpectedSizes[MESH_CACHE_WIDE_NODES] = sizeof(wide_bvh_node) * Header->WideNodesCount;
+        ExpectedSizes[MESH_CACHE_QUANTIZED_NODES] = sizeof(quantized_bvh_node) * Header->QuantizedNodesCount;
+        ExpectedSizes[MESH_CACHE_PACKETS] = sizeof(triangle_packet) * Header->PacketsCount;
+        ExpectedSizes[MESH_CACHE_LOCAL_LEAVES] = sizeof(u32) * Header->LocalWordsCount;
+        
+        //Normals and uvs are optional
+        ExpectedSizes[MESH_CACHE_NORMALS] = Header->SectionSizes[MESH_CACHE_NORMALS] ? sizeof(vec3) * Header->VerticesCount : 0;
+        ExpectedSizes[MESH_CACHE_UVS] = Header->SectionSizes[MESH_CACHE_UVS] ? sizeof(vec2) * Header->VerticesCount : 0;
+        
+        For(Section, MESH_CACHE_SECTION_COUNT)
+        {
+            u64 Offset = Header->SectionOffsets[Section];
+            u64 Size = Header->SectionSizes[Section];
+            if(Size != ExpectedSizes[Section] || Offset % MESH_CACHE_ALIGNMENT != 0 ||
+               Offset > View.Size || Size > View.Size - Offset)
+            {
+                Valid = false;
+            }
+        }
+    }
+    
+    if(!Valid)
+    {
+        UnmapFile(&View);
+        return false;
+    }
+    
+    u8* Base = (u8*)View.Data;
+    void* Sections[MESH_CACHE_SECTION_COUNT];
+    For(Section, MESH_CACHE_SECTION_COUNT)
+    {
+        Sections[Section] = Header->SectionSizes[Section] ? Base + Header->SectionOffsets[Section] : 0;
+    }
+    
+    Mesh->Data.Positions = (vec3*)Sections[MESH_CACHE_POSITIONS];
+    Mesh->Data.Normals = (vec3*)Sections[MESH_CACHE_NORMALS];
+    Mesh->Data.UVs = (vec2*)Sections[MESH_CACHE_UVS];
+    Mesh->Data.VerticesCount = Header->VerticesCount;
+    Mesh->Data.Indices = (u32*)Sections[MESH_CACHE_INDICES];
+    Mesh->Data.IndicesCount = Header->IndicesCount;
+    Mesh->TrianglesCount = Header->TrianglesCount;
+    Mesh->AABB = Header->AABB;
+    Mesh->FlatBVH.Nodes = (flat_bvh_node*)Sections[MESH_CACHE_FLAT_NODES];
+    Mesh->FlatBVH.NodesCount = Header->FlatNodesCount;
+    Mesh->WideBVH.Nodes = (wide_bvh_node*)Sections[MESH_CACHE_WIDE_NODES];
+    Mesh->WideBVH.NodesCount = Header->WideNodesCount;
+    Mesh->QuantizedBVH.Nodes = (quantized_bvh_node*)Sections[MESH_CACHE_QUANTIZED_NODES];
+    Mesh->QuantizedBVH.NodesCount = Header->QuantizedNodesCount;
+    Mesh->PackedTriangles.Packets = (triangle_packet*)Sections[MESH_CACHE_PACKETS];
+    Mesh->PackedTriangles.PacketsCount = Header->PacketsCount;
+    Mesh->LocalTriangles.Words = (u32*)Sections[MESH_CACHE_LOCAL_LEAVES];
+    Mesh->LocalTriangles.WordsCount = Header->LocalWordsCount;
+    Mesh->View = View;
+    
+    return true;
+}
+
+//Write the preprocessed mesh to a temporary file and move it to Path once complete,
+//so that a partially written cache is never loaded
+internal bool
+WriteMeshCache(char* Path, u64 Key, cached_mesh* Mesh, bvh_format Format, bvh_leaf_format LeafFormat)
+{
+    mesh_cache_header Header = {};
+    Header.Magic = MESH_CACHE_MAGIC;
+    Header.Version = MESH_CACHE_VERSION;
+    Header.Key = Key;
+    Header.VerticesCount = Mesh->Data.VerticesCount;
+    Header.IndicesCount = Mesh->Data.IndicesCount;
+    Header.TrianglesCount = Mesh->TrianglesCount;
+    Header.BVHFormat = Format;
+    Header.BVHLeafFormat = LeafFormat;
+    Header.FlatNodesCount = Mesh->FlatBVH.NodesCount;
+    Header.WideNodesCount = Mesh->WideBVH.NodesCount;
+    Header.QuantizedNodesCount = Mesh->QuantizedBVH.NodesCount;
+    Header.PacketsCount = Mesh->PackedTriangles.PacketsCount;
+    Header.LocalWordsCount = Mesh->LocalTriangles.WordsCount;
+    Header.AABB = Mesh->AABB;
+    
+    void* Sections[MESH_CACHE_SECTION_COUNT];
+    Sections[MESH_CACHE_POSITIONS] = Mesh->Data.Positions;
+    Sections[MESH_CACHE_NORMALS] = Mesh->Data.Normals;
+    Sections[MESH_CACHE_UVS] = Mesh->Data.UVs;
+    Sections[MESH_CACHE_INDICES] = Mesh->Data.Indices;
+    Sections[MESH_CACHE_FLAT_NODES] = Mesh->FlatBVH.Nodes;
+    Sections[MESH_CACHE_WIDE_NODES] = Mesh->WideBVH.Nodes;
+    Sections[MESH_CACHE_QUANTIZED_NODES] = Mesh->QuantizedBVH.Nodes;
+    Sections[MESH_CACHE_PACKETS] = Mesh->PackedTriangles.Packets;
+    Sections[MESH_CACHE_LOCAL_LEAVES] = Mesh->LocalTriangles.Words;
+    
+    Header.SectionSizes[MESH_CACHE_POSITIONS] = sizeof(vec3) * Header.VerticesCount;
+    Header.SectionSizes[MESH_CACHE_NORMALS] = Mesh->Data.Normals ? sizeof(vec3) * Header.VerticesCount : 0;
+    Header.SectionSizes[MESH_CACHE_UVS] = Mesh->Data.UVs ? sizeof(vec2) * Header.VerticesCount : 0;
+    Header.SectionSizes[MESH_CACHE_INDICES] = sizeof(u32) * Header.IndicesCount;
+    Header.SectionSizes[MESH_CACHE_FLAT_NODES] = sizeof(flat_bvh_node) * Header.FlatNodesCount;
+    Header.SectionSizes[MESH_CACHE_WIDE_NODES] = sizeof(wide_bvh_node) * Header.WideNodesCount;
+    Header.SectionSizes[MESH_CACHE_QUANTIZED_NODES] = sizeof(quantized_bvh_node) * Header.QuantizedNodesCount;
+    Header.SectionSizes[MESH_CACHE_PACKETS] = sizeof(triangle_packet) * Header.PacketsCount;
+    Header.SectionSizes[MESH_CACHE_LOCAL_LEAVES] = sizeof(u32) * Header.LocalWordsCount;
+    
+    u64 Offset = AlignMeshCacheOffset(sizeof(mesh_cache_header));
+    For(Section, MESH_CACHE_SECTION_COUNT)
+    {
+        Header.SectionOffsets[Section] = Offset;
+        Offset = AlignMeshCacheOffset(Offset + Header.SectionSizes[Section]);
+    }
+    
+    char TempPath[1024];
+    snprintf(TempPath, sizeof(TempPath), "%s.tmp", Path);
+    FILE* File = fopen(TempPath, "wb");
+    if(!File) return false;
+    
+    //Sections are written in order padding with zeros up to their offset
+    u8 Zeros[MESH_CACHE_ALIGNMENT] = {};
+    bool Success = fwrite(&Header, sizeof(Header), 1, File) == 1;
+    u64 Written = sizeof(Header);
+    For(Section, MESH_CACHE_SECTION_COUNT)
+    {
+        u64 Size = Header.SectionSizes[Section];
+        u64 Padding = Header.SectionOffsets[Section] - Written;
+        if(Padding) Success = Success && fwrite(Zeros, Padding, 1, File) == 1;
+        if(Size) Success = Success && fwrite(Sections[Section], Size, 1, File) == 1;
+        Written += Padding + Size;
+    }
+    Success = (fclose(File) == 0) && Success;
+    
+    //Rename doesn't replace existing files on windows
+    remove(Path);
+    if(!Success || rename(TempPath, Path) != 0)
+    {
+        remove(TempPath);
+        return false;
+    }
+    
+    //Caches of the asset with other keys were made from other settings or an older asset,
+    //the key is the 16 digits before the extension
+    char Pattern[1024];
+    u64 PathLength = strlen(Path);
+    if(PathLength < sizeof(Pattern) && PathLength > strlen(".cache") + 16)
+    {
+        strcpy(Pattern, Path);
+        memset(Pattern + PathLength - strlen(".cache") - 16, '?', 16);
+        DeleteMatchingFiles(Pattern, Path);
+    }
+    
+    return true;
+}
@@ -0,0 +1,58 @@
+//Binary cache of a preprocessed mesh written next to its source asset. The file starts with
+//a header followed by the sections, each aligned to MESH_CACHE_ALIGNMENT so they can be used
+//directly from the mapped file
+#define MESH_CACHE_MAGIC 0x48434152 //"RACH"
+#define MESH_CACHE_VERSION 6 //Bump when the layout changes
+#define MESH_CACHE_ALIGNMENT 64
+
+enum mesh_cache_section
+{
+    MESH_CACHE_POSITIONS,
+    MESH_CACHE_NORMALS,
+    MESH_CACHE_UVS,
+    MESH_CACHE_INDICES,
+    MESH_CACHE_FLAT_NODES,
+    MESH_CACHE_WIDE_NODES,
+    MESH_CACHE_QUANTIZED_NODES,
+    MESH_CACHE_PACKETS,
+    MESH_CACHE_LOCAL_LEAVES,
+    
+    MESH_CACHE_SECTION_COUNT,
+};
+
+struct mesh_cache_header
+{
+    u32 Magic;
+    u32 Version;
+    u64 Key; //Hash of the source asset and of everything that changes the preprocessing
+    
+    u32 VerticesCount;
+    u32 IndicesCount;
+    u32 BVHFormat;
+    u32 BVHLeafFormat;
+    u32 FlatNodesCount;
+    u32 WideNodesCount;
+    u32 PacketsCount;
+    u32 QuantizedNodesCount;
+    u32 LocalWordsCount;
+    u32 TrianglesCount; //Of the source mesh, IndicesCount can be bigger with spatial splits
+    aabb AABB;
+    
+    u64 SectionOffsets[MESH_CACHE_SECTION_COUNT];
+    u64 SectionSizes[MESH_CACHE_SECTION_COUNT];
+};
+
+//Preprocessed mesh, when loaded from a cache the arrays point inside the mapped file
+struct cached_mesh
+{
+    mesh_data Data;
+    u32 TrianglesCount;
+    aabb AABB;
+    flat_bvh FlatBVH;
+    wide_bvh WideBVH;
+    quantized_bvh QuantizedBVH;
+    packed_triangles PackedTriangles;
+    local_triangles LocalTriangles;
+    
+    file_view View;
+};
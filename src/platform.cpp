@@ -41,7 +41,7 @@ FreeFileMemory(void* Memory)
 
 //Appends a 0 to the returned buffer for c string compatibility
 internal void* 
-ReadFileAsString(char* FileName, u32* OutBytesRead = 0)
+ReadFileAsString(char* FileName, u64* OutBytesRead = 0)
 {
     void* Result = 0;
     HANDLE FileHandle;
@@ -51,19 +51,31 @@ ReadFileAsString(char* FileName, u32* OutBytesRead = 0)
         LARGE_INTEGER FileSize;
         if(GetFileSizeEx(FileHandle, &FileSize))
         {
-            Assert(FileSize.QuadPart <= 0xFFFFFFFF);
-            uint32 FileSize32 = (uint32)FileSize.QuadPart;
-            Result = VirtualAlloc(0, FileSize32 + 1, MEM_COMMIT | MEM_RESERVE, PAGE_READWRITE);
+            u64 FileSize64 = (u64)FileSize.QuadPart;
+            Result = VirtualAlloc(0, FileSize64 + 1, MEM_COMMIT | MEM_RESERVE, PAGE_READWRITE);
             if(Result)
             {
-                DWORD BytesRead = 0;
-                if(ReadFile(FileHandle, Result, FileSize32, &BytesRead,0)
-                   && FileSize32 == BytesRead)
+                //ReadFile takes a 32 bit size, files over 4GB are read in pieces
+                u64 TotalBytesRead = 0;
+                while(TotalBytesRead < FileSize64)
+                {
+                    u64 BytesLeft = FileSize64 - TotalBytesRead;
+                    DWORD BytesToRead = (BytesLeft > 0x40000000) ? 0x40000000 : (DWORD)BytesLeft;
+                    DWORD BytesRead = 0;
+                    if(!ReadFile(FileHandle, (u8*)Result + TotalBytesRead, BytesToRead, &BytesRead, 0)
+                       || BytesRead != BytesToRead)
+                    {
+                        break;
+                    }
+                    TotalBytesRead += BytesRead;
+                }
+                
+                if(TotalBytesRead == FileSize64)
                 {
                     //SUCCESS
                     if(OutBytesRead) 
                     {
-                        *OutBytesRead = BytesRead;
+                        *OutBytesRead = TotalBytesRead;
                     }
                 }
                 else
@@ -92,6 +104,144 @@ ReadFileAsString(char* FileName, u32* OutBytesRead = 0)
     return Result;
 }
 
+//Read only view of a whole file mapped in memory
+struct file_view
+{
+    void* Data;
+    u64 Size;
+    HANDLE Mapping;
+    //Set when the view is a ReadFileAsString copy instead of a mapping
+    bool Copied;
+};
+
+internal bool
+MapFile(char* FileName, file_view* View)
+{
+    *View = {};
+    HANDLE FileHandle = CreateFileA(FileName, GENERIC_READ, FILE_SHARE_READ, 0, OPEN_EXISTING, 0, 0);
+    if(FileHandle == INVALID_HANDLE_VALUE) return false;
+    
+    LARGE_INTEGER FileSize;
+    if(GetFileSizeEx(FileHandle, &FileSize) && FileSize.QuadPart > 0)
+    {
+        View->Mapping = CreateFileMappingA(FileHandle, 0, PAGE_READONLY, 0, 0, 0);
+        if(View->Mapping)
+        {
+            View->Data = MapViewOfFile(View->Mapping, FILE_MAP_READ, 0, 0, 0);
+            if(View->Data)
+            {
+                View->Size = FileSize.QuadPart;
+            }
+            else
+            {
+                CloseHandle(View->Mapping);
+                View->Mapping = 0;
+            }
+        }
+    }
+    
+    //The mapping keeps the file open
+    CloseHandle(FileHandle);
+    return View->Data != 0;
+}
+
+internal void
+UnmapFile(file_view* View)
+{
+    if(View->Copied)
+    {
+        if(View->Data) FreeFileMemory(View->Data);
+    }
+    else
+    {
+        if(View->Data) UnmapViewOfFile(View->Data);
+        if(View->Mapping) CloseHandle(View->Mapping);
+    }
+    *View = {};
+}
+
+//Size and last write time of a file, the time is in 100 nanosecond steps
+internal bool
+GetFileStamp(char* FileName, u64* Size, u64* ModifiedTime)
+{
+    WIN32_FILE_ATTRIBUTE_DATA Data;
+    if(!GetFileAttributesExA(FileName, GetFileExInfoStandard, &Data)) return false;
+    
+    *Size = ((u64)Data.nFileSizeHigh << 32) | Data.nFileSizeLow;
+    *ModifiedTime = ((u64)Data.ftLastWriteTime.dwHighDateTime << 32) | Data.ftLastWriteTime.dwLowDateTime;
+    return true;
+}
+
+//Delete the files matching a pattern with * and ? wildcards in the file name, except Keep.
+//Returns the number of deleted files
+internal u32
+DeleteMatchingFiles(char* Pattern, char* Keep)
+{
+    WIN32_FIND_DATAA FindData;
+    HANDLE Find = FindFirstFileA(Pattern, &FindData);
+    if(Find == INVALID_HANDLE_VALUE) return 0;
+    
+    //Found names don't have the directory of the pattern
+    char* Slash = strrchr(Pattern, '\\');
+    char* ForwardSlash = strrchr(Pattern, '/');
+    if(ForwardSlash > Slash) Slash = ForwardSlash;
+    int DirectoryLength = Slash ? (int)(Slash - Pattern + 1) : 0;
+    
+    u32 Result = 0;
+    do
+    {
+        char Path[MAX_PATH];
+        snprintf(Path, sizeof(Path), "%.*s%s", DirectoryLength, Pattern, FindData.cFileName);
+        if(strcmp(Path, Keep) != 0 && DeleteFileA(Path)) Result++;
+    } while(FindNextFileA(Find, &FindData));
+    
+    FindClose(Find);
+    return Result;
+}
+
+//Like MapFile but Data[Size] is guaranteed to be 0 so the view can be lexed as a c string.
+//The system zero fills the rest of the last mapped page, only files ending exactly on a
+//page boundary have no room for the terminator and fall back to a copy.
+internal bool
+MapFileAsString(char* FileName, file_view* View)
+{
+    SYSTEM_INFO SystemInfo;
+    GetSystemInfo(&SystemInfo);
+    
+    if(MapFile(FileName, View))
+    {
+        if(View->Size % SystemInfo.dwPageSize) return true;
+        UnmapFile(View);
+    }
+    
+    u64 BytesRead = 0;
+    View->Data = ReadFileAsString(FileName, &BytesRead);
+    View->Size = BytesRead;
+    View->Copied = true;
+    return View->Data != 0;
+}
+
+//Hardware cache counters need a kernel driver on windows, the benchmarks report them as unavailable
+typedef s32 cache_miss_counter;
+
+internal cache_miss_counter
+OpenCacheMissCounter()
+{
+    return -1;
+}
+
+internal bool
+ReadCacheMissCounter(cache_miss_counter Counter, u64* Count)
+{
+    *Count = 0;
+    return false;
+}
+
+internal void
+CloseCacheMissCounter(cache_miss_counter Counter)
+{
+}
+
 #else
 
 
@@ -100,6 +250,12 @@ ReadFileAsString(char* FileName, u32* OutBytesRead = 0)
 typedef timespec timestamp;
 #include <unistd.h>
 #include <time.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <glob.h>
+#include <linux/perf_event.h>
 
 inline timespec
 GetCurrentCounter()
@@ -119,36 +275,156 @@ GetSecondsElapsed(timespec Begin, timespec End)
     return SecondsElapsed;
 }
 
-internal void* 
-ReadFileAsString(char* FileName, u32* OutBytesRead = 0)
+//Read only view of a whole file mapped in memory
+struct file_view
 {
-    FILE *f = fopen(FileName, "rb");
-    if(!f) return 0;
-    
-    fseek(f, 0, SEEK_END);
-    long fsize = ftell(f);
-    fseek(f, 0, SEEK_SET);  /* same as rewind(f); */
+    void* Data;
+    u64 Size;
+    //Bytes to unmap, can be larger than Size for views made with MapFileAsString
+    u64 MappedSize;
+};
+
+internal bool
+MapFile(char* FileName, file_view* View)
+{
+    *View = {};
+    int File = open(FileName, O_RDONLY);
+    if(File < 0) return false;
     
-    char *string = (char*)malloc(fsize + 1);
-    if(!string) return 0;
+    struct stat Stat;
+    if(fstat(File, &Stat) == 0 && Stat.st_size > 0)
+    {
+        void* Data = mmap(0, Stat.st_size, PROT_READ, MAP_PRIVATE, File, 0);
+        if(Data != MAP_FAILED)
+        {
+            View->Data = Data;
+            View->Size = Stat.st_size;
+            View->MappedSize = Stat.st_size;
+        }
+    }
     
-    size_t bytes_read = fread(string, 1, fsize, f);
-    fclose(f);
+    //The mapping keeps the file open
+    close(File);
+    return View->Data != 0;
+}
+
+//Like MapFile but Data[Size] is guaranteed to be 0 so the view can be lexed as a c string.
+//An anonymous zero page is reserved right after the file pages: the kernel zero fills the
+//tail of the last file page and the extra page covers files ending on a page boundary.
+internal bool
+MapFileAsString(char* FileName, file_view* View)
+{
+    *View = {};
+    int File = open(FileName, O_RDONLY);
+    if(File < 0) return false;
     
-    if(bytes_read != fsize) {
-        free(string);
-        return 0;
+    struct stat Stat;
+    if(fstat(File, &Stat) == 0)
+    {
+        u64 PageSize = sysconf(_SC_PAGESIZE);
+        u64 FileSize = Stat.st_size;
+        u64 MappedSize = ((FileSize + PageSize - 1) / PageSize) * PageSize + PageSize;
+        
+        u8* Reserved = (u8*)mmap(0, MappedSize, PROT_READ, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if(Reserved != MAP_FAILED)
+        {
+            bool Mapped = true;
+            if(FileSize)
+            {
+                void* Data = mmap(Reserved, FileSize, PROT_READ, MAP_PRIVATE | MAP_FIXED, File, 0);
+                Mapped = (Data == Reserved);
+                //The lexer walks the file front to back once
+                if(Mapped) madvise(Data, FileSize, MADV_SEQUENTIAL);
+            }
+            
+            if(Mapped)
+            {
+                View->Data = Reserved;
+                View->Size = FileSize;
+                View->MappedSize = MappedSize;
+            }
+            else
+            {
+                munmap(Reserved, MappedSize);
+            }
+        }
     }
     
-    string[fsize] = 0;
+    //The mapping keeps the file open
+    close(File);
+    return View->Data != 0;
+}
+
+internal void
+UnmapFile(file_view* View)
+{
+    if(View->Data) munmap(View->Data, View->MappedSize);
+    *View = {};
+}
+
+//Size and last modification time of a file, the time is in nanoseconds
+internal bool
+GetFileStamp(char* FileName, u64* Size, u64* ModifiedTime)
+{
+    struct stat Stat;
+    if(stat(FileName, &Stat) != 0) return false;
+    
+    *Size = Stat.st_size;
+    *ModifiedTime = (u64)Stat.st_mtim.tv_sec * 1000000000ull + Stat.st_mtim.tv_nsec;
+    return true;
+}
+
+//Delete the files matching a pattern with * and ? wildcards in the file name, except Keep.
+//Returns the number of deleted files
+internal u32
+DeleteMatchingFiles(char* Pattern, char* Keep)
+{
+    u32 Result = 0;
+    glob_t Glob;
+    if(glob(Pattern, 0, 0, &Glob) == 0)
+    {
+        For(Index, Glob.gl_pathc)
+        {
+            char* Path = Glob.gl_pathv[Index];
+            if(strcmp(Path, Keep) != 0 && remove(Path) == 0) Result++;
+        }
+        globfree(&Glob);
+    }
+    return Result;
+}
+
+//Last level cache misses of the calling thread and of the threads it creates after opening the
+//counter, so it has to be opened before the thread pool. -1 if the hardware counters are not
+//available, like in most virtual machines or with a restrictive perf_event_paranoid
+typedef int cache_miss_counter;
+
+internal cache_miss_counter
+OpenCacheMissCounter()
+{
+    perf_event_attr Attributes = {};
+    Attributes.type = PERF_TYPE_HARDWARE;
+    Attributes.size = sizeof(Attributes);
+    Attributes.config = PERF_COUNT_HW_CACHE_MISSES;
+    Attributes.inherit = 1;
+    Attributes.exclude_kernel = 1;
+    Attributes.exclude_hv = 1;
     
-    return string;
+    return (int)syscall(SYS_perf_event_open, &Attributes, 0, -1, -1, 0);
+}
+
+//Total since the counter was opened, children included
+internal bool
+ReadCacheMissCounter(cache_miss_counter Counter, u64* Count)
+{
+    *Count = 0;
+    if(Counter < 0) return false;
+    return read(Counter, Count, sizeof(*Count)) == sizeof(*Count);
 }
 
 internal void
-FreeFileMemory(void* Memory)
+CloseCacheMissCounter(cache_miss_counter Counter)
 {
-    free(Memory);
+    if(Counter >= 0) close(Counter);
 }
 
 #define Sleep(i) usleep(i * 1000)
@@ -122,41 +122,6 @@ UVWInterpolate(vec2 a, vec2 b, vec2 c, vec3 UVW)
     return Result;
 }
 
-//Return distance along ray at which we intersect, FLT_MAX if miss
-internal f32
-RayAABBTest(aabb a, vec3 p, vec3 dir)
-{
-    float tmin = 0; // set to -FLT_MAX to get first hit on line
-    float tmax = FLT_MAX; // set to max distance ray can travel (for segment
-    
-    // For all three slabs
-    for (int i = 0; i < 3; i++) {
-        if (fabs(dir.e[i]) < 0.000001f) {
-            // Ray is parallel to slab. No hit if origin not within slab
-            if (p.e[i] < a.Min.e[i] || p.e[i] > a.Max.e[i]) return FLT_MAX;
-        } else {
-            // Compute intersection t value of ray with near and far plane of slab
-            float ood = 1.0f / dir.e[i];
-            float t1 = (a.Min.e[i] - p.e[i]) * ood;
-            float t2 = (a.Max.e[i] - p.e[i]) * ood;
-            // Make t1 be intersection with near plane, t2 with far plane
-            if (t1 > t2) {
-                f32 temp = t1;
-                t1 = t2;
-                t2 = temp;
-            }
-            // Compute the intersection of slab intersection intervals
-            if (t1 > tmin) tmin = t1;
-            if (t2 < tmax) tmax = t2;
-            // Exit with no collision as soon as slab intersection becomes empty
-            if (tmin > tmax) return FLT_MAX;
-        }
-    }
-    // Ray intersects all 3 slabs. q is point and tmin distance
-    //    q = p + dir * tmin;
-    return tmin;
-}
-
 inline b32
 PointAABBTest(vec3 Point, aabb AABB)
 {
@@ -165,16 +130,100 @@ PointAABBTest(vec3 Point, aabb AABB)
            AABB.Min.z <= Point.z &&  Point.z <= AABB.Max.z;
 }
 
-//Intersect ray with list of indexed triangles
-inline ray_triangle_intersection
-RayIndexedTrianglesIntersect(u32* Indices, u32 IndicesCount, vec3 p, vec3 dir, vec3* Positions, vec3* Normals, vec2* UVs)
+//Precompute the inverse direction and its signs used by the slab tests. The sign comes from the
+//inverse so that a -0 component, whose inverse is -inf, picks the planes the same way
+inline bvh_ray
+MakeBVHRay(vec3 p, vec3 dir)
+{
+    bvh_ray Ray;
+    Ray.Origin = p;
+    Ray.Direction = dir;
+    For(i, 3)
+    {
+        Ray.InvDirection.e[i] = 1.0f / dir.e[i];
+        Ray.Sign[i] = Ray.InvDirection.e[i] < 0.0f ? 1 : 0;
+    }
+    
+    //x and y are swapped when z is negative to keep the winding of the triangles
+    u32 kz = 0;
+    if(fabsf(dir.y) > fabsf(dir.e[kz])) kz = 1;
+    if(fabsf(dir.z) > fabsf(dir.e[kz])) kz = 2;
+    u32 kx = (kz + 1) % 3;
+    u32 ky = (kx + 1) % 3;
+    if(dir.e[kz] < 0.0f)
+    {
+        u32 Swap = kx;
+        kx = ky;
+        ky = Swap;
+    }
+    Ray.ShearAxis[0] = kx;
+    Ray.ShearAxis[1] = ky;
+    Ray.ShearAxis[2] = kz;
+    Ray.Shear = vec3(dir.e[kx] / dir.e[kz], dir.e[ky] / dir.e[kz], 1.0f / dir.e[kz]);
+    
+    return Ray;
+}
+
+//Return distance along ray at which we intersect, FLT_MAX if miss
+//Slab test with the precomputed inverse direction, its sign picks the near and far planes
+inline f32
+RayAABBSlabTest(aabb* AABB, bvh_ray* Ray)
 {
-    f32 MinDistance = FLT_MAX;
-    vec3 MinUVW;
-    u32 Mini0 = 0;
-    u32 Mini1 = 0;
-    u32 Mini2 = 0;
+    vec3* Bounds = &AABB->Min;
+    
+    f32 tmin = (Bounds[Ray->Sign[0]].x - Ray->Origin.x) * Ray->InvDirection.x;
+    f32 tmax = (Bounds[1 - Ray->Sign[0]].x - Ray->Origin.x) * Ray->InvDirection.x;
+    f32 tymin = (Bounds[Ray->Sign[1]].y - Ray->Origin.y) * Ray->InvDirection.y;
+    f32 tymax = (Bounds[1 - Ray->Sign[1]].y - Ray->Origin.y) * Ray->InvDirection.y;
+    f32 tzmin = (Bounds[Ray->Sign[2]].z - Ray->Origin.z) * Ray->InvDirection.z;
+    f32 tzmax = (Bounds[1 - Ray->Sign[2]].z - Ray->Origin.z) * Ray->InvDirection.z;
     
+    //Comparisons are written so that NaNs (origin on a plane parallel to the ray) are ignored
+    if(tymin > tmin) tmin = tymin;
+    if(tymax < tmax) tmax = tymax;
+    if(tzmin > tmin) tmin = tzmin;
+    if(tzmax < tmax) tmax = tzmax;
+    if(!(tmin > 0.0f)) tmin = 0.0f;
+    
+    if(tmin > tmax) return FLT_MAX;
+    return tmin;
+}
+
+//Rays parallel to the planes of a box they start inside of, with +0 and -0 direction components,
+//must hit it. Run by the -c self checks, exits on failure
+internal void
+CheckSignedZeroRays()
+{
+    aabb Box;
+    Box.Min = vec3(-1.0f);
+    Box.Max = vec3(1.0f);
+    f32 Zeros[2] = { 0.0f, -0.0f };
+    For(Axis, 3)
+    {
+        For(i, 2) For(j, 2) For(k, 2)
+        {
+            vec3 Direction;
+            Direction.e[Axis] = k ? -1.0f : 1.0f;
+            Direction.e[(Axis + 1) % 3] = Zeros[i];
+            Direction.e[(Axis + 2) % 3] = Zeros[j];
+            vec3 Origin = -4.0f * Direction;
+            
+            bvh_ray Ray = MakeBVHRay(Origin, Direction);
+            f32 Distance = RayAABBSlabTest(&Box, &Ray);
+            if(Distance != 3.0f)
+            {
+                printf("Ray from (%g, %g, %g) along (%g, %g, %g) missed its box\n",
+                       Origin.x, Origin.y, Origin.z, Direction.x, Direction.y, Direction.z);
+                exit(1);
+            }
+        }
+    }
+}
+
+//Intersect ray with list of indexed triangles, updates the hit if a closer triangle is found
+inline void
+RayIndexedTrianglesIntersect(u32* Indices, u32 IndicesCount, vec3 p, vec3 dir, vec3* Positions, ray_triangle_intersection* Hit)
+{
     Assert(IndicesCount % 3 == 0);
     for(u32 i = 0; i < IndicesCount; i += 3)
     {
@@ -188,135 +237,625 @@ RayIndexedTrianglesIntersect(u32* Indices, u32 IndicesCount, vec3 p, vec3 dir, v
         
         vec3 UVW = vec3(0.0f);
         f32 Distance = RayTriangleIntersect(a, b, c, p, dir, &UVW);
-        if(Distance > 0.0f && Distance < MinDistance)
+        if(Distance > 0.0f && Distance < Hit->Distance)
         {
-            MinDistance = Distance;
-            MinUVW = UVW;
-            Mini0 = i0;
-            Mini1 = i1;
-            Mini2 = i2;
+            Hit->Distance = Distance;
+            Hit->UVW = UVW;
+            Hit->i0 = i0;
+            Hit->i1 = i1;
+            Hit->i2 = i2;
         }
     }
+}
+
+//Intersect ray with the triangles of a leaf with local indices, positions are read from the cluster of the leaf
+//and so are the mesh indices of the closest hit
+inline void
+RayLocalTrianglesIntersect(u16* Leaf, u32 IndicesCount, vec3 p, vec3 dir, ray_triangle_intersection* Hit)
+{
+    Assert(IndicesCount % 3 == 0);
+    u32* CountWord = (u32*)(Leaf - Leaf[0]);
+    u32 VerticesCount = *CountWord;
+    vec3* Positions = (vec3*)CountWord - VerticesCount;
+    u32* Vertices = (u32*)Positions - VerticesCount;
+    void* LocalIndices = Leaf + 1;
+    u32 IndexSize = GetLocalIndexSize(VerticesCount);
     
-    ray_triangle_intersection Result = {};
-    Result.Distance = MinDistance;
-    Result.UVW = MinUVW;
-    Result.i0 = Mini0;
-    Result.i1 = Mini1;
-    Result.i2 = Mini2;
-    return Result;
+    u32 HitTriangle = (u32)-1;
+    for(u32 i = 0; i < IndicesCount; i += 3)
+    {
+        vec3 a = Positions[GetLocalIndex(LocalIndices, IndexSize, i + 0)];
+        vec3 b = Positions[GetLocalIndex(LocalIndices, IndexSize, i + 2)];
+        vec3 c = Positions[GetLocalIndex(LocalIndices, IndexSize, i + 1)];
+        
+        vec3 UVW = vec3(0.0f);
+        f32 Distance = RayTriangleIntersect(a, b, c, p, dir, &UVW);
+        if(Distance > 0.0f && Distance < Hit->Distance)
+        {
+            Hit->Distance = Distance;
+            Hit->UVW = UVW;
+            HitTriangle = i;
+        }
+    }
+    
+    if(HitTriangle != (u32)-1)
+    {
+        Hit->i0 = Vertices[GetLocalIndex(LocalIndices, IndexSize, HitTriangle + 0)];
+        Hit->i1 = Vertices[GetLocalIndex(LocalIndices, IndexSize, HitTriangle + 2)];
+        Hit->i2 = Vertices[GetLocalIndex(LocalIndices, IndexSize, HitTriangle + 1)];
+    }
 }
 
-//Intersect ray with aabbtree recursively
-internal ray_triangle_intersection
-RayMeshAABBTreeIntersectRec(aabb_tree* Tree, vec3 p, vec3 dir, float Distance, vec3* Positions, vec3* Normals, vec2* UVs)
+//Intersect ray with packets of triangles, all the lanes of a packet are tested at once with the watertight
+//test of Woop et al. 2013. The vertices are moved to the ray origin, their axes permuted and sheared so that
+//the ray is the z axis, then the edge functions are 2D and give the same result for the triangles sharing
+//an edge, so no ray goes through a mesh between them. Only triangles facing the ray are hit, as in
+//RayTriangleIntersect. Edge functions that round to 0 count as inside, there is no double precision retry
+internal void
+RayTrianglePacketsIntersect(triangle_packet* Packets, u32 TrianglesCount, u32* Indices, bvh_ray* Ray, ray_triangle_intersection* Hit)
 {
-    //If leaf intersect with all the contained triangles
-    if(!Tree->Left && !Tree->Right)
+    u32 PacketsCount = (TrianglesCount + SIMD_WIDTH - 1) / SIMD_WIDTH;
+    Thread_TriangleTestsTotal += TrianglesCount;
+    
+    u32 kx = Ray->ShearAxis[0];
+    u32 ky = Ray->ShearAxis[1];
+    u32 kz = Ray->ShearAxis[2];
+    wide_f32 OriginX = WideSet1(Ray->Origin.e[kx]);
+    wide_f32 OriginY = WideSet1(Ray->Origin.e[ky]);
+    wide_f32 OriginZ = WideSet1(Ray->Origin.e[kz]);
+    wide_f32 ShearX = WideSet1(Ray->Shear.x);
+    wide_f32 ShearY = WideSet1(Ray->Shear.y);
+    wide_f32 ShearZ = WideSet1(Ray->Shear.z);
+    wide_f32 Zero = WideSet1(0.0f);
+    wide_f32 One = WideSet1(1.0f);
+    
+    For(PacketIndex, PacketsCount)
+    {
+        triangle_packet* Packet = &Packets[PacketIndex];
+        
+        //Vertices relative to the origin in the permuted axes
+        wide_f32 Az = WideSub(WideLoad(Packet->Vertex0[kz]), OriginZ);
+        wide_f32 Bz = WideSub(WideLoad(Packet->Vertex1[kz]), OriginZ);
+        wide_f32 Cz = WideSub(WideLoad(Packet->Vertex2[kz]), OriginZ);
+        wide_f32 Ax = WideSub(WideSub(WideLoad(Packet->Vertex0[kx]), OriginX), WideMul(ShearX, Az));
+        wide_f32 Ay = WideSub(WideSub(WideLoad(Packet->Vertex0[ky]), OriginY), WideMul(ShearY, Az));
+        wide_f32 Bx = WideSub(WideSub(WideLoad(Packet->Vertex1[kx]), OriginX), WideMul(ShearX, Bz));
+        wide_f32 By = WideSub(WideSub(WideLoad(Packet->Vertex1[ky]), OriginY), WideMul(ShearY, Bz));
+        wide_f32 Cx = WideSub(WideSub(WideLoad(Packet->Vertex2[kx]), OriginX), WideMul(ShearX, Cz));
+        wide_f32 Cy = WideSub(WideSub(WideLoad(Packet->Vertex2[ky]), OriginY), WideMul(ShearY, Cz));
+        
+        //Scaled barycentrics, the edge functions of the opposite edges
+        wide_f32 U = WideSub(WideMul(Cx, By), WideMul(Cy, Bx));
+        wide_f32 V = WideSub(WideMul(Ax, Cy), WideMul(Ay, Cx));
+        wide_f32 W = WideSub(WideMul(Bx, Ay), WideMul(By, Ax));
+        wide_f32 Det = WideAdd(WideAdd(U, V), W);
+        
+        //Facing triangles have all the edge functions negative with this winding, degenerate and
+        //padding lanes have 0 determinant and are masked out, so the division is safe to ignore
+        wide_f32 Mask = WideLess(Det, Zero);
+        Mask = WideAnd(Mask, WideLessEqual(U, Zero));
+        Mask = WideAnd(Mask, WideLessEqual(V, Zero));
+        Mask = WideAnd(Mask, WideLessEqual(W, Zero));
+        
+        wide_f32 T = WideMul(ShearZ, WideAdd(WideAdd(WideMul(U, Az), WideMul(V, Bz)), WideMul(W, Cz)));
+        wide_f32 InvDet = WideDiv(One, Det);
+        wide_f32 t = WideMul(T, InvDet);
+        Mask = WideAnd(Mask, WideLess(Zero, t));
+        
+        u32 PassedMask = WideMoveMask(Mask);
+        Thread_TriangleTestsPassed += CountSetBits(PassedMask);
+        
+        u32 HitMask = PassedMask & WideMoveMask(WideLess(t, WideSet1(Hit->Distance)));
+        if(HitMask)
+        {
+            f32 Distances[SIMD_WIDTH];
+            f32 Us[SIMD_WIDTH];
+            f32 Vs[SIMD_WIDTH];
+            f32 Ws[SIMD_WIDTH];
+            WideStore(Distances, t);
+            WideStore(Us, WideMul(U, InvDet));
+            WideStore(Vs, WideMul(V, InvDet));
+            WideStore(Ws, WideMul(W, InvDet));
+            
+            //Pick the closest lane
+            u32 Closest = FindLowestSetBit(HitMask);
+            HitMask &= HitMask - 1;
+            while(HitMask)
+            {
+                u32 Lane = FindLowestSetBit(HitMask);
+                HitMask &= HitMask - 1;
+                if(Distances[Lane] < Distances[Closest]) Closest = Lane;
+            }
+            
+            u32 i = Packet->Triangle[Closest];
+            Hit->Distance = Distances[Closest];
+            Hit->UVW = vec3(Us[Closest], Vs[Closest], Ws[Closest]);
+            Hit->i0 = Indices[i + 0];
+            Hit->i1 = Indices[i + 2];
+            Hit->i2 = Indices[i + 1];
+        }
+    }
+}
+
+#define WATERTIGHT_CHECK_GRID 12
+#define WATERTIGHT_CHECK_RAYS_PER_EDGE 64
+
+//Rays through the edges and vertices inside a bumpy grid must always hit one of the packed triangles.
+//Run by the -c self checks, exits on failure
+internal void
+CheckWatertightPackets()
+{
+    u32 N = WATERTIGHT_CHECK_GRID;
+    random_series Series = RandSeries(0x9E3779B9);
+    vec3 Positions[WATERTIGHT_CHECK_GRID * WATERTIGHT_CHECK_GRID];
+    For(y, N) For(x, N)
+    {
+        Positions[y * N + x] = vec3(0.37f * x + RandRange(&Series, -0.1f, 0.1f),
+                                    0.37f * y + RandRange(&Series, -0.1f, 0.1f),
+                                    RandRange(&Series, -0.05f, 0.05f));
+    }
+    
+    //Triangles face up with the winding of the leaves, a ray toward the center from above must hit them
+    u32 Indices[(WATERTIGHT_CHECK_GRID - 1) * (WATERTIGHT_CHECK_GRID - 1) * 6];
+    u32 IndicesCount = 0;
+    For(y, N - 1) For(x, N - 1)
+    {
+        u32 Corners[4] = { y * N + x, y * N + x + 1, (y + 1) * N + x + 1, (y + 1) * N + x };
+        u32 Triangles[2][3] = { { Corners[0], Corners[1], Corners[2] }, { Corners[0], Corners[2], Corners[3] } };
+        For(Triangle, 2)
+        {
+            u32* t = Triangles[Triangle];
+            vec3 Center = (Positions[t[0]] + Positions[t[1]] + Positions[t[2]]) * (1.0f / 3.0f);
+            vec3 UVW;
+            if(RayTriangleIntersect(Positions[t[0]], Positions[t[2]], Positions[t[1]], Center + vec3(0, 0, 1), vec3(0, 0, -1), &UVW) == FLT_MAX)
+            {
+                u32 Swap = t[1];
+                t[1] = t[2];
+                t[2] = Swap;
+            }
+            For(Vertex, 3) Indices[IndicesCount++] = t[Vertex];
+        }
+    }
+    
+    _sbuf_ triangle_packet* Packets = 0;
+    PushLeafTrianglePackets(&Packets, Positions, Indices, 0, IndicesCount);
+    
+    //Edges between vertices off the border are inside the grid, the first ray of each goes through a vertex
+    u32 MissesCount = 0;
+    for(u32 i = 0; i < IndicesCount; i++)
     {
-        return RayIndexedTrianglesIntersect(Tree->Indices, Tree->IndicesCount, p, dir,
-                                            Positions, Normals, UVs);
+        u32 v0 = Indices[i];
+        u32 v1 = Indices[(i % 3 == 2) ? i - 2 : i + 1];
+        u32 x0 = v0 % N, y0 = v0 / N, x1 = v1 % N, y1 = v1 / N;
+        if(MIN(MIN(x0, y0), MIN(x1, y1)) == 0 || MAX(MAX(x0, y0), MAX(x1, y1)) == N - 1) continue;
+        
+        For(RayIndex, WATERTIGHT_CHECK_RAYS_PER_EDGE)
+        {
+            f32 s = (RayIndex == 0) ? 0.0f : Randf(&Series);
+            vec3 Target = Positions[v0] + (Positions[v1] - Positions[v0]) * s;
+            vec3 Origin = Target + vec3(RandNO(&Series), RandNO(&Series), RandRange(&Series, 2.0f, 4.0f));
+            bvh_ray Ray = MakeBVHRay(Origin, Normalize(Target - Origin));
+            
+            ray_triangle_intersection Hit = {};
+            Hit.Distance = FLT_MAX;
+            RayTrianglePacketsIntersect(Packets, IndicesCount / 3, Indices, &Ray, &Hit);
+            if(Hit.Distance == FLT_MAX) MissesCount++;
+        }
     }
+    SbufFree(Packets);
     
-    //Intersect ray with children aabb
-    ray_triangle_intersection ResultLeft, ResultRight;
-    f32 LeftDistance = Tree->Left ? RayAABBTest(Tree->Left->AABB, p, dir) : FLT_MAX;
-    f32 RightDistance = Tree->Right ? RayAABBTest(Tree->Right->AABB, p, dir) : FLT_MAX;
+    if(MissesCount)
+    {
+        printf("%u rays through the edges of a closed grid missed its triangle packets\n", MissesCount);
+        exit(1);
+    }
+}
+
+//Intersect ray with the triangles of a leaf in the leaf format of the hierarchy
+inline void
+RayLeafIntersect(bvh_leaves* Leaves, u32 Offset, u32 IndicesCount, bvh_ray* Ray, ray_triangle_intersection* Hit)
+{
+    if(Leaves->Format == BVH_LEAF_FORMAT_PACKET)
+    {
+        RayTrianglePacketsIntersect(Leaves->Packets + Offset, IndicesCount / 3, Leaves->Indices, Ray, Hit);
+    }
+    else if(Leaves->Format == BVH_LEAF_FORMAT_LOCAL)
+    {
+        RayLocalTrianglesIntersect(Leaves->LocalLeaves + Offset, IndicesCount, Ray->Origin, Ray->Direction, Hit);
+    }
+    else
+    {
+        RayIndexedTrianglesIntersect(Leaves->Indices + Offset, IndicesCount, Ray->Origin, Ray->Direction, Leaves->Positions, Hit);
+    }
+}
+
+//Intersect ray with aabbtree iteratively, the closest child is always traversed first
+//and the other one is pushed on the stack with its distance
+internal void
+RayAABBTreeIntersect(aabb_tree* Root, bvh_ray* Ray, vec3* Positions, ray_triangle_intersection* Hit)
+{
+    aabb_tree* Stack[BVH_MAX_DEPTH];
+    f32 StackDistances[BVH_MAX_DEPTH];
+    u32 StackCount = 0;
     
-    b32 TraverseLeft = LeftDistance < Distance;
-    b32 TraverseRight = RightDistance < Distance;
+    aabb_tree* Tree = Root;
+    if(RayAABBSlabTest(&Tree->AABB, Ray) >= Hit->Distance) return;
     
-    //If we have both children to traverse we traverse the closest first
-    if(TraverseLeft && TraverseRight)
+    while(true)
     {
-        if(LeftDistance < RightDistance)
+        if(!Tree->Left && !Tree->Right)
+        {
+            //If leaf intersect with all the contained triangles
+            RayIndexedTrianglesIntersect(Tree->Indices, Tree->IndicesCount, Ray->Origin, Ray->Direction, Positions, Hit);
+            Tree = 0;
+        }
+        else
         {
-            ResultLeft = RayMeshAABBTreeIntersectRec(Tree->Left, p, dir, Distance, Positions, Normals, UVs);
-            //We update our current distance if lower and traverse the other only if in range
-            if(ResultLeft.Distance < Distance) Distance = ResultLeft.Distance;
-            if(RightDistance < Distance)
+            //Intersect ray with children aabb
+            f32 LeftDistance = Tree->Left ? RayAABBSlabTest(&Tree->Left->AABB, Ray) : FLT_MAX;
+            f32 RightDistance = Tree->Right ? RayAABBSlabTest(&Tree->Right->AABB, Ray) : FLT_MAX;
+            
+            b32 TraverseLeft = LeftDistance < Hit->Distance;
+            b32 TraverseRight = RightDistance < Hit->Distance;
+            
+            if(TraverseLeft && TraverseRight)
             {
-                ResultRight = RayMeshAABBTreeIntersectRec(Tree->Right, p, dir, Distance, Positions, Normals, UVs);
-                //finally return the better result
-                return ResultLeft.Distance < ResultRight.Distance ? ResultLeft : ResultRight;
+                Assert(StackCount < BVH_MAX_DEPTH);
+                if(LeftDistance < RightDistance)
+                {
+                    Stack[StackCount] = Tree->Right;
+                    StackDistances[StackCount++] = RightDistance;
+                    Tree = Tree->Left;
+                }
+                else
+                {
+                    Stack[StackCount] = Tree->Left;
+                    StackDistances[StackCount++] = LeftDistance;
+                    Tree = Tree->Right;
+                }
+            }
+            else if(TraverseLeft)
+            {
+                Tree = Tree->Left;
+            }
+            else if(TraverseRight)
+            {
+                Tree = Tree->Right;
             }
             else
             {
-                return ResultLeft;
+                Tree = 0;
+            }
+        }
+        
+        //Pop the next node that is still closer than the current hit
+        while(!Tree)
+        {
+            if(StackCount == 0) return;
+            StackCount--;
+            if(StackDistances[StackCount] < Hit->Distance)
+            {
+                Tree = Stack[StackCount];
             }
         }
+    }
+}
+
+//Intersect ray with flattened aabbtree iteratively, same traversal order as the pointer tree
+internal void
+RayFlatBVHIntersect(flat_bvh_node* Nodes, bvh_ray* Ray, bvh_leaves* Leaves, ray_triangle_intersection* Hit)
+{
+    bvh_stack_entry Stack[BVH_MAX_DEPTH];
+    u32 StackCount = 0;
+    
+    if(RayAABBSlabTest(&Nodes[0].AABB, Ray) >= Hit->Distance) return;
+    
+    u32 NodeIndex = 0;
+    while(true)
+    {
+        flat_bvh_node* Node = &Nodes[NodeIndex];
+        b32 HasNext = false;
+        
+        if(Node->IndicesCount)
+        {
+            //If leaf intersect with all the contained triangles
+            RayLeafIntersect(Leaves, Node->Offset, Node->IndicesCount, Ray, Hit);
+        }
         else
         {
-            ResultRight = RayMeshAABBTreeIntersectRec(Tree->Right, p, dir, Distance, Positions, Normals, UVs);
-            if(ResultRight.Distance < Distance) Distance = ResultRight.Distance;
-            if(LeftDistance < Distance)
+            //Left child is stored right after its parent
+            u32 LeftIndex = NodeIndex + 1;
+            u32 RightIndex = Node->Offset;
+            f32 LeftDistance = RayAABBSlabTest(&Nodes[LeftIndex].AABB, Ray);
+            f32 RightDistance = RayAABBSlabTest(&Nodes[RightIndex].AABB, Ray);
+            
+            b32 TraverseLeft = LeftDistance < Hit->Distance;
+            b32 TraverseRight = RightDistance < Hit->Distance;
+            
+            if(TraverseLeft && TraverseRight)
             {
-                ResultLeft = RayMeshAABBTreeIntersectRec(Tree->Left, p, dir, Distance, Positions, Normals, UVs);
-                return ResultLeft.Distance < ResultRight.Distance ? ResultLeft : ResultRight;
+                Assert(StackCount < BVH_MAX_DEPTH);
+                if(LeftDistance < RightDistance)
+                {
+                    Stack[StackCount].NodeIndex = RightIndex;
+                    Stack[StackCount++].Distance = RightDistance;
+                    NodeIndex = LeftIndex;
+                }
+                else
+                {
+                    Stack[StackCount].NodeIndex = LeftIndex;
+                    Stack[StackCount++].Distance = LeftDistance;
+                    NodeIndex = RightIndex;
+                }
+                HasNext = true;
             }
-            else
+            else if(TraverseLeft || TraverseRight)
+            {
+                NodeIndex = TraverseLeft ? LeftIndex : RightIndex;
+                HasNext = true;
+            }
+        }
+        
+        //Pop the next node that is still closer than the current hit
+        while(!HasNext)
+        {
+            if(StackCount == 0) return;
+            bvh_stack_entry* Entry = &Stack[--StackCount];
+            if(Entry->Distance < Hit->Distance)
             {
-                return ResultRight;
+                NodeIndex = Entry->NodeIndex;
+                HasNext = true;
             }
         }
     }
-    else
+}
+
+//Push the children in HitMask on the stack of a wide traversal sorted from the farthest to the nearest,
+//so the nearest is popped first
+inline void
+PushWideBVHChildren(bvh_stack_entry* Stack, u32* StackCount, u32 StackSize, u32 NodeIndex, u32 HitMask, wide_f32 tmin)
+{
+    f32 Distances[WIDE_BVH_WIDTH];
+    WideStore(Distances, tmin);
+    
+    u32 Order[WIDE_BVH_WIDTH];
+    u32 OrderCount = 0;
+    while(HitMask)
     {
-        //If we only have 1 child traversable
-        if(TraverseLeft)
+        u32 Child = FindLowestSetBit(HitMask);
+        HitMask &= HitMask - 1;
+        
+        u32 Insert = OrderCount++;
+        while(Insert > 0 && Distances[Order[Insert - 1]] < Distances[Child])
         {
-            return RayMeshAABBTreeIntersectRec(Tree->Left, p, dir, Distance, Positions, Normals, UVs);
+            Order[Insert] = Order[Insert - 1];
+            Insert--;
         }
+        Order[Insert] = Child;
+    }
+    
+    Assert(*StackCount + OrderCount <= StackSize);
+    For(Index, OrderCount)
+    {
+        Stack[*StackCount].NodeIndex = NodeIndex * WIDE_BVH_WIDTH + Order[Index];
+        Stack[(*StackCount)++].Distance = Distances[Order[Index]];
+    }
+}
+
+//Intersect ray with wide bvh, the boxes of all the children of a node are tested at once
+//and the ones that are hit are pushed on the stack from the farthest to the nearest
+internal void
+RayWideBVHIntersect(wide_bvh_node* Nodes, bvh_ray* Ray, bvh_leaves* Leaves, ray_triangle_intersection* Hit)
+{
+    //Stack entries refer to a child of a node as NodeIndex * WIDE_BVH_WIDTH + ChildIndex
+    bvh_stack_entry Stack[BVH_MAX_DEPTH * WIDE_BVH_WIDTH];
+    u32 StackCount = 0;
+    
+    wide_f32 OriginX = WideSet1(Ray->Origin.x);
+    wide_f32 OriginY = WideSet1(Ray->Origin.y);
+    wide_f32 OriginZ = WideSet1(Ray->Origin.z);
+    wide_f32 InvDirectionX = WideSet1(Ray->InvDirection.x);
+    wide_f32 InvDirectionY = WideSet1(Ray->InvDirection.y);
+    wide_f32 InvDirectionZ = WideSet1(Ray->InvDirection.z);
+    wide_f32 Zero = WideSet1(0.0f);
+    
+    //Rows of the bounds containing the near and far planes of each axis
+    u32 NearX = 0 + Ray->Sign[0] * 3;
+    u32 NearY = 1 + Ray->Sign[1] * 3;
+    u32 NearZ = 2 + Ray->Sign[2] * 3;
+    u32 FarX = 3 - Ray->Sign[0] * 3;
+    u32 FarY = 4 - Ray->Sign[1] * 3;
+    u32 FarZ = 5 - Ray->Sign[2] * 3;
+    
+    u32 NodeIndex = 0;
+    while(true)
+    {
+        wide_bvh_node* Node = &Nodes[NodeIndex];
+        
+        //Slab test of all the children, NaNs are always in the first operand of min and max so they are ignored
+        wide_f32 tmin = WideMax(WideMul(WideSub(WideLoad(Node->Bounds[NearX]), OriginX), InvDirectionX), Zero);
+        tmin = WideMax(WideMul(WideSub(WideLoad(Node->Bounds[NearY]), OriginY), InvDirectionY), tmin);
+        tmin = WideMax(WideMul(WideSub(WideLoad(Node->Bounds[NearZ]), OriginZ), InvDirectionZ), tmin);
+        wide_f32 tmax = WideMin(WideMul(WideSub(WideLoad(Node->Bounds[FarX]), OriginX), InvDirectionX), WideSet1(Hit->Distance));
+        tmax = WideMin(WideMul(WideSub(WideLoad(Node->Bounds[FarY]), OriginY), InvDirectionY), tmax);
+        tmax = WideMin(WideMul(WideSub(WideLoad(Node->Bounds[FarZ]), OriginZ), InvDirectionZ), tmax);
+        u32 HitMask = WideMaskLE(tmin, tmax);
+        PushWideBVHChildren(Stack, &StackCount, ArrayCount(Stack), NodeIndex, HitMask, tmin);
         
-        if(TraverseRight)
+        //Pop children until we find a node that is still closer than the current hit,
+        //leaves are intersected right away
+        b32 HasNext = false;
+        while(!HasNext)
         {
-            return RayMeshAABBTreeIntersectRec(Tree->Right, p, dir, Distance, Positions, Normals, UVs);
+            if(StackCount == 0) return;
+            bvh_stack_entry* Entry = &Stack[--StackCount];
+            if(Entry->Distance >= Hit->Distance) continue;
+            
+            wide_bvh_node* Parent = &Nodes[Entry->NodeIndex / WIDE_BVH_WIDTH];
+            u32 Child = Entry->NodeIndex % WIDE_BVH_WIDTH;
+            if(Parent->IndicesCount[Child])
+            {
+                RayLeafIntersect(Leaves, Parent->Offset[Child], Parent->IndicesCount[Child], Ray, Hit);
+            }
+            else
+            {
+                NodeIndex = Parent->Offset[Child];
+                HasNext = true;
+            }
         }
+    }
+}
+
+//Same as the wide traversal, the child bounds are dequantized before the slab test
+internal void
+RayQuantizedBVHIntersect(quantized_bvh_node* Nodes, bvh_ray* Ray, bvh_leaves* Leaves, ray_triangle_intersection* Hit)
+{
+    bvh_stack_entry Stack[BVH_MAX_DEPTH * WIDE_BVH_WIDTH];
+    u32 StackCount = 0;
+    
+    wide_f32 OriginX = WideSet1(Ray->Origin.x);
+    wide_f32 OriginY = WideSet1(Ray->Origin.y);
+    wide_f32 OriginZ = WideSet1(Ray->Origin.z);
+    wide_f32 InvDirectionX = WideSet1(Ray->InvDirection.x);
+    wide_f32 InvDirectionY = WideSet1(Ray->InvDirection.y);
+    wide_f32 InvDirectionZ = WideSet1(Ray->InvDirection.z);
+    wide_f32 Zero = WideSet1(0.0f);
+    
+    u32 NearX = 0 + Ray->Sign[0] * 3;
+    u32 NearY = 1 + Ray->Sign[1] * 3;
+    u32 NearZ = 2 + Ray->Sign[2] * 3;
+    u32 FarX = 3 - Ray->Sign[0] * 3;
+    u32 FarY = 4 - Ray->Sign[1] * 3;
+    u32 FarZ = 5 - Ray->Sign[2] * 3;
+    
+    u32 NodeIndex = 0;
+    while(true)
+    {
+        quantized_bvh_node* Node = &Nodes[NodeIndex];
+        
+        wide_f32 NodeOriginX = WideSet1(Node->Origin[0]);
+        wide_f32 NodeOriginY = WideSet1(Node->Origin[1]);
+        wide_f32 NodeOriginZ = WideSet1(Node->Origin[2]);
+        wide_f32 ScaleX = WideSet1(Node->Scale[0]);
+        wide_f32 ScaleY = WideSet1(Node->Scale[1]);
+        wide_f32 ScaleZ = WideSet1(Node->Scale[2]);
+        
+        wide_f32 NearBoundX = WideAdd(NodeOriginX, WideMul(WideLoadU8(Node->Bounds[NearX]), ScaleX));
+        wide_f32 NearBoundY = WideAdd(NodeOriginY, WideMul(WideLoadU8(Node->Bounds[NearY]), ScaleY));
+        wide_f32 NearBoundZ = WideAdd(NodeOriginZ, WideMul(WideLoadU8(Node->Bounds[NearZ]), ScaleZ));
+        wide_f32 FarBoundX = WideAdd(NodeOriginX, WideMul(WideLoadU8(Node->Bounds[FarX]), ScaleX));
+        wide_f32 FarBoundY = WideAdd(NodeOriginY, WideMul(WideLoadU8(Node->Bounds[FarY]), ScaleY));
+        wide_f32 FarBoundZ = WideAdd(NodeOriginZ, WideMul(WideLoadU8(Node->Bounds[FarZ]), ScaleZ));
         
-        //If we have no child traversable
-        ray_triangle_intersection Result = {};
-        Result.Distance = FLT_MAX;
-        return Result;
+        wide_f32 tmin = WideMax(WideMul(WideSub(NearBoundX, OriginX), InvDirectionX), Zero);
+        tmin = WideMax(WideMul(WideSub(NearBoundY, OriginY), InvDirectionY), tmin);
+        tmin = WideMax(WideMul(WideSub(NearBoundZ, OriginZ), InvDirectionZ), tmin);
+        wide_f32 tmax = WideMin(WideMul(WideSub(FarBoundX, OriginX), InvDirectionX), WideSet1(Hit->Distance));
+        tmax = WideMin(WideMul(WideSub(FarBoundY, OriginY), InvDirectionY), tmax);
+        tmax = WideMin(WideMul(WideSub(FarBoundZ, OriginZ), InvDirectionZ), tmax);
+        
+        //Unused children are zeroed instead of inverted so they are masked out
+        u32 HitMask = WideMaskLE(tmin, tmax) & ((1 << Node->ChildrenCount) - 1);
+        PushWideBVHChildren(Stack, &StackCount, ArrayCount(Stack), NodeIndex, HitMask, tmin);
+        
+        b32 HasNext = false;
+        while(!HasNext)
+        {
+            if(StackCount == 0) return;
+            bvh_stack_entry* Entry = &Stack[--StackCount];
+            if(Entry->Distance >= Hit->Distance) continue;
+            
+            quantized_bvh_node* Parent = &Nodes[Entry->NodeIndex / WIDE_BVH_WIDTH];
+            u32 Child = Entry->NodeIndex % WIDE_BVH_WIDTH;
+            if(Parent->IndicesCount[Child])
+            {
+                RayLeafIntersect(Leaves, Parent->Offset[Child], Parent->IndicesCount[Child], Ray, Hit);
+            }
+            else
+            {
+                NodeIndex = Parent->Offset[Child];
+                HasNext = true;
+            }
+        }
     }
 }
 
-//Intersect ray with aabbtree and compute normals and uvs at hit point
-inline f32
-RayMeshAABBTreeIntersect(mesh_info* Mesh, vec3 p, vec3 dir, f32 Distance, vec3* HitNormal, vec2* HitUV)
+//Leaves of the hierarchy of a mesh in the given leaf format
+inline bvh_leaves
+GetMeshLeaves(mesh_info* Mesh, bvh_leaf_format LeafFormat)
+{
+    bvh_leaves Leaves;
+    Leaves.Format = LeafFormat;
+    Leaves.Indices = Mesh->Data.Indices;
+    Leaves.Positions = Mesh->Data.Positions;
+    Leaves.Packets = Mesh->PackedTriangles.Packets;
+    Leaves.LocalLeaves = (u16*)Mesh->LocalTriangles.Words;
+    return Leaves;
+}
+
+//Compute normal and uv at the hit point by interpolating vertex values
+internal void
+GetMeshHitAttributes(mesh_info* Mesh, ray_triangle_intersection* Hit, vec3* HitNormal, vec2* HitUV)
 {
-    vec3* Positions = Mesh->Data.Positions;
     vec3* Normals = Mesh->Data.Normals;
     vec2* UVs = Mesh->Data.UVs;
     
+    vec3 n0 = Normals[Hit->i0];
+    vec3 n1 = Normals[Hit->i1];
+    vec3 n2 = Normals[Hit->i2];
+    vec3 Normal = UVWInterpolate(n0, n1, n2, Hit->UVW);
+    *HitNormal = Normalize(Normal);
+    
+    vec2 t0 = UVs[Hit->i0];
+    vec2 t1 = UVs[Hit->i1];
+    vec2 t2 = UVs[Hit->i2];
+    vec2 UV = UVWInterpolate(t0, t1, t2, Hit->UVW);
+    *HitUV = UV;
+}
+
+//Intersect ray with the mesh hierarchy in the given format and compute normals and uvs at hit point
+//Returns FLT_MAX if nothing is hit closer than Distance
+internal f32
+RayMeshAABBTreeIntersect(mesh_info* Mesh, bvh_format Format, bvh_leaf_format LeafFormat, vec3 p, vec3 dir, f32 Distance, vec3* HitNormal, vec2* HitUV)
+{
+    bvh_ray Ray = MakeBVHRay(p, dir);
+    bvh_leaves Leaves = GetMeshLeaves(Mesh, LeafFormat);
+    
+    //Only triangles closer than the current hit are accepted
     ray_triangle_intersection Result = {};
+    Result.Distance = Distance;
     
-    //First test with the root aabb
-    f32 RootDistance = RayAABBTest(Mesh->AABBTree->AABB, p, dir);
-    if(RootDistance < Distance)
+    switch(Format)
     {
-        Result = RayMeshAABBTreeIntersectRec(Mesh->AABBTree, p, dir, Distance, Positions, Normals, UVs);
-    }
-    else
-    {
-        Result.Distance = FLT_MAX;
+        case BVH_FORMAT_TREE:
+        {
+            RayAABBTreeIntersect(Mesh->AABBTree, &Ray, Mesh->Data.Positions, &Result);
+        } break;
+        
+        case BVH_FORMAT_FLAT:
+        {
+            RayFlatBVHIntersect(Mesh->FlatBVH.Nodes, &Ray, &Leaves, &Result);
+        } break;
+        
+        case BVH_FORMAT_WIDE:
+        {
+            RayWideBVHIntersect(Mesh->WideBVH.Nodes, &Ray, &Leaves, &Result);
+        } break;
+        
+        case BVH_FORMAT_QUANTIZED:
+        {
+            RayQuantizedBVHIntersect(Mesh->QuantizedBVH.Nodes, &Ray, &Leaves, &Result);
+        } break;
+        
+        default: InvalidCodePath;
     }
     
-    //If we have a hit compute normals and uvs by interpolating vertex values
-    if(Result.Distance > 0.0f && Result.Distance < FLT_MAX)
+    if(Result.Distance >= Distance)
     {
-        vec3 n0 = Normals[Result.i0];
-        vec3 n1 = Normals[Result.i1];
-        vec3 n2 = Normals[Result.i2];
-        vec3 Normal = UVWInterpolate(n0, n1, n2, Result.UVW);
-        *HitNormal = Normalize(Normal);
-        
-        vec2 t0 = UVs[Result.i0];
-        vec2 t1 = UVs[Result.i1];
-        vec2 t2 = UVs[Result.i2];
-        vec2 UV = UVWInterpolate(t0, t1, t2, Result.UVW);
-        *HitUV = UV;
+        return FLT_MAX;
     }
     
+    GetMeshHitAttributes(Mesh, &Result, HitNormal, HitUV);
     return Result.Distance;
 }
 
@@ -351,148 +890,556 @@ BilinearSampleImage(image_data* Image, vec2 UV)
     return Result;
 }
 
-//
-internal vec3
-RayCast(world* World, vec3 Origin, vec3 Direction, u32 Bounces, random_series* Series)
+//Intersect ray with a sphere entry, updates the hit if closer
+internal void
+RaySphereEntryIntersect(sphere_entry* Entry, vec3 Origin, vec3 Direction, ray_hit* Hit)
 {
-    vec3 Result = vec3(0.0f);
+    f32 Distance = RaySphereIntersect(Entry->Sphere, Origin, Direction);
+    if(Distance > 0.0f && Distance < Hit->Distance)
+    {
+        Hit->Distance = Distance;
+        Hit->MaterialIndex = Entry->MaterialIndex;
+        vec3 Point = Distance * Direction + Origin;
+        Hit->Normal = Normalize(Point - Entry->Sphere.Center);
+        Hit->UV = vec2(0.0f);
+    }
+}
+
+//Intersect ray with a mesh instance in its local space, updates the hit if closer
+internal void
+RayMeshEntryIntersect(world* World, mesh_entry* Entry, vec3 Origin, vec3 Direction, ray_hit* Hit)
+{
+    mesh_info* Mesh = &World->MeshesInfo[Entry->MeshIndex];
     
-    vec3 DebugColor = vec3(0.0f);
-#if DEBUG_COLORS
-    u32 RayBounceCount = 1;
-#else
-    u32 RayBounceCount = Bounces;
-#endif
+    vec3 lOrigin = WorldToLocalP(Entry, Origin);
+    vec3 lDirection = WorldToLocalN(Entry, Direction);
+    f32 lHitDistance = Hit->Distance * Entry->InvScaleDet; 
+    if(Hit->Distance == FLT_MAX)
+    {
+        lHitDistance = FLT_MAX;
+    }
     
-    vec3 Attenuation = vec3(1.0f);
+    vec3 lNormal;
+    vec2 UV;
     
-    // Keep going until we hit the max number of bounces
-    For(BounceIndex, RayBounceCount)
+    f32 lDistance = RayMeshAABBTreeIntersect(Mesh, World->BVHFormat, World->BVHLeafFormat, lOrigin, lDirection, lHitDistance, &lNormal, &UV);
+    
+    if(lDistance > 0.0f && lDistance < lHitDistance)
     {
-        f32 HitDistance = FLT_MAX;
-        
-        u32 HitMaterialIndex = (u32)-1;
-        vec3 HitNormal;
-        vec2 HitUV = vec2(0.0f);
+        Hit->Distance = lDistance * Entry->ScaleDet;
+        Hit->Normal = LocalToWorldN(Entry, lNormal);
+        Hit->UV = UV;
+        Hit->MaterialIndex = Entry->MaterialIndex;
+    }
+}
+
+//Intersect ray with the top level hierarchy, the objects of a leaf are intersected
+//only if the ray enters the leaf closer than the current hit
+internal void
+RayTLASIntersect(world* World, bvh_ray* Ray, ray_hit* Hit)
+{
+    tlas* TLAS = &World->TLAS;
+    flat_bvh_node* Nodes = TLAS->Nodes;
+    
+    bvh_stack_entry Stack[BVH_MAX_DEPTH];
+    u32 StackCount = 0;
+    
+    if(RayAABBSlabTest(&Nodes[0].AABB, Ray) >= Hit->Distance) return;
+    
+    u32 NodeIndex = 0;
+    while(true)
+    {
+        flat_bvh_node* Node = &Nodes[NodeIndex];
+        b32 HasNext = false;
         
-        //Intersect all planes
-        For(Index, World->PlanesCount)
+        if(Node->IndicesCount)
         {
-            plane_entry* Entry = &World->Planes[Index];
-            f32 Distance = RayPlaneIntersect(Entry->Plane, Origin, Direction);
-
-            if(Distance > 0.0f && Distance < HitDistance)
+            For(Index, Node->IndicesCount)
             {
-                HitDistance = Distance;
-                HitMaterialIndex = Entry->MaterialIndex;
-                HitNormal = Entry->Plane.Normal;
-                
-                DebugColor = (HitNormal + 1.0f) * 0.5f;
+                tlas_object* Object = &TLAS->Objects[Node->Offset + Index];
+                if(Object->Type == TLAS_OBJECT_SPHERE)
+                {
+                    RaySphereEntryIntersect(&World->Spheres[Object->Index], Ray->Origin, Ray->Direction, Hit);
+                }
+                else
+                {
+                    RayMeshEntryIntersect(World, &World->Meshes[Object->Index], Ray->Origin, Ray->Direction, Hit);
+                }
+            }
+        }
+        else
+        {
+            u32 LeftIndex = NodeIndex + 1;
+            u32 RightIndex = Node->Offset;
+            f32 LeftDistance = RayAABBSlabTest(&Nodes[LeftIndex].AABB, Ray);
+            f32 RightDistance = RayAABBSlabTest(&Nodes[RightIndex].AABB, Ray);
+            
+            b32 TraverseLeft = LeftDistance < Hit->Distance;
+            b32 TraverseRight = RightDistance < Hit->Distance;
+            
+            if(TraverseLeft && TraverseRight)
+            {
+                Assert(StackCount < BVH_MAX_DEPTH);
+                if(LeftDistance < RightDistance)
+                {
+                    Stack[StackCount].NodeIndex = RightIndex;
+                    Stack[StackCount++].Distance = RightDistance;
+                    NodeIndex = LeftIndex;
+                }
+                else
+                {
+                    Stack[StackCount].NodeIndex = LeftIndex;
+                    Stack[StackCount++].Distance = LeftDistance;
+                    NodeIndex = RightIndex;
+                }
+                HasNext = true;
+            }
+            else if(TraverseLeft || TraverseRight)
+            {
+                NodeIndex = TraverseLeft ? LeftIndex : RightIndex;
+                HasNext = true;
             }
         }
         
-        //Intersect all spheres
-        For(Index, World->SpheresCount)
+        //Pop nodes until we find one that is still closer than the current hit
+        while(!HasNext)
         {
-            sphere_entry* Entry = &World->Spheres[Index];
-            f32 Distance = RaySphereIntersect(Entry->Sphere, Origin, Direction);
-            if(Distance > 0.0f && Distance < HitDistance)
+            if(StackCount == 0) return;
+            bvh_stack_entry* Entry = &Stack[--StackCount];
+            if(Entry->Distance < Hit->Distance)
             {
-                HitDistance = Distance;
-                HitMaterialIndex = Entry->MaterialIndex;
-                vec3 Point = Distance * Direction + Origin;
-                HitNormal = Normalize(Point - Entry->Sphere.Center);
-                
-                DebugColor = (HitNormal + 1.0f) * 0.5f;
+                NodeIndex = Entry->NodeIndex;
+                HasNext = true;
             }
         }
+    }
+}
+
+//Initialize the hit with the closest plane, planes are not in the top level hierarchy
+//so they are always tested linearly
+internal void
+RayPlanesIntersect(world* World, vec3 Origin, vec3 Direction, ray_hit* Hit)
+{
+    Hit->Distance = FLT_MAX;
+    Hit->Normal = vec3(0.0f);
+    Hit->UV = vec2(0.0f);
+    Hit->MaterialIndex = (u32)-1;
+    
+    //Intersect all planes
+    For(Index, World->PlanesCount)
+    {
+        plane_entry* Entry = &World->Planes[Index];
+        f32 Distance = RayPlaneIntersect(Entry->Plane, Origin, Direction);
         
-        //Intersect all meshes
-        For(Index, World->MeshesCount)
+        if(Distance > 0.0f && Distance < Hit->Distance)
         {
-            mesh_entry* Entry = &World->Meshes[Index];
-            mesh_info* Mesh = &World->MeshesInfo[Entry->MeshIndex];
+            Hit->Distance = Distance;
+            Hit->MaterialIndex = Entry->MaterialIndex;
+            Hit->Normal = Entry->Plane.Normal;
+        }
+    }
+}
+
+//Find the closest hit of a ray with the world, planes are tested linearly and
+//spheres and meshes through the top level hierarchy
+internal void
+RayWorldIntersect(world* World, vec3 Origin, vec3 Direction, ray_hit* Hit)
+{
+    RayPlanesIntersect(World, Origin, Direction, Hit);
+    
+    if(World->TLAS.NodesCount)
+    {
+        bvh_ray Ray = MakeBVHRay(Origin, Direction);
+        RayTLASIntersect(World, &Ray, Hit);
+    }
+}
+
+//Compute the bounds used by the interval culling, the rays of the packet must be already set
+internal void
+ComputeRayPacketBounds(ray_packet* Packet)
+{
+    Packet->CanCull = Packet->Count > 0;
+    Packet->MinOrigin = vec3(FLT_MAX);
+    Packet->MaxOrigin = vec3(-FLT_MAX);
+    Packet->MinInvDirection = vec3(FLT_MAX);
+    Packet->MaxInvDirection = vec3(-FLT_MAX);
+    For(Axis, 3)
+    {
+        Packet->Sign[Axis] = Packet->Rays[0].Sign[Axis];
+    }
+    
+    For(Index, Packet->Count)
+    {
+        bvh_ray* Ray = &Packet->Rays[Index];
+        For(Axis, 3)
+        {
+            f32 Origin = Ray->Origin.e[Axis];
+            f32 InvDirection = Ray->InvDirection.e[Axis];
             
-            vec3 lOrigin = WorldToLocalP(Entry, Origin);
-            vec3 lDirection = WorldToLocalN(Entry, Direction);
-            f32 lHitDistance = HitDistance * Entry->InvScaleDet; 
-            if(HitDistance == FLT_MAX)
+            //Rays parallel to an axis would make the bounds infinite
+            if(Ray->Sign[Axis] != Packet->Sign[Axis] || !(fabsf(InvDirection) < FLT_MAX))
             {
-                lHitDistance = FLT_MAX;
+                Packet->CanCull = false;
             }
             
-            vec3 lNormal;
-            vec2 UV;
-            
-            f32 lDistance = RayMeshAABBTreeIntersect(Mesh, lOrigin, lDirection, lHitDistance, &lNormal, &UV);
-            
-            if(lDistance > 0.0f && lDistance < lHitDistance)
+            Packet->MinOrigin.e[Axis] = MIN(Packet->MinOrigin.e[Axis], Origin);
+            Packet->MaxOrigin.e[Axis] = MAX(Packet->MaxOrigin.e[Axis], Origin);
+            Packet->MinInvDirection.e[Axis] = MIN(Packet->MinInvDirection.e[Axis], InvDirection);
+            Packet->MaxInvDirection.e[Axis] = MAX(Packet->MaxInvDirection.e[Axis], InvDirection);
+        }
+    }
+}
+
+inline f32
+GetRayPacketMaxDistance(ray_packet* Packet)
+{
+    f32 Result = 0.0f;
+    For(Index, Packet->Count)
+    {
+        Result = MAX(Result, Packet->Distances[Index]);
+    }
+    return Result;
+}
+
+//Bounds of a * b for a in [AMin, AMax] and b in [BMin, BMax]
+inline void
+IntervalMul(f32 AMin, f32 AMax, f32 BMin, f32 BMax, f32* Min, f32* Max)
+{
+    f32 p0 = AMin * BMin;
+    f32 p1 = AMin * BMax;
+    f32 p2 = AMax * BMin;
+    f32 p3 = AMax * BMax;
+    *Min = MIN(MIN(p0, p1), MIN(p2, p3));
+    *Max = MAX(MAX(p0, p1), MAX(p2, p3));
+}
+
+//Returns true if no ray of the packet can hit the box closer than MaxDistance, computing
+//the slab distances with interval arithmetic over the origins and inverse directions of the packet
+inline b32
+RayPacketCullAABB(aabb* AABB, ray_packet* Packet, f32 MaxDistance)
+{
+    if(!Packet->CanCull) return false;
+    
+    vec3* Bounds = &AABB->Min;
+    f32 tmin = 0.0f;
+    f32 tmax = MaxDistance;
+    For(Axis, 3)
+    {
+        f32 Near = Bounds[Packet->Sign[Axis]].e[Axis];
+        f32 Far = Bounds[1 - Packet->Sign[Axis]].e[Axis];
+        f32 MinOrigin = Packet->MinOrigin.e[Axis];
+        f32 MaxOrigin = Packet->MaxOrigin.e[Axis];
+        f32 MinInvDirection = Packet->MinInvDirection.e[Axis];
+        f32 MaxInvDirection = Packet->MaxInvDirection.e[Axis];
+        
+        f32 NearMin, NearMax, FarMin, FarMax;
+        IntervalMul(Near - MaxOrigin, Near - MinOrigin, MinInvDirection, MaxInvDirection, &NearMin, &NearMax);
+        IntervalMul(Far - MaxOrigin, Far - MinOrigin, MinInvDirection, MaxInvDirection, &FarMin, &FarMax);
+        
+        tmin = MAX(tmin, NearMin);
+        tmax = MIN(tmax, FarMax);
+    }
+    
+    return tmin > tmax;
+}
+
+//Index of the first ray starting from First that hits the box closer than its current hit, Count if none
+inline u32
+RayPacketFirstHit(aabb* AABB, ray_packet* Packet, u32 First)
+{
+    for(u32 Index = First; Index < Packet->Count; Index++)
+    {
+        if(RayAABBSlabTest(AABB, &Packet->Rays[Index]) < Packet->Distances[Index]) return Index;
+    }
+    return Packet->Count;
+}
+
+//Push the children of an internal flat node, the one closer to the first active ray is visited first
+inline void
+PushRayPacketChildren(flat_bvh_node* Nodes, u32 NodeIndex, ray_packet* Packet, u32 First,
+                      ray_packet_stack_entry* Stack, u32* StackCount)
+{
+    u32 LeftIndex = NodeIndex + 1;
+    u32 RightIndex = Nodes[NodeIndex].Offset;
+    bvh_ray* Ray = &Packet->Rays[First];
+    b32 LeftFirst = RayAABBSlabTest(&Nodes[LeftIndex].AABB, Ray) <= RayAABBSlabTest(&Nodes[RightIndex].AABB, Ray);
+    
+    Assert(*StackCount + 2 <= BVH_MAX_DEPTH + 1);
+    Stack[*StackCount].NodeIndex = LeftFirst ? RightIndex : LeftIndex;
+    Stack[(*StackCount)++].FirstActive = First;
+    Stack[*StackCount].NodeIndex = LeftFirst ? LeftIndex : RightIndex;
+    Stack[(*StackCount)++].FirstActive = First;
+}
+
+//Intersect a packet of rays with a flattened aabbtree, nodes are skipped if the interval test
+//culls them or if no ray hits them, rays before the first one hitting a node are not tested in its subtree
+internal void
+RayPacketFlatBVHIntersect(flat_bvh_node* Nodes, ray_packet* Packet, bvh_leaves* Leaves, ray_triangle_intersection* Hits)
+{
+    ray_packet_stack_entry Stack[BVH_MAX_DEPTH + 1];
+    u32 StackCount = 0;
+    Stack[StackCount].NodeIndex = 0;
+    Stack[StackCount++].FirstActive = 0;
+    
+    f32 MaxDistance = GetRayPacketMaxDistance(Packet);
+    while(StackCount)
+    {
+        ray_packet_stack_entry Entry = Stack[--StackCount];
+        flat_bvh_node* Node = &Nodes[Entry.NodeIndex];
+        
+        if(RayPacketCullAABB(&Node->AABB, Packet, MaxDistance)) continue;
+        u32 First = RayPacketFirstHit(&Node->AABB, Packet, Entry.FirstActive);
+        if(First == Packet->Count) continue;
+        
+        if(Node->IndicesCount)
+        {
+            for(u32 Index = First; Index < Packet->Count; Index++)
             {
-                HitDistance = lDistance * Entry->ScaleDet;
-                HitNormal = LocalToWorldN(Entry, lNormal);
-                HitUV = UV;
-                HitMaterialIndex = Entry->MaterialIndex;
+                bvh_ray* Ray = &Packet->Rays[Index];
+                if(Index != First && RayAABBSlabTest(&Node->AABB, Ray) >= Packet->Distances[Index]) continue;
                 
-                DebugColor = (HitNormal + 1.0f) * 0.5f;
+                RayLeafIntersect(Leaves, Node->Offset, Node->IndicesCount, Ray, &Hits[Index]);
+                Packet->Distances[Index] = Hits[Index].Distance;
             }
+            MaxDistance = GetRayPacketMaxDistance(Packet);
         }
+        else
+        {
+            PushRayPacketChildren(Nodes, Entry.NodeIndex, Packet, First, Stack, &StackCount);
+        }
+    }
+}
+
+//Intersect the rays of a packet starting from First with a mesh instance, the rays are
+//transformed in a local packet. Only flat hierarchies are traversed as packets
+internal void
+RayPacketMeshEntryIntersect(world* World, mesh_entry* Entry, ray_packet* Packet, u32 First, ray_hit* Hits)
+{
+    if(World->BVHFormat != BVH_FORMAT_FLAT)
+    {
+        for(u32 Index = First; Index < Packet->Count; Index++)
+        {
+            bvh_ray* Ray = &Packet->Rays[Index];
+            RayMeshEntryIntersect(World, Entry, Ray->Origin, Ray->Direction, &Hits[Index]);
+            Packet->Distances[Index] = Hits[Index].Distance;
+        }
+        return;
+    }
+    
+    mesh_info* Mesh = &World->MeshesInfo[Entry->MeshIndex];
+    
+    ray_packet Local;
+    Local.Count = Packet->Count - First;
+    f32 lHitDistances[RAY_PACKET_SIZE];
+    ray_triangle_intersection Results[RAY_PACKET_SIZE];
+    For(Index, Local.Count)
+    {
+        bvh_ray* Ray = &Packet->Rays[First + Index];
+        Local.Rays[Index] = MakeBVHRay(WorldToLocalP(Entry, Ray->Origin), WorldToLocalN(Entry, Ray->Direction));
+        
+        f32 HitDistance = Packet->Distances[First + Index];
+        lHitDistances[Index] = HitDistance == FLT_MAX ? FLT_MAX : HitDistance * Entry->InvScaleDet;
+        Local.Distances[Index] = lHitDistances[Index];
+        Results[Index] = {};
+        Results[Index].Distance = lHitDistances[Index];
+    }
+    ComputeRayPacketBounds(&Local);
+    
+    bvh_leaves Leaves = GetMeshLeaves(Mesh, World->BVHLeafFormat);
+    RayPacketFlatBVHIntersect(Mesh->FlatBVH.Nodes, &Local, &Leaves, Results);
+    
+    For(Index, Local.Count)
+    {
+        ray_triangle_intersection* Result = &Results[Index];
+        if(Result->Distance > 0.0f && Result->Distance < lHitDistances[Index])
+        {
+            ray_hit* Hit = &Hits[First + Index];
+            vec3 lNormal;
+            GetMeshHitAttributes(Mesh, Result, &lNormal, &Hit->UV);
+            Hit->Distance = Result->Distance * Entry->ScaleDet;
+            Hit->Normal = LocalToWorldN(Entry, lNormal);
+            Hit->MaterialIndex = Entry->MaterialIndex;
+            Packet->Distances[First + Index] = Hit->Distance;
+        }
+    }
+}
+
+//Intersect a packet of rays with the top level hierarchy, same traversal as RayPacketFlatBVHIntersect
+internal void
+RayPacketTLASIntersect(world* World, ray_packet* Packet, ray_hit* Hits)
+{
+    tlas* TLAS = &World->TLAS;
+    flat_bvh_node* Nodes = TLAS->Nodes;
+    
+    ray_packet_stack_entry Stack[BVH_MAX_DEPTH + 1];
+    u32 StackCount = 0;
+    Stack[StackCount].NodeIndex = 0;
+    Stack[StackCount++].FirstActive = 0;
+    
+    f32 MaxDistance = GetRayPacketMaxDistance(Packet);
+    while(StackCount)
+    {
+        ray_packet_stack_entry Entry = Stack[--StackCount];
+        flat_bvh_node* Node = &Nodes[Entry.NodeIndex];
+        
+        if(RayPacketCullAABB(&Node->AABB, Packet, MaxDistance)) continue;
+        u32 First = RayPacketFirstHit(&Node->AABB, Packet, Entry.FirstActive);
+        if(First == Packet->Count) continue;
+        
+        if(Node->IndicesCount)
+        {
+            For(ObjectIndex, Node->IndicesCount)
+            {
+                tlas_object* Object = &TLAS->Objects[Node->Offset + ObjectIndex];
+                if(Object->Type == TLAS_OBJECT_SPHERE)
+                {
+                    sphere_entry* Sphere = &World->Spheres[Object->Index];
+                    for(u32 Index = First; Index < Packet->Count; Index++)
+                    {
+                        bvh_ray* Ray = &Packet->Rays[Index];
+                        RaySphereEntryIntersect(Sphere, Ray->Origin, Ray->Direction, &Hits[Index]);
+                        Packet->Distances[Index] = Hits[Index].Distance;
+                    }
+                }
+                else
+                {
+                    RayPacketMeshEntryIntersect(World, &World->Meshes[Object->Index], Packet, First, Hits);
+                }
+            }
+            MaxDistance = GetRayPacketMaxDistance(Packet);
+        }
+        else
+        {
+            PushRayPacketChildren(Nodes, Entry.NodeIndex, Packet, First, Stack, &StackCount);
+        }
+    }
+}
+
+//Find the closest hit of every ray of the packet with the world, like RayWorldIntersect
+internal void
+RayPacketWorldIntersect(world* World, ray_packet* Packet, ray_hit* Hits)
+{
+    For(Index, Packet->Count)
+    {
+        bvh_ray* Ray = &Packet->Rays[Index];
+        RayPlanesIntersect(World, Ray->Origin, Ray->Direction, &Hits[Index]);
+        Packet->Distances[Index] = Hits[Index].Distance;
+    }
+    
+    if(World->TLAS.NodesCount)
+    {
+        RayPacketTLASIntersect(World, Packet, Hits);
+    }
+}
+
+//Add the contribution of a hit to the path and compute the next ray, returns false if the path
+//ended because nothing was hit
+internal b32
+ShadePathHit(world* World, path_state* Path, ray_hit* Hit, random_series* Series)
+{
+    f32 HitDistance = Hit->Distance;
+    u32 HitMaterialIndex = Hit->MaterialIndex;
+    vec3 HitNormal = Hit->Normal;
+    vec2 HitUV = Hit->UV;
+    
+    vec3 Origin = Path->Origin;
+    vec3 Direction = Path->Direction;
+    vec3 Attenuation = Path->Attenuation;
+    
+    //Compute color and next ray direction if we have a hit
+    if(HitMaterialIndex != -1){
+        Assert(HitMaterialIndex < World->MaterialsCount);
+        material* Material = &World->Materials[HitMaterialIndex];
         
-        //Compute color and next ray direction if we have a hit
-        if(HitMaterialIndex != -1){
-            Assert(HitMaterialIndex < World->MaterialsCount);
-            material* Material = &World->Materials[HitMaterialIndex];
-            
 #if DEBUG_COLORS
-            Result = DebugColor;
+        Path->Color = (HitNormal + 1.0f) * 0.5f;
 #else
-            Result = Result + Attenuation * Material->Emit;
+        Path->Color = Path->Color + Attenuation * Material->Emit;
 #endif
-            vec3 Albedo = Material->Albedo;
-            if(Material->AlbedoTexture)
-            {
-                Albedo = vec3(BilinearSampleImage(Material->AlbedoTexture, HitUV));
-            }
+        vec3 Albedo = Material->Albedo;
+        if(Material->AlbedoTexture)
+        {
+            Albedo = vec3(BilinearSampleImage(Material->AlbedoTexture, HitUV));
+        }
+        
+        
+        Origin = Origin + Direction * HitDistance;
+        
+        //Specular material
+        if(Material->Specular)
+        {
             
+            f32 CosineFactor = Dot(-Direction, HitNormal);
+            if(CosineFactor < 0.0f) CosineFactor = 0.0f;
+            Attenuation = Attenuation * Albedo * CosineFactor;
             
-            Origin = Origin + Direction * HitDistance;
+            //Add a small tolerance value along normal to surface
+            Origin = Origin + HitNormal * 0.000001f;
+            vec3 PureBounce = Bounce(Direction, HitNormal);
+            vec3 RandBounce = Normalize(HitNormal + RandDir(Series));
+            // vec3 RandBounce = Normalize(HitNormal + vec3(RandNO(Series), RandNO(Series), RandNO(Series)));
             
-            //Specular material
-            if(Material->Specular)
-            {
-                
-                f32 CosineFactor = Dot(-Direction, HitNormal);
-                if(CosineFactor < 0.0f) CosineFactor = 0.0f;
-                Attenuation = Attenuation * Albedo * CosineFactor;
-                
-                //Add a small tolerance value along normal to surface
-                Origin = Origin + HitNormal * 0.000001f;
-                vec3 PureBounce = Bounce(Direction, HitNormal);
-                vec3 RandBounce = Normalize(HitNormal + RandDir(Series));
-                // vec3 RandBounce = Normalize(HitNormal + vec3(RandNO(Series), RandNO(Series), RandNO(Series)));
-                
-                Direction = Normalize(Lerp(RandBounce, PureBounce, Material->Specularity));
-            }
-            //Refractive material
-            else
-            {
-                
-                f32 CosineFactor = Dot(-Direction, HitNormal);
-                if(CosineFactor < 0.0f) CosineFactor = 0.0f;
-                Attenuation = Attenuation * Albedo * CosineFactor;
-                
-                //Add a small tolerance value along ray direction
-                Origin = Origin + Direction * 0.0001f;
-                vec3 Refr = Refract(Direction, HitNormal, Material->OneOverRefractiveIndex);
-                Direction = Normalize(Refr);
-            }
-        } else {
-            //Missed everything, add backgroung color and break
-            Result = Result + Attenuation * World->BackgroundColor;
-            break;
+            Direction = Normalize(Lerp(RandBounce, PureBounce, Material->Specularity));
+        }
+        //Refractive material
+        else
+        {
+            
+            f32 CosineFactor = Dot(-Direction, HitNormal);
+            if(CosineFactor < 0.0f) CosineFactor = 0.0f;
+            Attenuation = Attenuation * Albedo * CosineFactor;
+            
+            //Add a small tolerance value along ray direction
+            Origin = Origin + Direction * 0.0001f;
+            vec3 Refr = Refract(Direction, HitNormal, Material->OneOverRefractiveIndex);
+            Direction = Normalize(Refr);
         }
+        
+        Path->Origin = Origin;
+        Path->Direction = Direction;
+        Path->Attenuation = Attenuation;
+        return true;
+    } else {
+        //Missed everything, add backgroung color
+        Path->Color = Path->Color + Attenuation * World->BackgroundColor;
+        return false;
     }
+}
+
+//
+//If FirstHit is given it is used instead of intersecting the world for the first bounce
+internal vec3
+RayCast(world* World, vec3 Origin, vec3 Direction, u32 Bounces, random_series* Series, ray_hit* FirstHit = 0)
+{
+#if DEBUG_COLORS
+    u32 RayBounceCount = 1;
+#else
+    u32 RayBounceCount = Bounces;
+#endif
     
-    return Result;
+    path_state Path;
+    Path.Origin = Origin;
+    Path.Direction = Direction;
+    Path.Attenuation = vec3(1.0f);
+    Path.Color = vec3(0.0f);
+    
+    // Keep going until we hit the max number of bounces
+    For(BounceIndex, RayBounceCount)
+    {
+        ray_hit Hit;
+        if(BounceIndex == 0 && FirstHit)
+        {
+            Hit = *FirstHit;
+        }
+        else
+        {
+            RayWorldIntersect(World, Path.Origin, Path.Direction, &Hit);
+        }
+        
+        if(!ShadePathHit(World, &Path, &Hit, Series)) break;
+    }
+    
+    return Path.Color;
 }
 
 
@@ -6,3 +6,77 @@ struct ray_triangle_intersection
     u32 i2;
     vec3 UVW;
 };
+
+//Ray with the values used by the slab tests precomputed once per traversal
+struct bvh_ray
+{
+    vec3 Origin;
+    vec3 Direction;
+    vec3 InvDirection;
+    u32 Sign[3]; //1 if the direction is negative along the axis
+    
+    //Watertight triangle test: axes permuted so that z is the largest direction component, and the
+    //shear that makes the direction (0, 0, 1) in them
+    u32 ShearAxis[3];
+    vec3 Shear;
+};
+
+//Data needed to intersect the triangles referenced by the leaves of a mesh hierarchy
+struct bvh_leaves
+{
+    bvh_leaf_format Format;
+    u32* Indices;
+    vec3* Positions;
+    triangle_packet* Packets;
+    u16* LocalLeaves; //Leaf offsets are in 16 bit units
+};
+
+//Node pushed on the traversal stack with the distance at which the ray enters it
+struct bvh_stack_entry
+{
+    u32 NodeIndex;
+    f32 Distance;
+};
+
+//Closest hit of a ray with the world
+struct ray_hit
+{
+    f32 Distance;
+    vec3 Normal;
+    vec2 UV;
+    u32 MaterialIndex; //-1 if nothing was hit
+};
+
+//State of a path carried between bounces
+struct path_state
+{
+    vec3 Origin;
+    vec3 Direction;
+    vec3 Attenuation;
+    vec3 Color; //Light gathered so far
+};
+
+//Rays traced together through the hierarchies, the bounds of origins and inverse directions
+//are used to cull nodes that no ray of the packet can hit
+#define RAY_PACKET_SIZE (RAY_PACKET_WIDTH * RAY_PACKET_WIDTH)
+struct ray_packet
+{
+    bvh_ray Rays[RAY_PACKET_SIZE];
+    f32 Distances[RAY_PACKET_SIZE]; //Closest hit found so far by each ray
+    u32 Count;
+    
+    //Interval culling is only done if all the rays have the same direction signs
+    b32 CanCull;
+    u32 Sign[3];
+    vec3 MinOrigin;
+    vec3 MaxOrigin;
+    vec3 MinInvDirection;
+    vec3 MaxInvDirection;
+};
+
+//Node to visit with the index of the first ray of the packet that can still hit it
+struct ray_packet_stack_entry
+{
+    u32 NodeIndex;
+    u32 FirstActive;
+};
@@ -0,0 +1,243 @@
+#include "scene.h"
+
+//Camera at Position looking towards Target with Z up
+internal camera
+LookAtCamera(vec3 Position, vec3 Target)
+{
+    camera Camera;
+    Camera.P = Position;
+    Camera.Z = Normalize(Target - Position);
+    Camera.X = Normalize(Cross(vec3(0, 0, 1), Camera.Z));
+    Camera.Y = Normalize(Cross(Camera.Z, Camera.X));
+    return Camera;
+}
+
+//Push a grid of small spheres with random materials on the z = 0 plane
+internal void
+PushSphereGrid(world* World, u32 SpheresX, u32 SpheresY, f32 Range, u32 FirstMaterial, u32 MaterialsCount)
+{
+    random_series ColSeries = RandSeries(324634);
+    random_series PosSeries = RandSeries(3634);
+    random_series SizeSeries = RandSeries(33);
+    
+    f32 Center = Range * 0.5f;
+    For(y, SpheresY)
+    {
+        For(x, SpheresX)
+        {
+            f32 Radius = RandRange(&SizeSeries, 0.2f, 0.3f);
+            f32 Off = 0.5f;
+
+            vec3 Position;
+            Position.x = (f32)x / SpheresX * Range - Center + RandRange(&PosSeries, -Off, Off);
+            Position.y = (f32)y / SpheresY * Range - Center + RandRange(&PosSeries, -Off, Off);
+            Position.z = Radius;
+            
+            
+            u32 Material = RandU32(&ColSeries) % MaterialsCount + FirstMaterial;
+            
+            PushSphere(World, Position, Radius, Material);
+        }
+    }
+}
+
+//Push the materials used by the sphere grids, returns the index of the first one
+internal u32
+PushSphereMaterials(world* World)
+{
+    u32 FirstSphereMaterial = World->MaterialsCount;
+    PushMaterial(World, vec3(1,1,1), vec3(0), 1.0f);
+    PushMaterial(World, vec3(1,0,0), vec3(0), 0.1f);
+    PushMaterial(World, vec3(0,1,0), vec3(0), 0.8f);
+    PushMaterial(World, vec3(0,0,1), vec3(0), 0.2f);
+    
+    PushMaterial(World, vec3(0.3f,0.2f,0.6f), vec3(0), 0.2f);
+    PushMaterial(World, vec3(1.0f,0.2f,0.1f), vec3(0), 0.3f);
+    PushMaterial(World, vec3(1.0f,0.6f,0.1f), vec3(0), 0.8f);
+    PushMaterial(World, vec3(0.3f, 1, 0.8f), vec3(0), 0.6f);
+    
+    return FirstSphereMaterial;
+}
+
+//Height of the generated terrain at (x, y) and its partial derivatives
+internal f32
+TerrainHeight(f32 x, f32 y, f32* dx, f32* dy)
+{
+    f32 Height = 0.15f * sinf(3.0f * x) * cosf(2.0f * y) + 0.05f * sinf(9.0f * x + 1.0f) * sinf(7.0f * y);
+    *dx = 0.45f * cosf(3.0f * x) * cosf(2.0f * y) + 0.45f * cosf(9.0f * x + 1.0f) * sinf(7.0f * y);
+    *dy = -0.3f * sinf(3.0f * x) * sinf(2.0f * y) + 0.35f * sinf(9.0f * x + 1.0f) * cosf(7.0f * y);
+    return Height;
+}
+
+//Height field over [-1, 1] x [-1, 1] with Z up made of Resolution^2 quads
+internal mesh_data
+GenerateTerrainMesh(u32 Resolution)
+{
+    mesh_data Mesh = {};
+    u32 Side = Resolution + 1;
+    Mesh.VerticesCount = Side * Side;
+    Mesh.Positions = (vec3*)ZeroAlloc(sizeof(vec3) * Mesh.VerticesCount);
+    Mesh.Normals = (vec3*)ZeroAlloc(sizeof(vec3) * Mesh.VerticesCount);
+    Mesh.UVs = (vec2*)ZeroAlloc(sizeof(vec2) * Mesh.VerticesCount);
+    
+    For(y, Side)
+    {
+        For(x, Side)
+        {
+            u32 Index = x + y * Side;
+            vec2 UV = vec2((f32)x / Resolution, (f32)y / Resolution);
+            f32 PosX = UV.x * 2.0f - 1.0f;
+            f32 PosY = UV.y * 2.0f - 1.0f;
+            f32 dx, dy;
+            f32 Height = TerrainHeight(PosX, PosY, &dx, &dy);
+            
+            Mesh.Positions[Index] = vec3(PosX, PosY, Height);
+            Mesh.Normals[Index] = Normalize(vec3(-dx, -dy, 1.0f));
+            Mesh.UVs[Index] = UV;
+        }
+    }
+    
+    //Two counter clockwise triangles per quad
+    Mesh.IndicesCount = Resolution * Resolution * 6;
+    Mesh.Indices = (u32*)ZeroAlloc(sizeof(u32) * Mesh.IndicesCount);
+    u32* Index = Mesh.Indices;
+    For(y, Resolution)
+    {
+        For(x, Resolution)
+        {
+            u32 i00 = x + y * Side;
+            u32 i10 = i00 + 1;
+            u32 i01 = i00 + Side;
+            u32 i11 = i01 + 1;
+            
+            *Index++ = i00; *Index++ = i10; *Index++ = i11;
+            *Index++ = i00; *Index++ = i11; *Index++ = i01;
+        }
+    }
+    
+    return Mesh;
+}
+
+//Push the first mesh of a collada file transformed by ModelMatrix. With UseCache, if a cache
+//preprocessed with the same settings exists next to the file the mesh is loaded from it,
+//otherwise the cache is written after preprocessing. Big arrays of the file are parsed by all the
+//threads of Pool. Returns false if the file can't be loaded
+internal bool
+PushColladaMeshInfo(world* World, char* Path, mat4 ModelMatrix, bvh_build_settings* Settings, bool UseCache,
+                    thread_pool* Pool)
+{
+    //The pointer tree is not cached
+    u64 CacheKey = 0;
+    char* CachePath = 0;
+    if(UseCache && Settings->Format != BVH_FORMAT_TREE)
+    {
+        CacheKey = GetMeshCacheKey(Path, ModelMatrix, Settings);
+        if(CacheKey)
+        {
+            CachePath = (char*)ZeroAlloc(strlen(Path) + 32);
+            GetMeshCachePath(CachePath, Path, CacheKey);
+            
+            cached_mesh Cached;
+            if(LoadMeshCache(CachePath, CacheKey, &Cached))
+            {
+                PushPreprocessedMeshInfo(World, &Cached);
+                Free(CachePath);
+                return true;
+            }
+        }
+    }
+    
+    collada_scene Scene = ReadColladaFromFile(Path, Pool);
+    if(Scene.MeshesCount == 0) {
+        Free(CachePath);
+        return false;
+    }
+    mesh_data Mesh = Scene.Meshes[0];
+    TransformMeshVertices(&Mesh, ModelMatrix);
+    
+    //The world owns the first mesh, the others are not used
+    for(u32 Index = 1; Index < Scene.MeshesCount; Index++)
+    {
+        FreeMeshData(&Scene.Meshes[Index]);
+    }
+    SbufFree(Scene.Meshes);
+    
+    PushCachedMeshInfo(World, &Mesh, CachePath, CacheKey);
+    return true;
+}
+
+//Allocate the world of a scene and fill its objects and camera, meshes are preprocessed
+//later with Settings unless they are loaded from a cache. Returns false if an asset of
+//the scene can't be loaded, the world is then already freed
+internal bool
+BuildScene(scene Scene, bvh_build_settings* Settings, bool UseMeshCache, thread_pool* Pool, world* Result, camera* Camera)
+{
+    world World = AllocWorld(vec3(0.7f, 0.9f, 1.0f));
+    
+    PushMaterial(&World, vec3(0.5f, 0.5f, 0.5f), vec3(0.0f), 0.1f);
+    PushMaterial(&World, vec3(0.7f, 0.5f, 0.3f), vec3(0.0f), 0.3f);
+    PushMaterial(&World, vec3(0.3f, 0.6f, 0.9f), vec3(0.0f), 0.8f);
+    PushMaterial(&World, vec3(0.0f), vec3(0.9f, 0.0, 0.0f), 0.0f);
+    
+    //Meshes
+    PushMaterial(&World, vec3(1, 1, 1), vec3(0.0f), 1.0f);
+    PushMaterial(&World, vec3(0.3f, 0.6f, 0.9f), vec3(0.0f), 0.8f);
+    PushMaterial(&World, vec3(0.804f, 0.498f, 0.196f), vec3(0.0f), 0.9f);
+    
+    PushPlane(&World, vec3(0, 0, 1), 0.0f, 0);
+    PushSphere(&World, vec3(5.5, 7, 2.5), 2.5f, 4);
+    PushSphere(&World, vec3(-5.5, 7, 2.5), 2.5f, 4);
+    
+    switch(Scene)
+    {
+        case SCENE_DRAGONS: {
+            char* DragonPath = "../res/dragon.dae";
+            //Transform to Z up
+            mat4 ModelMatrix = Mat4Rotate(90.0f, vec3(1.0f, 0.0f, 0.0f));
+            if(!PushColladaMeshInfo(&World, DragonPath, ModelMatrix, Settings, UseMeshCache, Pool)) {
+                printf("Failed to load collada file at %s\n", DragonPath);
+                FreeWorld(&World);
+                return false;
+            }
+
+            f32 DragonBigScale = 0.3f;
+            f32 DragonSmallScale = 0.20f;
+            PushMesh(&World, 0, vec3(-2.0f, 0.0f, 0.0f), Mat3Rotate(vec3(0.0f, 0.0f, 1.0f), 90.0f), vec3(DragonSmallScale), 5);
+            PushMesh(&World, 0, vec3(0.0f,  0.0f, 0.0f), Mat3Rotate(vec3(0.0f, 0.0f, 1.0f), 90.0f), vec3(DragonBigScale), 4);
+            PushMesh(&World, 0, vec3(2.0f,  0.0f, 0.0f), Mat3Rotate(vec3(0.0f, 0.0f, 1.0f), 90.0f), vec3(DragonSmallScale), 6);
+            
+            u32 FirstSphereMaterial = PushSphereMaterials(&World);
+            PushSphereGrid(&World, 15, 15, 30.0f, FirstSphereMaterial, World.MaterialsCount - FirstSphereMaterial);
+        } break;
+        
+        case SCENE_SPHERES: {
+            u32 FirstSphereMaterial = PushSphereMaterials(&World);
+            PushSphereGrid(&World, 30, 30, 30.0f, FirstSphereMaterial, World.MaterialsCount - FirstSphereMaterial);
+        } break;
+        
+        case SCENE_TERRAIN: {
+            mesh_data Terrain = GenerateTerrainMesh(TERRAIN_RESOLUTION);
+            PushMeshInfo(&World, &Terrain);
+            
+            //3x3 instances slightly above the plane, the far ones are rotated
+            For(y, 3)
+            {
+                For(x, 3)
+                {
+                    vec3 Position = vec3(((f32)x - 1.0f) * 4.0f, (f32)y * 4.0f, 0.5f);
+                    mat3 Rotation = Mat3Rotate(vec3(0.0f, 0.0f, 1.0f), (f32)(y * 90));
+                    PushMesh(&World, 0, Position, Rotation, vec3(2.0f), 4 + (x + y) % 3);
+                }
+            }
+        } break;
+        
+        default: {
+            Assert(0);
+        } break;
+    }
+    
+    *Camera = LookAtCamera(vec3(0, -10, 1), vec3(0, 0, 1));
+    *Result = World;
+    
+    return true;
+}
@@ -0,0 +1,23 @@
+//Scenes that can be rendered, the synthetic ones are generated and do not need resource files
+enum scene
+{
+    SCENE_DRAGONS, //Dragon meshes and spheres loaded from ../res/dragon.dae
+    SCENE_SPHERES, //Only spheres and a plane
+    SCENE_TERRAIN, //Instances of a generated height field mesh
+    
+    SCENE_COUNT,
+};
+
+char* SceneNames[SCENE_COUNT] = {
+    "dragons",
+    "spheres",
+    "terrain",
+};
+
+struct camera
+{
+    vec3 P;
+    vec3 X;
+    vec3 Y;
+    vec3 Z;
+};
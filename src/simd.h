@@ -0,0 +1,128 @@
+#include <immintrin.h>
+
+//Lanes used by the SIMD code, 8 with AVX2 and 4 with SSE which is always available on x64
+#if defined(__AVX2__)
+#define SIMD_WIDTH 8
+
+typedef __m256 wide_f32;
+
+#define WideSet1(x) _mm256_set1_ps(x)
+#define WideLoad(p) _mm256_loadu_ps(p)
+#define WideStore(p, a) _mm256_storeu_ps(p, a)
+#define WideAdd(a, b) _mm256_add_ps(a, b)
+#define WideSub(a, b) _mm256_sub_ps(a, b)
+#define WideMul(a, b) _mm256_mul_ps(a, b)
+//If one of the operands is NaN the second one is returned
+#define WideMin(a, b) _mm256_min_ps(a, b)
+#define WideMax(a, b) _mm256_max_ps(a, b)
+//Bitmask with one bit per lane
+#define WideMaskLE(a, b) _mm256_movemask_ps(_mm256_cmp_ps(a, b, _CMP_LE_OQ))
+
+#define WideDiv(a, b) _mm256_div_ps(a, b)
+//Comparisons return all bits set in the lanes where they are true
+#define WideLess(a, b) _mm256_cmp_ps(a, b, _CMP_LT_OQ)
+#define WideLessEqual(a, b) _mm256_cmp_ps(a, b, _CMP_LE_OQ)
+#define WideAnd(a, b) _mm256_and_ps(a, b)
+#define WideMoveMask(a) _mm256_movemask_ps(a)
+
+//Load SIMD_WIDTH unsigned bytes converted to floats
+#define WideLoadU8(p) _mm256_cvtepi32_ps(_mm256_cvtepu8_epi32(_mm_loadl_epi64((__m128i*)(p))))
+
+#else
+#define SIMD_WIDTH 4
+
+typedef __m128 wide_f32;
+
+#define WideSet1(x) _mm_set1_ps(x)
+#define WideLoad(p) _mm_loadu_ps(p)
+#define WideStore(p, a) _mm_storeu_ps(p, a)
+#define WideAdd(a, b) _mm_add_ps(a, b)
+#define WideSub(a, b) _mm_sub_ps(a, b)
+#define WideMul(a, b) _mm_mul_ps(a, b)
+//If one of the operands is NaN the second one is returned
+#define WideMin(a, b) _mm_min_ps(a, b)
+#define WideMax(a, b) _mm_max_ps(a, b)
+//Bitmask with one bit per lane
+#define WideMaskLE(a, b) _mm_movemask_ps(_mm_cmple_ps(a, b))
+
+#define WideDiv(a, b) _mm_div_ps(a, b)
+//Comparisons return all bits set in the lanes where they are true
+#define WideLess(a, b) _mm_cmplt_ps(a, b)
+#define WideLessEqual(a, b) _mm_cmple_ps(a, b)
+#define WideAnd(a, b) _mm_and_ps(a, b)
+#define WideMoveMask(a) _mm_movemask_ps(a)
+
+//Load SIMD_WIDTH unsigned bytes converted to floats, SSE2 has no zero extension from bytes so they are unpacked with zeros
+inline wide_f32
+WideLoadU8(u8* p)
+{
+    s32 Bytes;
+    memcpy(&Bytes, p, sizeof(Bytes));
+    __m128i Zero = _mm_setzero_si128();
+    __m128i Words = _mm_unpacklo_epi8(_mm_cvtsi32_si128(Bytes), Zero);
+    return _mm_cvtepi32_ps(_mm_unpacklo_epi16(Words, Zero));
+}
+
+#endif
+
+//Index of the lowest set bit, v must not be 0
+inline u32
+FindLowestSetBit(u32 v)
+{
+#ifdef COMPILER_MSVC
+    unsigned long Index = 0;
+    _BitScanForward(&Index, v);
+    return Index;
+#else
+    return __builtin_ctz(v);
+#endif
+}
+
+//Number of set bits
+inline u32
+CountSetBits(u32 v)
+{
+#ifdef COMPILER_MSVC
+    return __popcnt(v);
+#else
+    return __builtin_popcount(v);
+#endif
+}
+
+//Number of zero bits above the highest set bit, v must not be 0
+inline u32
+CountLeadingZeros(u32 v)
+{
+#ifdef COMPILER_MSVC
+    unsigned long Index = 0;
+    _BitScanReverse(&Index, v);
+    return 31 - Index;
+#else
+    return __builtin_clz(v);
+#endif
+}
+
+inline u32
+CountLeadingZeros64(u64 v)
+{
+#ifdef COMPILER_MSVC
+    unsigned long Index = 0;
+    _BitScanReverse64(&Index, v);
+    return 63 - Index;
+#else
+    return __builtin_clzll(v);
+#endif
+}
+
+//Low 64 bits of the full 128 bit product, the high ones go to High
+inline u64
+MultiplyU64(u64 a, u64 b, u64* High)
+{
+#ifdef COMPILER_MSVC
+    return _umul128(a, b, High);
+#else
+    unsigned __int128 Product = (unsigned __int128)a * b;
+    *High = (u64)(Product >> 64);
+    return (u64)Product;
+#endif
+}
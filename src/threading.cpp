@@ -27,19 +27,281 @@ s64 InterlockedAdd64(volatile s64* ptr, s64 value)
     return __sync_add_and_fetch(ptr, value);
 }
 
+u32 InterlockedDecrement(volatile u32* ptr)
+{
+    return __sync_sub_and_fetch(ptr, 1);
+}
+
+//Returns the initial value
+u32 InterlockedCompareExchange(volatile u32* ptr, u32 Exchange, u32 Comparand)
+{
+    return __sync_val_compare_and_swap(ptr, Comparand, Exchange);
+}
+
 #endif
 
 
 
 typedef THREAD_PROC(thread_proc);
 
+//Data written by different threads is kept on different cache lines to avoid false sharing
+#define CACHE_LINE_SIZE 64
+
+//Allocate zeroed memory starting at a cache line boundary, must be freed with FreeCacheAligned
+internal void*
+ZeroAllocCacheAligned(size_t Size)
+{
+    //The original pointer is stored right before the aligned one
+    u8* Memory = (u8*)ZeroAlloc(Size + CACHE_LINE_SIZE + sizeof(void*));
+    uintptr_t Aligned = ((uintptr_t)Memory + sizeof(void*) + CACHE_LINE_SIZE - 1) & ~(uintptr_t)(CACHE_LINE_SIZE - 1);
+    ((void**)Aligned)[-1] = Memory;
+    return (void*)Aligned;
+}
+
 internal void
-CreateWorkerThread(thread_proc Proc, void* Data)
+FreeCacheAligned(void* Memory)
 {
+    if(Memory) Free(((void**)Memory)[-1]);
+}
+
 #ifdef _WIN32
-    CreateThread(0, 0, Proc, Data, 0, 0);
+typedef HANDLE thread_handle;
+typedef CRITICAL_SECTION thread_mutex;
+typedef CONDITION_VARIABLE thread_condition;
+#else
+typedef pthread_t thread_handle;
+typedef pthread_mutex_t thread_mutex;
+typedef pthread_cond_t thread_condition;
+#endif
+
+internal thread_handle
+StartThread(thread_proc Proc, void* Data)
+{
+#ifdef _WIN32
+    return CreateThread(0, 0, Proc, Data, 0, 0);
 #else
     pthread_t Thread;
     pthread_create(&Thread, 0, Proc, Data);
+    return Thread;
+#endif
+}
+
+internal void
+JoinThread(thread_handle Thread)
+{
+#ifdef _WIN32
+    WaitForSingleObject(Thread, INFINITE);
+    CloseHandle(Thread);
+#else
+    pthread_join(Thread, 0);
+#endif
+}
+
+inline void
+InitMutex(thread_mutex* Mutex)
+{
+#ifdef _WIN32
+    InitializeCriticalSection(Mutex);
+#else
+    pthread_mutex_init(Mutex, 0);
+#endif
+}
+
+inline void
+DestroyMutex(thread_mutex* Mutex)
+{
+#ifdef _WIN32
+    DeleteCriticalSection(Mutex);
+#else
+    pthread_mutex_destroy(Mutex);
+#endif
+}
+
+inline void
+LockMutex(thread_mutex* Mutex)
+{
+#ifdef _WIN32
+    EnterCriticalSection(Mutex);
+#else
+    pthread_mutex_lock(Mutex);
+#endif
+}
+
+inline void
+UnlockMutex(thread_mutex* Mutex)
+{
+#ifdef _WIN32
+    LeaveCriticalSection(Mutex);
+#else
+    pthread_mutex_unlock(Mutex);
+#endif
+}
+
+inline void
+InitCondition(thread_condition* Condition)
+{
+#ifdef _WIN32
+    InitializeConditionVariable(Condition);
+#else
+    pthread_cond_init(Condition, 0);
 #endif
-}
\ No newline at end of file
+}
+
+inline void
+DestroyCondition(thread_condition* Condition)
+{
+#ifdef _WIN32
+    //Windows condition variables don't need to be destroyed
+#else
+    pthread_cond_destroy(Condition);
+#endif
+}
+
+//Mutex must be locked, it is released while waiting and locked again before returning
+inline void
+WaitCondition(thread_condition* Condition, thread_mutex* Mutex)
+{
+#ifdef _WIN32
+    SleepConditionVariableCS(Condition, Mutex, INFINITE);
+#else
+    pthread_cond_wait(Condition, Mutex);
+#endif
+}
+
+inline void
+WakeAllCondition(thread_condition* Condition)
+{
+#ifdef _WIN32
+    WakeAllConditionVariable(Condition);
+#else
+    pthread_cond_broadcast(Condition);
+#endif
+}
+
+//Threads created once that wait parked on a condition variable for jobs,
+//every job is run by all the threads of the pool with the same data
+struct thread_pool
+{
+    thread_handle* Threads;
+    u32 ThreadsCount;
+    
+    thread_mutex Mutex;
+    thread_condition JobStarted;
+    thread_condition JobDone;
+    
+    //Protected by Mutex
+    thread_proc* Proc;
+    void* Data;
+    u32 JobIndex;     //Incremented when a job is started
+    u32 ThreadsRunning;
+    b32 Quit;
+};
+
+THREAD_PROC(ThreadPoolProc)
+{
+    thread_pool* Pool = (thread_pool*)Data;
+    u32 LastJobIndex = 0;
+    
+    LockMutex(&Pool->Mutex);
+    while(true)
+    {
+        while(!Pool->Quit && Pool->JobIndex == LastJobIndex)
+        {
+            WaitCondition(&Pool->JobStarted, &Pool->Mutex);
+        }
+        if(Pool->Quit) break;
+        
+        LastJobIndex = Pool->JobIndex;
+        thread_proc* Proc = Pool->Proc;
+        void* JobData = Pool->Data;
+        
+        UnlockMutex(&Pool->Mutex);
+        Proc(JobData);
+        LockMutex(&Pool->Mutex);
+        
+        if(--Pool->ThreadsRunning == 0)
+        {
+            WakeAllCondition(&Pool->JobDone);
+        }
+    }
+    UnlockMutex(&Pool->Mutex);
+    
+    return 0;
+}
+
+internal void
+CreateThreadPool(thread_pool* Pool, u32 ThreadsCount)
+{
+    *Pool = {};
+    InitMutex(&Pool->Mutex);
+    InitCondition(&Pool->JobStarted);
+    InitCondition(&Pool->JobDone);
+    
+    Pool->ThreadsCount = ThreadsCount;
+    Pool->Threads = (thread_handle*)ZeroAlloc(sizeof(thread_handle) * MAX(ThreadsCount, 1));
+    For(Index, ThreadsCount)
+    {
+        Pool->Threads[Index] = StartThread(ThreadPoolProc, Pool);
+    }
+}
+
+//Wake all the threads of the pool to run Proc(Data), a previous job must be already finished
+internal void
+StartThreadPoolJob(thread_pool* Pool, thread_proc* Proc, void* Data)
+{
+    LockMutex(&Pool->Mutex);
+    Assert(Pool->ThreadsRunning == 0);
+    Pool->Proc = Proc;
+    Pool->Data = Data;
+    Pool->ThreadsRunning = Pool->ThreadsCount;
+    Pool->JobIndex++;
+    WakeAllCondition(&Pool->JobStarted);
+    UnlockMutex(&Pool->Mutex);
+}
+
+//Block until all the threads of the pool have finished the current job
+internal void
+WaitThreadPoolJob(thread_pool* Pool)
+{
+    LockMutex(&Pool->Mutex);
+    while(Pool->ThreadsRunning)
+    {
+        WaitCondition(&Pool->JobDone, &Pool->Mutex);
+    }
+    UnlockMutex(&Pool->Mutex);
+}
+
+internal void
+DestroyThreadPool(thread_pool* Pool)
+{
+    LockMutex(&Pool->Mutex);
+    Pool->Quit = true;
+    WakeAllCondition(&Pool->JobStarted);
+    UnlockMutex(&Pool->Mutex);
+    
+    For(Index, Pool->ThreadsCount)
+    {
+        JoinThread(Pool->Threads[Index]);
+    }
+    Free(Pool->Threads);
+    
+    DestroyCondition(&Pool->JobStarted);
+    DestroyCondition(&Pool->JobDone);
+    DestroyMutex(&Pool->Mutex);
+}
+
+//Spin lock for short critical sections, 0 is unlocked
+inline void
+LockSpinLock(volatile u32* Lock)
+{
+    while(InterlockedCompareExchange(Lock, 1, 0) != 0)
+    {
+        _mm_pause();
+    }
+}
+
+inline void
+UnlockSpinLock(volatile u32* Lock)
+{
+    InterlockedCompareExchange(Lock, 0, 1);
+}
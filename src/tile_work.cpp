@@ -1,5 +1,272 @@
 #include "tile_work.h"
 
+//Compute the tiles of the image with a size picked from the resolution and the number of workers,
+//and deal them to the worker deques
+internal tile_work_scheduler
+CreateTileWorkScheduler(u32 OutputWidth, u32 OutputHeight, u32 WorkersCount)
+{
+    tile_work_scheduler Scheduler = {};
+    Scheduler.DequesCount = WorkersCount;
+    Scheduler.Seed = rand();
+    Scheduler.MinTileSize = MIN_TILE_SIZE;
+    Scheduler.TotalPixels = (s64)OutputWidth * OutputHeight;
+    
+    //Start with about TILES_PER_THREAD tiles per worker, splitting takes care of the imbalance
+    f32 TilePixels = (f32)Scheduler.TotalPixels / (f32)(WorkersCount * TILES_PER_THREAD);
+    u32 TileSize = (u32)sqrtf(TilePixels);
+    TileSize = MAX(MIN_TILE_SIZE, MIN(MAX_TILE_SIZE, TileSize));
+    
+    u32 TilesX = (OutputWidth + TileSize - 1) / TileSize;
+    u32 TilesY = (OutputHeight + TileSize - 1) / TileSize;
+    u32 TilesCount = TilesX * TilesY;
+    Scheduler.MaxTilePixels = TileSize * TileSize;
+    
+    //Owners only push back tiles they split when their deque is empty
+    u32 Capacity = (TilesCount + WorkersCount - 1) / WorkersCount + 1;
+    Scheduler.Deques = (tile_work_deque*)ZeroAllocCacheAligned(sizeof(tile_work_deque) * WorkersCount);
+    Scheduler.WorkerStats = (tile_worker_stats*)ZeroAllocCacheAligned(sizeof(tile_worker_stats) * WorkersCount);
+    For(Index, WorkersCount)
+    {
+        tile_work_deque* Deque = &Scheduler.Deques[Index];
+        Deque->Capacity = Capacity;
+        Deque->Entries = (tile_work_entry*)ZeroAlloc(sizeof(tile_work_entry) * Capacity);
+    }
+    
+    //Neighbouring tiles go to different workers to spread expensive areas
+    For(y, TilesY)
+    {
+        For(x, TilesX)
+        {
+            u32 TileIndex = y * TilesX + x;
+            tile_work_deque* Deque = &Scheduler.Deques[TileIndex % WorkersCount];
+            tile_work_entry* Entry = &Deque->Entries[Deque->Count++];
+            Entry->x = x * TileSize;
+            Entry->y = y * TileSize;
+            Entry->CountX = MIN(TileSize, OutputWidth - Entry->x);
+            Entry->CountY = MIN(TileSize, OutputHeight - Entry->y);
+        }
+    }
+    
+    return Scheduler;
+}
+
+internal void
+FreeTileWorkScheduler(tile_work_scheduler* Scheduler)
+{
+    For(Index, Scheduler->DequesCount)
+    {
+        Free(Scheduler->Deques[Index].Entries);
+    }
+    FreeCacheAligned(Scheduler->Deques);
+    FreeCacheAligned(Scheduler->WorkerStats);
+    *Scheduler = {};
+}
+
+//Sum of the stats of all the workers
+internal tile_worker_stats
+GetTileWorkStats(tile_work_scheduler* Scheduler)
+{
+    tile_worker_stats Result = {};
+#if SHARED_RAY_COUNTERS
+    Result.RaysCasted = Scheduler->RaysCasted;
+    Result.TriangleTestsPassed = Scheduler->TriangleTestsPassed;
+    Result.TriangleTestsTotal = Scheduler->TriangleTestsTotal;
+#else
+    For(Index, Scheduler->DequesCount)
+    {
+        tile_worker_stats* Stats = &Scheduler->WorkerStats[Index];
+        Result.RaysCasted += Stats->RaysCasted;
+        Result.TriangleTestsPassed += Stats->TriangleTestsPassed;
+        Result.TriangleTestsTotal += Stats->TriangleTestsTotal;
+    }
+#endif
+    return Result;
+}
+
+//Count rays cast by a worker, in its tile total added to its stats at the end of the tile
+//or right away in the shared counters
+#if SHARED_RAY_COUNTERS
+inline void
+CountRaysCasted(tile_work_scheduler* Scheduler, s64* RaysCasted, s64 Count)
+{
+    InterlockedAdd64(&Scheduler->RaysCasted, Count);
+}
+#else
+inline void
+CountRaysCasted(tile_work_scheduler*, s64* RaysCasted, s64 Count)
+{
+    *RaysCasted += Count;
+}
+#endif
+
+internal void
+PushTileWork(tile_work_deque* Deque, tile_work_entry* Work)
+{
+    LockSpinLock(&Deque->Lock);
+    Assert(Deque->Count < Deque->Capacity);
+    Deque->Entries[(Deque->Top + Deque->Count++) % Deque->Capacity] = *Work;
+    UnlockSpinLock(&Deque->Lock);
+}
+
+//Take the most recently pushed tile, only called by the owner
+internal b32
+PopTileWork(tile_work_deque* Deque, tile_work_entry* Work)
+{
+    b32 Result = false;
+    LockSpinLock(&Deque->Lock);
+    if(Deque->Count)
+    {
+        *Work = Deque->Entries[(Deque->Top + --Deque->Count) % Deque->Capacity];
+        Result = true;
+    }
+    UnlockSpinLock(&Deque->Lock);
+    return Result;
+}
+
+//Take the oldest tile, called by the other workers
+internal b32
+StealTileWork(tile_work_deque* Deque, tile_work_entry* Work)
+{
+    //Avoid taking the lock of empty deques
+    if(Deque->Count == 0) return false;
+    
+    b32 Result = false;
+    LockSpinLock(&Deque->Lock);
+    if(Deque->Count)
+    {
+        *Work = Deque->Entries[Deque->Top];
+        Deque->Top = (Deque->Top + 1) % Deque->Capacity;
+        Deque->Count--;
+        Result = true;
+    }
+    UnlockSpinLock(&Deque->Lock);
+    return Result;
+}
+
+//Get the next tile for a worker from its own deque or by stealing from the others,
+//returns false when all the pixels are done
+internal b32
+GetNextTileWork(tile_work_scheduler* Scheduler, u32 WorkerIndex, tile_work_entry* Work)
+{
+    tile_work_deque* Own = &Scheduler->Deques[WorkerIndex];
+    if(PopTileWork(Own, Work)) return true;
+    
+    InterlockedIncrement(&Scheduler->IdleWorkers);
+    while(Scheduler->PixelsDone < Scheduler->TotalPixels)
+    {
+        For(Offset, Scheduler->DequesCount - 1)
+        {
+            u32 Victim = (WorkerIndex + 1 + Offset) % Scheduler->DequesCount;
+            if(StealTileWork(&Scheduler->Deques[Victim], Work))
+            {
+                InterlockedDecrement(&Scheduler->IdleWorkers);
+                return true;
+            }
+        }
+        
+        //Nothing to steal, let the busy workers run
+        Sleep(0);
+    }
+    InterlockedDecrement(&Scheduler->IdleWorkers);
+    
+    return false;
+}
+
+//Split the tile in half along its longest side while other workers are idle and have nothing to steal,
+//the second half goes back in the deque of the worker
+internal void
+SplitTileWork(tile_work_scheduler* Scheduler, u32 WorkerIndex, tile_work_entry* Work)
+{
+    tile_work_deque* Own = &Scheduler->Deques[WorkerIndex];
+    while(Scheduler->IdleWorkers > 0 && Own->Count == 0)
+    {
+        tile_work_entry Half = *Work;
+        if(Work->CountX >= Work->CountY && Work->CountX >= 2 * Scheduler->MinTileSize)
+        {
+            Work->CountX /= 2;
+            Half.x += Work->CountX;
+            Half.CountX -= Work->CountX;
+        }
+        else if(Work->CountY >= 2 * Scheduler->MinTileSize)
+        {
+            Work->CountY /= 2;
+            Half.y += Work->CountY;
+            Half.CountY -= Work->CountY;
+        }
+        else
+        {
+            break;
+        }
+        
+        PushTileWork(Own, &Half);
+    }
+}
+
+//Split the rows of the tile after NextY like SplitTileWork if workers became idle since it was taken,
+//Work is left with the rest of the rows the worker keeps. Rests shorter than the minimum tile are kept whole
+internal void
+SplitRemainingTileWork(tile_work_scheduler* Scheduler, u32 WorkerIndex, tile_work_entry* Work, u32 NextY)
+{
+    if(Scheduler->IdleWorkers == 0) return;
+    
+    tile_work_entry Rest = *Work;
+    Rest.y = NextY;
+    Rest.CountY = Work->y + Work->CountY - NextY;
+    if(Rest.CountY < Scheduler->MinTileSize) return;
+    
+    SplitTileWork(Scheduler, WorkerIndex, &Rest);
+    *Work = Rest;
+}
+
+//Random series of a sample, it only depends on the frame seed and the sample so that images
+//don't change with the way the tiles are split between the workers
+inline random_series
+GetSampleRandomSeries(u32 Seed, u32 x, u32 y, u32 SampleIndex)
+{
+    u32 Keys[4] = { x, y, SampleIndex, Seed };
+    u32 Hash = 0;
+    For(Index, 4)
+    {
+        //Integer hash by Chris Wellons
+        Hash ^= Keys[Index];
+        Hash ^= Hash >> 16;
+        Hash *= 0x7feb352d;
+        Hash ^= Hash >> 15;
+        Hash *= 0x846ca68b;
+        Hash ^= Hash >> 16;
+    }
+    
+    return RandSeries(Hash | 1);
+}
+
+//Output computed pixel color into SRGB texture
+inline void
+WriteOutputPixel(image_data* OutputImage, u32 x, u32 y, vec3 Color)
+{
+    u32* OutputMemory = (u32*)OutputImage->Data;
+    u32* OutputPixel = OutputMemory + x + y * OutputImage->Width;
+    vec4 SRGBColor = ExactLinearToSRGB(vec4(Color, 1.0f));
+    *OutputPixel = ClampVec4ToRGBA(SRGBColor);
+}
+
+//Only the main thread prints stats
+internal void
+PrintTileWorkProgress(tile_worker_thread_init* Init, thread_id ThreadId, s64 TotalRaysToCast, u32* PercentageCounter)
+{
+    if(Init->PrintProgress && Init->MainThreadId == ThreadId)
+    {
+        s64 RaysCasted = GetTileWorkStats(Init->Scheduler).RaysCasted;
+        Assert(RaysCasted <= TotalRaysToCast);
+        f32 PercentageDone = (f32)RaysCasted / TotalRaysToCast * 100.0f;
+        if((u32)PercentageDone > *PercentageCounter)
+        {
+            *PercentageCounter = (u32)PercentageDone;
+            printf("\rRay casting progress: %u%%", *PercentageCounter);
+            fflush(stdout);
+        }
+    }
+}
+
 THREAD_PROC(TileWorkerProc)
 {
     // Extract work info into locals
@@ -48,76 +315,198 @@ THREAD_PROC(TileWorkerProc)
     f32 PixH = 2.0f / OutputHeight;
     
     //Work loop
-    tile_work_array* WorkArray = Init->WorkArray;
+    tile_work_scheduler* Scheduler = Init->Scheduler;
+    u32 WorkerIndex = InterlockedIncrement(&Scheduler->NextWorkerIndex) - 1;
+    Assert(WorkerIndex < Scheduler->DequesCount);
+    
+    //The colors are sized for the biggest tile, the queue holds a batch of its rays
+    wavefront_queue Queue = {};
+    vec3* PixelColors = 0;
+    if(Init->RenderMode == RENDER_MODE_WAVEFRONT)
+    {
+        Queue = AllocWavefrontQueue(MIN(Scheduler->MaxTilePixels * RaysPerPixel, WAVEFRONT_MAX_QUEUE_RAYS));
+        PixelColors = (vec3*)ZeroAlloc(sizeof(vec3) * Scheduler->MaxTilePixels);
+    }
+    
+    tile_work_entry WorkEntry;
     while(true)
     {
-        //Get and increment work index
-        u32 WorkIndex = InterlockedIncrement(&WorkArray->CurrentEntry) - 1;
-        if(WorkIndex < WorkArray->TotalEntries)
+        if(GetNextTileWork(Scheduler, WorkerIndex, &WorkEntry))
         {
-            //Extract work info into locals
-            tile_work_entry* Work = WorkArray->Entries + WorkIndex;
-            u32 CountX = Work->CountX;
-            u32 CountY = Work->CountY;
-            random_series Series = Work->RandomSeries;
+            SplitTileWork(Scheduler, WorkerIndex, &WorkEntry);
+            
+            //Extract work info into locals, single and packet modes can give away the rows of the tile
+            //they didn't render yet so the size is reread after each row
+            tile_work_entry* Work = &WorkEntry;
+            u32 Seed = Scheduler->Seed;
+            s64 PixelsRendered = 0;
             
             //Reset stats accumulators to 0
             Thread_TriangleTestsPassed = 0;
             Thread_TriangleTestsTotal = 0;
+            s64 RaysCasted = 0;
             
             //Execute work
-            for(u32 y = Work->y; y < Work->y + CountY; y++)
+            if(Init->RenderMode == RENDER_MODE_WAVEFRONT)
             {
-                f32 FilmY = (f32)y / OutputHeight * 2.0f - 1.0f;
-                for(u32 x = Work->x; x < Work->x + CountX; x++)
+                u32 CountX = Work->CountX;
+                u32 CountY = Work->CountY;
+                
+                For(PixelIndex, CountX * CountY)
                 {
-                    f32 FilmX = (f32)x / OutputWidth * 2.0f - 1.0f;
+                    PixelColors[PixelIndex] = vec3(0.0f);
+                }
+                
+                //Queue the camera rays of the tile in pixel order and trace them every time the queue is full
+                f32 RayContrib = 1.0f / (f32)RaysPerPixel;
+                For(RayIndex, CountX * CountY * RaysPerPixel)
+                {
+                    if(Queue.Count == Queue.Capacity)
+                    {
+                        TraceWavefrontQueue(World, &Queue, Bounces, PixelColors, RayContrib);
+                    }
+                    
+                    u32 PixelIndex = RayIndex / RaysPerPixel;
+                    u32 SampleIndex = RayIndex % RaysPerPixel;
+                    u32 x = Work->x + PixelIndex % CountX;
+                    u32 y = Work->y + PixelIndex / CountX;
+                    f32 OffX = (f32)x / OutputWidth * 2.0f - 1.0f + Samples[SampleIndex].x * HalfPixW;
+                    f32 OffY = (f32)y / OutputHeight * 2.0f - 1.0f + Samples[SampleIndex].y * HalfPixH;
+                    vec3 RayOrigin = FilmCenter + OffX * HalfFilmW * CameraX + OffY * HalfFilmH * CameraY;
                     
-                    f32 RayContrib = 1.0f / (f32)RaysPerPixel;
-                    vec3 Color = vec3(0.0f);
-                    For(Index, RaysPerPixel)
+                    wavefront_ray* Ray = &Queue.Rays[Queue.Count++];
+                    Ray->Path.Origin = RayOrigin;
+                    Ray->Path.Direction = Normalize(CameraP - RayOrigin);
+                    Ray->Path.Attenuation = vec3(1.0f);
+                    Ray->Path.Color = vec3(0.0f);
+                    Ray->Series = GetSampleRandomSeries(Seed, x, y, SampleIndex);
+                    Ray->PixelIndex = PixelIndex;
+                }
+                TraceWavefrontQueue(World, &Queue, Bounces, PixelColors, RayContrib);
+                
+                For(PixelIndex, CountX * CountY)
+                {
+                    WriteOutputPixel(OutputImage, Work->x + PixelIndex % CountX, Work->y + PixelIndex / CountX, PixelColors[PixelIndex]);
+                }
+                
+                CountRaysCasted(Scheduler, &RaysCasted, CountX * CountY * RaysPerPixel);
+                PixelsRendered += CountX * CountY;
+                PrintTileWorkProgress(Init, ThreadId, TotalRaysToCast, &PercentageCounter);
+            }
+            else if(Init->RenderMode == RENDER_MODE_PACKET)
+            {
+                //Trace the camera rays of each block of the tile as packets, one sample at a time,
+                //bounces are traced one ray at a time since they are not coherent
+                for(u32 BlockY = Work->y; BlockY < Work->y + Work->CountY; BlockY += RAY_PACKET_WIDTH)
+                {
+                    u32 BlockHeight = MIN(RAY_PACKET_WIDTH, Work->y + Work->CountY - BlockY);
+                    for(u32 BlockX = Work->x; BlockX < Work->x + Work->CountX; BlockX += RAY_PACKET_WIDTH)
                     {
-//                        f32 OffX = FilmX + RandNO(&Series) * HalfPixW;
-//                        f32 OffY = FilmY + RandNO(&Series) * HalfPixH;
-                        f32 OffX = FilmX + Samples[Index].x * HalfPixW;
-                        f32 OffY = FilmY + Samples[Index].y * HalfPixH;
+                        u32 BlockWidth = MIN(RAY_PACKET_WIDTH, Work->x + Work->CountX - BlockX);
                         
-                        vec3 RayOrigin = FilmCenter + OffX * HalfFilmW * CameraX + OffY * HalfFilmH * CameraY;
-                        vec3 RayDirection = Normalize(CameraP - RayOrigin);
+                        f32 RayContrib = 1.0f / (f32)RaysPerPixel;
+                        vec3 Colors[RAY_PACKET_SIZE];
+                        For(Index, RAY_PACKET_SIZE)
+                        {
+                            Colors[Index] = vec3(0.0f);
+                        }
                         
-                        //Raycast and accumulate color
-                        Color = Color + RayCast(World, RayOrigin, RayDirection, Bounces, &Series) * RayContrib;
+                        ray_packet Packet;
+                        ray_hit Hits[RAY_PACKET_SIZE];
+                        For(SampleIndex, RaysPerPixel)
+                        {
+                            Packet.Count = BlockWidth * BlockHeight;
+                            For(Index, Packet.Count)
+                            {
+                                u32 x = BlockX + Index % BlockWidth;
+                                u32 y = BlockY + Index / BlockWidth;
+                                f32 OffX = (f32)x / OutputWidth * 2.0f - 1.0f + Samples[SampleIndex].x * HalfPixW;
+                                f32 OffY = (f32)y / OutputHeight * 2.0f - 1.0f + Samples[SampleIndex].y * HalfPixH;
+                                
+                                vec3 RayOrigin = FilmCenter + OffX * HalfFilmW * CameraX + OffY * HalfFilmH * CameraY;
+                                vec3 RayDirection = Normalize(CameraP - RayOrigin);
+                                Packet.Rays[Index] = MakeBVHRay(RayOrigin, RayDirection);
+                            }
+                            ComputeRayPacketBounds(&Packet);
+                            
+                            RayPacketWorldIntersect(World, &Packet, Hits);
+                            
+                            //Shade and continue the path of each ray from its first hit
+                            For(Index, Packet.Count)
+                            {
+                                bvh_ray* Ray = &Packet.Rays[Index];
+                                random_series Series = GetSampleRandomSeries(Seed, BlockX + Index % BlockWidth,
+                                                                             BlockY + Index / BlockWidth, SampleIndex);
+                                Colors[Index] = Colors[Index] +
+                                    RayCast(World, Ray->Origin, Ray->Direction, Bounces, &Series, &Hits[Index]) * RayContrib;
+                            }
+                            
+                            CountRaysCasted(Scheduler, &RaysCasted, Packet.Count);
+                        }
                         
-                        InterlockedIncrement64(&Init->RaysCasted);
+                        For(Index, BlockWidth * BlockHeight)
+                        {
+                            u32 x = BlockX + Index % BlockWidth;
+                            u32 y = BlockY + Index / BlockWidth;
+                            WriteOutputPixel(OutputImage, x, y, Colors[Index]);
+                        }
                     }
                     
-                    //Output computed pixel color into SRGB texture
-                    u32* OutputMemory = (u32*)OutputImage->Data;
-                    u32* OutputPixel = OutputMemory + x + y * OutputWidth;
-                    vec4 SRGBColor = ExactLinearToSRGB(vec4(Color, 1.0f));
-                    *OutputPixel = ClampVec4ToRGBA(SRGBColor);
+                    PixelsRendered += Work->CountX * BlockHeight;
+                    PrintTileWorkProgress(Init, ThreadId, TotalRaysToCast, &PercentageCounter);
+                    SplitRemainingTileWork(Scheduler, WorkerIndex, Work, BlockY + BlockHeight);
                 }
-                
-                //Only the main thread prints stats
-                if(Init->MainThreadId == ThreadId)
+            }
+            else
+            {
+                for(u32 y = Work->y; y < Work->y + Work->CountY; y++)
                 {
-                    Assert(Init->RaysCasted <= TotalRaysToCast);
-                    f32 PercentageDone = (f32)Init->RaysCasted / TotalRaysToCast * 100.0f;
-                    if((u32)PercentageDone > PercentageCounter)
+                    f32 FilmY = (f32)y / OutputHeight * 2.0f - 1.0f;
+                    for(u32 x = Work->x; x < Work->x + Work->CountX; x++)
                     {
-                        PercentageCounter = (u32)PercentageDone;
-                        printf("\rRay casting progress: %u%%", PercentageCounter);
-                        fflush(stdout);
+                        f32 FilmX = (f32)x / OutputWidth * 2.0f - 1.0f;
+                        
+                        f32 RayContrib = 1.0f / (f32)RaysPerPixel;
+                        vec3 Color = vec3(0.0f);
+                        For(Index, RaysPerPixel)
+                        {
+//                            f32 OffX = FilmX + RandNO(&Series) * HalfPixW;
+//                            f32 OffY = FilmY + RandNO(&Series) * HalfPixH;
+                            f32 OffX = FilmX + Samples[Index].x * HalfPixW;
+                            f32 OffY = FilmY + Samples[Index].y * HalfPixH;
+                            
+                            vec3 RayOrigin = FilmCenter + OffX * HalfFilmW * CameraX + OffY * HalfFilmH * CameraY;
+                            vec3 RayDirection = Normalize(CameraP - RayOrigin);
+                            random_series Series = GetSampleRandomSeries(Seed, x, y, Index);
+                            
+                            //Raycast and accumulate color
+                            Color = Color + RayCast(World, RayOrigin, RayDirection, Bounces, &Series) * RayContrib;
+                            
+                            CountRaysCasted(Scheduler, &RaysCasted, 1);
+                        }
+                        
+                        WriteOutputPixel(OutputImage, x, y, Color);
                     }
+                    
+                    PixelsRendered += Work->CountX;
+                    PrintTileWorkProgress(Init, ThreadId, TotalRaysToCast, &PercentageCounter);
+                    SplitRemainingTileWork(Scheduler, WorkerIndex, Work, y + 1);
                 }
             }
             
             //Update stats
-            InterlockedAdd64((s64*)&Init->TriangleTestsPassed, Thread_TriangleTestsPassed);
-            InterlockedAdd64((s64*)&Init->TriangleTestsTotal,  Thread_TriangleTestsTotal);
+#if SHARED_RAY_COUNTERS
+            InterlockedAdd64(&Scheduler->TriangleTestsPassed, Thread_TriangleTestsPassed);
+            InterlockedAdd64(&Scheduler->TriangleTestsTotal, Thread_TriangleTestsTotal);
+#else
+            tile_worker_stats* Stats = &Scheduler->WorkerStats[WorkerIndex];
+            Stats->RaysCasted += RaysCasted;
+            Stats->TriangleTestsPassed += Thread_TriangleTestsPassed;
+            Stats->TriangleTestsTotal += Thread_TriangleTestsTotal;
+#endif
             
             //Increment work done counter
-            InterlockedIncrement(&WorkArray->EntriesDone);
+            InterlockedAdd64(&Scheduler->PixelsDone, PixelsRendered);
         }
         else
         {
@@ -125,5 +514,44 @@ THREAD_PROC(TileWorkerProc)
         }
     }
     
+    if(Init->RenderMode == RENDER_MODE_WAVEFRONT)
+    {
+        FreeWavefrontQueue(&Queue);
+        Free(PixelColors);
+    }
+    
     return 0;
 }
+
+//Render a frame with the threads of the pool and the calling thread, the scheduler
+//and main thread of Init are filled here, all the other settings must already be set
+internal frame_stats
+RenderTileWorkFrame(thread_pool* ThreadPool, tile_worker_thread_init* Init)
+{
+    u32 WorkersCount = ThreadPool->ThreadsCount + 1;
+    tile_work_scheduler Scheduler = CreateTileWorkScheduler(Init->OutputWidth, Init->OutputHeight, WorkersCount);
+    Init->Scheduler = &Scheduler;
+    Init->MainThreadId = GetCurrentThreadId();
+    
+    //Start workers
+    timestamp BeginCounter = GetCurrentCounter();
+    StartThreadPoolJob(ThreadPool, TileWorkerProc, Init);
+    TileWorkerProc(Init);
+    
+    //Wait for other workers to finish
+    WaitThreadPoolJob(ThreadPool);
+    Assert(Scheduler.PixelsDone == Scheduler.TotalPixels);
+    timestamp EndCounter = GetCurrentCounter();
+    
+    tile_worker_stats Stats = GetTileWorkStats(&Scheduler);
+    frame_stats Result = {};
+    Result.SecondsElapsed = GetSecondsElapsed(BeginCounter, EndCounter);
+    Result.RaysCasted = Stats.RaysCasted;
+    Result.TriangleTestsPassed = Stats.TriangleTestsPassed;
+    Result.TriangleTestsTotal = Stats.TriangleTestsTotal;
+    
+    FreeTileWorkScheduler(&Scheduler);
+    Init->Scheduler = 0;
+    
+    return Result;
+}
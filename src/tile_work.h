@@ -1,29 +1,81 @@
+//How camera rays are traced through the world
+enum render_mode
+{
+    RENDER_MODE_SINGLE, //Every sample is traced on its own
+    RENDER_MODE_PACKET, //Primary rays of RAY_PACKET_WIDTH^2 pixel blocks are traced together
+    RENDER_MODE_WAVEFRONT, //All the rays of a tile are traced one bounce at a time
+    
+    RENDER_MODE_COUNT,
+};
+
+char* RenderModeNames[RENDER_MODE_COUNT] = {
+    "single",
+    "packet",
+    "wavefront",
+};
+
 struct tile_work_entry
 {
     u32 x;
     u32 y;
     u32 CountX;
     u32 CountY;
-    random_series RandomSeries;
 };
 
-struct tile_work_array
+//Tiles owned by a worker, the owner pushes and pops at the bottom and the other
+//workers steal from the top. Tiles are coarse so a spin lock is enough
+struct alignas(CACHE_LINE_SIZE) tile_work_deque
+{
+    volatile u32 Lock;
+    tile_work_entry* Entries; //Ring buffer
+    u32 Top;
+    volatile u32 Count; //Also read without the lock to skip empty deques
+    u32 Capacity;
+};
+
+//Stats of a worker, only written by the worker itself when it finishes a tile
+struct alignas(CACHE_LINE_SIZE) tile_worker_stats
 {
-    tile_work_entry* Entries;
-    volatile u32 CurrentEntry;
-    volatile u32 EntriesDone;
-    u32 TotalEntries;
+    volatile s64 RaysCasted;
+    volatile s64 TriangleTestsPassed;
+    volatile s64 TriangleTestsTotal;
+};
+
+//Work stealing scheduler, each worker takes tiles from its own deque and when it is empty
+//steals from the others. Tiles are split in half when some workers are idle, when they are taken
+//and between the rows that are rendered
+struct tile_work_scheduler
+{
+    tile_work_deque* Deques; //One per worker
+    tile_worker_stats* WorkerStats; //One per worker
+    u32 DequesCount;
+    volatile u32 NextWorkerIndex;
+    volatile u32 IdleWorkers;
+    
+    u32 Seed; //Random series of the samples are derived from it and the pixel coordinates
+    u32 MinTileSize;
+    u32 MaxTilePixels; //Biggest tile before any split
+    volatile s64 PixelsDone;
+    s64 TotalPixels;
+    
+#if SHARED_RAY_COUNTERS
+    //Used instead of WorkerStats
+    volatile s64 RaysCasted;
+    volatile s64 TriangleTestsPassed;
+    volatile s64 TriangleTestsTotal;
+#endif
 };
 
 struct tile_worker_thread_init
 {
-    tile_work_array* WorkArray;
+    tile_work_scheduler* Scheduler;
     
     //Output settings (read only)
     u32 OutputWidth;
     u32 OutputHeight;
     u32 RaysPerPixel;
     u32 RayBounces;
+    render_mode RenderMode;
     vec2 Samples[MAX_RAYS_PER_PIXEL];
     
     //Scene info (read only)
@@ -36,11 +88,16 @@ struct tile_worker_thread_init
     //Output data (shared but written without overlap)
     image_data* OutputImage;
     
-    //Stats
-    volatile s64 RaysCasted;
-    volatile s64 TriangleTestsPassed;
-    volatile s64 TriangleTestsTotal;
-    
     //Used to identify the printer thread
     thread_id MainThreadId;
+    bool PrintProgress;
+};
+
+//Timing and stats of a rendered frame
+struct frame_stats
+{
+    f32 SecondsElapsed;
+    s64 RaysCasted;
+    s64 TriangleTestsPassed;
+    s64 TriangleTestsTotal;
 };
@@ -0,0 +1,133 @@
+#include "wavefront.h"
+
+internal wavefront_queue
+AllocWavefrontQueue(u32 Capacity)
+{
+    wavefront_queue Queue = {};
+    Queue.Capacity = Capacity;
+    Queue.Rays = (wavefront_ray*)ZeroAlloc(sizeof(wavefront_ray) * Capacity);
+    Queue.Hits = (ray_hit*)ZeroAlloc(sizeof(ray_hit) * Capacity);
+    Queue.SortedRays = (wavefront_ray*)ZeroAlloc(sizeof(wavefront_ray) * Capacity);
+    Queue.SortedHits = (ray_hit*)ZeroAlloc(sizeof(ray_hit) * Capacity);
+    Queue.Keys = (u32*)ZeroAlloc(sizeof(u32) * Capacity);
+    return Queue;
+}
+
+internal void
+FreeWavefrontQueue(wavefront_queue* Queue)
+{
+    Free(Queue->Rays);
+    Free(Queue->Hits);
+    Free(Queue->SortedRays);
+    Free(Queue->SortedHits);
+    Free(Queue->Keys);
+    *Queue = {};
+}
+
+//Stable counting sort of the queue by the keys already computed in Queue->Keys,
+//hits are moved with their rays only if SortHits is set
+internal void
+SortWavefrontQueue(wavefront_queue* Queue, u32 KeysCount, b32 SortHits)
+{
+    u32 Offsets[WAVEFRONT_MATERIAL_KEYS_COUNT] = {};
+    Assert(KeysCount <= ArrayCount(Offsets));
+    
+    For(Index, Queue->Count)
+    {
+        Assert(Queue->Keys[Index] < KeysCount);
+        Offsets[Queue->Keys[Index]]++;
+    }
+    
+    u32 Sum = 0;
+    For(Key, KeysCount)
+    {
+        u32 Count = Offsets[Key];
+        Offsets[Key] = Sum;
+        Sum += Count;
+    }
+    
+    For(Index, Queue->Count)
+    {
+        u32 Destination = Offsets[Queue->Keys[Index]]++;
+        Queue->SortedRays[Destination] = Queue->Rays[Index];
+        if(SortHits)
+        {
+            Queue->SortedHits[Destination] = Queue->Hits[Index];
+        }
+    }
+    
+    wavefront_ray* Rays = Queue->Rays;
+    Queue->Rays = Queue->SortedRays;
+    Queue->SortedRays = Rays;
+    if(SortHits)
+    {
+        ray_hit* Hits = Queue->Hits;
+        Queue->Hits = Queue->SortedHits;
+        Queue->SortedHits = Hits;
+    }
+}
+
+//Octant of the direction, one bit per axis set if negative
+inline u32
+GetDirectionOctant(vec3 Direction)
+{
+    return (Direction.x < 0.0f ? 1 : 0) | (Direction.y < 0.0f ? 2 : 0) | (Direction.z < 0.0f ? 4 : 0);
+}
+
+//Trace all the paths in the queue until they end or run out of bounces, the color of every
+//path is added to the pixel it came from scaled by Contrib.
+//Each bounce sorts the rays by direction octant, intersects all of them, sorts the hits by
+//material, shades them and compacts the paths that continue in place
+internal void
+TraceWavefrontQueue(world* World, wavefront_queue* Queue, u32 Bounces, vec3* PixelColors, f32 Contrib)
+{
+#if DEBUG_COLORS
+    Bounces = 1;
+#endif
+    
+    For(BounceIndex, Bounces)
+    {
+        if(Queue->Count == 0) break;
+        
+        For(Index, Queue->Count)
+        {
+            Queue->Keys[Index] = GetDirectionOctant(Queue->Rays[Index].Path.Direction);
+        }
+        SortWavefrontQueue(Queue, WAVEFRONT_OCTANT_KEYS_COUNT, false);
+        
+        For(Index, Queue->Count)
+        {
+            path_state* Path = &Queue->Rays[Index].Path;
+            RayWorldIntersect(World, Path->Origin, Path->Direction, &Queue->Hits[Index]);
+        }
+        
+        For(Index, Queue->Count)
+        {
+            Queue->Keys[Index] = Queue->Hits[Index].MaterialIndex + 1;
+        }
+        SortWavefrontQueue(Queue, World->MaterialsCount + 1, true);
+        
+        u32 ContinuingCount = 0;
+        For(Index, Queue->Count)
+        {
+            wavefront_ray* Ray = &Queue->Rays[Index];
+            if(ShadePathHit(World, &Ray->Path, &Queue->Hits[Index], &Ray->Series))
+            {
+                Queue->Rays[ContinuingCount++] = *Ray;
+            }
+            else
+            {
+                PixelColors[Ray->PixelIndex] = PixelColors[Ray->PixelIndex] + Ray->Path.Color * Contrib;
+            }
+        }
+        Queue->Count = ContinuingCount;
+    }
+    
+    //Paths that ran out of bounces
+    For(Index, Queue->Count)
+    {
+        wavefront_ray* Ray = &Queue->Rays[Index];
+        PixelColors[Ray->PixelIndex] = PixelColors[Ray->PixelIndex] + Ray->Path.Color * Contrib;
+    }
+    Queue->Count = 0;
+}
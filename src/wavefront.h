@@ -0,0 +1,25 @@
+//Path waiting in a wavefront queue with the pixel of the tile it contributes to
+struct wavefront_ray
+{
+    path_state Path;
+    random_series Series; //Each ray has its own so that the result doesn't depend on the order of the queue
+    u32 PixelIndex;
+};
+
+//Rays of a tile traced one bounce at a time, the sorted arrays are used as scratch
+//space by the counting sorts and swapped with the main ones
+struct wavefront_queue
+{
+    wavefront_ray* Rays;
+    ray_hit* Hits;
+    u32 Count;
+    u32 Capacity;
+    
+    wavefront_ray* SortedRays;
+    ray_hit* SortedHits;
+    u32* Keys;
+};
+
+//Hits are sorted by material, misses go in the first bucket
+#define WAVEFRONT_MATERIAL_KEYS_COUNT (MAX_MATERIALS + 1)
+#define WAVEFRONT_OCTANT_KEYS_COUNT 8
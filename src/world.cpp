@@ -15,6 +15,39 @@ AllocWorld(vec3 BackgroundColor)
     return World;
 }
 
+//Free the world with the meshes it owns, the data of meshes loaded from a cache lives in the mapped file
+internal void
+FreeWorld(world* World)
+{
+    For(Index, World->MeshesInfoCount)
+    {
+        mesh_info* Mesh = &World->MeshesInfo[Index];
+        if(Mesh->Preprocessed)
+        {
+            UnmapFile(&Mesh->CacheView);
+            continue;
+        }
+        
+        FreeMeshData(&Mesh->Data);
+        FreeAABBTree(Mesh->AABBTree);
+        Free(Mesh->FlatBVH.Nodes);
+        Free(Mesh->WideBVH.Nodes);
+        Free(Mesh->QuantizedBVH.Nodes);
+        Free(Mesh->PackedTriangles.Packets);
+        Free(Mesh->LocalTriangles.Words);
+        Free(Mesh->CachePath);
+    }
+    
+    Free(World->TLAS.Nodes);
+    Free(World->TLAS.Objects);
+    Free(World->Spheres);
+    Free(World->Planes);
+    Free(World->Meshes);
+    Free(World->MeshesInfo);
+    Free(World->Materials);
+    *World = {};
+}
+
 //Transform a position to world space multiplying by the inverse model matrix of a mesh entry
 internal vec3
 WorldToLocalP(mesh_entry* M, vec3 P)
@@ -90,6 +123,35 @@ PushMeshInfo(world* World, mesh_data* Data)
     Assert(World->MeshesInfoCount < MAX_MESHES_INFO);
     mesh_info* Info = &World->MeshesInfo[World->MeshesInfoCount++];
     Info->Data = *Data;
+    Info->TrianglesCount = Data->IndicesCount / 3;
+}
+
+//Push mesh data already preprocessed with the settings that will be used for the world
+internal void
+PushPreprocessedMeshInfo(world* World, cached_mesh* Mesh)
+{
+    Assert(World->MeshesInfoCount < MAX_MESHES_INFO);
+    mesh_info* Info = &World->MeshesInfo[World->MeshesInfoCount++];
+    Info->Data = Mesh->Data;
+    Info->TrianglesCount = Mesh->TrianglesCount;
+    Info->AABB = Mesh->AABB;
+    Info->FlatBVH = Mesh->FlatBVH;
+    Info->WideBVH = Mesh->WideBVH;
+    Info->QuantizedBVH = Mesh->QuantizedBVH;
+    Info->PackedTriangles = Mesh->PackedTriangles;
+    Info->LocalTriangles = Mesh->LocalTriangles;
+    Info->Preprocessed = true;
+    Info->CacheView = Mesh->View;
+}
+
+//Push mesh data that is written to the cache at CachePath once preprocessed
+internal void
+PushCachedMeshInfo(world* World, mesh_data* Data, char* CachePath, u64 CacheKey)
+{
+    PushMeshInfo(World, Data);
+    mesh_info* Info = &World->MeshesInfo[World->MeshesInfoCount - 1];
+    Info->CachePath = CachePath;
+    Info->CacheKey = CacheKey;
 }
 
 internal void
@@ -114,26 +176,367 @@ PushTexturedMaterial(world* World, image_data* AlbedoTexture)
     Material->AlbedoTexture = AlbedoTexture;
 }
 
-//Compute aabb trees for each mesh_info, if Verbose print stats for each tree
+//Build the traversal layout of the meshes taken from the job until there are none left
+THREAD_PROC(MeshLayoutJobProc)
+{
+    mesh_layout_job* Job = (mesh_layout_job*)Data;
+    world* World = Job->World;
+    bvh_build_settings* Settings = Job->Settings;
+    
+    while(true)
+    {
+        u32 Index = InterlockedIncrement(&Job->NextMesh) - 1;
+        if(Index >= World->MeshesInfoCount) break;
+        
+        mesh_info* Mesh = &World->MeshesInfo[Index];
+        if(Mesh->Preprocessed) continue;
+        
+        //The build sorted the indices by leaf, the tree only references their positions
+        if(Settings->ReorderVertices) ReorderMeshVertices(&Mesh->Data);
+        
+        switch(Settings->Format)
+        {
+            case BVH_FORMAT_FLAT: Mesh->FlatBVH = FlattenAABBTree(Mesh->AABBTree, Mesh->Data.Indices); break;
+            case BVH_FORMAT_WIDE:
+            case BVH_FORMAT_QUANTIZED: Mesh->WideBVH = BuildWideBVH(Mesh->AABBTree, Mesh->Data.Indices); break;
+            default: break;
+        }
+        
+        if(World->BVHLeafFormat == BVH_LEAF_FORMAT_PACKET)
+        {
+            vec3* Positions = Mesh->Data.Positions;
+            u32* Indices = Mesh->Data.Indices;
+            if(Settings->Format == BVH_FORMAT_FLAT) Mesh->PackedTriangles = PackFlatBVHLeaves(&Mesh->FlatBVH, Positions, Indices);
+            if(Settings->Format != BVH_FORMAT_FLAT) Mesh->PackedTriangles = PackWideBVHLeaves(&Mesh->WideBVH, Positions, Indices);
+        }
+        else if(World->BVHLeafFormat == BVH_LEAF_FORMAT_LOCAL)
+        {
+            if(Settings->Format == BVH_FORMAT_FLAT) Mesh->LocalTriangles = PackFlatBVHLocalLeaves(&Mesh->FlatBVH, &Mesh->Data);
+            if(Settings->Format != BVH_FORMAT_FLAT) Mesh->LocalTriangles = PackWideBVHLocalLeaves(&Mesh->WideBVH, &Mesh->Data);
+        }
+        
+        //Leaf offsets are final after packing, the float nodes are not needed anymore
+        if(Settings->Format == BVH_FORMAT_QUANTIZED)
+        {
+            Mesh->QuantizedBVH = QuantizeWideBVH(&Mesh->WideBVH);
+            Free(Mesh->WideBVH.Nodes);
+            Mesh->WideBVH = {};
+        }
+        Job->MeshesEnd[Index] = GetCurrentCounter();
+    }
+    
+    return 0;
+}
+
+//Compute aabb trees for each mesh_info using all the threads of the pool, if Verbose print stats for each tree
 internal void
-PreprocessWorldMeshes(world* World, bool Verbose)
+PreprocessWorldMeshes(world* World, bvh_build_settings* Settings, thread_pool* Pool, bool Verbose)
 {
     if(Verbose)
+    {
         printf("AABB Preprocessing settings:\n %2u MIN_TRIANGLES_PER_LEAF\n %2u MIN_TRIANGLE_DIFFERENCE\n\n", MIN_TRIANGLES_PER_LEAF, MIN_TRIANGLE_DIFFERENCE);
+        printf("SAH settings:\n %2u Bins\n %.2f SAH_TRAVERSAL_COST\n %.2f SAH_TRIANGLE_COST\n %2u SAH_MAX_TRIANGLES_PER_LEAF\n\n",
+               Settings->SAHBinsCount, SAH_TRAVERSAL_COST, SAH_TRIANGLE_COST, SAH_MAX_TRIANGLES_PER_LEAF);
+        printf("Builder: %s\nFormat: %s\nLeaf format: %s\nVertex order: %s\n\n", BVHBuilderNames[Settings->Builder],
+               BVHFormatNames[Settings->Format], BVHLeafFormatNames[Settings->LeafFormat],
+               Settings->ReorderVertices ? "leaf" : "file");
+    }
+    
+    //The pointer tree always references the mesh indices
+    World->BVHFormat = Settings->Format;
+    World->BVHLeafFormat = Settings->Format == BVH_FORMAT_TREE ? BVH_LEAF_FORMAT_INDEXED : Settings->LeafFormat;
+    
+    timestamp Begin = GetCurrentCounter();
+    
+    //Trees of all the meshes are built together so that every thread has work to do,
+    //meshes loaded from a cache are skipped
+    bvh_build_mesh BuildMeshes[MAX_MESHES_INFO];
+    u32 BuildMeshesIndices[MAX_MESHES_INFO];
+    u32 BuildMeshesCount = 0;
     
+    //Spatial splits replace the indices and the layout can renumber the vertices,
+    //the builders comparison uses a copy of the meshes as they were loaded
+    bvh_build_mesh SourceMeshes[MAX_MESHES_INFO] = {};
     For(Index, World->MeshesInfoCount)
     {
         mesh_info* Mesh = &World->MeshesInfo[Index];
-        timestamp Begin = GetCurrentCounter();
+        if(Mesh->Preprocessed) continue;
+        
+        if(Verbose)
+        {
+            bvh_build_mesh* Source = &SourceMeshes[Index];
+            Source->IndicesCount = Mesh->Data.IndicesCount;
+            Source->Positions = (vec3*)ZeroAlloc(sizeof(vec3) * Mesh->Data.VerticesCount);
+            Source->Indices = (u32*)ZeroAlloc(sizeof(u32) * Mesh->Data.IndicesCount);
+            memcpy(Source->Positions, Mesh->Data.Positions, sizeof(vec3) * Mesh->Data.VerticesCount);
+            memcpy(Source->Indices, Mesh->Data.Indices, sizeof(u32) * Mesh->Data.IndicesCount);
+        }
         
-        Mesh->AABBTree = ComputeAABBTree(Mesh->Data.Positions, Mesh->Data.Indices, Mesh->Data.IndicesCount);
+        bvh_build_mesh* BuildMesh = &BuildMeshes[BuildMeshesCount];
+        BuildMesh->Positions = Mesh->Data.Positions;
+        BuildMesh->Indices = Mesh->Data.Indices;
+        BuildMesh->IndicesCount = Mesh->Data.IndicesCount;
+        BuildMeshesIndices[BuildMeshesCount++] = Index;
+    }
+    BuildAABBTreesParallel(Pool, BuildMeshes, BuildMeshesCount, Settings);
+    
+    For(Index, BuildMeshesCount)
+    {
+        mesh_info* Mesh = &World->MeshesInfo[BuildMeshesIndices[Index]];
+        Mesh->AABBTree = BuildMeshes[Index].Tree;
+        Mesh->AABB = Mesh->AABBTree->AABB;
+        
+        //Spatial splits return new indices with the duplicated triangles, the loaded ones are not used anymore
+        if(BuildMeshes[Index].Indices != Mesh->Data.Indices) Free(Mesh->Data.Indices);
+        Mesh->Data.Indices = BuildMeshes[Index].Indices;
+        Mesh->Data.IndicesCount = BuildMeshes[Index].IndicesCount;
+    }
+    
+    //Then each mesh is converted to the traversal layout by a single thread
+    mesh_layout_job Job = {};
+    Job.World = World;
+    Job.Settings = Settings;
+    StartThreadPoolJob(Pool, MeshLayoutJobProc, &Job);
+    MeshLayoutJobProc(&Job);
+    WaitThreadPoolJob(Pool);
+    
+    //The pointer tree is not cached so meshes using it are always preprocessed
+    if(Settings->Format != BVH_FORMAT_TREE)
+    {
+        For(Index, World->MeshesInfoCount)
+        {
+            mesh_info* Mesh = &World->MeshesInfo[Index];
+            if(Mesh->Preprocessed || !Mesh->CachePath) continue;
+            
+            cached_mesh Cached = {};
+            Cached.Data = Mesh->Data;
+            Cached.TrianglesCount = Mesh->TrianglesCount;
+            Cached.AABB = Mesh->AABB;
+            Cached.FlatBVH = Mesh->FlatBVH;
+            Cached.WideBVH = Mesh->WideBVH;
+            Cached.QuantizedBVH = Mesh->QuantizedBVH;
+            Cached.PackedTriangles = Mesh->PackedTriangles;
+            Cached.LocalTriangles = Mesh->LocalTriangles;
+            if(!WriteMeshCache(Mesh->CachePath, Mesh->CacheKey, &Cached, World->BVHFormat, World->BVHLeafFormat))
+            {
+                printf("Failed to write mesh cache at %s\n", Mesh->CachePath);
+            }
+        }
+    }
+    
+    if(Verbose)
+    {
         timestamp End = GetCurrentCounter();
-        f32 SecondsElapsed = GetSecondsElapsed(Begin, End);
+        printf("Built %u meshes with %u threads (%.3f ms)\n\n", World->MeshesInfoCount, Pool->ThreadsCount + 1,
+               GetSecondsElapsed(Begin, End) * 1000.0f);
         
-        if(Verbose)
+        For(Index, World->MeshesInfoCount)
+        {
+            mesh_info* Mesh = &World->MeshesInfo[Index];
+            
+            if(Mesh->Preprocessed)
+            {
+                printf("Mesh %u: %u triangles, %u vertices (loaded from cache):\n", Index, Mesh->TrianglesCount,
+                       Mesh->Data.VerticesCount);
+            }
+            else
+            {
+                //Meshes are built at the same time so this is the time until the mesh was ready
+                f32 SecondsElapsed = GetSecondsElapsed(Begin, Job.MeshesEnd[Index]);
+                printf("Mesh %u: %u triangles, %u vertices (%.3f ms):\n", Index, Mesh->TrianglesCount,
+                       Mesh->Data.VerticesCount, SecondsElapsed * 1000.0f);
+                PrintAABBInfo(Mesh->AABBTree);
+            }
+            if(Mesh->Data.IndicesCount / 3 != Mesh->TrianglesCount)
+            {
+                u32 ReferencesCount = Mesh->Data.IndicesCount / 3;
+                printf(" Spatial splits: %u references (%.2f%% duplicated)\n", ReferencesCount,
+                       (f32)(ReferencesCount - Mesh->TrianglesCount) / (f32)Mesh->TrianglesCount * 100.0f);
+            }
+            //Bytes per triangle only count the nodes, leaves reference the mesh indices or the packets below
+            f32 TrianglesCount = (f32)Mesh->TrianglesCount;
+            if(Settings->Format == BVH_FORMAT_FLAT)
+            {
+                u64 Size = sizeof(flat_bvh_node) * Mesh->FlatBVH.NodesCount;
+                printf(" Flattened: %u nodes (%ukb, %.1f bytes per triangle)\n", Mesh->FlatBVH.NodesCount,
+                       (u32)(Size / 1024), (f32)Size / TrianglesCount);
+            }
+            else if(Settings->Format == BVH_FORMAT_WIDE)
+            {
+                u64 Size = sizeof(wide_bvh_node) * Mesh->WideBVH.NodesCount;
+                printf(" Collapsed to %u wide: %u nodes (%ukb, %.1f bytes per triangle)\n", WIDE_BVH_WIDTH, Mesh->WideBVH.NodesCount,
+                       (u32)(Size / 1024), (f32)Size / TrianglesCount);
+            }
+            else if(Settings->Format == BVH_FORMAT_QUANTIZED)
+            {
+                u64 Size = sizeof(quantized_bvh_node) * Mesh->QuantizedBVH.NodesCount;
+                printf(" Quantized %u wide: %u nodes (%ukb, %.1f bytes per triangle)\n", WIDE_BVH_WIDTH, Mesh->QuantizedBVH.NodesCount,
+                       (u32)(Size / 1024), (f32)Size / TrianglesCount);
+            }
+            if(World->BVHLeafFormat == BVH_LEAF_FORMAT_PACKET)
+            {
+                u32 PacketsCount = Mesh->PackedTriangles.PacketsCount;
+                printf(" Leaf packets: %u of %u triangles, %.2f%% lanes used (%ukb)\n", PacketsCount, SIMD_WIDTH,
+                       100.0f * (f32)(Mesh->Data.IndicesCount / 3) / (f32)(PacketsCount * SIMD_WIDTH),
+                       (u32)((sizeof(triangle_packet) * PacketsCount) / 1024));
+            }
+            else if(World->BVHLeafFormat == BVH_LEAF_FORMAT_LOCAL)
+            {
+                //Compared with the mesh indices and positions used by indexed leaves
+                u64 Size = sizeof(u32) * Mesh->LocalTriangles.WordsCount;
+                u64 IndexedSize = sizeof(u32) * Mesh->Data.IndicesCount + sizeof(vec3) * Mesh->Data.VerticesCount;
+                printf(" Local leaves: %ukb (%.1f bytes per triangle, %.1f indexed)\n", (u32)(Size / 1024),
+                       (f32)Size / TrianglesCount, (f32)IndexedSize / TrianglesCount);
+            }
+            printf("\n");
+            if(!Mesh->Preprocessed)
+            {
+                bvh_build_mesh* Source = &SourceMeshes[Index];
+                PrintAABBBuildersComparison(Pool, Source->Positions, Source->Indices, Source->IndicesCount, Settings);
+                Free(Source->Positions);
+                Free(Source->Indices);
+            }
+        }
+    }
+}
+
+//Bounds of a sphere or of a mesh instance in world space
+internal aabb
+GetTLASObjectAABB(world* World, tlas_object* Object)
+{
+    aabb Result;
+    if(Object->Type == TLAS_OBJECT_SPHERE)
+    {
+        sphere* Sphere = &World->Spheres[Object->Index].Sphere;
+        Result.Min = Sphere->Center - Sphere->Radius;
+        Result.Max = Sphere->Center + Sphere->Radius;
+    }
+    else
+    {
+        //Transform all the corners of the local bounds of the mesh
+        mesh_entry* Entry = &World->Meshes[Object->Index];
+        aabb Local = World->MeshesInfo[Entry->MeshIndex].AABB;
+        
+        Result.Min = vec3(FLT_MAX);
+        Result.Max = vec3(-FLT_MAX);
+        For(Corner, 8)
+        {
+            vec3 P = vec3((Corner & 1) ? Local.Max.x : Local.Min.x,
+                          (Corner & 2) ? Local.Max.y : Local.Min.y,
+                          (Corner & 4) ? Local.Max.z : Local.Min.z);
+            UpdateAABB(&Result, LocalToWorldP(Entry, P));
+        }
+    }
+    
+    return Result;
+}
+
+//Build a node over a range of objects splitting at the middle of the centroids bounds
+//along the largest axis, returns the index of the node
+internal u32
+BuildTLASRec(tlas* TLAS, aabb* Bounds, u32 First, u32 Count, u32 Depth)
+{
+    u32 NodeIndex = TLAS->NodesCount++;
+    flat_bvh_node* Node = &TLAS->Nodes[NodeIndex];
+    
+    aabb CentroidAABB;
+    CentroidAABB.Min = vec3(FLT_MAX);
+    CentroidAABB.Max = vec3(-FLT_MAX);
+    Node->AABB = CentroidAABB;
+    for(u32 i = First; i < First + Count; i++)
+    {
+        UpdateAABB(&Node->AABB, Bounds[i].Min);
+        UpdateAABB(&Node->AABB, Bounds[i].Max);
+        UpdateAABB(&CentroidAABB, (Bounds[i].Min + Bounds[i].Max) * 0.5f);
+    }
+    
+    if(Count <= TLAS_MAX_OBJECTS_PER_LEAF || Depth + 1 >= BVH_MAX_DEPTH)
+    {
+        Node->Offset = First;
+        Node->IndicesCount = Count;
+        return NodeIndex;
+    }
+    
+    vec3 Extent = CentroidAABB.Max - CentroidAABB.Min;
+    u32 Axis = 0;
+    if(Extent.y > Extent.e[Axis]) Axis = 1;
+    if(Extent.z > Extent.e[Axis]) Axis = 2;
+    f32 Split = (CentroidAABB.Min.e[Axis] + CentroidAABB.Max.e[Axis]) * 0.5f;
+    
+    //Move the objects with the centroid below the split to the beginning of the range
+    u32 k = First;
+    for(u32 i = First; i < First + Count; i++)
+    {
+        f32 Centroid = (Bounds[i].Min.e[Axis] + Bounds[i].Max.e[Axis]) * 0.5f;
+        if(Centroid < Split)
         {
-            printf("Mesh %u: %u triangles (%.3f ms):\n", Index, Mesh->Data.IndicesCount / 3, SecondsElapsed * 1000.0f);
-            PrintAABBInfo(Mesh->AABBTree);
+            aabb TempBounds = Bounds[i];
+            Bounds[i] = Bounds[k];
+            Bounds[k] = TempBounds;
+            
+            tlas_object TempObject = TLAS->Objects[i];
+            TLAS->Objects[i] = TLAS->Objects[k];
+            TLAS->Objects[k] = TempObject;
+            k++;
         }
     }
+    
+    //All the centroids are in the same place, any split is as good
+    if(k == First || k == First + Count)
+    {
+        k = First + Count / 2;
+    }
+    
+    //Left child is stored right after its parent
+    Node->IndicesCount = 0;
+    BuildTLASRec(TLAS, Bounds, First, k - First, Depth + 1);
+    u32 Right = BuildTLASRec(TLAS, Bounds, k, First + Count - k, Depth + 1);
+    TLAS->Nodes[NodeIndex].Offset = Right;
+    
+    return NodeIndex;
+}
+
+//Build the top level hierarchy over spheres and mesh instances, mesh hierarchies must be already built
+internal void
+BuildWorldTLAS(world* World, bool Verbose)
+{
+    tlas* TLAS = &World->TLAS;
+    timestamp Begin = GetCurrentCounter();
+    
+    TLAS->ObjectsCount = World->SpheresCount + World->MeshesCount;
+    if(TLAS->ObjectsCount == 0) return;
+    
+    TLAS->Objects = (tlas_object*)ZeroAlloc(sizeof(tlas_object) * TLAS->ObjectsCount);
+    aabb* Bounds = (aabb*)ZeroAlloc(sizeof(aabb) * TLAS->ObjectsCount);
+    
+    u32 ObjectIndex = 0;
+    For(Index, World->SpheresCount)
+    {
+        tlas_object* Object = &TLAS->Objects[ObjectIndex];
+        Object->Type = TLAS_OBJECT_SPHERE;
+        Object->Index = Index;
+        Bounds[ObjectIndex++] = GetTLASObjectAABB(World, Object);
+    }
+    For(Index, World->MeshesCount)
+    {
+        tlas_object* Object = &TLAS->Objects[ObjectIndex];
+        Object->Type = TLAS_OBJECT_MESH;
+        Object->Index = Index;
+        Bounds[ObjectIndex++] = GetTLASObjectAABB(World, Object);
+    }
+    
+    //Every leaf has at least one object so a binary tree has at most 2n - 1 nodes
+    TLAS->Nodes = (flat_bvh_node*)ZeroAlloc(sizeof(flat_bvh_node) * 2 * TLAS->ObjectsCount);
+    TLAS->NodesCount = 0;
+    BuildTLASRec(TLAS, Bounds, 0, TLAS->ObjectsCount, 0);
+    
+    Free(Bounds);
+    
+    timestamp End = GetCurrentCounter();
+    if(Verbose)
+    {
+        printf("TLAS: %u objects (%u spheres, %u meshes), %u nodes (%.3f ms)\n\n",
+               TLAS->ObjectsCount, World->SpheresCount, World->MeshesCount, TLAS->NodesCount,
+               GetSecondsElapsed(Begin, End) * 1000.0f);
+    }
 }
@@ -25,7 +25,21 @@ struct sphere_entry
 struct mesh_info
 {
     mesh_data Data;
-    aabb_tree* AABBTree;
+    u32 TrianglesCount; //Of the source mesh, the indices of spatial split trees repeat some triangles
+    aabb AABB; //Local space bounds
+    aabb_tree* AABBTree; //0 if loaded from a cache
+    flat_bvh FlatBVH;
+    wide_bvh WideBVH;
+    quantized_bvh QuantizedBVH;
+    packed_triangles PackedTriangles;
+    local_triangles LocalTriangles;
+    
+    //Meshes loaded from a cache are already preprocessed, the others are written
+    //to CachePath after preprocessing if it's not 0
+    b32 Preprocessed;
+    char* CachePath;
+    u64 CacheKey;
+    file_view CacheView;
 };
 
 struct mesh_entry
@@ -41,6 +55,31 @@ struct mesh_entry
     float InvScaleDet; //Inverse of ScaleDet
 };
 
+//Object referenced by a leaf of the top level hierarchy
+enum tlas_object_type
+{
+    TLAS_OBJECT_SPHERE,
+    TLAS_OBJECT_MESH,
+};
+
+struct tlas_object
+{
+    u32 Type;
+    u32 Index; //Index in the spheres or meshes of the world
+};
+
+//Top level hierarchy over the world space bounds of spheres and mesh instances,
+//meshes are then intersected with their own hierarchy in local space.
+//Planes are infinite so they are not included
+struct tlas
+{
+    flat_bvh_node* Nodes; //IndicesCount of leaves is the number of objects
+    u32 NodesCount;
+    
+    tlas_object* Objects;
+    u32 ObjectsCount;
+};
+
 #define MAX_SPHERES 1024
 #define MAX_PLANES 1024
 #define MAX_MATERIALS 64
@@ -65,4 +104,19 @@ struct world
     
     material* Materials;
     u32 MaterialsCount;
+    
+    //Hierarchy used to intersect meshes
+    bvh_format BVHFormat;
+    bvh_leaf_format BVHLeafFormat;
+    
+    tlas TLAS;
+};
+
+//Meshes whose tree is already built, taken by the threads of the pool to build their traversal layout
+struct mesh_layout_job
+{
+    world* World;
+    bvh_build_settings* Settings;
+    volatile u32 NextMesh;
+    timestamp MeshesEnd[MAX_MESHES_INFO];
 };